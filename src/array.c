@@ -6,6 +6,7 @@
 #include "qsort.h"
 #include "array.h"
 #include "md.h"
+#include "reclaim.h"
 
 /*
  * This file contains functions used to manipulate arrays.
@@ -40,8 +41,24 @@ array_t the_null_array =
     1,                          /* extra ref */
 #endif
     0,				/* size */
+    the_null_array.own,		/* item */
+    &the_null_array,		/* store */
+    1,				/* shares */
+    0,				/* nown */
 };
 
+/*
+ * Set up a newly allocated array with room for n elements to use them.
+ */
+array_t *init_array_store P2(array_t *, p, int, n)
+{
+    p->item = p->own;
+    p->store = p;
+    p->shares = 1;
+    p->nown = n;
+    return p;
+}
+
 /*
  * Allocate an array of size 'n'.
  */
@@ -56,8 +73,7 @@ array_t *allocate_array P1(int, n)
     }
 #ifdef ARRAY_STATS
     num_arrays++;
-    total_array_size += sizeof(array_t) + sizeof(svalue_t) *
-	(n - 1);
+    total_array_size += ARRAY_SIZE(n);
 #endif
     p = ALLOC_ARRAY(n);
     p->ref = 1;
@@ -84,7 +100,7 @@ array_t *allocate_empty_array P1(int, n)
     if (!n) return &the_null_array;
 #ifdef ARRAY_STATS
     num_arrays++;
-    total_array_size += sizeof(array_t) + sizeof(svalue_t) * (n-1);
+    total_array_size += ARRAY_SIZE(n);
 #endif
     p = ALLOC_ARRAY(n);
     p->ref = 1;
@@ -100,24 +116,76 @@ array_t *allocate_empty_array P1(int, n)
     return p;
 }
 
-void dealloc_array P1(array_t *, p)
+static void free_array_block P1(array_t *, p)
+{
+#ifdef PACKAGE_MUDLIB_STATS
+    add_array_size(&p->stats, -p->nown);
+#endif
+#ifdef ARRAY_STATS
+    num_arrays--;
+    total_array_size -= ARRAY_SIZE(p->nown);
+#endif
+    FREE((char *) p);
+}
+
+/*
+ * p no longer uses the elements in its store; free them if nothing else
+ * does.  A store that is still an array in use (one which has been given
+ * a store of its own since) just has its own[] cleared, in case an
+ * lvalue into it is still about.
+ */
+static void release_store P1(array_t *, p)
 {
+    array_t *s = p->store;
     int i;
 
+    if (--s->shares)
+	return;
+    if (s != p && s->ref) {
+	for (i = s->nown; i--;) {
+	    free_svalue(&s->own[i], "release_store");
+	    s->own[i] = const0;
+	}
+	return;
+    }
+    for (i = s->nown; i--;)
+	free_svalue(&s->own[i], "free_array");
+    if (s != p)
+	free_array_block(s);
+}
+
+void dealloc_array P1(array_t *, p)
+{
     if (p == &the_null_array)
 	return;
     
-    for (i = p->size; i--;)
-	free_svalue(&p->item[i], "free_array");
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&p->stats, -((int)p->size));
+    RECLAIM_FORGET(p);
+    release_store(p);
+    /* other arrays may still be using p's own[] */
+    if (!p->shares)
+	free_array_block(p);
+}
+
+/*
+ * RESIZE_ARRAY(); p's elements must be its own.  The array may be a cycle
+ * candidate, which has to be looked up before it moves.
+ */
+array_t *resize_array P2(array_t *, p, int, n)
+{
+#ifdef RECLAIM_SLICE
+    int type = 0;
+
+    if (reclaim_candidates)
+	type = reclaim_forget(p);
 #endif
-#ifdef ARRAY_STATS
-    num_arrays--;
-    total_array_size -= sizeof(array_t) + sizeof(svalue_t) *
-	(p->size - 1);
+    p = (array_t *) DREALLOC(p, ARRAY_SIZE(n), TAG_ARRAY, "RESIZE_ARRAY");
+    if (p)
+	init_array_store(p, n);
+#ifdef RECLAIM_SLICE
+    if (type && p)
+	reclaim_renote(type, p);
 #endif
-    FREE((char *) p);
+    return p;
 }
 
 void free_array P1(array_t *, p)
@@ -128,20 +196,78 @@ void free_array P1(array_t *, p)
     dealloc_array(p);
 }
 
+/*
+ * Free an array whose elements have been taken over by the caller; only
+ * for one that was ARRAY_PRIVATE().
+ */
 void free_empty_array P1(array_t *, p)
 {
     if ((--(p->ref) > 0) || (p == &the_null_array)) {
         return;
       }
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&p->stats, -((int)p->size));
-#endif
+    RECLAIM_FORGET(p);
+    free_array_block(p);
+}
+
+/*
+ * Give p a store of its own, if the one it has is shared.  p itself stays
+ * where it is, so every reference to it sees the change that follows.
+ */
+void unshare_array P1(array_t *, p)
+{
+    array_t *s;
+    int n;
+
+    if (!ARRAY_SHARED(p))
+	return;
+    s = allocate_empty_array(n = p->size);
+    while (n--)
+	assign_svalue_no_free(&s->own[n], &p->item[n]);
+    /* s only exists as p's store */
+    s->ref = 0;
+    release_store(p);
+    p->store = s;
+    p->item = s->own;
+}
+
+/* elements from .. to of p contain nothing that would stop them being shared */
+static int can_share P3(array_t *, p, int, from, int, to)
+{
+    svalue_t *sv = p->item + from, *end = p->item + to;
+
+    for (; sv <= end; sv++)
+	if (sv->type & (T_ARRAY | T_CLASS | T_MAPPING | T_BUFFER | T_FUNCTION))
+	    return 0;
+    return 1;
+}
+
+/*
+ * A new array of elements from .. to of p, which uses p's store instead
+ * of copying them.
+ */
+static array_t *array_view P3(array_t *, p, int, from, int, to)
+{
+    array_t *v;
+
 #ifdef ARRAY_STATS
-    num_arrays--;
-    total_array_size -= sizeof(array_t) + sizeof(svalue_t) *
-        (p->size - 1);
+    num_arrays++;
+    total_array_size += ARRAY_SIZE(0);
 #endif
-    FREE((char *) p);
+    v = (array_t *) DXALLOC(ARRAY_SIZE(0), TAG_ARRAY, "array_view");
+    v->ref = 1;
+    v->size = to - from + 1;
+    v->item = p->item + from;
+    v->store = p->store;
+    v->store->shares++;
+    v->shares = 0;
+    v->nown = 0;
+#ifdef PACKAGE_MUDLIB_STATS
+    if (current_object)
+	assign_stats(&v->stats, current_object);
+    else
+	null_stats(&v->stats);
+#endif
+    return v;
 }
 
 array_t *explode_string P4(char *, str, int, slen, char *, del, int, len)
@@ -150,7 +276,7 @@ array_t *explode_string P4(char *, str, int, slen, char *, del, int, len)
     int num, j, limit;
     array_t *ret;
     char *buff, *tmp;
-    short sz;
+    int sz;
 
     if (!slen)
 	return &the_null_array;
@@ -452,7 +578,7 @@ array_t *slice_array P3(array_t *, p, int, from, int, to)
 	return &the_null_array;
     }
 
-    if (!(--p->ref)){
+    if (!(--p->ref) && p->store == p && p->shares == 1) {
 #ifdef PACKAGE_MUDLIB_STATS
 	add_array_size(&p->stats, -((int)p->size));
 #endif
@@ -485,11 +611,19 @@ array_t *slice_array P3(array_t *, p, int, from, int, to)
     } else {
 	array_t *d;
 
-	d = allocate_empty_array(to - from + 1);
-	sv1 = d->item - from;
-	sv2 = p->item;
-	for (cnt = from; cnt <= to; cnt++)
-	  assign_svalue_no_free(sv1 + cnt, sv2 + cnt);
+	/* don't keep a large store alive for a small part of it */
+	if ((cnt = to - from + 1) >= ARRAY_SHARE_MIN &&
+	    cnt * 2 >= p->store->nown && can_share(p, from, to))
+	    d = array_view(p, from, to);
+	else {
+	    d = allocate_empty_array(cnt);
+	    sv1 = d->item - from;
+	    sv2 = p->item;
+	    for (cnt = from; cnt <= to; cnt++)
+		assign_svalue_no_free(sv1 + cnt, sv2 + cnt);
+	}
+	if (!p->ref)
+	    dealloc_array(p);
 	return d;
     }
 }
@@ -510,6 +644,21 @@ array_t *copy_array P1(array_t *, p)
     return d;
 }
 
+/*
+ * Copy of an array for copy(): one which shares p's elements where it
+ * can, so that nothing is copied unless one of them is changed.  Returns
+ * 0 if p has arrays, classes, mappings, buffers or functions in it, which
+ * copy() has to copy in turn.
+ */
+array_t *share_array P1(array_t *, p)
+{
+    if (!can_share(p, 0, p->size - 1))
+	return 0;
+    if (p->size < ARRAY_SHARE_MIN)
+	return copy_array(p);
+    return array_view(p, 0, p->size - 1);
+}
+
 #ifdef F_COMMANDS
 array_t *commands P1(object_t *, ob)
 {
@@ -810,7 +959,7 @@ array_t *add_array P2(array_t *, p, array_t *, r)
       error("result of array addition is greater than maximum array size.\n");
 
     /* x += x */
-    if ((p == r) && (p->ref == 2)) {
+    if ((p == r) && (p->ref == 2) && p->store == p && p->shares == 1) {
 	d = RESIZE_ARRAY(p, res);
         if (!d)
 	    fatal("Out of memory.\n");
@@ -836,7 +985,7 @@ array_t *add_array P2(array_t *, p, array_t *, r)
     }
     
     /* transfer svalues for ref 1 target array */
-    if (p->ref == 1) {
+    if (ARRAY_PRIVATE(p)) {
 	/*
 	 * realloc(p) to try extending block; this will save an
 	 * allocate_array(), copying the svalues over, and free()'ing p
@@ -865,26 +1014,19 @@ array_t *add_array P2(array_t *, p, array_t *, r)
 
 	for (cnt = p->size; cnt--;)
 	    assign_svalue_no_free(&d->item[cnt], &p->item[cnt]);
-	p->ref--;
+	free_array(p);
     }
 
     /* transfer svalues from ref 1 source array */
-    if (r->ref == 1) {
+    if (ARRAY_PRIVATE(r)) {
 	for (cnt = r->size; cnt--;)
 	    d->item[--res] = r->item[cnt];
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&r->stats, -((int)r->size));
-#endif
-#ifdef ARRAY_STATS
-	num_arrays--;
-	total_array_size -= sizeof(array_t) +
-	    sizeof(svalue_t) * (r->size - 1);
-#endif
-	FREE((char *) r);
+	RECLAIM_FORGET(r);
+	free_array_block(r);
     } else {
 	for (cnt = r->size; cnt--;)
 	    assign_svalue_no_free(&d->item[--res], &r->item[cnt]);
-	r->ref--;
+	free_array(r);
     }
 
     return d;
@@ -1040,7 +1182,7 @@ static function_to_call_t *sort_array_ftc;
 
 array_t *builtin_sort_array P2(array_t *, inlist, int, dir)
 {
-    quickSort((char *) inlist->item, inlist->size, sizeof(inlist->item),
+    quickSort((char *) inlist->item, inlist->size, sizeof(svalue_t),
 	      (dir<0) ? builtin_sort_array_cmp_rev : builtin_sort_array_cmp_fwd);
 
     return inlist;
@@ -1202,7 +1344,7 @@ f_sort_array PROT((void))
 	    process_efun_callback(1, &ftc, F_SORT_ARRAY);
 
 	    tmp = copy_array(tmp);
-	    quickSort((char *) tmp->item, tmp->size, sizeof(tmp->item), sort_array_cmp);
+	    quickSort((char *) tmp->item, tmp->size, sizeof(svalue_t), sort_array_cmp);
 	    sort_array_ftc = old_ptr;
 	    break;
 	}
@@ -1335,7 +1477,7 @@ INLINE_STATIC svalue_t *alist_sort P1(array_t *, inlist) {
     char *str;
 
     if (!(size = inlist->size)) return (svalue_t *)NULL;
-    if ((flag = (inlist->ref > 1))) {
+    if ((flag = !ARRAY_PRIVATE(inlist))) {
 	sv_tab = CALLOCATE(size, svalue_t, TAG_TEMPORARY, "alist_sort: sv_tab");
 	sv_ptr = inlist->item;
 	for (j = 0; j < size; j++) {
@@ -1471,18 +1613,12 @@ array_t *subtract_array P2(array_t *, minuend, array_t *, subtrahend) {
     i = size;
     while (i--) free_svalue(svt + i, "subtract_array");
     FREE((char *) svt);
-    if (subtrahend->ref > 1) {
-	subtrahend->ref--;
+    if (!ARRAY_PRIVATE(subtrahend)) {
+	free_array(subtrahend);
     } else {
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&subtrahend->stats, -size);
-#endif
-#ifdef ARRAY_STATS
-	num_arrays--;
-	total_array_size -= sizeof(array_t) + sizeof(svalue_t) *
-	    (size - 1);
-#endif
-	FREE((char *) subtrahend);
+	/* alist_sort() took over its elements */
+	RECLAIM_FORGET(subtrahend);
+	free_array_block(subtrahend);
     }
     free_array(minuend);
     msize = dest - difference->item;
@@ -1521,7 +1657,7 @@ array_t *intersect_array P2(array_t *, a1, array_t *, a2) {
     }
 
     svt_1 = alist_sort(a1);
-    if ((flag = (a2->ref > 1))) {
+    if ((flag = !ARRAY_PRIVATE(a2))) {
 	sv_tab = CALLOCATE(a2s, svalue_t, TAG_TEMPORARY, "intersect_array: sv2_tab");
 	sv_ptr = a2->item;
 	for (j = 0; j < a2s; j++) {
@@ -1623,30 +1759,18 @@ array_t *intersect_array P2(array_t *, a1, array_t *, a2) {
     while (i--) free_svalue(svt_1 + i, "intersect_array");
     FREE((char *)svt_1);
 
-    if (a1->ref > 1) a1->ref--;
+    if (!ARRAY_PRIVATE(a1)) free_array(a1);
     else {
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&a1->stats, -a1s);
-#endif
-#ifdef ARRAY_STATS
-	num_arrays--;
-	total_array_size -= sizeof(array_t) + sizeof(svalue_t) * (a1s - 1);
-#endif
-	FREE((char *) a1);
+	RECLAIM_FORGET(a1);
+	free_array_block(a1);
     }
     
     if (flag) {
-	a2->ref--;
+	free_array(a2);
 	FREE((char *) sv_tab);
     } else {
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&a2->stats, -a2s);
-#endif
-#ifdef ARRAY_STATS
-	num_arrays--;
-	total_array_size -= sizeof(array_t) + sizeof(svalue_t) * (a2s - 1);
-#endif
-	FREE((char *) a2);
+	RECLAIM_FORGET(a2);
+	free_array_block(a2);
     }
     a3 = RESIZE_ARRAY(a3, l);
     a3->ref = 1;
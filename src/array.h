@@ -1,18 +1,49 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
+/*
+ * The elements of an array live in the own[] of its store: normally the
+ * array itself, but copy() and slicing can give an array a view of the
+ * elements of another one's store instead of copying them.  Elements
+ * that are shared (ARRAY_SHARED()) are never changed; anything that
+ * changes an array's elements unshares it first, which copies them into a
+ * store of its own.  A store whose array has been freed, or which never
+ * was one (ref 0), is kept until the last array using it goes away.
+ *
+ * Only arrays with no arrays, classes, mappings, buffers or functions in
+ * them are shared, so a shared store can't be part of a reference cycle,
+ * and copy() of a view is still a deep copy.
+ */
 typedef struct array_s {
-    unsigned short ref;
+    unsigned int ref;
 #ifdef DEBUG
     int extra_ref;
 #endif
-    unsigned short size;
+    int size;
+    svalue_t *item;		/* the size elements, in store->own[] */
+    struct array_s *store;
+    unsigned int shares;	/* # of arrays whose item is in own[] */
+    int nown;			/* # of elements allocated in own[] */
 #ifdef PACKAGE_MUDLIB_STATS
     statgroup_t stats;		/* creator of the array */
 #endif
-    svalue_t item[1];
+    svalue_t own[1];		/* must be last */
 } array_t;
 
+#define ARRAY_SIZE(n) (sizeof(array_t) + sizeof(svalue_t) * ((n) - 1))
+
+/* p's elements are seen by other arrays too, and mustn't be changed */
+#define ARRAY_SHARED(p) ((p)->store->shares > 1)
+/*
+ * nothing else refers to p or to its elements, so it can be changed,
+ * resized or have its elements taken over in place
+ */
+#define ARRAY_PRIVATE(p) ((p)->ref == 1 && (p)->store == (p) && \
+			  (p)->shares == 1)
+
+/* fewest elements copy() or a slice shares rather than copies */
+#define ARRAY_SHARE_MIN 8
+
 extern array_t the_null_array;
 
 /*
@@ -32,6 +63,9 @@ array_t *add_array PROT((array_t *, array_t *));
 void implode_array PROT((funptr_t *, array_t *, svalue_t *, int));
 array_t *subtract_array PROT((array_t *, array_t *));
 array_t *slice_array PROT((array_t *, int, int));
+array_t *copy_array PROT((array_t *));
+array_t *share_array PROT((array_t *));
+void unshare_array PROT((array_t *));
 array_t *explode_string PROT((char *, int, char *, int));
 char *implode_string PROT((array_t *, char *, int));
 array_t *users PROT((void));
@@ -56,11 +90,14 @@ int match_single_regexp PROT((char *, char *));
 array_t *match_regexp PROT((array_t *, char *, int));
 array_t *reg_assoc PROT((char *, array_t *, array_t *, svalue_t *));
 void dealloc_array PROT((array_t *));
+array_t *resize_array PROT((array_t *, int));
 
+/* a new array's elements are its own */
 #define ALLOC_ARRAY(nelem) \
-    (array_t *)DXALLOC(sizeof (array_t) + \
-	  sizeof(svalue_t) * (nelem - 1), TAG_ARRAY, "ALLOC_ARRAY")
-#define RESIZE_ARRAY(vec, nelem) \
-    (array_t *)DREALLOC(vec, sizeof (array_t) + \
-	  sizeof(svalue_t) * (nelem - 1), TAG_ARRAY, "RESIZE_ARRAY")
+    init_array_store((array_t *)DXALLOC(ARRAY_SIZE(nelem), TAG_ARRAY, \
+					"ALLOC_ARRAY"), nelem)
+/* only for arrays whose elements are their own */
+#define RESIZE_ARRAY(vec, nelem) resize_array(vec, nelem)
+
+array_t *init_array_store PROT((array_t *, int));
 #endif
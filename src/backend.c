@@ -9,7 +9,11 @@
 #include "socket_efuns.h"
 #include "swap.h"
 #include "call_out.h"
+#include "poller.h"
 #include "port.h"
+#include "reclaim.h"
+#include "resolver.h"
+#include "fcache.h"
 #include "lint.h"
 
 #ifdef WIN32
@@ -29,6 +33,8 @@ int heart_beat_flag = 0;
 object_t *current_heart_beat;
 static void look_for_objects_to_swap PROT((void));
 static void call_heart_beat PROT((void));
+static int run_heart_beats PROT((void));
+static int heart_beats_pending PROT((void));
 
 /*
  * There are global variables that must be zeroed before any execution.
@@ -113,6 +119,7 @@ void backend()
     int nb;
     int i;
     int there_is_a_port = 0;
+    static int commands_left = 0;
     error_context_t econ;
 
     debug_message("Initializations complete.\n\n");
@@ -135,8 +142,11 @@ void backend()
 	call_heart_beat();
     clear_state();
     save_context(&econ);
-    if (SETJMP(econ.context))
+    if (SETJMP(econ.context)) {
 	restore_context(&econ);
+	/* the rest of that pass's commands haven't run yet */
+	commands_left = 1;
+    }
 
     while (1) {	
 	/* Has to be cleared if we jumped out of process_user_command() */
@@ -158,11 +168,20 @@ void backend()
 	    slow_shut_down(tmp);
 	}
 	/*
-	 * select
+	 * wait for network activity
 	 */
-	make_selectmasks();
-	if (heart_beat_flag) {	/* use zero timeout if a heartbeat is
-				 * pending. */
+	if (heart_beat_flag || heart_beats_pending() || commands_left
+	    || logons_waiting
+#ifdef RESOLVER
+	    || resolver_ready()
+#endif
+	    ) {
+	    /*
+	     * use zero timeout if a heartbeat is pending, or some were
+	     * left over by an error, or users still have commands waiting
+	     * from the last pass, or new connections are waiting to log
+	     * on, or there are resolve() callbacks to make.
+	     */
 	    timeout.tv_sec = 0;	/* this should avoid problems with longjmp's
 				 * too */
 	    timeout.tv_usec = 0;
@@ -170,7 +189,7 @@ void backend()
 	    /*
 	     * not using infinite timeout so that we'll have insurance in the
 	     * unlikely event a heartbeat happens between now and the
-	     * select(). Note that SIGALRMs (for heartbeats) do make select()
+	     * poll_wait(). Note that SIGALRMs (for heartbeats) do make it
 	     * drop through. (Except on Windows)
 	     */
 #ifdef WIN32
@@ -180,24 +199,59 @@ void backend()
 	    timeout.tv_sec = 60;
 	    timeout.tv_usec = 0;
 #endif
-	}
-#ifndef hpux
-	nb = select(FD_SETSIZE, &readmask, &writemask, (fd_set *) 0, &timeout);
-#else
-	nb = select(FD_SETSIZE, (int *) &readmask, (int *) &writemask,
-		    (int *) 0, &timeout);
+	    /* wake up in time for the next call_out */
+	    if (!t_flag && (i = next_call_out_delay()) >= 0 &&
+		i < timeout.tv_sec * 1000 + timeout.tv_usec / 1000) {
+		timeout.tv_sec = i / 1000;
+		timeout.tv_usec = (i % 1000) * 1000;
+	    }
+#ifdef RESOLVER
+	    /* and in time to ask the name server again */
+	    if (resolver_pending() && timeout.tv_sec >= 1) {
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+	    }
 #endif
+#ifdef RECLAIM_SLICE
+	    /* and soon enough for reclaim_slice() to get on with things */
+	    if (reclaim_pending() && (timeout.tv_sec ||
+				      timeout.tv_usec > RECLAIM_WAIT)) {
+		timeout.tv_sec = 0;
+		timeout.tv_usec = RECLAIM_WAIT;
+	    }
+#endif
+#ifdef USE_FILE_CACHE
+	    /* and to write out buffered write_file()s */
+	    if (fcache_buffered && timeout.tv_sec >= 1) {
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+	    }
+#endif
+	}
+	/*
+	 * squeeze the holes out of mappings that have had a lot deleted.
+	 */
+	compact_mappings();
+	/*
+	 * write out everything users were sent this cycle.
+	 */
+	flush_pending_output();
+	nb = poll_wait(&timeout);
 	/*
 	 * process I/O if necessary.
 	 */
 	if (nb > 0) {
-	    process_io();
+	    process_io(nb);
 	}
+	/*
+	 * let some of the new connections log on.
+	 */
+	if (logons_waiting)
+	    process_logons();
 	/*
 	 * process user commands.
 	 */
-	for (i = 0; process_user_command() && i < max_users; i++)
-	    ;
+	commands_left = process_user_commands();
 
 	/*
 	 * call heartbeat if appropriate.
@@ -205,7 +259,27 @@ void backend()
 	if (heart_beat_flag) {
 	    debug(512, ("backend: HEARTBEAT\n"));
 	    call_heart_beat();
+	} else if (heart_beats_pending()) {
+	    current_interactive = 0;
+	    run_heart_beats();
 	}
+
+	/*
+	 * call_outs that are due, including those with no delay made
+	 * during this cycle.
+	 */
+	if (!t_flag)
+	    call_out();
+
+#ifdef RECLAIM_SLICE
+	reclaim_slice();
+#endif
+#ifdef RESOLVER
+	resolver_run();
+#endif
+#ifdef USE_FILE_CACHE
+	fcache_tick();
+#endif
     }
 }				/* backend() */
 
@@ -339,32 +413,93 @@ static void look_for_objects_to_swap()
 
 /* Call all heart_beat() functions in all objects.  Also call the next reset,
  * and the call out.
- * We do heart beats by moving each object done to the end of the heart beat
- * list before we call its function, and always using the item at the head
- * of the list as our function to call.  We keep calling heart beats until
- * a timeout or we have done num_heart_objs calls.  It is done this way so
- * that objects can delete heart beating objects from the list from within
- * their heart beat without truncating the current round of heart beats.
+ *
+ * Heart beats live on a timing wheel: an object is kept in the slot for the
+ * tick its next heart beat is due, so a tick only looks at the objects that
+ * are due then (plus the few whose interval is longer than the wheel, which
+ * are passed over until their round comes up).  The due slot is moved onto
+ * a pending list before any heart beat is called; entries are taken off the
+ * front one at a time and rescheduled before their function runs.  That way
+ * objects may add or remove heart beats, including their own, from within a
+ * heart beat, an error in one doesn't lose the rest, and anything left over
+ * when the next alarm arrives is done first on the next tick.
  *
  * Set command_giver to current_object if it is a living object. If the object
  * is shadowed, check the shadowed object if living. There is no need to save
  * the value of the command_giver, as the caller resets it to 0 anyway.  */
 
-typedef struct {
+#define HB_WHEEL_SIZE	256	/* must be a power of 2 */
+
+typedef struct heart_beat_s {
     object_t *ob;
-    short heart_beat_ticks;
     short time_to_heart_beat;
+    int due;			/* tick of the next heart beat */
+    struct heart_beat_s *next, *prev;
 } heart_beat_t;
 
-static heart_beat_t *heart_beats = 0;
-static int max_heart_beats = 0;
-static int heart_beat_index = 0;
+static heart_beat_t hb_wheel[HB_WHEEL_SIZE];	/* list heads */
+static heart_beat_t hb_pending;
+static heart_beat_t *hb_free = 0;
+static int hb_tick = 0;
 static int num_hb_objs = 0;
-static int num_hb_to_do = 0;
+static int num_hb_allocated = 0;
 
 static int num_hb_calls = 0;	/* starts */
 static float perc_hb_probes = 100.0;	/* decaying avge of how many complete */
 
+#define hb_list_init(l) ((l)->next = (l)->prev = (l))
+#define hb_list_empty(l) ((l)->next == (l))
+
+static void hb_unlink P1(heart_beat_t *, hb)
+{
+    hb->prev->next = hb->next;
+    hb->next->prev = hb->prev;
+}
+
+static void hb_append P2(heart_beat_t *, list, heart_beat_t *, hb)
+{
+    hb->next = list;
+    hb->prev = list->prev;
+    list->prev->next = hb;
+    list->prev = hb;
+}
+
+static void hb_schedule P2(heart_beat_t *, hb, int, due)
+{
+    hb->due = due;
+    hb_append(&hb_wheel[due & (HB_WHEEL_SIZE - 1)], hb);
+}
+
+static void init_hb_wheel()
+{
+    int i;
+
+    for (i = 0; i < HB_WHEEL_SIZE; i++)
+	hb_list_init(&hb_wheel[i]);
+    hb_list_init(&hb_pending);
+}
+
+static heart_beat_t *new_hb_entry()
+{
+    heart_beat_t *hb;
+
+    if (!hb_free) {
+	int i;
+
+	if (!hb_pending.next)
+	    init_hb_wheel();
+	hb_free = CALLOCATE(HEART_BEAT_CHUNK, heart_beat_t, TAG_HEART_BEAT,
+			    "new_hb_entry");
+	for (i = 0; i < HEART_BEAT_CHUNK - 1; i++)
+	    hb_free[i].next = &hb_free[i + 1];
+	hb_free[i].next = 0;
+	num_hb_allocated += HEART_BEAT_CHUNK;
+    }
+    hb = hb_free;
+    hb_free = hb->next;
+    return hb;
+}
+
 #ifdef WIN32
 void CDECL alarm_loop P1(void *, ignore)
 {
@@ -377,9 +512,6 @@ void CDECL alarm_loop P1(void *, ignore)
 
 static void call_heart_beat()
 {
-    object_t *ob;
-    heart_beat_t *curr_hb;
-
 #ifdef WIN32
     static long Win32Thread = -1;
 #endif
@@ -404,103 +536,128 @@ static void call_heart_beat()
     current_time = get_current_time();
     current_interactive = 0;
 
-    if ((num_hb_to_do = num_hb_objs)) {
+    if (num_hb_objs) {
+	heart_beat_t *list, *hb;
+	int num_done, num_to_do = 0;
+
 	num_hb_calls++;
-	heart_beat_index = 0;
-	while (!heart_beat_flag) {
-	    ob = (curr_hb = &heart_beats[heart_beat_index])->ob;
-	    DEBUG_CHECK(!(ob->flags & O_HEART_BEAT),
-			"Heartbeat not set in object on heartbeat list!");
-	    DEBUG_CHECK(ob->flags & O_SWAPPED,
-			"Heartbeat in swapped object.\n");
-	    /* is it time to do a heart beat ? */
-	    curr_hb->heart_beat_ticks--;
-
-	    if (ob->prog->heart_beat != -1) {
-		if (curr_hb->heart_beat_ticks < 1) {
-		    curr_hb->heart_beat_ticks = curr_hb->time_to_heart_beat;
-		    current_heart_beat = ob;
-		    command_giver = ob;
-#ifndef NO_SHADOWS
-		    while (command_giver->shadowing)
-			command_giver = command_giver->shadowing;
-#endif
-#ifndef NO_ADD_ACTION
-		    if (!(command_giver->flags & O_ENABLE_COMMANDS))
-			command_giver = 0;
-#endif
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_heart_beats(&ob->stats, 1);
-#endif
-		    eval_cost = max_cost;
-		    /* this should be looked at ... */
-		    call_function(ob->prog, ob->prog->heart_beat);
-		    command_giver = 0;
-		    current_object = 0;
-		}
-	    }
-	    if (++heart_beat_index == num_hb_to_do)
-		break;
+	hb_tick++;
+	/*
+	 * move this tick's slot onto the end of whatever wasn't finished
+	 * last time.
+	 */
+	list = &hb_wheel[hb_tick & (HB_WHEEL_SIZE - 1)];
+	if (!hb_list_empty(list)) {
+	    hb_pending.prev->next = list->next;
+	    list->next->prev = hb_pending.prev;
+	    list->prev->next = &hb_pending;
+	    hb_pending.prev = list->prev;
+	    hb_list_init(list);
 	}
-	if (heart_beat_index < num_hb_to_do)
-	    perc_hb_probes = 100 * (float) heart_beat_index / num_hb_to_do;
+	for (hb = hb_pending.next; hb != &hb_pending; hb = hb->next)
+	    if (hb->due <= hb_tick)
+		num_to_do++;
+
+	num_done = run_heart_beats();
+	if (num_done < num_to_do)
+	    perc_hb_probes = 100 * (float) num_done / num_to_do;
 	else
 	    perc_hb_probes = 100.0;
-	heart_beat_index = num_hb_to_do = 0;
     }
     current_prog = 0;
     current_heart_beat = 0;
     look_for_objects_to_swap();
-    call_out();
 #ifdef PACKAGE_MUDLIB_STATS
     mudlib_stats_decay();
 #endif
 }				/* call_heart_beat() */
 
+/*
+ * Work through the pending list until it is empty or the next alarm
+ * arrives.  Returns the number of heart beats done.
+ */
+static int run_heart_beats()
+{
+    heart_beat_t *hb;
+    object_t *ob;
+    int num_done = 0;
+
+    while (!heart_beat_flag && !hb_list_empty(&hb_pending)) {
+	hb = hb_pending.next;
+	hb_unlink(hb);
+	/* not this time round the wheel */
+	if (hb->due > hb_tick) {
+	    hb_schedule(hb, hb->due);
+	    continue;
+	}
+	hb_schedule(hb, hb_tick + hb->time_to_heart_beat);
+	num_done++;
+
+	ob = hb->ob;
+	DEBUG_CHECK(!(ob->flags & O_HEART_BEAT),
+		    "Heartbeat not set in object on heartbeat list!");
+	DEBUG_CHECK(ob->flags & O_SWAPPED,
+		    "Heartbeat in swapped object.\n");
+	if (ob->prog->heart_beat != -1) {
+	    current_heart_beat = ob;
+	    command_giver = ob;
+#ifndef NO_SHADOWS
+	    while (command_giver->shadowing)
+		command_giver = command_giver->shadowing;
+#endif
+#ifndef NO_ADD_ACTION
+	    if (!(command_giver->flags & O_ENABLE_COMMANDS))
+		command_giver = 0;
+#endif
+#ifdef PACKAGE_MUDLIB_STATS
+	    add_heart_beats(&ob->stats, 1);
+#endif
+	    eval_cost = max_cost;
+	    /* this should be looked at ... */
+	    call_function(ob->prog, ob->prog->heart_beat);
+	    command_giver = 0;
+	    current_object = 0;
+	}
+    }
+    current_prog = 0;
+    current_heart_beat = 0;
+    return num_done;
+}				/* run_heart_beats() */
+
+/*
+ * An error in a heart beat jumps straight back to backend(), leaving the
+ * rest of that tick's heart beats on the pending list.
+ */
+static int heart_beats_pending()
+{
+    return hb_pending.next && !hb_list_empty(&hb_pending);
+}
+
 int
 query_heart_beat P1(object_t *, ob)
 {
-    int index;
-    
     if (!(ob->flags & O_HEART_BEAT))  return 0;
-    index = num_hb_objs;
-    while (index--) {
-	if (heart_beats[index].ob == ob) 
-	    return heart_beats[index].time_to_heart_beat;
-    }
-    return 0;
+    return ob->heart_beat->time_to_heart_beat;
 }				/* query_heart_beat() */
 
-/* add or remove an object from the heart beat list; does the major check...
- * If an object removes something from the list from within a heart beat,
- * various pointers in call_heart_beat could be stuffed, so we must
- * check current_heart_beat and adjust pointers.  */
+/* add or remove an object from the heart beat wheel; does the major check...
+ * Entries are unlinked from whichever list they are on, so this is safe to
+ * call from within a heart beat.  */
 
 int set_heart_beat P2(object_t *, ob, int, to)
 {
-    int index;
+    heart_beat_t *hb;
     
     if (ob->flags & O_DESTRUCTED) return 0;
 
     if (!to) {
-	int num;
-	
-	index = num_hb_objs;
-	while (index--) {
-	    if (heart_beats[index].ob == ob) break;
-	}
-	if (index < 0) return 0;
+	if (!(ob->flags & O_HEART_BEAT)) return 0;
 
-	if (num_hb_to_do) {
-	    if (index <= heart_beat_index)
-		heart_beat_index--;
-	    if (index < num_hb_to_do)
-		num_hb_to_do--;
-	}
-	
-	if ((num = (num_hb_objs - (index + 1))))
-	    memmove(heart_beats + index, heart_beats + (index + 1), num * sizeof(heart_beat_t));
-	
+	hb = ob->heart_beat;
+	hb_unlink(hb);
+	hb->next = hb_free;
+	hb_free = hb;
+	ob->heart_beat = 0;
 	num_hb_objs--;
 	ob->flags &= ~O_HEART_BEAT;
 	return 1;
@@ -509,35 +666,19 @@ int set_heart_beat P2(object_t *, ob, int, to)
     if (ob->flags & O_HEART_BEAT) {
 	if (to < 0) return 0;
 	
-	index = num_hb_objs;
-	while (index--) {
-	    if (heart_beats[index].ob == ob) {
-		heart_beats[index].time_to_heart_beat = heart_beats[index].heart_beat_ticks = to;
-		break;
-	    }
-	}
-	DEBUG_CHECK(index < 0, "Couldn't find enabled object in heart_beat list!\n");
+	hb = ob->heart_beat;
+	DEBUG_CHECK(!hb, "Couldn't find enabled object in heart_beat list!\n");
+	hb_unlink(hb);
     } else {
-	heart_beat_t *hb;
-	
-	if (!max_heart_beats)
-	    heart_beats = CALLOCATE(max_heart_beats = HEART_BEAT_CHUNK,
-				    heart_beat_t, TAG_HEART_BEAT,
-				    "set_heart_beat: 1");
-	else if (num_hb_objs == max_heart_beats) {
-	    max_heart_beats += HEART_BEAT_CHUNK;
-	    heart_beats = RESIZE(heart_beats, max_heart_beats,
-				 heart_beat_t, TAG_HEART_BEAT,
-				 "set_heart_beat: 1");
-	}
-	
-	hb = &heart_beats[num_hb_objs++];
+	hb = new_hb_entry();
 	hb->ob = ob;
 	if (to < 0) to = 1;
-	hb->time_to_heart_beat = to;
-	hb->heart_beat_ticks = to;
+	ob->heart_beat = hb;
 	ob->flags |= O_HEART_BEAT;
+	num_hb_objs++;
     }
+    hb->time_to_heart_beat = to;
+    hb_schedule(hb, hb_tick + to);
     
     return 1;
 }
@@ -551,6 +692,8 @@ int heart_beat_status P2(outbuffer_t *, ob, int, verbose)
 	outbuf_add(ob, "-----------------------\n");
 	outbuf_addv(ob, "Number of objects with heart beat: %d, starts: %d\n",
 		    num_hb_objs, num_hb_calls);
+	outbuf_addv(ob, "Wheel slots: %d, entries allocated: %d\n",
+		    HB_WHEEL_SIZE, num_hb_allocated);
 	
 	/* passing floats to varargs isn't highly portable so let sprintf
 	   handle it */
@@ -683,16 +826,23 @@ char *query_load_av()
 
 #ifdef F_HEART_BEATS
 array_t *get_heart_beats() {
-    int n = num_hb_objs;
-    heart_beat_t *hb = heart_beats;
+    int n = 0, i;
+    heart_beat_t *list, *hb;
     array_t *arr;
     
-    arr = allocate_empty_array(n);
-    while (n--) {
-	arr->item[n].type = T_OBJECT;
-	arr->item[n].u.ob = hb->ob;
-	add_ref(hb->ob, "get_heart_beats");
-	hb++;
+    /* in the order they will next be called */
+    arr = allocate_empty_array(num_hb_objs);
+    list = &hb_pending;
+    for (i = 0; i <= HB_WHEEL_SIZE; i++) {
+	if (list->next) {
+	    for (hb = list->next; hb != list; hb = hb->next) {
+		arr->item[n].type = T_OBJECT;
+		arr->item[n].u.ob = hb->ob;
+		add_ref(hb->ob, "get_heart_beats");
+		n++;
+	    }
+	}
+	list = &hb_wheel[(hb_tick + 1 + i) & (HB_WHEEL_SIZE - 1)];
     }
     return arr;
 }
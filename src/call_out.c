@@ -4,6 +4,8 @@
 #include "comm.h"
 #include "call_out.h"
 #include "eoperators.h"
+#include "port.h"
+#include "qsort.h"
 
 /*
  * This file implements delayed calls of functions.
@@ -11,35 +13,319 @@
  *
  * Allocate the structures several in one chunk, to get rid of malloc
  * overhead.
+ *
+ * Pending calls are kept on a hierarchical timing wheel with millisecond
+ * ticks: CO_LEVELS wheels of CO_SLOTS slots each, the first covering the
+ * next CO_SLOTS ms one slot per ms, each further one covering CO_SLOTS
+ * times as much.  When the first wheel wraps, the next slot of the wheel
+ * above is emptied back into the lower wheels ("cascaded").  Calls further
+ * off than the top wheel reaches wait on a separate list, which is looked
+ * at again each time the top wheel moves on a slot.  While a wheel and
+ * all those below it are empty, the clock skips straight to the next slot
+ * of the wheel above, so catching up after a stall costs no more than
+ * the calls and cascades it involves.  Calls with equal
+ * deadlines go off in the order they were made; calls with a delay of 0 go
+ * off at the end of the current backend cycle.
+ *
+ * Every call is also hashed by handle and by owning object, so they can
+ * be found or removed without looking at the wheels.
  */
 
 #define CHUNK_SIZE	20
 
+#define CO_LEVEL_BITS	8
+#define CO_SLOTS	(1 << CO_LEVEL_BITS)
+#define CO_SLOT_MASK	(CO_SLOTS - 1)
+#define CO_LEVELS	4
+/* true if a call 'd' ms away is past the reach of the top wheel */
+#define CO_BEYOND_WHEELS(d) \
+    (((d) >> (CO_LEVELS * CO_LEVEL_BITS - 1)) > 1)
+
 typedef struct pending_call_s {
-    int delta;
+    unsigned long expires;	/* in ms; see call_out_clock() */
+    int handle;			/* also orders calls with equal deadlines */
+    int level;			/* wheel it is on, or -1 */
     union string_or_func function;
     object_t *ob;
     array_t *vs;
-    struct pending_call_s *next;
+    struct pending_call_s *next, *prev;	/* wheel slot or run list */
+    struct pending_call_s *next_handle;	/* handle hash chain */
+    struct pending_call_s *next_owner;	/* owner hash chain */
 #ifdef THIS_PLAYER_IN_CALL_OUT
     object_t *command_giver;
 #endif
-#ifdef CALLOUT_HANDLES
-    int handle;
-#endif
 } pending_call_t;
 
-static pending_call_t *call_list[CALLOUT_CYCLE_SIZE];
+static pending_call_t call_wheel[CO_LEVELS][CO_SLOTS];	/* list heads */
+static int wheel_count[CO_LEVELS];	/* calls on each wheel */
+static pending_call_t call_now;		/* delay 0 calls */
+static pending_call_t call_far;		/* beyond the top wheel */
+static pending_call_t call_due;		/* expired, about to be called */
+static unsigned long wheel_time;	/* all slots up to here are done */
+static pending_call_t **handle_table, **owner_table;
+static int call_table_size;
 static pending_call_t *call_list_free;
-static int num_call, call_out_time = 0;
-#ifdef CALLOUT_HANDLES
+static int num_call, num_pending = 0;
 static int unique = 0;
-#endif
+static int num_cascades = 0;
+static long clock_base = -1;
 
 static void free_call PROT((pending_call_t *));
 static void free_called_call PROT((pending_call_t *));
 void remove_all_call_out PROT((object_t *));
 
+#define co_list_init(l) ((l)->next = (l)->prev = (l))
+#define co_list_empty(l) ((l)->next == (l))
+/* wrap-safe comparison of two times or two handles */
+#define co_before(a, b) ((long) ((a) - (b)) < 0)
+
+#define CALL_OWNER(cop) ((cop)->ob ? (cop)->ob : (cop)->function.f->hdr.owner)
+#define HASH_OWNER(ob) ((((POINTER_INT) (ob)) >> 4) & (call_table_size - 1))
+#define HASH_HANDLE(h) ((h) & (call_table_size - 1))
+
+/*
+ * Milliseconds since the first call_out.
+ */
+static unsigned long call_out_clock()
+{
+    long sec, usec;
+
+    get_usec_clock(&sec, &usec);
+    if (clock_base == -1)
+	clock_base = sec;
+    return (unsigned long) (sec - clock_base) * 1000 + usec / 1000;
+}
+
+static void init_call_out()
+{
+    int i, j;
+
+    for (i = 0; i < CO_LEVELS; i++)
+	for (j = 0; j < CO_SLOTS; j++)
+	    co_list_init(&call_wheel[i][j]);
+    co_list_init(&call_now);
+    co_list_init(&call_far);
+    co_list_init(&call_due);
+    wheel_time = call_out_clock();
+    call_table_size = 64;
+    handle_table = CALLOCATE(call_table_size, pending_call_t *,
+			     TAG_CALL_OUT, "init_call_out");
+    owner_table = CALLOCATE(call_table_size, pending_call_t *,
+			    TAG_CALL_OUT, "init_call_out");
+    for (i = 0; i < call_table_size; i++)
+	handle_table[i] = owner_table[i] = 0;
+}
+
+static void co_unlink P1(pending_call_t *, cop)
+{
+    if (cop->level >= 0) {
+	wheel_count[cop->level]--;
+	cop->level = -1;
+    }
+    cop->prev->next = cop->next;
+    cop->next->prev = cop->prev;
+}
+
+static void co_append P2(pending_call_t *, list, pending_call_t *, cop)
+{
+    cop->next = list;
+    cop->prev = list->prev;
+    list->prev->next = cop;
+    list->prev = cop;
+}
+
+/*
+ * Put a call on the wheel that covers its deadline.  Everything in a
+ * first-level slot has the same deadline; keep those in handle order so
+ * that cascaded calls don't end up behind later ones.
+ */
+static void co_schedule P1(pending_call_t *, cop)
+{
+    unsigned long delta = cop->expires - wheel_time;
+    unsigned long when = cop->expires;
+    pending_call_t *list, *p;
+    int level;
+
+    if (CO_BEYOND_WHEELS(delta)) {
+	cop->level = -1;
+	co_append(&call_far, cop);
+	return;
+    }
+    for (level = 0; level < CO_LEVELS - 1; level++)
+	if (delta < (1UL << ((level + 1) * CO_LEVEL_BITS)))
+	    break;
+    cop->level = level;
+    wheel_count[level]++;
+    list = &call_wheel[level][(when >> (level * CO_LEVEL_BITS)) & CO_SLOT_MASK];
+    if (level == 0) {
+	for (p = list->prev; p != list; p = p->prev)
+	    if (!co_before(cop->handle, p->handle))
+		break;
+	co_append(p->next, cop);
+    } else
+	co_append(list, cop);
+}
+
+/*
+ * Move everything in slot 'slot' of wheel 'level' down to the wheels
+ * below.
+ */
+static void co_cascade P2(int, level, int, slot)
+{
+    pending_call_t *list = &call_wheel[level][slot];
+    pending_call_t *cop;
+
+    num_cascades++;
+    while (!co_list_empty(list)) {
+	cop = list->next;
+	co_unlink(cop);
+	co_schedule(cop);
+    }
+}
+
+/*
+ * Put the calls that have come within reach of the top wheel onto it.
+ */
+static void co_recheck_far()
+{
+    pending_call_t far, *cop;
+
+    far.next = call_far.next;
+    far.prev = call_far.prev;
+    far.next->prev = far.prev->next = &far;
+    co_list_init(&call_far);
+    while (!co_list_empty(&far)) {
+	cop = far.next;
+	co_unlink(cop);
+	co_schedule(cop);
+    }
+}
+
+/*
+ * Bring the wheels up to 'now', moving every call that has come due onto
+ * the end of call_due.
+ */
+static void advance_wheel P1(unsigned long, now)
+{
+    pending_call_t *list, *cop;
+    unsigned long skip;
+    int level, slot;
+
+    while (co_before(wheel_time, now)) {
+	/*
+	 * Nothing can happen before the next slot of the lowest wheel with
+	 * anything on it comes round, so go to just short of that.
+	 */
+	for (level = 0; level < CO_LEVELS; level++)
+	    if (wheel_count[level])
+		break;
+	if (level == CO_LEVELS) {
+	    if (co_list_empty(&call_far)) {
+		wheel_time = now;
+		return;
+	    }
+	    level = CO_LEVELS - 1;
+	}
+	if (level) {
+	    skip = wheel_time | ((1UL << (level * CO_LEVEL_BITS)) - 1);
+	    if (!co_before(skip, now)) {
+		wheel_time = now;
+		return;
+	    }
+	    wheel_time = skip;
+	}
+	wheel_time++;
+	for (level = 1; level < CO_LEVELS; level++) {
+	    if (wheel_time & ((1UL << (level * CO_LEVEL_BITS)) - 1))
+		break;
+	    slot = (wheel_time >> (level * CO_LEVEL_BITS)) & CO_SLOT_MASK;
+	    co_cascade(level, slot);
+	    if (level == CO_LEVELS - 1 && !co_list_empty(&call_far))
+		co_recheck_far();
+	}
+	list = &call_wheel[0][wheel_time & CO_SLOT_MASK];
+	if (!co_list_empty(list)) {
+	    for (cop = list->next; cop != list; cop = cop->next) {
+		cop->level = -1;
+		wheel_count[0]--;
+	    }
+	    call_due.prev->next = list->next;
+	    list->next->prev = call_due.prev;
+	    list->prev->next = &call_due;
+	    call_due.prev = list->prev;
+	    co_list_init(list);
+	}
+    }
+}
+
+static void grow_call_tables()
+{
+    pending_call_t **new_handles, **new_owners, *cop, *next;
+    int i, old_size = call_table_size;
+
+    call_table_size *= 2;
+    new_handles = CALLOCATE(call_table_size, pending_call_t *,
+			    TAG_CALL_OUT, "grow_call_tables");
+    new_owners = CALLOCATE(call_table_size, pending_call_t *,
+			   TAG_CALL_OUT, "grow_call_tables");
+    for (i = 0; i < call_table_size; i++)
+	new_handles[i] = new_owners[i] = 0;
+    for (i = 0; i < old_size; i++) {
+	for (cop = handle_table[i]; cop; cop = next) {
+	    next = cop->next_handle;
+	    cop->next_handle = new_handles[HASH_HANDLE(cop->handle)];
+	    new_handles[HASH_HANDLE(cop->handle)] = cop;
+	}
+	for (cop = owner_table[i]; cop; cop = next) {
+	    next = cop->next_owner;
+	    cop->next_owner = new_owners[HASH_OWNER(CALL_OWNER(cop))];
+	    new_owners[HASH_OWNER(CALL_OWNER(cop))] = cop;
+	}
+    }
+    FREE(handle_table);
+    FREE(owner_table);
+    handle_table = new_handles;
+    owner_table = new_owners;
+}
+
+static void hash_call P1(pending_call_t *, cop)
+{
+    int h;
+
+    if (++num_pending > call_table_size)
+	grow_call_tables();
+    h = HASH_HANDLE(cop->handle);
+    cop->next_handle = handle_table[h];
+    handle_table[h] = cop;
+    h = HASH_OWNER(CALL_OWNER(cop));
+    cop->next_owner = owner_table[h];
+    owner_table[h] = cop;
+}
+
+static void unhash_call P1(pending_call_t *, cop)
+{
+    pending_call_t **copp;
+
+    for (copp = &handle_table[HASH_HANDLE(cop->handle)]; *copp != cop;
+	 copp = &(*copp)->next_handle)
+	;
+    *copp = cop->next_handle;
+    for (copp = &owner_table[HASH_OWNER(CALL_OWNER(cop))]; *copp != cop;
+	 copp = &(*copp)->next_owner)
+	;
+    *copp = cop->next_owner;
+    num_pending--;
+}
+
+/*
+ * Take a call off the wheel and out of the tables; the caller frees it.
+ */
+static void dequeue_call P1(pending_call_t *, cop)
+{
+    co_unlink(cop);
+    unhash_call(cop);
+}
+
 /*
  * Free a call out structure.
  */
@@ -69,25 +355,35 @@ INLINE_STATIC void free_call P1(pending_call_t *, cop)
 }
 
 /*
- * Setup a new call out.
+ * Seconds until a call goes off, as returned by find_call_out() etc.
+ */
+static int time_left P1(pending_call_t *, cop)
+{
+    unsigned long now = call_out_clock();
+
+    if (!co_before(now, cop->expires))
+	return 0;
+    return (cop->expires - now + 999) / 1000;
+}
+
+/*
+ * Setup a new call out.  The delay is in milliseconds.
  */
 #ifdef CALLOUT_HANDLES
 int
 #else
 void
 #endif
-new_call_out P5(object_t *, ob, svalue_t *, fun, int, delay, 
+new_call_out P5(object_t *, ob, svalue_t *, fun, long, delay,
 		int, num_args, svalue_t *, arg)
 {
-    pending_call_t *cop, **copp;
-    int tm;
-
-    if (delay < 1)
-	delay = 1;
-    /* Needs to be initialized here in case of very early call_outs */
-    if (!call_out_time)
-	call_out_time = current_time;
-    
+    pending_call_t *cop;
+
+    if (!call_table_size)
+	init_call_out();
+    if (delay < 0)
+	delay = 0;
+
     if (!call_list_free) {
 	int i;
 
@@ -121,34 +417,71 @@ new_call_out P5(object_t *, ob, svalue_t *, fun, int, delay,
     } else
 	cop->vs = 0;
 
-    /* Find out which slot this one fits in */
-    tm = (delay + current_time) & (CALLOUT_CYCLE_SIZE - 1);
-    delay = (1 + (delay + current_time - call_out_time - 1) / CALLOUT_CYCLE_SIZE);
-
-    for (copp = &call_list[tm]; *copp; copp = &(*copp)->next) {
-	if ((*copp)->delta >= delay) {
-	    (*copp)->delta -= delay;
-	    cop->delta = delay;
-	    cop->next = *copp;
-	    *copp = cop;
+    if (++unique <= 0)
+	unique = 1;
+    cop->handle = unique;
+    /* nothing pending, so the wheels haven't been kept up to date */
+    if (!num_pending)
+	wheel_time = call_out_clock();
+    hash_call(cop);
+    if (delay) {
+	cop->expires = call_out_clock() + delay;
+	/* the slot for wheel_time itself has already been emptied */
+	if (co_before(cop->expires, wheel_time + 1))
+	    cop->expires = wheel_time + 1;
+	co_schedule(cop);
+    } else {
+	cop->expires = wheel_time;
+	cop->level = -1;
+	co_append(&call_now, cop);
+    }
 #ifdef CALLOUT_HANDLES
-	    tm += CALLOUT_CYCLE_SIZE * ++unique;
-	    cop->handle = tm;
-	    return tm;
-#else
-	    return;
+    return cop->handle;
 #endif
+}
+
+/*
+ * How long the backend may sleep before a call out is due, in ms;
+ * -1 if nothing is pending.
+ */
+int next_call_out_delay()
+{
+    unsigned long now, when, best = 0;
+    int level, i, slot, found = 0;
+
+    if (!num_pending)
+	return -1;
+    if (!co_list_empty(&call_now) || !co_list_empty(&call_due))
+	return 0;
+    now = call_out_clock();
+    if (!co_before(wheel_time, now))
+	now = wheel_time;
+    for (level = 0; level < CO_LEVELS; level++) {
+	int shift = level * CO_LEVEL_BITS;
+
+	if (!wheel_count[level])
+	    continue;
+	for (i = 1; i <= CO_SLOTS; i++) {
+	    slot = ((wheel_time >> shift) + i) & CO_SLOT_MASK;
+	    if (!co_list_empty(&call_wheel[level][slot]))
+		break;
+	}
+	if (i > CO_SLOTS)
+	    continue;
+	/* when this slot is reached (level 0) or cascaded */
+	when = (((wheel_time >> shift) + i) << shift);
+	if (!found || co_before(when, best)) {
+	    best = when;
+	    found = 1;
 	}
-	delay -= (*copp)->delta;
     }
-    *copp = cop;
-    cop->delta = delay;
-    cop->next = 0;
-#ifdef CALLOUT_HANDLES
-    tm += CALLOUT_CYCLE_SIZE * ++unique;
-    cop->handle = tm;
-    return tm;
-#endif
+    if (!found)
+	return -1;
+    if (!co_before(now, best))
+	return 0;
+    if (best - now > 60000)
+	return 60000;
+    return (int) (best - now);
 }
 
 /*
@@ -162,8 +495,7 @@ void call_out()
     static pending_call_t *cop = 0;
     object_t *save_command_giver = command_giver;
     error_context_t econ;
-    int tm;
-    
+
     current_interactive = 0;
 
     /* could be still allocated if an error occured during a call_out */
@@ -171,91 +503,123 @@ void call_out()
 	free_called_call(cop);
 	cop = 0;
     }
-    if (!call_out_time)
-	call_out_time = current_time;
+    if (!num_pending)
+	return;
+    advance_wheel(call_out_clock());
+    /*
+     * delay 0 calls made before now go after the timed ones; any made
+     * while these run wait for the next cycle.
+     */
+    if (!co_list_empty(&call_now)) {
+	call_due.prev->next = call_now.next;
+	call_now.next->prev = call_due.prev;
+	call_now.prev->next = &call_due;
+	call_due.prev = call_now.prev;
+	co_list_init(&call_now);
+    }
+    if (co_list_empty(&call_due))
+	return;
+    current_time = get_current_time();
     save_context(&econ);
-    while (call_out_time < current_time) {
-	/* we increment at the end in case we are interrupted by errors,
-	   but we need to use call_out_time + 1 here. */
-	tm = (call_out_time+1) & (CALLOUT_CYCLE_SIZE - 1);
-	if (call_list[tm] && --call_list[tm]->delta == 0)
-	    do {
-		/*
-		 * Move the first call_out out of the chain.
-		 */
-		cop = call_list[tm];
-		call_list[tm] = call_list[tm]->next;
-		if (cop->ob && (cop->ob->flags & O_DESTRUCTED)) {
-		    free_call(cop);
-		    cop = 0;
-		} else {
-		    if (SETJMP(econ.context)) {
-			restore_context(&econ);
-		    } else {
-			object_t *ob;
-			
-			ob = cop->ob;
+    while (!co_list_empty(&call_due)) {
+	/*
+	 * Move the first call_out out of the chain.
+	 */
+	cop = call_due.next;
+	dequeue_call(cop);
+	if (cop->ob && (cop->ob->flags & O_DESTRUCTED)) {
+	    free_call(cop);
+	    cop = 0;
+	} else {
+	    if (SETJMP(econ.context)) {
+		restore_context(&econ);
+	    } else {
+		object_t *ob;
+
+		ob = cop->ob;
 #ifndef NO_SHADOWS
-			if (ob)
-			    while (ob->shadowing)
-				ob = ob->shadowing;
+		if (ob)
+		    while (ob->shadowing)
+			ob = ob->shadowing;
 #endif
-			command_giver = 0;
+		command_giver = 0;
 #ifdef THIS_PLAYER_IN_CALL_OUT
-			if (cop->command_giver &&
-			    !(cop->command_giver->flags & O_DESTRUCTED)) {
-			    command_giver = cop->command_giver;
-			} else if (ob && (ob->flags & O_LISTENER)) {
-			    command_giver = ob;
-			}
+		if (cop->command_giver &&
+		    !(cop->command_giver->flags & O_DESTRUCTED)) {
+		    command_giver = cop->command_giver;
+		} else if (ob && (ob->flags & O_LISTENER)) {
+		    command_giver = ob;
+		}
 #endif
-			/* current object no longer set */
-			
-			if (cop->vs) {
-			    array_t *vec = cop->vs;
-			    svalue_t *svp = vec->item + vec->size;
-			    
-			    while (svp-- > vec->item) {
-				if (svp->type == T_OBJECT && 
-				    (svp->u.ob->flags & O_DESTRUCTED)) {
-				    free_object(svp->u.ob, "call_out");
-				    *svp = const0;
-				}
-			    }
-			    /* cop->vs is ref one */
-			    extra = cop->vs->size;
-			    transfer_push_some_svalues(cop->vs->item, extra);
-			    free_empty_array(cop->vs);
-			} else
-			    extra = 0;
-			
-			if (cop->ob) {
-			    if (cop->function.s[0] == APPLY___INIT_SPECIAL_CHAR)
-				error("Illegal function name\n");
-    
-			    (void) apply(cop->function.s, cop->ob, extra,
-					 ORIGIN_CALL_OUT);
-			} else {
-			    (void) call_function_pointer(cop->function.f, extra);
+		/* current object no longer set */
+
+		if (cop->vs) {
+		    array_t *vec = cop->vs;
+		    svalue_t *svp = vec->item + vec->size;
+
+		    while (svp-- > vec->item) {
+			if (svp->type == T_OBJECT &&
+			    (svp->u.ob->flags & O_DESTRUCTED)) {
+			    free_object(svp->u.ob, "call_out");
+			    *svp = const0;
 			}
 		    }
-		    free_called_call(cop);
-		    cop = 0;
+		    /* cop->vs is ref one */
+		    extra = cop->vs->size;
+		    transfer_push_some_svalues(cop->vs->item, extra);
+		    free_empty_array(cop->vs);
+		} else
+		    extra = 0;
+
+		if (cop->ob) {
+		    if (cop->function.s[0] == APPLY___INIT_SPECIAL_CHAR)
+			error("Illegal function name\n");
+
+		    (void) apply(cop->function.s, cop->ob, extra,
+				 ORIGIN_CALL_OUT);
+		} else {
+		    (void) call_function_pointer(cop->function.f, extra);
 		}
-	    } while (call_list[tm] && call_list[tm]->delta == 0);
-	call_out_time++;
+	    }
+	    free_called_call(cop);
+	    cop = 0;
+	}
     }
     pop_context(&econ);
     command_giver = save_command_giver;
 }
 
-static int time_left P2(int, slot, int, delay) {
-    int current_slot = call_out_time & (CALLOUT_CYCLE_SIZE - 1);
-    if (slot > current_slot) {
-	return (delay-1) * CALLOUT_CYCLE_SIZE + (slot - current_slot) + call_out_time - current_time;
-    } else {
-	return delay * CALLOUT_CYCLE_SIZE + (slot - current_slot) + call_out_time - current_time;
+/*
+ * Find a call out by owner and function name; the first one to go off
+ * if there are several.
+ */
+static pending_call_t *find_call P2(object_t *, ob, char *, fun)
+{
+    pending_call_t *cop, *found = 0;
+
+    if (!num_pending)
+	return 0;
+    for (cop = owner_table[HASH_OWNER(ob)]; cop; cop = cop->next_owner) {
+	if (cop->ob == ob && strcmp(cop->function.s, fun) == 0) {
+	    if (!found || co_before(cop->expires, found->expires) ||
+		(cop->expires == found->expires &&
+		 co_before(cop->handle, found->handle)))
+		found = cop;
+	}
     }
+    return found;
+}
+
+static pending_call_t *find_handle P1(int, handle)
+{
+    pending_call_t *cop;
+
+    if (!num_pending)
+	return 0;
+    for (cop = handle_table[HASH_HANDLE(handle)]; cop; cop = cop->next_handle)
+	if (cop->handle == handle)
+	    return cop;
+    return 0;
 }
 
 /*
@@ -265,101 +629,69 @@ static int time_left P2(int, slot, int, delay) {
  */
 int remove_call_out P2(object_t *, ob, char *, fun)
 {
-    pending_call_t **copp, *cop;
+    pending_call_t *cop;
     int delay;
-    int i;
-    
+
     if (!ob) return -1;
-    for (i = 0; i < CALLOUT_CYCLE_SIZE; i++) {
-	delay = 0;
-	for (copp = &call_list[i]; *copp; copp = &(*copp)->next) {
-	    delay += (*copp)->delta;
-	    if ((*copp)->ob == ob && strcmp((*copp)->function.s, fun) == 0) {
-		cop = *copp;
-		if (cop->next)
-		    cop->next->delta += cop->delta;
-		*copp = cop->next;
-		free_call(cop);
-		return time_left(i, delay);
-	    }
-	}
-    }
-    return -1;
+    if (!(cop = find_call(ob, fun)))
+	return -1;
+    delay = time_left(cop);
+    dequeue_call(cop);
+    free_call(cop);
+    return delay;
 }
 
 #ifdef CALLOUT_HANDLES
 int remove_call_out_by_handle P1(int, handle)
 {
-    pending_call_t **copp, *cop;
-    int delay = 0;
-    
-    for (copp = &call_list[handle & (CALLOUT_CYCLE_SIZE - 1)]; *copp; copp = &(*copp)->next) {
-	delay += (*copp)->delta;
-	if ((*copp)->handle == handle) {
-	    cop = *copp;
-	    if (cop->next)
-		cop->next->delta += cop->delta;
-	    *copp = cop->next;
-	    free_call(cop);
-	    return time_left(handle & (CALLOUT_CYCLE_SIZE - 1), delay);
-	}
-    }
-    return -1;
+    pending_call_t *cop;
+    int delay;
+
+    if (!(cop = find_handle(handle)))
+	return -1;
+    delay = time_left(cop);
+    dequeue_call(cop);
+    free_call(cop);
+    return delay;
 }
 
-int find_call_out_by_handle P1(int, handle) 
+int find_call_out_by_handle P1(int, handle)
 {
     pending_call_t *cop;
-    int delay = 0;
-    
-    for (cop = call_list[handle & (CALLOUT_CYCLE_SIZE - 1)]; cop; cop = cop->next) {
-	delay += cop->delta;
-	if (cop->handle == handle) 
-	    return time_left(handle & (CALLOUT_CYCLE_SIZE - 1), delay);
-    }
-    return -1;
+
+    if (!(cop = find_handle(handle)))
+	return -1;
+    return time_left(cop);
 }
 #endif
-	
+
 int find_call_out P2(object_t *, ob, char *, fun)
 {
     pending_call_t *cop;
-    int delay;
-    int i;
-    
+
     if (!ob) return -1;
-    for (i = 0; i < CALLOUT_CYCLE_SIZE; i++) {
-	delay = 0;
-	for (cop = call_list[i]; cop; cop = cop->next) {
-	    delay += cop->delta;
-	    if (cop->ob == ob && strcmp(cop->function.s, fun) == 0) 
-		return time_left(i, delay);
-	}
-    }
-    return -1;
+    if (!(cop = find_call(ob, fun)))
+	return -1;
+    return time_left(cop);
 }
 
 int print_call_out_usage P2(outbuffer_t *, ob, int, verbose)
 {
-    int i, j;
-    pending_call_t *cop;
-
-    for (i = 0, j = 0; j < CALLOUT_CYCLE_SIZE; j++)
-	for (cop = call_list[j]; cop; cop = cop->next)
-	    i++;
-
     if (verbose == 1) {
 	outbuf_add(ob, "Call out information:\n");
 	outbuf_add(ob, "---------------------\n");
 	outbuf_addv(ob, "Number of allocated call outs: %8d, %8d bytes\n",
 		    num_call, num_call * sizeof(pending_call_t));
-	outbuf_addv(ob, "Current length: %d\n", i);
+	outbuf_addv(ob, "Current length: %d\n", num_pending);
+	outbuf_addv(ob, "Hash table size: %d, cascades: %d\n",
+		    call_table_size, num_cascades);
     } else {
 	if (verbose != -1)
 	    outbuf_addv(ob, "call out:\t\t\t%8d %8d (current length %d)\n", num_call,
-			num_call * sizeof(pending_call_t), i);
+			num_call * sizeof(pending_call_t), num_pending);
     }
-    return (int) (num_call * sizeof(pending_call_t));
+    return (int) (num_call * sizeof(pending_call_t) +
+		  2 * call_table_size * sizeof(pending_call_t *));
 }
 
 #ifdef DEBUGMALLOC_EXTENSIONS
@@ -367,9 +699,9 @@ void mark_call_outs()
 {
     pending_call_t *cop;
     int i;
-    
-    for (i = 0; i < CALLOUT_CYCLE_SIZE; i++) {
-	for (cop = call_list[i]; cop; cop = cop->next) {
+
+    for (i = 0; i < call_table_size; i++) {
+	for (cop = handle_table[i]; cop; cop = cop->next_handle) {
 	    if (cop->vs)
 		cop->vs->extra_ref++;
 	    if (cop->ob) {
@@ -388,61 +720,72 @@ void mark_call_outs()
 #endif
 
 /*
- * Construct an array of all pending call_outs. Every item in the array
- * consists of 3 items (but only if the object not is destructed):
+ * Order calls by when they go off.
+ */
+static int compare_calls P2(pending_call_t **, x, pending_call_t **, y)
+{
+    if ((*x)->expires != (*y)->expires)
+	return co_before((*x)->expires, (*y)->expires) ? -1 : 1;
+    return co_before((*x)->handle, (*y)->handle) ? -1 : 1;
+}
+
+/*
+ * Construct an array of all pending call_outs, soonest first. Every item
+ * in the array consists of 3 items (but only if the object not is
+ * destructed):
  * 0:	The object.
  * 1:	The function (string).
  * 2:	The delay.
  */
 array_t *get_all_call_outs()
 {
-    int i, j, delay, tm;
-    pending_call_t *cop;
+    int i, j, n;
+    pending_call_t *cop, **calls;
     array_t *v;
 
-    for (i = 0, j = 0; j < CALLOUT_CYCLE_SIZE; j++)
-	for (cop = call_list[j]; cop; cop = cop->next)
+    for (n = 0, j = 0; j < call_table_size; j++)
+	for (cop = handle_table[j]; cop; cop = cop->next_handle)
 	    if (!cop->ob || !(cop->ob->flags & O_DESTRUCTED))
-		i++;
+		n++;
 
-    v = allocate_empty_array(i);
-    tm = call_out_time & (CALLOUT_CYCLE_SIZE-1);
+    v = allocate_empty_array(n);
+    if (!n)
+	return v;
 
-    for (i = 0, j = 0; j < CALLOUT_CYCLE_SIZE; j++) {
-	delay = 0;
-	for (cop = call_list[j]; cop; cop = cop->next) {
-	    array_t *vv;
+    calls = CALLOCATE(n, pending_call_t *, TAG_TEMPORARY, "get_all_call_outs");
+    for (i = 0, j = 0; j < call_table_size; j++)
+	for (cop = handle_table[j]; cop; cop = cop->next_handle)
+	    if (!cop->ob || !(cop->ob->flags & O_DESTRUCTED))
+		calls[i++] = cop;
+    quickSort((char *) calls, n, sizeof(pending_call_t *), compare_calls);
 
-	    delay += cop->delta;
-	    if (cop->ob && (cop->ob->flags & O_DESTRUCTED))
-		continue;
-	    vv = allocate_empty_array(3);
-	    if (cop->ob) {
-		vv->item[0].type = T_OBJECT;
-		vv->item[0].u.ob = cop->ob;
-		add_ref(cop->ob, "get_all_call_outs");
-		vv->item[1].type = T_STRING;
-		vv->item[1].subtype = STRING_SHARED;
-		vv->item[1].u.string = make_shared_string(cop->function.s);
-	    } else {
-		vv->item[0].type = T_OBJECT;
-		vv->item[0].u.ob = cop->function.f->hdr.owner;
-		add_ref(cop->function.f->hdr.owner, "get_all_call_outs");
-		vv->item[1].type = T_STRING;
-		vv->item[1].subtype = STRING_SHARED;
-		vv->item[1].u.string = make_shared_string("<function>");
-	    }
-	    vv->item[2].type = T_NUMBER;
-	    if (j > tm) {
-		vv->item[2].u.number = (delay-1) * CALLOUT_CYCLE_SIZE + (j - tm) + call_out_time - current_time;
-	    } else {
-		vv->item[2].u.number = delay * CALLOUT_CYCLE_SIZE + (j - tm) + call_out_time - current_time;
-	    }
-	    
-	    v->item[i].type = T_ARRAY;
-	    v->item[i++].u.arr = vv;	/* Ref count is already 1 */
+    for (i = 0; i < n; i++) {
+	array_t *vv;
+
+	cop = calls[i];
+	vv = allocate_empty_array(3);
+	if (cop->ob) {
+	    vv->item[0].type = T_OBJECT;
+	    vv->item[0].u.ob = cop->ob;
+	    add_ref(cop->ob, "get_all_call_outs");
+	    vv->item[1].type = T_STRING;
+	    vv->item[1].subtype = STRING_SHARED;
+	    vv->item[1].u.string = make_shared_string(cop->function.s);
+	} else {
+	    vv->item[0].type = T_OBJECT;
+	    vv->item[0].u.ob = cop->function.f->hdr.owner;
+	    add_ref(cop->function.f->hdr.owner, "get_all_call_outs");
+	    vv->item[1].type = T_STRING;
+	    vv->item[1].subtype = STRING_SHARED;
+	    vv->item[1].u.string = make_shared_string("<function>");
 	}
+	vv->item[2].type = T_NUMBER;
+	vv->item[2].u.number = time_left(cop);
+
+	v->item[i].type = T_ARRAY;
+	v->item[i].u.arr = vv;	/* Ref count is already 1 */
     }
+    FREE(calls);
     return v;
 }
 
@@ -450,24 +793,17 @@ void
 remove_all_call_out P1(object_t *, obj)
 {
     pending_call_t **copp, *cop;
-    int i;
-    
-    for (i = 0; i < CALLOUT_CYCLE_SIZE; i++) {
-	copp = &call_list[i];
-	while (*copp) {
-	    if ( ((*copp)->ob &&
-		  (((*copp)->ob == obj) || ((*copp)->ob->flags & O_DESTRUCTED))) ||
-		 (!(*copp)->ob &&
-		  ((*copp)->function.f->hdr.owner == obj ||
-		   (*copp)->function.f->hdr.owner->flags & O_DESTRUCTED)) )
-		{
-		    cop = *copp;
-		    if (cop->next)
-			cop->next->delta += cop->delta;
-		    *copp = cop->next;
-		    free_call(cop);
-		} else
-		    copp = &(*copp)->next;
-	}
+
+    if (!num_pending)
+	return;
+    copp = &owner_table[HASH_OWNER(obj)];
+    while (*copp) {
+	cop = *copp;
+	if (CALL_OWNER(cop) == obj) {
+	    dequeue_call(cop);
+	    free_call(cop);
+	    /* unhash_call() has already unlinked *copp */
+	} else
+	    copp = &cop->next_owner;
     }
 }
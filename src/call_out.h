@@ -1,16 +1,25 @@
 #ifndef CALL_OUT_H
 #define CALL_OUT_H
 
+/*
+ * The longest delay new_call_out() takes, in ms: find_call_out() must be
+ * able to give it back in seconds, and deadlines must still compare
+ * correctly after the millisecond clock wraps.
+ */
+#define MAX_CALL_OUT_DELAY \
+    (sizeof(long) > 4 ? 0x7fffffffL * 1000 : 0x3fffffffL)
+
 /*
  * call_out.c
  */
 void call_out PROT((void));
+int next_call_out_delay PROT((void));
 #ifdef CALLOUT_HANDLES
 int find_call_out_by_handle PROT((int));
 int remove_call_out_by_handle PROT((int));
-int new_call_out PROT((object_t *, svalue_t *, int, int, svalue_t *));
+int new_call_out PROT((object_t *, svalue_t *, long, int, svalue_t *));
 #else
-void new_call_out PROT((object_t *, svalue_t *, int, int, svalue_t *));
+void new_call_out PROT((object_t *, svalue_t *, long, int, svalue_t *));
 #endif
 int remove_call_out PROT((object_t *, char *));
 void remove_all_call_out PROT((object_t *));
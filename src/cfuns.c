@@ -8,6 +8,7 @@
 #include "eoperators.h"
 #include "parse.h"
 #include "qsort.h"
+#include "reclaim.h"
 
 IF_DEBUG(extern int stack_in_use_as_temporary);
 
@@ -92,8 +93,9 @@ void c_foreach P3(int, flags, int, idx1, int, idx2) {
     } else {
 	CHECK_TYPES(sp, T_ARRAY, 2, F_FOREACH);
 
+	/* an index, as the loop may give the array a new store */
 	(++sp)->type = T_NUMBER;
-	sp->u.lvalue = (sp-1)->u.arr->item;
+	sp->u.number = 0;
 	sp->subtype = (sp-1)->u.arr->size;
     }
 
@@ -134,7 +136,7 @@ void c_expand_varargs P1(int, where) {
 	    t--;
 	}
 	t = s + n - 1;
-	if (arr->ref == 1) {
+	if (ARRAY_PRIVATE(arr)) {
 	    memcpy(s, arr->item, n * sizeof(svalue_t));
 	    free_empty_array(arr);
 	    return;
@@ -182,7 +184,8 @@ int c_next_foreach PROT((void)) {
 		sp->u.lvalue->type = T_NUMBER;
 		sp->u.lvalue->u.number = *((sp-1)->u.lvalue_byte)++;
 	    } else {
-		assign_svalue(sp->u.lvalue, (sp-1)->u.lvalue++);
+		assign_svalue(sp->u.lvalue,
+			      (sp-2)->u.arr->item + (sp-1)->u.number++);
 	    }
 	    return 1;
 	}
@@ -280,6 +283,7 @@ void c_void_assign() {
 	    {
 		free_svalue(lval, "F_VOID_ASSIGN : 3");
 		*lval = *sp--;
+		RECLAIM_STORE(lval);
 	    }
 	}
     } else sp--;
@@ -391,6 +395,7 @@ void c_assign() {
 	break;
     default:
 	assign_svalue(sp->u.lvalue, sp - 1);
+	RECLAIM_STORE(sp->u.lvalue);
 	break;
     case T_LVALUE_RANGE:
 	assign_lvalue_range(sp - 1);
@@ -713,6 +718,7 @@ void c_add_eq P1(int, is_void) {
 	else {
 	    /* add_array now frees the arrays */
 	    lval->u.arr = add_array(lval->u.arr, sp->u.arr);
+	    RECLAIM_STORE(lval);
 	}
 	break;
     case T_MAPPING:
@@ -721,6 +727,9 @@ void c_add_eq P1(int, is_void) {
 	else {
 	    absorb_mapping(lval->u.map, sp->u.map);
 	    free_mapping(sp->u.map);	/* free RHS */
+#ifdef RECLAIM_SLICE
+	    reclaim_note_container(lval);
+#endif
 	    /* LHS not freed because its being reused */
 	}
 	break;
@@ -1,9 +1,11 @@
 #include "std.h"
 #include "lpc_incl.h"
+#include "reclaim.h"
 
 void dealloc_class P1(array_t *, p) {
     int i;
 
+    RECLAIM_FORGET(p);
     for (i = p->size; i--;)
 	free_svalue(&p->item[i], "dealloc_class");
     FREE((char *) p);
@@ -21,7 +23,8 @@ array_t *allocate_class P2(class_def_t *, cld, int, has_values) {
     array_t *p;
     int n = cld->size;
 
-    p = (array_t *)DXALLOC(sizeof(array_t) + sizeof(svalue_t) * (n - 1), TAG_CLASS, "allocate_class");
+    p = (array_t *)DXALLOC(ARRAY_SIZE(n), TAG_CLASS, "allocate_class");
+    init_array_store(p, n);
     p->ref = 1;
     p->size = n;
     if (has_values) {
@@ -37,7 +40,8 @@ array_t *allocate_class P2(class_def_t *, cld, int, has_values) {
 array_t *allocate_class_by_size P1(int, size) {
     array_t *p;
 
-    p = (array_t *)DXALLOC(sizeof(array_t) + sizeof(svalue_t) * (size - 1), TAG_CLASS, "allocate_class");
+    p = (array_t *)DXALLOC(ARRAY_SIZE(size), TAG_CLASS, "allocate_class");
+    init_array_store(p, size);
     p->ref = 1;
     p->size = size;
 
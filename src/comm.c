@@ -16,6 +16,12 @@
 #include "debug.h"
 #include "ed.h"
 #include "file.h"
+#include "port.h"
+#include "poller.h"
+#include "resolver.h"
+#ifndef WINSOCK
+#include <sys/uio.h>
+#endif
 
 #define TELOPTS
 
@@ -31,7 +37,9 @@ static void sigpipe_handler PROT((int));
 #else
 static void sigpipe_handler PROT((void));
 #endif
+#ifndef RESOLVER
 static void hname_handler PROT((void));
+#endif
 static void get_user_data PROT((interactive_t *));
 static char *get_user_command PROT((void));
 static char *first_cmd_in_buf PROT((interactive_t *));
@@ -40,19 +48,36 @@ static void next_cmd_in_buf PROT((interactive_t *));
 static int call_function_interactive PROT((interactive_t *, char *));
 static void print_prompt PROT((interactive_t *));
 static void telnet_neg PROT((char *, char *));
+#ifndef RESOLVER
 static void query_addr_name PROT((object_t *));
 static void got_addr_number PROT((char *, char *));
 static void add_ip_entry PROT((long, char *));
+#endif
 #ifndef NO_ADD_ACTION
 static void clear_notify PROT((interactive_t *));
 #endif
 static void new_user_handler PROT((int));
+static void new_user PROT((int, int, struct sockaddr_in *));
 static void receive_snoop PROT((char *, object_t * ob));
+static void update_user_poll PROT((interactive_t *));
+static void add_flush_user PROT((interactive_t *));
+static void unlink_flush_user PROT((interactive_t *));
+static void queue_message PROT((interactive_t *, char *));
+static void free_message_queue PROT((interactive_t *));
+static void set_cmd_in_buf PROT((interactive_t *));
+static void clear_cmd_in_buf PROT((interactive_t *));
+static void reset_text PROT((interactive_t *));
+static int write_failed PROT((interactive_t *));
+#ifdef MCCP
+static void start_compression PROT((interactive_t *));
+static void end_compression PROT((interactive_t *));
+static void free_compression PROT((interactive_t *));
+static int flush_compressed PROT((interactive_t *));
+#endif
 
 /*
  * public local variables.
  */
-fd_set readmask, writemask;
 int num_user;
 int num_hidden;			/* for the O_HIDDEN flag.  This counter must
 				 * be kept up to date at all times!  If you
@@ -60,15 +85,42 @@ int num_hidden;			/* for the O_HIDDEN flag.  This counter must
 				 * make sure that you update this counter if
 				 * the object is interactive. */
 int add_message_calls = 0;
+int num_message_chunks = 0;
+int message_chunk_bytes = 0;
+int input_buffer_bytes = 0;
+#ifdef MCCP
+int num_compressed = 0;
+double compress_bytes_in = 0;
+double compress_bytes_out = 0;
+double compress_usec = 0;
+#endif
 int inet_packets = 0;
 int inet_volume = 0;
+int connections_accepted = 0;
+int connections_dropped = 0;
+int logons_waiting = 0;
 interactive_t **all_users = 0;
 int max_users = 0;
 
 /*
  * private local variables.
  */
+#ifndef RESOLVER
 static int addr_server_fd = -1;
+#endif
+
+/*
+ * connections that have been accepted, but not yet handed to the master;
+ * a ring of logons_waiting entries starting at logon_head.
+ */
+typedef struct {
+    int fd;
+    int which;
+    struct sockaddr_in addr;
+} pending_logon_t;
+
+static pending_logon_t pending_logons[MAX_PENDING_LOGONS];
+static int logon_head = 0;
 
 static void
 receive_snoop P2(char *, buf, object_t *, snooper)
@@ -159,11 +211,12 @@ void init_user_conn()
 	/*
 	 * listen on socket for connections.
 	 */
-	if (listen(external_port[i].fd, 128) == -1) {
+	if (listen(external_port[i].fd, LISTEN_BACKLOG) == -1) {
 	    debug_perror("init_user_conn: listen", 0);
 	    CLEANUP;
 	    exit(10);
 	}
+	poll_set(external_port[i].fd, PK_EXTERNAL_PORT, i, POLL_READ);
     }
     /*
      * register signal handler for SIGPIPE.
@@ -183,8 +236,15 @@ void ipc_remove()
 {
     int i;
 
+    while (logons_waiting) {
+	OS_socket_close(pending_logons[logon_head].fd);
+	logon_head = (logon_head + 1) % MAX_PENDING_LOGONS;
+	logons_waiting--;
+    }
+
     for (i = 0; i < 5; i++) {
 	if (!external_port[i].port) continue;
+	poll_remove(external_port[i].fd);
 	if (OS_socket_close(external_port[i].fd) == -1) {
 	    debug_perror("ipc_remove: close", 0);
 	}
@@ -193,6 +253,7 @@ void ipc_remove()
     debug_message("closed external ports\n");
 }
 
+#ifndef RESOLVER
 void init_addr_server P2(char *, hostname, int, addr_server_port)
 {
     struct sockaddr_in server;
@@ -258,6 +319,7 @@ void init_addr_server P2(char *, hostname, int, addr_server_port)
 	return;
     }
     addr_server_fd = server_fd;
+    poll_set(addr_server_fd, PK_ADDR_SERVER, 0, POLL_READ);
     debug_message("Connected to address server on %s port %d\n", hostname,
 	    addr_server_port);
     /*
@@ -268,6 +330,7 @@ void init_addr_server P2(char *, hostname, int, addr_server_port)
 	return;
     }
 }
+#endif
 
 /*
  * If there is a shadow for this object, then the message should be
@@ -303,6 +366,213 @@ static int shadow_catch_message P2(object_t *, ob, char *, str)
 }
 #endif
 
+/*
+ * Output queues.  Chunks hold text that is ready to go out on the wire;
+ * a chunk with only one reference is still open for appending.
+ */
+static message_chunk_t *new_message_chunk P1(int, size)
+{
+    message_chunk_t *mc;
+
+    if (size < MESSAGE_BUF_SIZE)
+	size = MESSAGE_BUF_SIZE;
+    mc = (message_chunk_t *)DXALLOC(sizeof(message_chunk_t) + size - 1,
+				    TAG_MESSAGE_CHUNK, "new_message_chunk");
+    mc->ref = 1;
+    mc->size = size;
+    mc->len = 0;
+    num_message_chunks++;
+    message_chunk_bytes += size;
+    return mc;
+}
+
+static void free_message_chunk P1(message_chunk_t *, mc)
+{
+    if (--mc->ref > 0)
+	return;
+    num_message_chunks--;
+    message_chunk_bytes -= mc->size;
+    FREE(mc);
+}
+
+/*
+ * The length str will have once each \n has become \r\n.
+ */
+static int translated_length P2(char *, str, int, len)
+{
+    char *end = str + len;
+    int ret = len;
+
+    while ((str = memchr(str, '\n', end - str))) {
+	str++;
+	ret++;
+    }
+    return ret;
+}
+
+/*
+ * Copy len bytes of str to dest, putting \r in front of each \n.
+ * Returns the number of bytes written.
+ */
+static int translate_newlines P3(char *, dest, char *, str, int, len)
+{
+    char *end = str + len, *d = dest, *nl;
+    int n;
+
+    while ((nl = memchr(str, '\n', end - str))) {
+	n = nl - str;
+	memcpy(d, str, n);
+	d += n;
+	*d++ = '\r';
+	*d++ = '\n';
+	str = nl + 1;
+    }
+    n = end - str;
+    memcpy(d, str, n);
+    return (d + n) - dest;
+}
+
+/*
+ * Put a chunk on the end of ip's queue.  The caller's reference to it
+ * becomes the queue's.
+ */
+static void enqueue_message_chunk P2(interactive_t *, ip, message_chunk_t *, mc)
+{
+    message_link_t *link;
+
+    link = ALLOCATE(message_link_t, TAG_MESSAGE_LINK, "enqueue_message_chunk");
+    link->next = 0;
+    link->chunk = mc;
+    if (ip->message_tail)
+	ip->message_tail->next = link;
+    else
+	ip->message_head = link;
+    ip->message_tail = link;
+    ip->message_length += mc->len;
+#ifdef NET_STATS
+    if (ip->message_length > ip->stats.peak_queue)
+	ip->stats.peak_queue = ip->message_length;
+#endif
+}
+
+/*
+ * Broadcasts.  say(), tell_room(), shout() and message() name the string
+ * they are about to send to everyone with start_broadcast().  The first
+ * user that string is queued for gets it translated into a chunk, and
+ * the rest just get a reference to the same chunk, however the string
+ * reaches add_message() (catch_tell()/receive_message() passing it
+ * straight to receive(), snoop, ...).  We hold a reference to the string
+ * itself, so it can't be changed, or freed and the address reused, while
+ * it is the broadcast string, even if an error means end_broadcast() is
+ * never reached.
+ */
+static svalue_t broadcast_str = { T_NUMBER };
+static message_chunk_t *broadcast_chunk = 0;
+
+void start_broadcast P1(svalue_t *, v)
+{
+    end_broadcast();
+    if (v->type == T_STRING && (v->subtype & STRING_COUNTED))
+	assign_svalue_no_free(&broadcast_str, v);
+}
+
+void end_broadcast()
+{
+    if (broadcast_chunk) {
+	free_message_chunk(broadcast_chunk);
+	broadcast_chunk = 0;
+    }
+    if (broadcast_str.type == T_STRING) {
+	free_string_svalue(&broadcast_str);
+	broadcast_str = const0;
+    }
+}
+
+/*
+ * Add str to the output for ip.  Nothing is dropped: a user with too much
+ * waiting stops being read from (see update_user_poll()) until it drains,
+ * and one that has stopped reading altogether is disconnected.
+ */
+static void queue_message P2(interactive_t *, ip, char *, str)
+{
+    message_chunk_t *mc;
+    int len, need;
+
+    if (ip->message_length > MESSAGE_QUEUE_LIMIT) {
+	flush_message(ip);
+	if (ip->message_length > MESSAGE_QUEUE_LIMIT
+	    && !(ip->iflags & NET_DEAD)) {
+	    debug_message("Output queue full for %s; closing connection.\n",
+			  ip->ob->name);
+	    ip->iflags |= NET_DEAD;
+	}
+	if (ip->iflags & NET_DEAD) {
+#ifdef NET_STATS
+	    ip->stats.dropped += strlen(str);
+#endif
+	    return;
+	}
+    }
+    if (broadcast_str.type == T_STRING && str == broadcast_str.u.string) {
+	if (!broadcast_chunk) {
+	    if (!(len = SVALUE_STRLEN(&broadcast_str)))
+		return;
+	    need = translated_length(str, len);
+	    /* short ones are cheaper to copy onto the end of each queue */
+	    if (need < MESSAGE_SHARE_MIN)
+		goto copy;
+	    broadcast_chunk = new_message_chunk(need);
+	    broadcast_chunk->len = translate_newlines(broadcast_chunk->data,
+						      str, len);
+	}
+	broadcast_chunk->ref++;
+	enqueue_message_chunk(ip, broadcast_chunk);
+	return;
+    }
+    if (!(len = strlen(str)))
+	return;
+    need = translated_length(str, len);
+  copy:
+    if (ip->message_tail && (mc = ip->message_tail->chunk)->ref == 1
+	&& mc->size - mc->len >= need) {
+	mc->len += translate_newlines(mc->data + mc->len, str, len);
+	ip->message_length += need;
+#ifdef NET_STATS
+	if (ip->message_length > ip->stats.peak_queue)
+	    ip->stats.peak_queue = ip->message_length;
+#endif
+    } else {
+	mc = new_message_chunk(need);
+	mc->len = translate_newlines(mc->data, str, len);
+	enqueue_message_chunk(ip, mc);
+    }
+}
+
+/*
+ * Drop the first n bytes of ip's queue, which have been sent.
+ */
+static void consume_message_queue P2(interactive_t *, ip, int, n)
+{
+    message_link_t *link;
+
+    ip->message_length -= n;
+    n += ip->message_offset;
+    while ((link = ip->message_head) && n >= link->chunk->len) {
+	n -= link->chunk->len;
+	ip->message_head = link->next;
+	free_message_chunk(link->chunk);
+	FREE(link);
+    }
+    if (!link)
+	ip->message_tail = 0;
+    ip->message_offset = n;
+}
+
+static void free_message_queue P1(interactive_t *, ip)
+{
+    consume_message_queue(ip, ip->message_length);
+}
+
 /*
  * Send a message to an interactive object. If that object is shadowed,
  * special handling is done.
@@ -310,7 +580,6 @@ static int shadow_catch_message P2(object_t *, ob, char *, str)
 void add_message P2(object_t *, who, char *, data)
 {
     interactive_t *ip;
-    char *cp;
 
     /*
      * if who->interactive is not valid, write message on stderr.
@@ -345,35 +614,9 @@ void add_message P2(object_t *, who, char *, data)
 #endif				/* NO_SHADOWS */
 
     /*
-     * write message into ip->message_buf.
+     * put the message on ip's output queue.
      */
-    for (cp = data; *cp != '\0'; cp++) {
-	if (ip->message_length == MESSAGE_BUF_SIZE) {
-	    if (!flush_message(ip)) {
-		debug_message("Broken connection during add_message.\n");
-		return;
-	    }
-	    if (ip->message_length == MESSAGE_BUF_SIZE)
-		break;
-	}
-	if (*cp == '\n') {
-	    if (ip->message_length == (MESSAGE_BUF_SIZE - 1)) {
-		if (!flush_message(ip)) {
-		    debug_message("Broken connection during add_message.\n");
-		    return;
-		}
-		if (ip->message_length == (MESSAGE_BUF_SIZE - 1))
-		    break;
-	    }
-	    ip->message_buf[ip->message_producer] = '\r';
-	    ip->message_producer = (ip->message_producer + 1)
-		% MESSAGE_BUF_SIZE;
-	    ip->message_length++;
-	}
-	ip->message_buf[ip->message_producer] = *cp;
-	ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-	ip->message_length++;
-    }
+    queue_message(ip, data);
     /*
      * snoop handling.
      */
@@ -383,6 +626,7 @@ void add_message P2(object_t *, who, char *, data)
 #ifdef FLUSH_OUTPUT_IMMEDIATELY
     flush_message(ip);
 #endif
+    update_user_poll(ip);
     
     add_message_calls++;
 }				/* add_message() */
@@ -391,7 +635,7 @@ void add_message P2(object_t *, who, char *, data)
 void add_vmessage P2V(object_t *, who, char *, format)
 {
     interactive_t *ip;
-    char *cp, new_string_data[LARGEST_PRINTABLE_STRING + 1];
+    char new_string_data[LARGEST_PRINTABLE_STRING + 1];
     va_list args;
     V_DCL(char *format);
     V_DCL(object_t *who);
@@ -442,41 +686,9 @@ void add_vmessage P2V(object_t *, who, char *, format)
 #endif				/* NO_SHADOWS */
 
     /*
-     * write message into ip->message_buf.
+     * put the message on ip's output queue.
      */
-    for (cp = new_string_data; *cp != '\0'; cp++) {
-	if (ip->message_length == MESSAGE_BUF_SIZE) {
-	    if (!flush_message(ip)) {
-		debug_message("Broken connection during add_message.\n");
-		return;
-	    }
-	    if (ip->message_length == MESSAGE_BUF_SIZE)
-		break;
-	}
-	if (*cp == '\n') {
-	    if (ip->message_length == (MESSAGE_BUF_SIZE - 1)) {
-		if (!flush_message(ip)) {
-		    debug_message("Broken connection during add_message.\n");
-		    return;
-		}
-		if (ip->message_length == (MESSAGE_BUF_SIZE - 1))
-		    break;
-	    }
-	    ip->message_buf[ip->message_producer] = '\r';
-	    ip->message_producer = (ip->message_producer + 1)
-		% MESSAGE_BUF_SIZE;
-	    ip->message_length++;
-	}
-	ip->message_buf[ip->message_producer] = *cp;
-	ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-	ip->message_length++;
-    }
-    if (ip->message_length != 0) {
-	if (!flush_message(ip)) {
-	    debug_message("Broken connection during add_message.\n");
-	    return;
-	}
-    }
+    queue_message(ip, new_string_data);
     /*
      * snoop handling.
      */
@@ -486,71 +698,260 @@ void add_vmessage P2V(object_t *, who, char *, format)
 #ifdef FLUSH_OUTPUT_IMMEDIATELY
     flush_message(ip);
 #endif
+    update_user_poll(ip);
     
     add_message_calls++;
 }				/* add_message() */
 
+#define MAX_FLUSH_IOVEC 16
+
+/*
+ * A write to ip returned -1.  Returns 0 if it only would have blocked;
+ * otherwise the connection is marked as dead and 1 is returned.
+ */
+static int write_failed P1(interactive_t *, ip)
+{
+#ifdef EWOULDBLOCK
+    if (errno == EWOULDBLOCK) {
+	debug(512, ("flush_message: write: Operation would block\n"));
+#ifdef NET_STATS
+	ip->stats.would_block++;
+#endif
+	ip->iflags |= OUTPUT_BLOCKED;
+	return 0;
+#else
+#  ifdef WINSOCK
+    if (errno == WSAEWOULDBLOCK) {
+	debug(512, ("flush_message: write: Operation would block\n"));
+#ifdef NET_STATS
+	ip->stats.would_block++;
+#endif
+	ip->iflags |= OUTPUT_BLOCKED;
+	return 0;
+#  else
+    if (0) {
+	;
+#  endif
+#endif
+#ifdef linux
+    } else if (errno == EINTR) {
+	debug(512, ("flush_message: write: Interrupted system call"));
+	/* nothing was written; try again with the rest of the flush list */
+	update_user_poll(ip);
+	return 0;
+#endif
+    }
+    debug_perror("flush_message: write", 0);
+    ip->iflags |= NET_DEAD;
+    update_user_poll(ip);
+    return 1;
+}
+
+#ifdef MCCP
+/*
+ * Compress len bytes of data onto the end of ip->mccp->out, growing it
+ * as much as need be.
+ */
+static void compress_data P4(mccp_t *, c, char *, data, int, len, int, mode)
+{
+    int ret;
+
+    c->zs.next_in = (Bytef *) data;
+    c->zs.avail_in = len;
+    do {
+	if (c->end == c->size) {
+	    c->size *= 2;
+	    c->out = DREALLOC(c->out, c->size, TAG_MCCP, "compress_data");
+	}
+	c->zs.next_out = (Bytef *) c->out + c->end;
+	c->zs.avail_out = c->size - c->end;
+	ret = deflate(&c->zs, mode);
+	c->end = c->size - c->zs.avail_out;
+    } while (c->zs.avail_in || c->zs.avail_out == 0
+	     || (mode == Z_FINISH && ret != Z_STREAM_END && ret != Z_STREAM_ERROR));
+    compress_bytes_in += len;
+}
+
+/*
+ * Compress what is queued for ip onto the end of ip->mccp->out: all of
+ * it if finish is set, otherwise about MCCP_BUFFER_SIZE bytes worth.
+ */
+static void compress_message_queue P2(interactive_t *, ip, int, finish)
+{
+    mccp_t *c = ip->mccp;
+    message_link_t *link;
+    long sec, usec, end_sec, end_usec;
+    int len, before = c->end;
+
+    get_usec_clock(&sec, &usec);
+    while ((link = ip->message_head)
+	   && (finish || c->end < MCCP_BUFFER_SIZE)) {
+	len = link->chunk->len - ip->message_offset;
+	compress_data(c, link->chunk->data + ip->message_offset, len,
+		      Z_NO_FLUSH);
+	consume_message_queue(ip, len);
+    }
+    /* the client has to be able to decompress all of it straight away */
+    compress_data(c, 0, 0, finish ? Z_FINISH : Z_SYNC_FLUSH);
+    get_usec_clock(&end_sec, &end_usec);
+    compress_bytes_out += c->end - before;
+    compress_usec += (end_sec - sec) * 1000000.0 + (end_usec - usec);
+}
+
+static void free_compression P1(interactive_t *, ip)
+{
+    deflateEnd(&ip->mccp->zs);
+    FREE(ip->mccp->out);
+    FREE(ip->mccp);
+    ip->mccp = 0;
+    num_compressed--;
+}
+
+/*
+ * flush_message() for a compressed connection.  Returns -1 if the
+ * connection died, 0 if the socket is full, and 1 if everything has been
+ * sent (and compression is over, if it was ending).
+ */
+static int flush_compressed P1(interactive_t *, ip)
+{
+    mccp_t *c = ip->mccp;
+    int num_bytes;
+
+    while (1) {
+	if (c->start == c->end) {
+	    c->start = c->end = 0;
+	    if (c->ending) {
+		free_compression(ip);
+		return 1;
+	    }
+	    if (!ip->message_head)
+		return 1;
+	    compress_message_queue(ip, 0);
+	    continue;
+	}
+	num_bytes = OS_socket_write(ip->fd, c->out + c->start,
+				    c->end - c->start);
+#ifdef NET_STATS
+	ip->stats.writes++;
+#endif
+	if (num_bytes == -1)
+	    return (write_failed(ip) ? -1 : 0);
+	c->start += num_bytes;
+	inet_packets++;
+	inet_volume += num_bytes;
+#ifdef NET_STATS
+	ip->stats.bytes_out += num_bytes;
+#endif
+	if (c->start < c->end) {
+#ifdef NET_STATS
+	    ip->stats.partial_writes++;
+#endif
+	    ip->iflags |= OUTPUT_BLOCKED;
+	    return 0;
+	}
+    }
+}
+#endif
+
 /*
  * Flush outgoing message buffer of current interactive object.
  */
 int flush_message P1(interactive_t *, ip)
 {
-    int length, num_bytes;
+    message_link_t *link;
+    int num_bytes, want;
+#ifndef WINSOCK
+    struct iovec iov[MAX_FLUSH_IOVEC];
+    int n;
+#  ifdef MSG_MORE
+    struct msghdr msg;
+#  endif
+#endif
 
     /*
      * if ip is not valid, do nothing.
      */
-    if (!ip || (ip->iflags & CLOSING)) {
+    if (!ip) {
 	debug_message("flush_message: invalid target!\n");
 	return 0;
     }
+    unlink_flush_user(ip);
+    if (ip->iflags & CLOSING) {
+	debug_message("flush_message: invalid target!\n");
+	return 0;
+    }
+    /* process_io() will notice and close it */
+    if (ip->iflags & NET_DEAD)
+	return 0;
+    /* we'll find out again if it is still full */
+    ip->iflags &= ~OUTPUT_BLOCKED;
+#ifdef MCCP
+    if (ip->mccp) {
+	ip->out_of_band = 0;
+	switch (flush_compressed(ip)) {
+	case -1:
+	    return 0;
+	case 0:
+	    update_user_poll(ip);
+	    return 1;
+	}
+    }
+#endif
     /*
-     * write ip->message_buf[] to socket.
+     * write the output queue to the socket, as many chunks at a time as
+     * writev() will take.  If it takes more than one, the kernel is told
+     * there is more to come (MSG_MORE), so it doesn't send a short
+     * packet in between.
      */
-    while (ip->message_length != 0) {
-	if (ip->message_consumer < ip->message_producer) {
-	    length = ip->message_producer - ip->message_consumer;
-	} else {
-	    length = MESSAGE_BUF_SIZE - ip->message_consumer;
-	}
-/* Need to use send to get out of band data
-   num_bytes = write(ip->fd,ip->message_buf + ip->message_consumer,length);
- */
-	num_bytes = send(ip->fd, ip->message_buf + ip->message_consumer,
-			 length, ip->out_of_band);
-	if (num_bytes == -1) {
-#ifdef EWOULDBLOCK
-	    if (errno == EWOULDBLOCK) {
-		debug(512, ("flush_message: write: Operation would block\n"));
-		return 1;
+    while ((link = ip->message_head)) {
+#ifndef WINSOCK
+	if (!ip->out_of_band) {
+	    iov[0].iov_base = link->chunk->data + ip->message_offset;
+	    iov[0].iov_len = want = link->chunk->len - ip->message_offset;
+	    for (n = 1; n < MAX_FLUSH_IOVEC && (link = link->next); n++) {
+		iov[n].iov_base = link->chunk->data;
+		iov[n].iov_len = link->chunk->len;
+		want += link->chunk->len;
+	    }
+#ifdef MSG_MORE
+	    memset((char *) &msg, 0, sizeof(msg));
+	    msg.msg_iov = iov;
+	    msg.msg_iovlen = n;
+	    num_bytes = sendmsg(ip->fd, &msg,
+				(link && link->next) ? MSG_MORE : 0);
 #else
-#  ifdef WINSOCK
-	    if (errno == WSAEWOULDBLOCK) {
-		debug(512, ("flush_message: write: Operation would block\n"));
-		return 1;
-#  else
-	    if (0) {
-		;
-#  endif
+	    num_bytes = writev(ip->fd, iov, n);
 #endif
-#ifdef linux
-	    } else if (errno == EINTR) {
-		debug(512, ("flush_message: write: Interrupted system call"));
-		return 1;
+	} else
 #endif
-	    } else {
-		debug_perror("flush_message: write", 0);
-		ip->iflags |= NET_DEAD;
-		return 0;
-	    }
+	{
+	    /* Need to use send to get out of band data */
+	    want = link->chunk->len - ip->message_offset;
+	    num_bytes = send(ip->fd, link->chunk->data + ip->message_offset,
+			     want, ip->out_of_band);
 	}
-	ip->message_consumer = (ip->message_consumer + num_bytes) %
-	    MESSAGE_BUF_SIZE;
-	ip->message_length -= num_bytes;
+#ifdef NET_STATS
+	ip->stats.writes++;
+#endif
+	if (num_bytes == -1)
+	    return !write_failed(ip);
+	consume_message_queue(ip, num_bytes);
 	ip->out_of_band = 0;
 	inet_packets++;
 	inet_volume += num_bytes;
+#ifdef NET_STATS
+	ip->stats.bytes_out += num_bytes;
+#endif
+	/* a short write means the socket is full */
+	if (num_bytes < want) {
+#ifdef NET_STATS
+	    ip->stats.partial_writes++;
+#endif
+	    ip->iflags |= OUTPUT_BLOCKED;
+	    break;
+	}
     }
+    update_user_poll(ip);
     return 1;
 }				/* flush_message() */
 
@@ -604,35 +1005,129 @@ static char telnet_yes_single[] =
     { (SCHAR)IAC, (SCHAR)WILL, TELOPT_SGA, 0 };
 static char telnet_ga[] = 
     { (SCHAR)IAC, (SCHAR)GA, 0 };
+#ifdef MCCP
+static char telnet_will_compress[] =
+    { (SCHAR)IAC, (SCHAR)WILL, TELOPT_COMPRESS2, 0 };
+static char telnet_wont_compress[] =
+    { (SCHAR)IAC, (SCHAR)WONT, TELOPT_COMPRESS2, 0 };
+static char telnet_start_compress[] =
+    { (SCHAR)IAC, (SCHAR)SB, TELOPT_COMPRESS2, (SCHAR)IAC, (SCHAR)SE, 0 };
+#endif
+
+#ifdef MCCP
+/*
+ * The client agreed to IAC WILL COMPRESS2.  What is already queued goes
+ * as it is, followed by IAC SB COMPRESS2 IAC SE, and everything after
+ * that is compressed.  If an earlier stream has been finished but isn't
+ * all sent yet, the new one starts straight after it.
+ */
+static void start_compression P1(interactive_t *, ip)
+{
+    mccp_t *c = ip->mccp;
+    message_link_t *link;
+    int n;
+
+    if (c && !c->ending)
+	return;
+    if (c) {
+	if (deflateReset(&c->zs) != Z_OK) {
+	    debug_message("start_compression: deflateReset failed.\n");
+	    return;
+	}
+    } else {
+	c = ALLOCATE(mccp_t, TAG_MCCP, "start_compression");
+	memset(&c->zs, 0, sizeof(c->zs));
+	if (deflateInit(&c->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+	    debug_message("start_compression: deflateInit failed.\n");
+	    FREE(c);
+	    return;
+	}
+	c->size = MCCP_BUFFER_SIZE;
+	c->out = DXALLOC(c->size, TAG_MCCP, "start_compression");
+	c->start = c->end = 0;
+	ip->mccp = c;
+	num_compressed++;
+    }
+    c->ending = 0;
+    queue_message(ip, telnet_start_compress);
+    if (c->end + ip->message_length > c->size) {
+	while (c->size < c->end + ip->message_length)
+	    c->size *= 2;
+	c->out = DREALLOC(c->out, c->size, TAG_MCCP, "start_compression");
+    }
+    n = ip->message_offset;
+    for (link = ip->message_head; link; link = link->next) {
+	memcpy(c->out + c->end, link->chunk->data + n, link->chunk->len - n);
+	c->end += link->chunk->len - n;
+	n = 0;
+    }
+    free_message_queue(ip);
+    update_user_poll(ip);
+}
+
+/*
+ * Finish the compressed stream, with everything that is queued in it;
+ * output after this is sent uncompressed.
+ */
+static void end_compression P1(interactive_t *, ip)
+{
+    if (!ip->mccp || ip->mccp->ending)
+	return;
+    compress_message_queue(ip, 1);
+    ip->mccp->ending = 1;
+    update_user_poll(ip);
+}
+#endif
+
+#define ROOM_ON_LINE (to - line < MAX_TEXT - 2)
 
 static int copy_chars P4(unsigned char *, from, unsigned char *, to, int, n, interactive_t *, ip)
 {
-    int i;
+    int i, j, len;
     unsigned char *start = to;
+    unsigned char *line = (unsigned char *)ip->text + ip->text_line;
 
     for (i = 0; i < n; i++) {
 	switch (ip->state) {
 	case TS_DATA:
+	    /*
+	     * copy a run of plain characters in one go.  Anything past
+	     * MAX_TEXT - 2 on one line is dropped, since that is all
+	     * get_user_command() has room for.
+	     */
+	    for (j = i; j < n && from[j] != IAC && from[j] != '\r'
+		     && from[j] != '\n'; j++)
+		;
+	    if (j > i) {
+		len = (MAX_TEXT - 2) - (to - line);
+		if (len > j - i)
+		    len = j - i;
+		if (len > 0) {
+		    memcpy(to, from + i, len);
+		    to += len;
+		}
+		i = j - 1;
+		break;
+	    }
 	    switch (from[i]) {
 	    case IAC:
 		ip->state = TS_IAC;
 		break;
 	    case '\r':
-		if (ip->iflags & SINGLE_CHAR)
+		if ((ip->iflags & SINGLE_CHAR) && ROOM_ON_LINE)
 		    *to++ = from[i];
 		break;
 	    case '\n':
-		if (ip->iflags & SINGLE_CHAR)
-		    *to++ = from[i];
-		else {
+		if (ip->iflags & SINGLE_CHAR) {
+		    if (ROOM_ON_LINE)
+			*to++ = from[i];
+		} else {
 		    *to++ = ' ';
 		    *to++ = '\b';
 		    *to++ = '\0';
+		    line = to;
 		}
 		break;
-	    default:
-		*to++ = from[i];
-		break;
 	    }
 	    break;
 	case TS_SB_IAC:
@@ -686,7 +1181,8 @@ static int copy_chars P4(unsigned char *, from, unsigned char *, to, int, n, int
 	    switch (from[i]) {
 	    case IAC:
 		/* IAC IAC is a quoted IAC char */
-		*to++ = IAC;
+		if (ROOM_ON_LINE)
+		    *to++ = IAC;
 		ip->state = TS_DATA;
 		break;
 	    case DO:
@@ -704,7 +1200,6 @@ static int copy_chars P4(unsigned char *, from, unsigned char *, to, int, n, int
 	    case BREAK:
 /* Send back a break character. */
 		add_message(ip->ob, telnet_break_response);
-		flush_message(ip);
 		break;
 	    case IP:
 /* Send back an interupt process character. */
@@ -734,10 +1229,16 @@ static int copy_chars P4(unsigned char *, from, unsigned char *, to, int, n, int
 	    }
 	    break;
 	case TS_DO:
-	    if (from[i] == TELOPT_TM) {
+	    if (from[i] == TELOPT_TM)
 		add_message(ip->ob, telnet_do_tm_response);
-		flush_message(ip);
+#ifdef MCCP
+	    if (from[i] == TELOPT_COMPRESS2) {
+		if (ip->iflags & COMPRESS_OFFERED)
+		    start_compression(ip);
+		else
+		    add_message(ip->ob, telnet_wont_compress);
 	    }
+#endif
 	    ip->state = TS_DATA;
 	    break;
 	case TS_WILL:
@@ -753,6 +1254,12 @@ static int copy_chars P4(unsigned char *, from, unsigned char *, to, int, n, int
 		flush_message(ip);
 	    }
 	case TS_DONT:
+#ifdef MCCP
+	    if (ip->state == TS_DONT && from[i] == TELOPT_COMPRESS2) {
+		ip->iflags &= ~COMPRESS_OFFERED;
+		end_compression(ip);
+	    }
+#endif
 	case TS_WONT:
 	    /* if we get any IAC WILL or IAC WONTs back, we assume they
 	     * understand the telnet protocol.  Typically this will become
@@ -777,6 +1284,7 @@ static int copy_chars P4(unsigned char *, from, unsigned char *, to, int, n, int
 	    break;
 	}
     }
+    ip->text_line = (char *)line - ip->text;
     return (to - start);
 }				/* copy_chars() */
 
@@ -808,180 +1316,281 @@ void sigalrm_handler()
 }				/* sigalrm_handler() */
 #endif
 
-INLINE void make_selectmasks()
+/*
+ * Keep the poller's interest in a user's fd in step with its state.
+ * A user with a complete command waiting, or with more than
+ * MESSAGE_HIGH_WATER bytes of output still to send, isn't read from until
+ * that has been dealt with; a dead connection is watched for writing so
+ * that process_io() notices it and cleans up.
+ */
+/*
+ * Users with output to write.  Output isn't written as it is produced;
+ * each user on this list gets everything that was queued for them
+ * during the backend cycle written at once, by flush_pending_output()
+ * just before we wait for I/O again.  Only a user whose socket is full
+ * (OUTPUT_BLOCKED) waits for POLL_WRITE instead.
+ */
+static interactive_t *flush_head = 0, *flush_tail = 0;
+
+static void add_flush_user P1(interactive_t *, ip)
 {
-    int i;
+    ip->iflags |= FLUSH_PENDING;
+    ip->flush_next = 0;
+    ip->flush_prev = flush_tail;
+    if (flush_tail)
+	flush_tail->flush_next = ip;
+    else
+	flush_head = ip;
+    flush_tail = ip;
+}
 
-    /*
-     * generate readmask and writemask for select() call.
-     */
-    FD_ZERO(&readmask);
-    FD_ZERO(&writemask);
-    /*
-     * set new user accept fd in readmask.
-     */
-    for (i = 0; i < 5; i++) {
-	if (!external_port[i].port) continue;
-	FD_SET(external_port[i].fd, &readmask);
+static void unlink_flush_user P1(interactive_t *, ip)
+{
+    if (!(ip->iflags & FLUSH_PENDING))
+	return;
+    ip->iflags &= ~FLUSH_PENDING;
+    if (ip->flush_prev)
+	ip->flush_prev->flush_next = ip->flush_next;
+    else
+	flush_head = ip->flush_next;
+    if (ip->flush_next)
+	ip->flush_next->flush_prev = ip->flush_prev;
+    else
+	flush_tail = ip->flush_prev;
+    ip->flush_next = ip->flush_prev = 0;
+}
+
+void flush_pending_output()
+{
+    while (flush_head)
+	flush_message(flush_head);
+}
+
+static void update_user_poll P1(interactive_t *, ip)
+{
+    int events = 0;
+
+    if (!(ip->iflags & CLOSING)) {
+	if (!(ip->iflags & CMD_IN_BUF)
+	    && ip->message_length <= MESSAGE_HIGH_WATER)
+	    events = POLL_READ;
+	if (ip->message_length != 0
+#ifdef MCCP
+	    || (ip->mccp && (ip->mccp->start != ip->mccp->end
+			     || ip->mccp->ending))
+#endif
+	    ) {
+	    if (ip->iflags & OUTPUT_BLOCKED)
+		events |= POLL_WRITE;
+	    else if (!(ip->iflags & (FLUSH_PENDING | NET_DEAD)))
+		add_flush_user(ip);
+	}
+	if (ip->iflags & NET_DEAD)
+	    events |= POLL_WRITE;
     }
-    /*
-     * set user fds in readmask.
-     */
-    for (i = 0; i < max_users; i++) {
-	if (!all_users[i] || (all_users[i]->iflags & (CLOSING | CMD_IN_BUF)))
-	    continue;
+    poll_modify(ip->fd, events);
+}
+
+/*
+ * Process I/O.  poll_events[0 .. nb-1] describe the descriptors that are
+ * ready.
+ */
+INLINE void process_io P1(int, nb)
+{
+    int i, fd, events, which;
+    interactive_t *ip;
+
+    debug(256, ("@"));
+    for (i = 0; i < nb; i++) {
+	fd = poll_events[i].fd;
 	/*
-	 * if this user needs more input to make a complete command, set his
-	 * fd so we can get it.
+	 * a handler earlier in the list may have closed this fd, or
+	 * changed what we are interested in.
 	 */
-	FD_SET(all_users[i]->fd, &readmask);
-	if (all_users[i]->message_length != 0)
-	    FD_SET(all_users[i]->fd, &writemask);
-    }
-    /*
-     * if addr_server_fd is set, set its fd in readmask.
-     */
-    if (addr_server_fd >= 0) {
-	FD_SET(addr_server_fd, &readmask);
-    }
+	if (fd >= poll_fds_size)
+	    continue;
+	events = poll_events[i].events & poll_fds[fd].events;
+	which = poll_fds[fd].which;
+	switch (poll_fds[fd].kind) {
+	case PK_EXTERNAL_PORT:
+	    /*
+	     * new user connection.
+	     */
+	    if (events & POLL_READ) {
+		debug(512, ("process_io: NEW_USER\n"));
+		new_user_handler(which);
+	    }
+	    break;
+	case PK_USER:
+	    /*
+	     * data pending on a user connection.
+	     */
+	    ip = all_users[which];
+	    if (!ip || ip->fd != fd || (ip->iflags & CLOSING))
+		break;
+	    if (ip->iflags & NET_DEAD) {
+		remove_interactive(ip->ob, 0);
+		break;
+	    }
+	    if (events & POLL_READ) {
+		debug(512, ("process_io: USER %d\n", which));
+		get_user_data(ip);
+		if (all_users[which] != ip)
+		    break;
+	    }
+	    if (events & POLL_WRITE)
+		flush_message(ip);
+	    break;
 #ifdef PACKAGE_SOCKETS
-    /*
-     * set fd's for efun sockets.
-     */
-    for (i = 0; i < max_lpc_socks; i++) {
-	if (lpc_socks[i].state != CLOSED) {
-	    if (lpc_socks[i].state != FLUSHING &&
-		(lpc_socks[i].flags & S_WACCEPT) == 0)
-		FD_SET(lpc_socks[i].fd, &readmask);
-	    if (lpc_socks[i].flags & S_BLOCKED)
-		FD_SET(lpc_socks[i].fd, &writemask);
+	case PK_LPC_SOCKET:
+	    /*
+	     * data pending on an efun socket connection.
+	     */
+	    if ((events & POLL_READ) && lpc_socks[which].state != CLOSED
+		&& lpc_socks[which].fd == fd)
+		socket_read_select_handler(which);
+	    if ((events & POLL_WRITE) && lpc_socks[which].state != CLOSED
+		&& lpc_socks[which].fd == fd)
+		socket_write_select_handler(which);
+	    break;
+#endif
+	case PK_ADDR_SERVER:
+	    /*
+	     * data pending from address server, or name server.
+	     */
+	    if (events & POLL_READ) {
+		debug(512, ("process_io: IP_DAEMON\n"));
+#ifdef RESOLVER
+		resolver_handler();
+#else
+		hname_handler();
+#endif
+	    }
+	    break;
 	}
     }
-#endif
-}				/* make_selectmasks() */
+}
 
 /*
- * Process I/O.
+ * This is the new user connection handler. This function is called by the
+ * event handler when data is pending on the listening socket (new_user_fd).
+ * Everything waiting is accepted (up to ACCEPTS_PER_EVENT at a time) and
+ * queued; process_logons() hands them to the master a few at a time.
  */
-INLINE void process_io()
+static void new_user_handler P1(int, which)
 {
-    int i;
+    int new_socket_fd;
+    struct sockaddr_in addr;
+#if defined(HAS_ACCEPT4) && defined(SOCK_NONBLOCK)
+    socklen_t length;
+#else
+    int length;
+#endif
+    int n;
+    pending_logon_t *pl;
 
-    debug(256, ("@"));
-    /*
-     * check for new user connection.
-     */
-    for (i = 0; i < 5; i++) {
-	if (!external_port[i].port) continue;
-	if (FD_ISSET(external_port[i].fd, &readmask)) {
-	    debug(512, ("process_io: NEW_USER\n"));
-	    new_user_handler(i);
+    debug(512, ("new_user_handler: accept on fd %d\n", external_port[which].fd));
+    for (n = 0; n < ACCEPTS_PER_EVENT; n++) {
+	length = sizeof(addr);
+#if defined(HAS_ACCEPT4) && defined(SOCK_NONBLOCK)
+	new_socket_fd = accept4(external_port[which].fd,
+				(struct sockaddr *) & addr, &length,
+				SOCK_NONBLOCK);
+#else
+	new_socket_fd = accept(external_port[which].fd,
+			       (struct sockaddr *) & addr, (int *) &length);
+#endif
+	if (new_socket_fd < 0) {
+#ifdef WINSOCK
+	    if (errno == WSAEWOULDBLOCK) {
+#else
+	    if (errno == EWOULDBLOCK) {
+#endif
+		debug(512, ("new_user_handler: accept: Operation would block\n"));
+	    } else {
+		debug_perror("new_user_handler: accept", 0);
+	    }
+	    return;
 	}
-    }
-    /*
-     * check for data pending on user connections.
-     */
-    for (i = 0; i < max_users; i++) {
-	if (!all_users[i] || (all_users[i]->iflags & (CLOSING | CMD_IN_BUF)))
-	    continue;
-	if (all_users[i]->iflags & NET_DEAD) {
-	    remove_interactive(all_users[i]->ob, 0);
-	    continue;
+	connections_accepted++;
+#if defined(linux) && !(defined(HAS_ACCEPT4) && defined(SOCK_NONBLOCK))
+	/*
+	 * according to Amylaar, 'accepted' sockets in Linux 0.99p6 don't
+	 * properly inherit the nonblocking property from the listening socket.
+	 */
+	if (set_socket_nonblocking(new_socket_fd, 1) == -1) {
+	    debug_perror("new_user_handler: set_socket_nonblocking 1", 0);
+	    exit(8);
 	}
-	if (FD_ISSET(all_users[i]->fd, &readmask)) {
-	    debug(512, ("process_io: USER %d\n", i));
-	    get_user_data(all_users[i]);
-	    if (!all_users[i])
-		continue;
+#endif				/* linux */
+	if (logons_waiting == MAX_PENDING_LOGONS) {
+	    debug(512, ("new_user_handler: too many waiting, dropped %s\n",
+			inet_ntoa(addr.sin_addr)));
+	    connections_dropped++;
+	    OS_socket_close(new_socket_fd);
+	    continue;
 	}
-	if (FD_ISSET(all_users[i]->fd, &writemask))
-	    flush_message(all_users[i]);
+	pl = &pending_logons[(logon_head + logons_waiting++) % MAX_PENDING_LOGONS];
+	pl->fd = new_socket_fd;
+	pl->which = which;
+	memcpy((char *) &pl->addr, (char *) &addr, sizeof(addr));
     }
-#ifdef PACKAGE_SOCKETS
-    /*
-     * check for data pending on efun socket connections.
-     */
-    for (i = 0; i < max_lpc_socks; i++) {
-	if (lpc_socks[i].state != CLOSED)
-	    if (FD_ISSET(lpc_socks[i].fd, &readmask))
-		socket_read_select_handler(i);
-	if (lpc_socks[i].state != CLOSED)
-	    if (FD_ISSET(lpc_socks[i].fd, &writemask))
-		socket_write_select_handler(i);
-    }
-#endif
-    /*
-     * check for data pending from address server.
-     */
-    if (addr_server_fd >= 0) {
-	if (FD_ISSET(addr_server_fd, &readmask)) {
-	    debug(512, ("process_io: IP_DAEMON\n"));
-	    hname_handler();
-	}
+}				/* new_user_handler() */
+
+/*
+ * Hand up to LOGONS_PER_PASS of the waiting connections to the master.
+ * Each is taken off the queue before the master sees it, so an error
+ * in connect() or logon() only loses that one.
+ */
+void process_logons()
+{
+    pending_logon_t pl;
+    int n;
+
+    for (n = 0; n < LOGONS_PER_PASS && logons_waiting; n++) {
+	pl = pending_logons[logon_head];
+	logon_head = (logon_head + 1) % MAX_PENDING_LOGONS;
+	logons_waiting--;
+	new_user(pl.fd, pl.which, &pl.addr);
     }
 }
 
 /*
- * This is the new user connection handler. This function is called by the
- * event handler when data is pending on the listening socket (new_user_fd).
  * If space is available, an interactive data structure is initialized and
  * the user is connected.
  */
-static void new_user_handler P1(int, which)
+static void new_user P3(int, new_socket_fd, int, which,
+			struct sockaddr_in *, addr)
 {
-    int new_socket_fd;
-    struct sockaddr_in addr;
-    int length;
     int i;
     object_t *ob;
     svalue_t *ret;
 
-    length = sizeof(addr);
-    debug(512, ("new_user_handler: accept on fd %d\n", external_port[which].fd));
-    new_socket_fd = accept(external_port[which].fd,
-			   (struct sockaddr *) & addr, (int *) &length);
-    if (new_socket_fd < 0) {
-#ifdef WINSOCK
-	if (errno == WSAEWOULDBLOCK) {
-#else
-	if (errno == EWOULDBLOCK) {
-#endif
-	    debug(512, ("new_user_handler: accept: Operation would block\n"));
-	} else {
-	    debug_perror("new_user_handler: accept", 0);
-	}
-	return;
-    }
-#ifdef linux
-    /*
-     * according to Amylaar, 'accepted' sockets in Linux 0.99p6 don't
-     * properly inherit the nonblocking property from the listening socket.
-     */
-    if (set_socket_nonblocking(new_socket_fd, 1) == -1) {
-	debug_perror("new_user_handler: set_socket_nonblocking 1", 0);
-	exit(8);
-    }
-#endif				/* linux */
     for (i = 0; i < max_users; i++)
 	if (!all_users[i]) break;
 
     if (i == max_users) {
 	if (all_users) {
 	    all_users = RESIZE(all_users, max_users + 10, interactive_t *,
-			       TAG_USERS, "new_user_handler");
+			       TAG_USERS, "new_user");
 	} else {
 	    all_users = CALLOCATE(10, interactive_t *,
-				  TAG_USERS, "new_user_handler");
+				  TAG_USERS, "new_user");
 	}
 	while (max_users < i + 10)
 	    all_users[max_users++] = 0;
     }
+    if (!poll_set(new_socket_fd, PK_USER, i, POLL_READ)) {
+	debug_message("new_user: can't watch fd %d\n", new_socket_fd);
+	OS_socket_close(new_socket_fd);
+	return;
+    }
 
     command_giver = master_ob;
     master_ob->interactive =
 	(interactive_t *)
 	    DXALLOC(sizeof(interactive_t), TAG_INTERACTIVE,
-		    "new_user_handler");
+		    "new_user");
     total_users++;
 #ifndef NO_ADD_ACTION
     master_ob->interactive->default_err_message.s = 0;
@@ -994,9 +1603,27 @@ static void new_user_handler P1(int, which)
     master_ob->interactive->ob = master_ob;
     master_ob->interactive->input_to = 0;
     master_ob->interactive->iflags = 0;
+    master_ob->interactive->text = DXALLOC(MAX_TEXT, TAG_INPUT_BUFFER,
+					   "new_user");
+    master_ob->interactive->text_size = MAX_TEXT;
+    input_buffer_bytes += MAX_TEXT;
     master_ob->interactive->text[0] = '\0';
     master_ob->interactive->text_end = 0;
     master_ob->interactive->text_start = 0;
+    master_ob->interactive->text_line = 0;
+    master_ob->interactive->cmd_next = 0;
+    master_ob->interactive->cmd_prev = 0;
+    master_ob->interactive->flush_next = 0;
+    master_ob->interactive->flush_prev = 0;
+    master_ob->interactive->cmd_pass = 0;
+    master_ob->interactive->cmd_count = 0;
+#ifdef MCCP
+    master_ob->interactive->mccp = 0;
+#endif
+#ifdef NET_STATS
+    memset((char *) &master_ob->interactive->stats, 0, sizeof(net_stats_t));
+    master_ob->interactive->stats.connected = current_time;
+#endif
     master_ob->interactive->carryover = NULL;
     master_ob->interactive->snoop_on = 0;
     master_ob->interactive->snoop_by = 0;
@@ -1008,8 +1635,9 @@ static void new_user_handler P1(int, which)
 #ifdef OLD_ED
     master_ob->interactive->ed_buffer = 0;
 #endif
-    master_ob->interactive->message_producer = 0;
-    master_ob->interactive->message_consumer = 0;
+    master_ob->interactive->message_head = 0;
+    master_ob->interactive->message_tail = 0;
+    master_ob->interactive->message_offset = 0;
     master_ob->interactive->message_length = 0;
     master_ob->interactive->num_carry = 0;
     master_ob->interactive->state = TS_DATA;
@@ -1021,8 +1649,8 @@ static void new_user_handler P1(int, which)
 #endif
     set_prompt("> ");
     
-    memcpy((char *) &all_users[i]->addr, (char *) &addr, length);
-    debug(512, ("New connection from %s.\n", inet_ntoa(addr.sin_addr)));
+    memcpy((char *) &all_users[i]->addr, (char *) addr, sizeof(*addr));
+    debug(512, ("New connection from %s.\n", inet_ntoa(addr->sin_addr)));
     num_user++;
     /*
      * The user object has one extra reference. It is asserted that the
@@ -1037,7 +1665,7 @@ static void new_user_handler P1(int, which)
 	|| !master_ob->interactive) {
 	if (master_ob->interactive)
 	    remove_interactive(master_ob, 0);
-	debug_message("Connection from %s aborted.\n", inet_ntoa(addr.sin_addr));
+	debug_message("Connection from %s aborted.\n", inet_ntoa(addr->sin_addr));
 	return;
     }
     /*
@@ -1061,21 +1689,28 @@ static void new_user_handler P1(int, which)
     free_object(master_ob, "reconnect");
     add_ref(ob, "new_user");
     command_giver = ob;
+#ifdef RESOLVER
+    resolve_ip_name(query_ip_number(ob));
+#else
     if (addr_server_fd >= 0) {
 	query_addr_name(ob);
     }
+#endif
     
     if (external_port[which].kind == PORT_TELNET) {
 	/* Ask permission to ask them for their terminal type */
 	add_message(ob, telnet_do_ttype);
 	/* Ask them for their window size */
 	add_message(ob, telnet_do_naws);
+#if defined(MCCP) && defined(MCCP_OFFER)
+	compress_output(ob, 1);
+#endif
     }
     
     logon(ob);
-    debug(512, ("new_user_handler: end\n"));
+    debug(512, ("new_user: end\n"));
     command_giver = 0;
-}				/* new_user_handler() */
+}				/* new_user() */
 
 /*
  * This is the user command handler. This function is called when
@@ -1213,6 +1848,7 @@ int process_user_command()
     return 0;
 }				/* process_user_command() */
 
+#ifndef RESOLVER
 #define HNAME_BUF_SIZE 200
 /*
  * This is the hname input data handler. This function is called by the
@@ -1245,6 +1881,7 @@ static void hname_handler()
 	    debug_perror("hname_handler: read", 0);
 	    tmp = addr_server_fd;
 	    addr_server_fd = -1;
+	    poll_remove(tmp);
 	    OS_socket_close(tmp);
 	    return;
 	}
@@ -1253,6 +1890,7 @@ static void hname_handler()
 	debug_message("hname_handler: closing address server connection.\n");
 	tmp = addr_server_fd;
 	addr_server_fd = -1;
+	poll_remove(tmp);
 	OS_socket_close(tmp);
 	return;
     default:
@@ -1292,160 +1930,293 @@ static void hname_handler()
 	break;
     }
 }				/* hname_handler() */
+#endif
+
+/*
+ * Make room at the end of ip->text for the next read, moving what is
+ * left down to the start of the buffer and growing it if need be.  Each
+ * character read can become 'scale' characters in the buffer.  Returns
+ * how much to read, or 0 if the buffer is as big as it gets.
+ */
+static int make_text_space P2(interactive_t *, ip, int, scale)
+{
+    int space, size;
+
+    space = (ip->text_size - ip->text_end - 1) / scale;
+    if (space >= INPUT_READ_SIZE / 2)
+	return (space > INPUT_READ_SIZE ? INPUT_READ_SIZE : space);
+    if (ip->text_start) {
+	ip->text_end -= ip->text_start;
+	ip->text_line -= ip->text_start;
+	if (ip->text_line < 0)
+	    ip->text_line = 0;
+	memmove(ip->text, ip->text + ip->text_start, ip->text_end + 1);
+	ip->text_start = 0;
+	space = (ip->text_size - ip->text_end - 1) / scale;
+    }
+    if (space < INPUT_READ_SIZE / 2 && ip->text_size < MAX_INPUT_BUFFER) {
+	size = ip->text_size * 2;
+	if (size > MAX_INPUT_BUFFER)
+	    size = MAX_INPUT_BUFFER;
+	ip->text = DREALLOC(ip->text, size, TAG_INPUT_BUFFER, "make_text_space");
+	input_buffer_bytes += size - ip->text_size;
+	ip->text_size = size;
+	space = (ip->text_size - ip->text_end - 1) / scale;
+    }
+    if (space > INPUT_READ_SIZE)
+	space = INPUT_READ_SIZE;
+    return (space > 0 ? space : 0);
+}
+
+/*
+ * Empty ip->text, giving back the space a burst of typing needed.
+ */
+static void reset_text P1(interactive_t *, ip)
+{
+    ip->text_start = ip->text_end = ip->text_line = 0;
+    if (ip->text_size > MAX_TEXT) {
+	ip->text = DREALLOC(ip->text, MAX_TEXT, TAG_INPUT_BUFFER, "reset_text");
+	input_buffer_bytes -= ip->text_size - MAX_TEXT;
+	ip->text_size = MAX_TEXT;
+    }
+    ip->text[0] = '\0';
+}
 
 /*
  * Read pending data for a user into user->interactive->text.
- * This also does telnet negotiation.
+ * This also does telnet negotiation.  We keep reading until the socket
+ * is drained (or the buffer is as big as it gets), so a paste arrives
+ * in one go rather than a read per trip round the backend.
  */
 static void get_user_data P1(interactive_t *, ip)
 {
-    static char buf[MAX_TEXT];
+    static char buf[INPUT_READ_SIZE + 1];
+    object_t *ob = ip->ob;
     int text_space;
     int num_bytes;
-    
-    /*
-     * this /3 is here because of the trick copy_chars() uses to allow empty
-     * commands. it needs to be fixed right. later.
-     */
-    if (ip->connection_type == PORT_TELNET) {
-	text_space = (MAX_TEXT - ip->text_end - 1) / 3;
-    } else {
-	text_space = sizeof(buf) - 1;
-    }
-    /*
-     * Check if we need more space.
-     */
-    if (text_space < MAX_TEXT/16) {
-	int l = ip->text_end - ip->text_start;
-	
-	memmove(ip->text, ip->text + ip->text_start, l + 1);
-	ip->text_start = 0;
-	ip->text_end = l;
-	text_space = (MAX_TEXT - ip->text_end - 1) / 3;
-	if (text_space < MAX_TEXT/16) {
-	    /* almost 2k data without a newline.  Flush it, otherwise
-	       text_space will eventually go to zero and dest the user. */
-	    ip->text_start = 0;
-	    ip->text_end = 0;
-	    text_space = MAX_TEXT / 3;
+
+    do {
+	/*
+	 * copy_chars() can turn one character into three (see the empty
+	 * command trick there).
+	 */
+	if (ip->connection_type == PORT_BINARY)
+	    text_space = INPUT_READ_SIZE;
+	else if (!(text_space = make_text_space(ip,
+			ip->connection_type == PORT_TELNET ? 3 : 1))) {
+	    /* the rest can wait in the kernel until some commands have run */
+	    break;
 	}
-    }
-    /*
-     * read user data.
-     */
-    debug(512, ("get_user_data: read on fd %d\n", ip->fd));
-    num_bytes = OS_socket_read(ip->fd, buf, text_space);
-    switch (num_bytes) {
-    case 0:
-	if (ip->iflags & CLOSING)
-	    debug_message("get_user_data: tried to read from closing fd.\n");
-	remove_interactive(ip->ob, 0);
-	return;
-    case -1:
+	/*
+	 * read user data.
+	 */
+	debug(512, ("get_user_data: read on fd %d\n", ip->fd));
+	num_bytes = OS_socket_read(ip->fd, buf, text_space);
+	switch (num_bytes) {
+	case 0:
+	    if (ip->iflags & CLOSING)
+		debug_message("get_user_data: tried to read from closing fd.\n");
+	    remove_interactive(ip->ob, 0);
+	    return;
+	case -1:
 #ifdef EWOULDBLOCK
-	if (errno == EWOULDBLOCK) {
-	    debug(512, ("get_user_data: read on fd %d: Operation would block.\n",
-			ip->fd));
-	} else
+	    if (errno == EWOULDBLOCK) {
+		debug(512, ("get_user_data: read on fd %d: Operation would block.\n",
+			    ip->fd));
+	    } else
 #endif
 #ifdef WSAEWOULDBLOCK
-	if (errno == WSAEWOULDBLOCK) {
-	    debug(512, ("get_user_data: read on fd %d: Operation would block.\n",
-			ip->fd));
-	} else
+	    if (errno == WSAEWOULDBLOCK) {
+		debug(512, ("get_user_data: read on fd %d: Operation would block.\n",
+			    ip->fd));
+	    } else
 #endif
-	{
-	    debug_message("get_user_data: read on fd %d\n", ip->fd);
-	    debug_perror("get_user_data: read", 0);
-	    remove_interactive(ip->ob, 0);
-	    return;
-	}
-	break;
-    default:
-	buf[num_bytes] = '\0';
-	switch (ip->connection_type) {
-	case PORT_TELNET:
-	    /*
-	     * replace newlines with nulls and catenate to buffer. Also do all
-	     * the useful telnet negotation at this point too. Rip out the sub
-	     * option stuff and send back anything non useful we feel we have
-	     * to.
-	     */
-	    ip->text_end += copy_chars((unsigned char *)buf, (unsigned char *)ip->text + ip->text_end, num_bytes, ip);
-	    /*
-	     * now, text->end is just after the last char read. If last char
-	     was a nl, char *before* text_end will be null.
-	     */
-	    ip->text[ip->text_end] = '\0';
-	    /*
-	     * handle snooping - snooper does not see type-ahead. seems like
-	     * that would be very inefficient, for little functional gain.
-	     */
-	    if (ip->snoop_by && !(ip->iflags & NOECHO))
-		receive_snoop(buf, ip->snoop_by->ob);
-
-	    /*
-	     * set flag if new data completes command.
-	     */
-	    if (cmd_in_buf(ip))
-		ip->iflags |= CMD_IN_BUF;
-	    break;
-	case PORT_ASCII:
 	    {
-		char *nl, *str;
-		char *p = ip->text + ip->text_start;
-		
-		while ((nl = memchr(p, '\n', ip->text_end - ip->text_start))) {
-		    ip->text_start = (nl + 1) - ip->text;
-
-		    *nl = 0;
-		    str = new_string(nl - p, "PORT_ASCII");
-		    memcpy(str, p, nl - p + 1);
-		    if (!(ip->ob->flags & O_DESTRUCTED)) {
+		debug_message("get_user_data: read on fd %d\n", ip->fd);
+		debug_perror("get_user_data: read", 0);
+		remove_interactive(ip->ob, 0);
+		return;
+	    }
+	    break;
+	default:
+#ifdef NET_STATS
+	    ip->stats.bytes_in += num_bytes;
+#endif
+	    buf[num_bytes] = '\0';
+	    switch (ip->connection_type) {
+	    case PORT_TELNET:
+		/*
+		 * replace newlines with nulls and catenate to buffer. Also do
+		 * all the useful telnet negotation at this point too. Rip out
+		 * the sub option stuff and send back anything non useful we
+		 * feel we have to.
+		 */
+		ip->text_end += copy_chars((unsigned char *)buf, (unsigned char *)ip->text + ip->text_end, num_bytes, ip);
+		if (!IP_VALID(ip, ob))
+		    return;
+		/*
+		 * now, text->end is just after the last char read. If last
+		 * char was a nl, char *before* text_end will be null.
+		 */
+		ip->text[ip->text_end] = '\0';
+		/*
+		 * handle snooping - snooper does not see type-ahead. seems
+		 * like that would be very inefficient, for little functional
+		 * gain.
+		 */
+		if (ip->snoop_by && !(ip->iflags & NOECHO)) {
+		    receive_snoop(buf, ip->snoop_by->ob);
+		    if (!IP_VALID(ip, ob))
+			return;
+		}
+		break;
+	    case PORT_ASCII:
+		{
+		    char *nl, *str;
+		    char *p;
+
+		    memcpy(ip->text + ip->text_end, buf, num_bytes + 1);
+		    ip->text_end += num_bytes;
+		    p = ip->text + ip->text_start;
+		    while ((nl = memchr(p, '\n', ip->text_end - ip->text_start))) {
+			ip->text_start = (nl + 1) - ip->text;
+
+			*nl = 0;
+			str = new_string(nl - p, "PORT_ASCII");
+			memcpy(str, p, nl - p + 1);
+			if (!(ip->ob->flags & O_DESTRUCTED)) {
+			    push_malloced_string(str);
+			    apply(APPLY_PROCESS_INPUT, ip->ob, 1, ORIGIN_DRIVER);
+			}
+			if (!IP_VALID(ip, ob))
+			    return;
+			if (ip->text_start == ip->text_end) {
+			    reset_text(ip);
+			    break;
+			} else {
+			    p = nl + 1;
+			}
+		    }
+		    /* a line too long for the buffer is passed on as it is */
+		    if (ip->text_end - ip->text_start >= MAX_INPUT_BUFFER - 1) {
+			str = new_string(ip->text_end - ip->text_start, "PORT_ASCII");
+			memcpy(str, ip->text + ip->text_start,
+			       ip->text_end - ip->text_start + 1);
+			reset_text(ip);
 			push_malloced_string(str);
 			apply(APPLY_PROCESS_INPUT, ip->ob, 1, ORIGIN_DRIVER);
+			if (!IP_VALID(ip, ob))
+			    return;
 		    }
-		    if (ip->text_start == ip->text_end) {
-			ip->text_start = 0;
-			ip->text_end = 0;
-			break;
-		    } else {
-			p = nl + 1;
-		    }
+		    break;
+		}
+	    case PORT_BINARY:
+		{
+		    buffer_t *buffer;
+
+		    buffer = allocate_buffer(num_bytes);
+		    memcpy(buffer->item, buf, num_bytes);
+
+		    push_refed_buffer(buffer);
+		    apply(APPLY_PROCESS_INPUT, ip->ob, 1, ORIGIN_DRIVER);
+		    if (!IP_VALID(ip, ob))
+			return;
+		    break;
 		}
-		break;
-	    }
-	case PORT_BINARY:
-	    {
-		buffer_t *buffer;
-		svalue_t *ret;
-		
-		buffer = allocate_buffer(num_bytes);
-		memcpy(buffer->item, buf, num_bytes);
-		
-		push_refed_buffer(buffer);
-		ret = apply(APPLY_PROCESS_INPUT, ip->ob, 1, ORIGIN_DRIVER);
-		break;
 	    }
 	}
-    }
+	/* a short read means the socket has been drained */
+    } while (num_bytes == text_space);
+
+    /*
+     * set flag if new data completes command.
+     */
+    if (ip->connection_type == PORT_TELNET && !(ip->iflags & CMD_IN_BUF)
+	&& cmd_in_buf(ip))
+	set_cmd_in_buf(ip);
 }				/* get_user_data() */
 
 /*
- * Return the first cmd of the next user in sequence that has a complete cmd
- * in their buffer.
- * CmdsGiven is used to allow users in ED to send more cmds (if they have
- * them queued up) than users not in ED.
+ * Users with a complete command in their buffer (CMD_IN_BUF) are kept in
+ * a list, in the order they get to go next.
+ */
+static interactive_t *cmd_head = 0, *cmd_tail = 0;
+static int num_cmd_users = 0;
+static int command_pass = 0;
+static int commands_deferred = 0;
+
+static void set_cmd_in_buf P1(interactive_t *, ip)
+{
+    ip->iflags |= CMD_IN_BUF;
+    ip->cmd_next = 0;
+    ip->cmd_prev = cmd_tail;
+    if (cmd_tail)
+	cmd_tail->cmd_next = ip;
+    else
+	cmd_head = ip;
+    cmd_tail = ip;
+    num_cmd_users++;
+    update_user_poll(ip);
+}
+
+static void unlink_cmd_user P1(interactive_t *, ip)
+{
+    if (ip->cmd_prev)
+	ip->cmd_prev->cmd_next = ip->cmd_next;
+    else
+	cmd_head = ip->cmd_next;
+    if (ip->cmd_next)
+	ip->cmd_next->cmd_prev = ip->cmd_prev;
+    else
+	cmd_tail = ip->cmd_prev;
+    ip->cmd_next = ip->cmd_prev = 0;
+    num_cmd_users--;
+}
+
+static void clear_cmd_in_buf P1(interactive_t *, ip)
+{
+    ip->iflags &= ~CMD_IN_BUF;
+    unlink_cmd_user(ip);
+    update_user_poll(ip);
+}
+
+/* send a user with more commands waiting to the back of the line */
+static void requeue_cmd_user P1(interactive_t *, ip)
+{
+    if (ip == cmd_tail)
+	return;
+    unlink_cmd_user(ip);
+    ip->cmd_next = 0;
+    ip->cmd_prev = cmd_tail;
+    cmd_tail->cmd_next = ip;
+    cmd_tail = ip;
+    num_cmd_users++;
+}
+
+/*
+ * Run commands until every user has had their turns for this pass.
+ * Returns nonzero if some were held back for the next pass, so that the
+ * backend doesn't sleep on them.
+ */
+int process_user_commands()
+{
+    command_pass++;
+    commands_deferred = 0;
+    while (process_user_command())
+	;
+    return commands_deferred;
+}
+
+/*
+ * Return the first cmd of the next user in turn that has a complete cmd
+ * in their buffer and hasn't used up their USER_COMMANDS_PER_PASS.  Users
+ * go to the back of the line after each command, so everyone gets one
+ * command at a time.
  * This should also return a value if there is something in the
  * buffer and we are supposed to be in single character mode.
  */
-#define IncCmdGiver     NextCmdGiver = (NextCmdGiver == 0 ? max_users - 1: \
-                                        NextCmdGiver - 1)
-
 static char *get_user_command()
 {
-    static int NextCmdGiver = 0;
-
     int i;
     interactive_t *ip;
     char *user_command = NULL;
@@ -1454,33 +2225,38 @@ static char *get_user_command()
     /*
      * find and return a user command.
      */
-    for (i = 0; i < max_users; i++) {
-	ip = all_users[NextCmdGiver];
-	if (ip && ip->message_length) {
-	    object_t *ob = ip->ob;
-	    flush_message(ip);
-	    if (!IP_VALID(ip, ob))
-		ip = 0;
+    for (i = num_cmd_users; i > 0; i--) {
+	ip = cmd_head;
+	if (ip->cmd_pass != command_pass) {
+	    ip->cmd_pass = command_pass;
+	    ip->cmd_count = 0;
 	}
-	if (ip && ip->iflags & CMD_IN_BUF) {
-	    user_command = first_cmd_in_buf(ip);
-	    if (user_command) 
-		break;
-	    else
-		ip->iflags &= ~CMD_IN_BUF;
+	if (ip->message_length > MESSAGE_HIGH_WATER)
+	    flush_message(ip);
+	/*
+	 * leave the commands of users who have had their turns, or who
+	 * aren't keeping up with their output, until later.
+	 */
+	if (ip->cmd_count >= USER_COMMANDS_PER_PASS
+	    || ip->message_length > MESSAGE_HIGH_WATER) {
+	    if (ip->cmd_count >= USER_COMMANDS_PER_PASS)
+		commands_deferred = 1;
+	    requeue_cmd_user(ip);
+	    continue;
 	}
-	if (NextCmdGiver-- == 0)
-	    NextCmdGiver = max_users - 1;
+	user_command = first_cmd_in_buf(ip);
+	if (user_command)
+	    break;
+	clear_cmd_in_buf(ip);
     }
     /*
      * no cmds found; return 0.
      */
-    if (!ip || !user_command)
+    if (!user_command)
 	return 0;
     /*
-     * we have a user cmd -- return it. If user has only one partially
-     * completed cmd left after this, move it to the start of his buffer; new
-     * stuff will be appended.
+     * we have a user cmd -- return it, and send the user to the back of
+     * the line if they have more.
      */
     debug(512, ("get_user_command: user_command = (%s)\n", user_command));
     command_giver = ip->ob;
@@ -1492,11 +2268,14 @@ static char *get_user_command()
      * move input buffer pointers to next command.
      */
     next_cmd_in_buf(ip);
-    if (!cmd_in_buf(ip))
-	ip->iflags &= ~CMD_IN_BUF;
-
-    if (NextCmdGiver-- == 0)
-	NextCmdGiver = max_users - 1;
+    ip->cmd_count++;
+#ifdef NET_STATS
+    ip->stats.commands++;
+#endif
+    if (cmd_in_buf(ip))
+	requeue_cmd_user(ip);
+    else
+	clear_cmd_in_buf(ip);
 
     if (ip->iflags & NOECHO) {
 	/*
@@ -1520,7 +2299,7 @@ static char *get_user_command()
  */
 static char *first_cmd_in_buf P1(interactive_t *, ip)
 {
-    char *p, *q;
+    char *p;
 
     p = ip->text + ip->text_start;
 
@@ -1533,8 +2312,7 @@ static char *first_cmd_in_buf P1(interactive_t *, ip)
     ip->text_start = p - ip->text;
 
     if (ip->text_start >= ip->text_end) {
-	ip->text_start = ip->text_end = 0;
-	ip->text[0] = '\0';
+	reset_text(ip);
 	return 0;
     }
     /* If we got here, must have something in the array */
@@ -1543,35 +2321,12 @@ static char *first_cmd_in_buf P1(interactive_t *, ip)
 	return (ip->text + ip->text_start);
     }
     /*
-     * find end of cmd.
-     */
-    while ((p < (ip->text + ip->text_end)) && *p)
-	p++;
-    /*
-     * null terminated; was command.
+     * null terminated; was command.  A partial command is left where it
+     * is; make_text_space() moves it down when more input arrives, and
+     * copy_chars() never lets it grow past MAX_TEXT - 2.
      */
-    if (p < ip->text + ip->text_end)
+    if (memchr(p, '\0', ip->text_end - ip->text_start))
 	return (ip->text + ip->text_start);
-    /*
-     * have a partial command at end of buffer; move it to start, return
-     * null. if it can't move down, truncate it and return it as cmd.
-     */
-    p = ip->text + ip->text_start;
-    q = ip->text;
-    while (p < (ip->text + ip->text_end))
-	*(q++) = *(p++);
-
-    ip->text_end -= ip->text_start;
-    ip->text_start = 0;
-    if (ip->text_end > MAX_TEXT - 2) {
-	ip->text[ip->text_end - 2] = '\0';	/* nulls to truncate */
-	ip->text[ip->text_end - 1] = '\0';	/* nulls to truncate */
-	ip->text_end--;
-	return (ip->text);
-    }
-    /*
-     * buffer not full and no newline - no cmd.
-     */
     return 0;
 }				/* first_command_in_buf() */
 
@@ -1598,19 +2353,9 @@ static int cmd_in_buf P1(interactive_t *, ip)
 	return (1);
     }
     /*
-     * find end of cmd.
-     */
-    while ((p < (ip->text + ip->text_end)) && *p)
-	p++;
-    /*
-     * null terminated; was command.
-     */
-    if (p < ip->text + ip->text_end)
-	return (1);
-    /*
-     * no newline - no cmd.
+     * null terminated; was command.  No null - no cmd.
      */
-    return (0);
+    return (memchr(p, '\0', ip->text + ip->text_end - p) != 0);
 }				/* cmd_in_buf() */
 
 /*
@@ -1619,20 +2364,19 @@ static int cmd_in_buf P1(interactive_t *, ip)
 static void next_cmd_in_buf P1(interactive_t *, ip)
 {
     char *p = ip->text + ip->text_start;
+    char *end = ip->text + ip->text_end;
 
-    while (*p && p < ip->text + ip->text_end)
-	p++;
+    if (!(p = memchr(p, '\0', end - p)))
+	p = end;
     /*
      * skip past any nulls at the end.
      */
-    while (!*p && p < ip->text + ip->text_end)
+    while (p < end && !*p)
 	p++;
-    if (p < ip->text + ip->text_end)
+    if (p < end)
 	ip->text_start = p - ip->text;
-    else {
-	ip->text_start = ip->text_end = 0;
-	ip->text[0] = '\0';
-    }
+    else
+	reset_text(ip);
 }				/* next_cmd_in_buf() */
 
 /*
@@ -1662,6 +2406,7 @@ void remove_interactive P2(object_t *, ob, int, dested)
 
     flush_message(ip);
     ip->iflags |= CLOSING;
+    unlink_flush_user(ip);
 
 #ifdef F_ED
     if (ip->ed_buffer) {
@@ -1686,6 +2431,7 @@ void remove_interactive P2(object_t *, ob, int, dested)
     }
 
     debug(512, ("remove_interactive: closing fd %d\n", ip->fd));
+    poll_remove(ip->fd);
     if (OS_socket_close(ip->fd) == -1) {
  	debug_perror("remove_interactive: close", 0);
     }
@@ -1707,6 +2453,15 @@ void remove_interactive P2(object_t *, ob, int, dested)
     for (idx = 0; idx < max_users; idx++)
 	if (all_users[idx] == ip) break;
     DEBUG_CHECK(idx == max_users, "remove_interactive: could not find and remove user!\n");
+    if (ip->iflags & CMD_IN_BUF)
+	unlink_cmd_user(ip);
+    free_message_queue(ip);
+#ifdef MCCP
+    if (ip->mccp)
+	free_compression(ip);
+#endif
+    input_buffer_bytes -= ip->text_size;
+    FREE(ip->text);
     FREE(ip);
     total_users--;
     ob->interactive = 0;
@@ -1859,8 +2614,6 @@ static void print_prompt P1(interactive_t*, ip)
      */
     if (ip->iflags & USING_TELNET)
 	add_message(command_giver, telnet_ga);
-    if (!IP_VALID(ip, ob)) return;
-    flush_message(ip);
 }				/* print_prompt() */
 
 /*
@@ -1939,26 +2692,53 @@ int new_set_snoop P2(object_t *, me, object_t *, you)
  */
 static void telnet_neg P2(char *, to, char *, from)
 {
-    int ch;
-    char *first = to;
+    char *first = to, *p;
+    int n;
 
-    while (1) {
-	ch = *from++;
-	switch (ch) {
-	case '\b':		/* Backspace */
-	case 0x7f:		/* Delete */
-	    if (to <= first)
-		continue;
-	    to -= 1;
-	    continue;
-	default:
-	    *to++ = ch;
-	    if (ch == 0)
-		return;
-	}			/* switch() */
-    }				/* while() */
+    /*
+     * copy up to each backspace or delete, then rub out the character
+     * before it (if there is one).
+     */
+    while ((p = strpbrk(from, "\b\177"))) {
+	n = p - from;
+	memcpy(to, from, n);
+	to += n;
+	if (to > first)
+	    to--;
+	from = p + 1;
+    }
+    strcpy(to, from);
 }				/* telnet_neg() */
 
+#ifdef RESOLVER
+/*
+ * Does a call back on the current_object with the function call_back.
+ */
+int query_addr_number P2(char *, name, char *, call_back)
+{
+    return resolve_callback(name, call_back);
+}
+
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_iptable() {
+    if (broadcast_str.type == T_STRING)
+	mark_svalue(&broadcast_str);
+}
+#endif
+
+char *query_ip_name P1(object_t *, ob)
+{
+    char *name;
+
+    if (ob == 0)
+	ob = command_giver;
+    if (!ob || ob->interactive == 0)
+	return NULL;
+    if ((name = resolved_ip_name(inet_ntoa(ob->interactive->addr.sin_addr))))
+	return name;
+    return (inet_ntoa(ob->interactive->addr.sin_addr));
+}
+#else
 static void query_addr_name P1(object_t *, ob)
 {
     static char buf[100];
@@ -1981,6 +2761,7 @@ static void query_addr_name P1(object_t *, ob)
 	switch (errno) {
 	case EBADF:
 	    debug_message("Address server has closed connection.\n");
+	    poll_remove(addr_server_fd);
 	    addr_server_fd = -1;
 	    break;
 	default:
@@ -2031,6 +2812,7 @@ int query_addr_number P2(char *, name, char *, call_back)
 	switch (errno) {
 	case EBADF:
 	    debug_message("Address server has closed connection.\n");
+	    poll_remove(addr_server_fd);
 	    addr_server_fd = -1;
 	    break;
 	default:
@@ -2129,6 +2911,8 @@ void mark_iptable() {
     for (i=0; i < IPSIZE; i++)
 	if (iptable[i].name)
 	    EXTRA_REF(BLOCK(iptable[i].name))++;
+    if (broadcast_str.type == T_STRING)
+	mark_svalue(&broadcast_str);
 }
 #endif
 
@@ -2162,6 +2946,7 @@ static void add_ip_entry P2(long, addr, char *, name)
     iptable[ipcur].name = make_shared_string(name);
     ipcur = (ipcur + 1) % IPSIZE;
 }
+#endif
 
 char *query_ip_number P1(object_t *, ob)
 {
@@ -2225,6 +3010,133 @@ int query_idle P1(object_t *, ob)
     return (current_time - ob->interactive->last_time);
 }				/* query_idle() */
 
+int query_output_queue P1(object_t *, ob)
+{
+    if (!ob->interactive)
+	error("query_output_queue() of non-interactive object.\n");
+    return ob->interactive->message_length;
+}				/* query_output_queue() */
+
+#ifdef NET_STATS
+/*
+ * The counters for a user's connection, as a mapping.
+ */
+mapping_t *query_net_stats P1(object_t *, ob)
+{
+    interactive_t *ip = ob->interactive;
+    mapping_t *m;
+
+    if (!ip)
+	error("query_net_stats() of non-interactive object.\n");
+    m = allocate_mapping(11);
+    add_mapping_pair(m, "connected", ip->stats.connected);
+    add_mapping_pair(m, "bytes_in", ip->stats.bytes_in);
+    add_mapping_pair(m, "bytes_out", ip->stats.bytes_out);
+    add_mapping_pair(m, "commands", ip->stats.commands);
+    add_mapping_pair(m, "writes", ip->stats.writes);
+    add_mapping_pair(m, "partial_writes", ip->stats.partial_writes);
+    add_mapping_pair(m, "would_block", ip->stats.would_block);
+    add_mapping_pair(m, "dropped", ip->stats.dropped);
+    add_mapping_pair(m, "peak_queue", ip->stats.peak_queue);
+    add_mapping_pair(m, "queue", ip->message_length);
+#ifdef MCCP
+    add_mapping_pair(m, "compressed", ip->mccp != 0);
+#endif
+    return m;
+}
+
+/*
+ * How many users fall into each range: under 1K, 4K, ... 1M, or more.
+ */
+#define NET_STATS_BUCKETS 7
+
+static void add_net_histogram P3(outbuffer_t *, ob, char *, what, int *, h)
+{
+    int i;
+
+    outbuf_addv(ob, "%-12s", what);
+    for (i = 0; i < NET_STATS_BUCKETS; i++)
+	outbuf_addv(ob, "%7d", h[i]);
+    outbuf_add(ob, "\n");
+}
+
+static void count_net_bucket P2(int *, h, int, n)
+{
+    int i, limit;
+
+    for (i = 0, limit = 1024; i < NET_STATS_BUCKETS - 1; i++, limit *= 4)
+	if ((unsigned int) n < (unsigned int) limit)
+	    break;
+    h[i]++;
+}
+
+void net_stats_status P1(outbuffer_t *, ob)
+{
+    int in[NET_STATS_BUCKETS], out[NET_STATS_BUCKETS], peak[NET_STATS_BUCKETS];
+    int i, n = 0, writes = 0, partial = 0, would_block = 0, dropped = 0;
+    interactive_t *ip;
+
+    memset((char *) in, 0, sizeof(in));
+    memset((char *) out, 0, sizeof(out));
+    memset((char *) peak, 0, sizeof(peak));
+    for (i = 0; i < max_users; i++) {
+	if (!(ip = all_users[i]))
+	    continue;
+	n++;
+	count_net_bucket(in, ip->stats.bytes_in);
+	count_net_bucket(out, ip->stats.bytes_out);
+	count_net_bucket(peak, ip->stats.peak_queue);
+	writes += ip->stats.writes;
+	partial += ip->stats.partial_writes;
+	would_block += ip->stats.would_block;
+	dropped += ip->stats.dropped;
+    }
+    outbuf_addv(ob, "Connections: %d   Writes: %d   Short: %d   Would block: %d   Dropped: %d bytes\n",
+		n, writes, partial, would_block, dropped);
+    outbuf_addv(ob, "%-12s%7s%7s%7s%7s%7s%7s%7s\n", "Users with",
+		"<1K", "<4K", "<16K", "<64K", "<256K", "<1M", "more");
+    add_net_histogram(ob, "bytes in", in);
+    add_net_histogram(ob, "bytes out", out);
+    add_net_histogram(ob, "peak queue", peak);
+}
+#endif
+
+#ifdef MCCP
+/*
+ * Offer compression to a user, or stop compressing their output.
+ */
+void compress_output P2(object_t *, ob, int, flag)
+{
+    interactive_t *ip = ob->interactive;
+
+    if (!ip)
+	error("compress_output() of non-interactive object.\n");
+    if (ip->connection_type != PORT_TELNET)
+	return;
+    if (flag) {
+	if (!(ip->iflags & COMPRESS_OFFERED)
+	    && (!ip->mccp || ip->mccp->ending)) {
+	    ip->iflags |= COMPRESS_OFFERED;
+	    add_message(ob, telnet_will_compress);
+	}
+    } else {
+	if (ip->iflags & COMPRESS_OFFERED) {
+	    ip->iflags &= ~COMPRESS_OFFERED;
+	    if (!ip->mccp || ip->mccp->ending)
+		add_message(ob, telnet_wont_compress);
+	}
+	end_compression(ip);
+    }
+}
+
+int compressedp P1(object_t *, ob)
+{
+    if (!ob->interactive)
+	error("compressedp() of non-interactive object.\n");
+    return ob->interactive->mccp && !ob->interactive->mccp->ending;
+}
+#endif
+
 #ifndef NO_ADD_ACTION
 void notify_no_command()
 {
@@ -2333,15 +3245,15 @@ int outbuf_extend P2(outbuffer_t *, outbuf, int, l)
     if (outbuf->buffer) {
 	limit = MSTR_SIZE(outbuf->buffer);
 	if (outbuf->real_size + l > limit) {
-	    if (outbuf->real_size == USHRT_MAX) return 0; /* TRUNCATED */
+	    if (outbuf->real_size == max_string_length) return 0; /* TRUNCATED */
 
 	    /* assume it's going to grow some more */
 	    limit = (outbuf->real_size + l) * 2;
-	    if (limit > USHRT_MAX) {
+	    if (limit > max_string_length) {
 		limit = outbuf->real_size + l;
-		if (limit > USHRT_MAX) {
-		    outbuf->buffer = extend_string(outbuf->buffer, USHRT_MAX);
-		    return USHRT_MAX - outbuf->real_size;
+		if (limit > max_string_length) {
+		    outbuf->buffer = extend_string(outbuf->buffer, max_string_length);
+		    return max_string_length - outbuf->real_size;
 		}
 	    }
 	    outbuf->buffer = extend_string(outbuf->buffer, limit);
@@ -2362,18 +3274,18 @@ void outbuf_add P2(outbuffer_t *, outbuf, char *, str)
     if (outbuf->buffer) {
 	limit = MSTR_SIZE(outbuf->buffer);
 	if (outbuf->real_size + l > limit) {
-	    if (outbuf->real_size == USHRT_MAX) return; /* TRUNCATED */
+	    if (outbuf->real_size == max_string_length) return; /* TRUNCATED */
 
 	    /* assume it's going to grow some more */
 	    limit = (outbuf->real_size + l) * 2;
-	    if (limit > USHRT_MAX) {
+	    if (limit > max_string_length) {
 		limit = outbuf->real_size + l;
-		if (limit > USHRT_MAX) {
-		    outbuf->buffer = extend_string(outbuf->buffer, USHRT_MAX);
+		if (limit > max_string_length) {
+		    outbuf->buffer = extend_string(outbuf->buffer, max_string_length);
 		    strncpy(outbuf->buffer + outbuf->real_size, str,
-			    USHRT_MAX - outbuf->real_size);
-		    outbuf->buffer[USHRT_MAX] = 0;
-		    outbuf->real_size = USHRT_MAX;
+			    max_string_length - outbuf->real_size);
+		    outbuf->buffer[max_string_length] = 0;
+		    outbuf->real_size = max_string_length;
 		    return;
 		}
 	    }
@@ -2396,17 +3308,17 @@ void outbuf_addchar P2(outbuffer_t *, outbuf, char, c)
     if (outbuf->buffer) {
 	limit = MSTR_SIZE(outbuf->buffer);
 	if (outbuf->real_size + 1 > limit) {
-	    if (outbuf->real_size == USHRT_MAX) return; /* TRUNCATED */
+	    if (outbuf->real_size == max_string_length) return; /* TRUNCATED */
 
 	    /* assume it's going to grow some more */
 	    limit = (outbuf->real_size + 1) * 2;
-	    if (limit > USHRT_MAX) {
+	    if (limit > max_string_length) {
 		limit = outbuf->real_size + 1;
-		if (limit > USHRT_MAX) {
-		    outbuf->buffer = extend_string(outbuf->buffer, USHRT_MAX);
+		if (limit > max_string_length) {
+		    outbuf->buffer = extend_string(outbuf->buffer, max_string_length);
 		    *(outbuf->buffer + outbuf->real_size) = c;
-		    outbuf->buffer[USHRT_MAX] = 0;
-		    outbuf->real_size = USHRT_MAX;
+		    outbuf->buffer[max_string_length] = 0;
+		    outbuf->real_size = max_string_length;
 		    return;
 		}
 	    }
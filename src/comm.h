@@ -7,11 +7,36 @@
 #define COMM_H
 
 #include "network_incl.h"
+#ifdef MCCP
+#include <zlib.h>
+#endif
 
-#define MAX_TEXT                   2048
+#define MAX_TEXT                   2048	/* longest command              */
+#define MAX_INPUT_BUFFER           (MAX_TEXT * 16)	/* most typed ahead */
+#define INPUT_READ_SIZE            4096
 #define MAX_SOCKET_PACKET_SIZE     1024
 #define DESIRED_SOCKET_PACKET_SIZE 800
 #define MESSAGE_BUF_SIZE           MESSAGE_BUFFER_SIZE	/* from options.h */
+#ifndef MESSAGE_HIGH_WATER
+#define MESSAGE_HIGH_WATER         (MESSAGE_BUF_SIZE * 16)
+#endif
+#ifndef MESSAGE_QUEUE_LIMIT
+#define MESSAGE_QUEUE_LIMIT        (MESSAGE_HIGH_WATER * 16)
+#endif
+#define MESSAGE_SHARE_MIN          256	/* smaller broadcasts are copied */
+#ifndef USER_COMMANDS_PER_PASS
+#define USER_COMMANDS_PER_PASS     10
+#endif
+#ifndef LISTEN_BACKLOG
+#define LISTEN_BACKLOG             128
+#endif
+#ifndef LOGONS_PER_PASS
+#define LOGONS_PER_PASS            20
+#endif
+#ifndef MAX_PENDING_LOGONS
+#define MAX_PENDING_LOGONS         1024
+#endif
+#define ACCEPTS_PER_EVENT          64	/* before polling the rest again */
 #define OUT_BUF_SIZE               2048
 #define DFAULT_PROTO               0	/* use the appropriate protocol */
 #define I_NOECHO                   0x1	/* input_to flag */
@@ -37,6 +62,67 @@ enum msgtypes {
 #define NOTIFY_FAIL_FUNC  512   /* default_err_mesg is a function pointer  */
 #define USING_TELNET     1024   /* they're using telnet, or something that */
                                 /* understands telnet codes                */
+#define COMPRESS_OFFERED 2048   /* we've sent IAC WILL COMPRESS2           */
+#define OUTPUT_BLOCKED   4096   /* socket is full; waiting until writable */
+#define FLUSH_PENDING    8192   /* output to write at the end of the cycle */
+
+#ifndef TELOPT_COMPRESS2
+#define TELOPT_COMPRESS2    86
+#endif
+#define MCCP_BUFFER_SIZE    MESSAGE_BUF_SIZE
+
+#ifdef MCCP
+/*
+ * A compressed connection deflates its output queue into out[] as it is
+ * flushed; out[start..end) is what hasn't been written yet.  Once ending
+ * is set, the stream has been finished and the user goes back to plain
+ * output when out[] is empty.
+ */
+typedef struct mccp_s {
+    z_stream zs;
+    char *out;
+    int size;
+    int start;
+    int end;
+    int ending;
+} mccp_t;
+#endif
+
+/*
+ * Output waiting to be sent to a user is a list of links, each pointing
+ * at a chunk of text that has already had \r put in front of each \n.
+ * Chunks are reference counted so that one chunk can be queued for more
+ * than one user; only a chunk nobody else holds is appended to.
+ */
+typedef struct message_chunk_s {
+    int ref;
+    int size;			/* space in data[]                         */
+    int len;			/* bytes of data[] in use                  */
+    char data[1];
+} message_chunk_t;
+
+typedef struct message_link_s {
+    struct message_link_s *next;
+    message_chunk_t *chunk;
+} message_link_t;
+
+#ifdef NET_STATS
+/*
+ * Counters for one connection, since it was made.  See query_net_stats().
+ */
+typedef struct net_stats_s {
+    int connected;		/* time() when they connected              */
+    int bytes_in;		/* read from the socket                    */
+    int bytes_out;		/* written to it (after compression)       */
+    int commands;		/* commands run                            */
+    int writes;			/* write()s and writev()s made             */
+    int partial_writes;		/* that didn't take everything             */
+    int would_block;		/* that took nothing (EWOULDBLOCK)         */
+    int dropped;		/* bytes of output thrown away             */
+    int peak_queue;		/* most output ever waiting to be sent     */
+} net_stats_t;
+#endif
+
 typedef struct interactive_s {
     object_t *ob;		/* points to the associated object         */
     sentence_t *input_to;	/* to be called with next input line       */
@@ -47,9 +133,17 @@ typedef struct interactive_s {
     int local_port;		/* which of our ports they connected to    */
 #endif
     char *prompt;		/* prompt string for interactive object    */
-    char text[MAX_TEXT];	/* input buffer for interactive object     */
+    char *text;			/* input buffer for interactive object     */
+    int text_size;		/* space allocated for text                */
     int text_end;		/* first free char in buffer               */
     int text_start;		/* where we are up to in user command buffer */
+    int text_line;		/* start of the line being typed           */
+    struct interactive_s *cmd_next;	/* users with a command waiting */
+    struct interactive_s *cmd_prev;
+    struct interactive_s *flush_next;	/* users with output to write   */
+    struct interactive_s *flush_prev;
+    int cmd_pass;		/* pass of the backend cmd_count is for    */
+    int cmd_count;		/* commands run in that pass               */
     struct interactive_s *snoop_on;
     struct interactive_s *snoop_by;
     int last_time;		/* time of last command executed           */
@@ -64,10 +158,16 @@ typedef struct interactive_s {
 #ifdef OLD_ED
     struct ed_buffer_s *ed_buffer;  /* local ed                        */
 #endif
-    int message_producer;	/* message buffer producer index */
-    int message_consumer;	/* message buffer consumer index */
-    int message_length;		/* message buffer length */
-    char message_buf[MESSAGE_BUF_SIZE];	/* message buffer */
+    message_link_t *message_head;	/* output queue */
+    message_link_t *message_tail;
+    int message_offset;		/* bytes of the first chunk already sent */
+    int message_length;		/* bytes waiting to be sent */
+#ifdef MCCP
+    mccp_t *mccp;		/* compression state, if compressing       */
+#endif
+#ifdef NET_STATS
+    net_stats_t stats;
+#endif
     int iflags;                 /* interactive flags */
     svalue_t *carryover;	/* points to args for input_to             */
     int num_carry;		/* number of args for input_to             */
@@ -109,19 +209,31 @@ typedef struct interactive_s {
  * comm.c
  */
 extern int total_users;
-extern fd_set readmask;
-extern fd_set writemask;
 extern int inet_packets;
 extern int inet_volume;
 extern int num_user;
 extern int num_hidden;
 extern int add_message_calls;
+extern int num_message_chunks;
+extern int message_chunk_bytes;
+extern int input_buffer_bytes;
+#ifdef MCCP
+extern int num_compressed;
+extern double compress_bytes_in;
+extern double compress_bytes_out;
+extern double compress_usec;
+#endif
+extern int connections_accepted;
+extern int connections_dropped;
+extern int logons_waiting;
 
 extern interactive_t **all_users;
 extern int max_users;
 
 void add_vmessage PROT2V(object_t *, char *);
 void add_message PROT((object_t *, char *));
+void start_broadcast PROT((svalue_t *));
+void end_broadcast PROT((void));
 
 #ifdef SIGNAL_FUNC_TAKES_INT
 void sigalrm_handler PROT((int));
@@ -129,15 +241,17 @@ void sigalrm_handler PROT((int));
 void sigalrm_handler PROT((void));
 #endif
 void update_ref_counts_for_users PROT((void));
-INLINE void make_selectmasks PROT((void));
 void init_user_conn PROT((void));
 void init_addr_server PROT((char *, int));
 void ipc_remove PROT((void));
 void set_prompt PROT((char *));
 void notify_no_command PROT((void));
 void set_notify_fail_message PROT((char *));
-INLINE void process_io PROT((void));
+INLINE void process_io PROT((int));
+void process_logons PROT((void));
+void flush_pending_output PROT((void));
 int process_user_command PROT((void));
+int process_user_commands PROT((void));
 int replace_interactive PROT((object_t *, object_t *));
 int set_call PROT((object_t *, sentence_t *, int));
 void remove_interactive PROT((object_t *, int));
@@ -147,6 +261,15 @@ char *query_ip_name PROT((object_t *));
 char *query_ip_number PROT((object_t *));
 char *query_host_name PROT((void));
 int query_idle PROT((object_t *));
+int query_output_queue PROT((object_t *));
+#ifdef NET_STATS
+mapping_t *query_net_stats PROT((object_t *));
+void net_stats_status PROT((outbuffer_t *));
+#endif
+#ifdef MCCP
+void compress_output PROT((object_t *, int));
+int compressedp PROT((object_t *));
+#endif
 int new_set_snoop PROT((object_t *, object_t *));
 object_t *query_snoop PROT((object_t *));
 object_t *query_snooping PROT((object_t *));
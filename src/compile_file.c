@@ -185,6 +185,7 @@ int generate_source P2(svalue_t *, arg1, char *, out_fname)
 
     if (arg1->type != T_ARRAY) {
 #ifdef RUNTIME_LOADING
+	init_array_store(&tmp_arr, 1);
 	tmp_arr.size = 1;
 	tmp_arr.item[0] = *arg1;
 	arr = &tmp_arr;
@@ -80,6 +80,7 @@ char *runtime_locals_ptr;
 int locals_size = 0;
 int type_of_locals_size = 0; 
 int current_number_of_locals = 0;
+int num_call_other_sites = 0;
 int max_num_locals = 0;
 
 /* This function has strput() semantics; see comments in simulate.c */
@@ -1961,6 +1962,7 @@ static program_t *epilog() {
     total_num_prog_blocks += 1;
 
     prog->line_swap_index = -1;
+    prog->num_call_other_sites = num_call_other_sites;
     /* Format is now:
      * <short total size> <short line_info_offset> <file info> <line info>
      */
@@ -2096,6 +2098,7 @@ static void prolog P2(int, f, char *, name) {
     }
     memset(string_tags, 0, sizeof(string_tags));
     freed_string = -1;
+    num_call_other_sites = 0;
     initialize_parser();
 
     current_file = make_shared_string(name);
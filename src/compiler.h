@@ -162,6 +162,7 @@ extern ident_hash_elem_t **locals;
 extern unsigned short *type_of_locals;
 extern char *runtime_locals;
 extern int current_number_of_locals;
+extern int num_call_other_sites;
 extern int max_num_locals;
 extern unsigned short *type_of_locals_ptr;
 extern ident_hash_elem_t **locals_ptr;
@@ -281,6 +281,31 @@ disassemble P5(FILE *, f, char *, code, int, start, int, end, program_t *, prog)
 	    pc += 2;
 	    break;
 
+	case F_BRANCH_LOCALS:
+	    i = EXTRACT_UCHAR(pc++);
+	    iarg = EXTRACT_UCHAR(pc++);
+	    j = EXTRACT_UCHAR(pc++);
+	    COPY_SHORT(&sarg, pc);
+	    offset = (pc - code) + (unsigned short) sarg;
+	    pc += 2;
+	    sprintf(buff, "LV%d LV%d %s %04x (%04x)", iarg, j, get_f_name(i),
+		    (unsigned) sarg, (unsigned) offset);
+	    break;
+	case F_BRANCH_STRING:
+	    i = EXTRACT_UCHAR(pc++);
+	    LOAD_SHORT(sarg, pc);
+	    if (sarg < NUM_STRS)
+		sprintf(buff, "\"%s\" ", disassem_string(STRS[sarg]));
+	    else
+		sprintf(buff, "<out of range %d> ", (int)sarg);
+	    iarg = sarg;
+	    COPY_SHORT(&sarg, pc);
+	    offset = (pc - code) + (unsigned short) sarg;
+	    pc += 2;
+	    sprintf(buff + strlen(buff), "%s %04x (%04x)", get_f_name(i),
+		    (unsigned) sarg, (unsigned) offset);
+	    break;
+
 	case F_NEXT_FOREACH:
 	case F_BBRANCH_LT:
 	    COPY_SHORT(&sarg, pc);
@@ -337,6 +362,10 @@ disassemble P5(FILE *, f, char *, code, int, start, int, end, program_t *, prog)
 	case F_MEMBER_LVALUE:
 	    sprintf(buff, "%d", (int)EXTRACT_UCHAR(pc++));
 	    break;
+	case F_LOCAL_MEMBER:
+	    sprintf(buff, "LV%d %d", EXTRACT_UCHAR(pc), EXTRACT_UCHAR(pc + 1));
+	    pc += 2;
+	    break;
 
 	case F_EXPAND_VARARGS:
 	    {
@@ -403,6 +432,7 @@ disassemble P5(FILE *, f, char *, code, int, start, int, end, program_t *, prog)
 	    pc += 3;
 	    break;
 	case F_TRANSFER_LOCAL:
+	case F_LOCAL_INDEX:
 	case F_LOCAL:
 	case F_LOCAL_LVALUE:
 	case F_VOID_ASSIGN_LOCAL:
@@ -448,6 +478,27 @@ disassemble P5(FILE *, f, char *, code, int, start, int, end, program_t *, prog)
 	    sprintf(buff, "\"%s\" %d", simuls[sarg].func->name, pc[2]);
 	    pc += 3;
 	    break;
+	case F_CACHED_CALL_OTHER:
+	    COPY_SHORT(&sarg, pc + 1);
+	    sprintf(buff, "%d (site %d)", EXTRACT_UCHAR(pc), (int) sarg);
+	    pc += 3;
+	    break;
+	case F_GLOBAL_CALL_OTHER:
+	    if ((unsigned) (iarg = EXTRACT_UCHAR(pc++)) < NUM_VARS)
+		sprintf(buff, "%s", variable_name(prog, iarg));
+	    else
+		sprintf(buff, "<out of range %d>", iarg);
+	    LOAD_SHORT(sarg, pc);
+	    if (sarg < NUM_STRS)
+		sprintf(buff + strlen(buff), " \"%s\"",
+			disassem_string(STRS[sarg]));
+	    else
+		sprintf(buff + strlen(buff), " <out of range %d>", (int)sarg);
+	    COPY_SHORT(&sarg, pc + 1);
+	    sprintf(buff + strlen(buff), " %d (site %d)", EXTRACT_UCHAR(pc),
+		    (int) sarg);
+	    pc += 3;
+	    break;
 
 	case F_FUNCTION_CONSTRUCTOR:
 	    switch (EXTRACT_UCHAR(pc++)) {
@@ -32,8 +32,7 @@ static int svalue_size P1(svalue_t *, v)
 	return (int) (strlen(v->u.string) + 1);
     case T_ARRAY:
     case T_CLASS:
-	/* first svalue is stored inside the array struct */
-	total = sizeof(array_t) - sizeof(svalue_t);
+	total = ARRAY_SIZE(0);
 	for (i = 0; i < v->u.arr->size; i++) {
 	    total += svalue_size(&v->u.arr->item[i]) + sizeof(svalue_t);
 	}
@@ -1,4 +1,4 @@
-#define CONFIGURE_VERSION	5
+#define CONFIGURE_VERSION	6
 
 #define EDIT_SOURCE
 #define NO_MALLOC
@@ -1126,6 +1126,8 @@ static void handle_malloc() {
 	perror("link malloc.c");
 }
 
+static int has_zlib;
+
 static int check_include2 P4(char *, tag, char *, file,
 			     char *, before, char *, after) {
     char buf[1024];
@@ -1426,6 +1428,23 @@ static void handle_configure() {
 		       "", "gettimeofday(0, 0);", 0);
     verbose_check_prog("Checking for fchmod()", "HAS_FCHMOD",
 		       "", "fchmod(0, 0);", 0);
+    verbose_check_prog("Checking for epoll()", "HAS_EPOLL",
+		       "#include <sys/epoll.h>", "epoll_create(1);", 0);
+    verbose_check_prog("Checking for accept4()", "HAS_ACCEPT4",
+		       "#include <sys/socket.h>\n"
+		       "extern int accept4(int, struct sockaddr *, socklen_t *, int);",
+		       "accept4(0, 0, 0, SOCK_NONBLOCK);", 0);
+    has_zlib = check_include("HAS_ZLIB", "zlib.h");
+    verbose_check_prog("Checking for computed goto", "HAS_COMPUTED_GOTO",
+		       "", "void *l = &&x; goto *l; x: ;", 0);
+    verbose_check_prog("Checking for mmap()", "HAS_MMAP",
+		       "#include <sys/mman.h>",
+		       "mmap(0, 0, PROT_READ, MAP_PRIVATE, 0, 0);", 0);
+    verbose_check_prog("Checking for nanosecond file times", "HAS_ST_MTIM",
+		       "#include <sys/stat.h>",
+		       "struct stat st; st.st_mtim.tv_nsec = 0;", 0);
+    verbose_check_prog("Checking for pread()", "HAS_PREAD",
+		       "", "char c; pread(0, &c, 1, 0);", 0);
     
     find_memmove();
 #endif
@@ -1495,6 +1514,10 @@ static void handle_configure() {
     fprintf(stderr, "Checking for flaky Linux systems ...\n");
     check_linux_libc();
 
+    /* zlib, for MCCP */
+    if (has_zlib)
+	check_library("-lz");
+
     /* PACKAGE_DB stuff */
     if (lookup_define("MSQL")) {
 	if (!(check_library("-lmsql") ||
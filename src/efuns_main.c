@@ -28,6 +28,9 @@
 #include "debug.h"
 #include "ed.h"
 #include "md.h"
+#include "poller.h"
+#include "resolver.h"
+#include "fcache.h"
 #ifdef LPC_TO_C
 #include "interface.h"
 #include "compile_file.h"
@@ -195,6 +198,12 @@ static void print_cache_stats P1(outbuffer_t *, ob)
     outbuf_addv(ob, "collisions:      %10lu\n", apply_low_collisions);
     outbuf_addv(ob, "%% collisions:    %10.2f\n",
 	     100 * ((double) apply_low_collisions / apply_low_call_others));
+    outbuf_addv(ob, "call_other sites: %9lu\n", call_other_sites_used);
+    outbuf_addv(ob, "site cache hits: %10lu\n", call_other_site_hits);
+    outbuf_addv(ob, "site cache misses: %8lu\n", call_other_site_misses);
+    outbuf_addv(ob, "%% site hits:     %10.2f\n",
+		100 * ((double) call_other_site_hits /
+		       (call_other_site_hits + call_other_site_misses)));
 }
 
 void f_cache_stats PROT((void))
@@ -216,7 +225,10 @@ f_call_other PROT((void))
     char *funcname;
     int i;
     int num_arg = st_num_arg;
+    struct cache_entry_s *site = call_other_site;
 
+    /* set by F_CACHED_CALL_OTHER; only good for this call */
+    call_other_site = 0;
 
     if (current_object->flags & O_DESTRUCTED) {	/* No external calls allowed */
 	pop_n_elems(num_arg);
@@ -261,6 +273,7 @@ f_call_other PROT((void))
     }
 #endif
     call_origin = ORIGIN_CALL_OTHER;
+    call_other_site = site;
     if (apply_low(funcname, ob, num_arg - 2) == 0) {	/* Function not found */
 	pop_2_elems();
 	push_undefined();
@@ -283,11 +296,27 @@ f_call_out PROT((void))
 {
     svalue_t *arg = sp - st_num_arg + 1;
     int num = st_num_arg - 2;
+    double secs;
+    long delay;
 #ifdef CALLOUT_HANDLES
     int ret;
+#endif
+
+    /* the delay is in seconds; a float gives finer resolution */
+    if (arg[1].type == T_REAL)
+	secs = arg[1].u.real;
+    else
+	secs = arg[1].u.number;
+    if (secs >= MAX_CALL_OUT_DELAY / 1000)
+	delay = MAX_CALL_OUT_DELAY;
+    else if (secs > 0)
+	delay = (long) (secs * 1000 + 0.5);
+    else
+	delay = 0;
+#ifdef CALLOUT_HANDLES
 
     if (!(current_object->flags & O_DESTRUCTED)) {
-	ret = new_call_out(current_object, arg, arg[1].u.number, num, arg + 2);
+	ret = new_call_out(current_object, arg, delay, num, arg + 2);
 	/* args have been transfered; don't free them;
 	   also don't need to free the int */
 	sp -= num + 1;
@@ -301,7 +330,7 @@ f_call_out PROT((void))
     put_number(ret);
 #else
     if (!(current_object->flags & O_DESTRUCTED)) {
-	new_call_out(current_object, arg, arg[1].u.number, num, arg + 2);
+	new_call_out(current_object, arg, delay, num, arg + 2);
 	sp -= num + 1;
     } else {
 	pop_n_elems(num);
@@ -1680,7 +1709,9 @@ f_message PROT((void))
 	}
     } else
 	avoid = &the_null_array;
+    start_broadcast(&args[1]);
     do_message(&args[0], &args[1], use, avoid, 1);
+    end_broadcast();
     pop_n_elems(num_arg);
 }
 #endif
@@ -1755,8 +1786,29 @@ void f_mud_status PROT((void))
 		    get_current_dir(dir_buf, 1024));
 	outbuf_add(&ob, "add_message statistics\n");
 	outbuf_add(&ob, "------------------------------\n");
-	outbuf_addv(&ob, "Calls to add_message: %d   Packets: %d   Average packet size: %f\n\n",
+	outbuf_addv(&ob, "Calls to add_message: %d   Packets: %d   Average packet size: %f\n",
 	add_message_calls, inet_packets, (float) inet_volume / inet_packets);
+	outbuf_addv(&ob, "Output queued: %d chunks, %d bytes\n",
+		    num_message_chunks, message_chunk_bytes);
+#ifdef MCCP
+	outbuf_addv(&ob, "Compressed users: %d   Bytes in: %.0f   Bytes out: %.0f (%.1f%%)   Time: %.3f sec\n",
+		    num_compressed, compress_bytes_in, compress_bytes_out,
+		    compress_bytes_in ? 100 * compress_bytes_out / compress_bytes_in : 0.0,
+		    compress_usec / 1000000);
+#endif
+	outbuf_addv(&ob, "Connections accepted: %d   Waiting to log on: %d   Dropped: %d\n",
+		    connections_accepted, logons_waiting, connections_dropped);
+#ifdef NET_STATS
+	net_stats_status(&ob);
+#endif
+	poll_status(&ob);
+#ifdef RESOLVER
+	resolver_status(&ob, verbose);
+#endif
+#ifdef USE_FILE_CACHE
+	fcache_status(&ob);
+#endif
+	outbuf_add(&ob, "\n");
 
 #ifndef NO_ADD_ACTION
 	stat_living_objects(&ob);
@@ -1776,6 +1828,13 @@ void f_mud_status PROT((void))
         tot += add_string_status(&ob, verbose);
         outbuf_add(&ob, "\n");
         tot += print_call_out_usage(&ob, verbose);
+#ifdef RECLAIM_SLICE
+        outbuf_add(&ob, "\n");
+        tot += reclaim_status(&ob, verbose);
+#endif
+#ifdef RESOLVER
+        tot += resolver_status(&ob, -1);
+#endif
     } else {
 	/* !verbose */
 	outbuf_addv(&ob, "Sentences:\t\t\t%8d %8d\n", tot_alloc_sentence,
@@ -1794,12 +1853,20 @@ void f_mud_status PROT((void))
 		    total_mapping_size);
 	outbuf_addv(&ob, "Mappings(nodes):\t\t%8d\n", total_mapping_nodes);
 	outbuf_addv(&ob, "Interactives:\t\t\t%8d %8d\n", total_users,
-		    total_users * sizeof(interactive_t));
+		    total_users * sizeof(interactive_t) + input_buffer_bytes);
+	outbuf_addv(&ob, "Output chunks:\t\t\t%8d %8d\n", num_message_chunks,
+		    message_chunk_bytes);
 
 	tot = show_otable_status(&ob, verbose) +
 	    heart_beat_status(&ob, verbose) +
 	    add_string_status(&ob, verbose) +
 	    print_call_out_usage(&ob, verbose);
+#ifdef RECLAIM_SLICE
+	tot += reclaim_status(&ob, verbose);
+#endif
+#ifdef RESOLVER
+	tot += resolver_status(&ob, verbose);
+#endif
     }
 
     tot += total_prog_block_size +
@@ -1809,7 +1876,8 @@ void f_mud_status PROT((void))
 	total_mapping_size +
 	tot_alloc_sentence * sizeof(sentence_t) +
 	tot_alloc_object_size +
-	total_users * sizeof(interactive_t) +
+	total_users * sizeof(interactive_t) + input_buffer_bytes +
+	message_chunk_bytes +
 	res;
 
     if (!verbose) {
@@ -2051,6 +2119,54 @@ f_query_idle PROT((void))
 }
 #endif
 
+#ifdef F_QUERY_OUTPUT_QUEUE
+void
+f_query_output_queue PROT((void))
+{
+    int i;
+
+    i = query_output_queue(sp->u.ob);
+    free_object(sp->u.ob, "f_query_output_queue");
+    put_number(i);
+}
+#endif
+
+#ifdef F_QUERY_NET_STATS
+void
+f_query_net_stats PROT((void))
+{
+    mapping_t *m;
+
+    m = query_net_stats(sp->u.ob);
+    free_object(sp->u.ob, "f_query_net_stats");
+    sp->type = T_MAPPING;
+    sp->u.map = m;
+}
+#endif
+
+#ifdef F_COMPRESS_OUTPUT
+void
+f_compress_output PROT((void))
+{
+    compress_output((sp - 1)->u.ob, sp->u.number);
+    sp--;
+    free_object(sp->u.ob, "f_compress_output");
+    sp--;
+}
+#endif
+
+#ifdef F_COMPRESSEDP
+void
+f_compressedp PROT((void))
+{
+    int i;
+
+    i = compressedp(sp->u.ob);
+    free_object(sp->u.ob, "f_compressedp");
+    put_number(i);
+}
+#endif
+
 #ifdef F_QUERY_IP_NAME
 void
 f_query_ip_name PROT((void))
@@ -2720,7 +2836,7 @@ f_save_object PROT((void))
 {
     int flag;
 
-    flag = (st_num_arg == 2) && (sp--)->u.number;
+    flag = (st_num_arg == 2) ? (sp--)->u.number : 0;
     flag = save_object(current_object, sp->u.string, flag);
     free_string_svalue(sp);
     put_number(flag);
@@ -2748,7 +2864,7 @@ f_say PROT((void))
 #ifdef DEBUG
      1,
 #endif
-     1,
+     1, vtmp.own, &vtmp, 1, 1,
 #ifdef PACKAGE_MUDLIB_STATS
      {(mudlib_stats_t *) NULL, (mudlib_stats_t *) NULL}
 #endif
@@ -2756,7 +2872,9 @@ f_say PROT((void))
 
     if (st_num_arg == 1) {
 	avoid = &the_null_array;
+	start_broadcast(sp);
 	say(sp, avoid);
+	end_broadcast();
 	pop_stack();
     } else {
 	if (sp->type == T_OBJECT) {
@@ -2766,7 +2884,9 @@ f_say PROT((void))
 	} else {		/* must be a array... */
 	    avoid = sp->u.arr;
 	}
+	start_broadcast(sp - 1);
 	say(sp - 1, avoid);
+	end_broadcast();
 	pop_2_elems();
     }
 }
@@ -2964,7 +3084,9 @@ f_shadow PROT((void))
 void
 f_shout PROT((void))
 {
+    start_broadcast(sp);
     shout_string(sp->u.string);
+    end_broadcast();
     free_string_svalue(sp--);
 }
 #endif
@@ -3286,7 +3408,9 @@ f_tell_room PROT((void))
         avoid = arg[2].u.arr;
     }
 
+    start_broadcast(&arg[1]);
     tell_room(ob, &arg[1], avoid);
+    end_broadcast();
     free_array(avoid);
     free_svalue(arg + 1, "f_tell_room");
     free_svalue(arg, "f_tell_room");
@@ -3733,7 +3857,8 @@ f_memory_info PROT((void))
 	    total_mapping_size +
 	    tot_alloc_object_size +
 	    tot_alloc_sentence * sizeof(sentence_t) +
-	    total_users * sizeof(interactive_t) +
+	    total_users * sizeof(interactive_t) + input_buffer_bytes +
+	    message_chunk_bytes +
 	    show_otable_status(0, -1) +
 	    heart_beat_status(0, -1) +
 	    add_string_status(0, -1) +
@@ -10,6 +10,7 @@
 #include "lex.h"
 #include "backend.h"
 #include "eoperators.h"
+#include "reclaim.h"
 #include "parse.h"
 #include "swap.h"
 #ifdef TRACE
@@ -870,6 +871,7 @@ f_sub_eq()
 	{
 	    sp->u.arr = argp->u.arr = subtract_array(argp->u.arr, sp->u.arr);
 	    sp->u.arr->ref++;
+	    RECLAIM_STORE(argp);
 	    break;
 	}
 
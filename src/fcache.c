@@ -0,0 +1,524 @@
+/*
+ * fcache.c -- open files, line indexes and append buffers for the file
+ * efuns.
+ *
+ * read_file(), read_bytes() and write_bytes() used to open the file, seek,
+ * read or write, and close it again on every call, and write_file() did
+ * the same for every line a mudlib appended to a log.  read_file() of a
+ * range of lines read from the top of the file every time to count its
+ * way to the first one.
+ *
+ * Here the last FILE_CACHE_SIZE files used are kept open.  Each use
+ * stat()s the name first, and if it no longer names the file we have
+ * open (it was removed, renamed over, or rotated), we start again.  A
+ * file read by ranges of lines gets an index of where every
+ * FCACHE_LINE_STEP'th line starts, which is thrown away if the file
+ * changes size or modification time, except when the change is our own
+ * append.  write_file() appends go into a buffer for each file, written
+ * out when it fills, about once a second from the backend, and by
+ * check_valid_path() before any other efun looks at any file, so nothing
+ * in the driver ever sees a file without them.
+ */
+#include "std.h"
+#include "lpc_incl.h"
+#include "file_incl.h"
+#include "file.h"
+#include "md.h"
+#include "fcache.h"
+
+#ifdef USE_FILE_CACHE
+
+typedef struct fcache_s {
+    struct fcache_s *next;	/* least recently used last          */
+    struct fcache_s *prev;
+    char *name;			/* as check_valid_path() returned it */
+    int fd;			/* for reading, or -1                */
+    int writable;		/* fd is open for writing too        */
+    int afd;			/* O_APPEND, for write_file(), or -1 */
+    dev_t dev;			/* the file fd and afd are open on   */
+    ino_t ino;
+    int *lines;			/* offsets of lines 1, 1 + STEP, ... */
+    int num_lines;		/* entries used in lines[]           */
+    int lines_size;		/* and allocated                     */
+    int newlines;		/* in the whole file                 */
+    off_t size;			/* the file lines[] describes        */
+    time_t mtime;
+    long mtime_ns;
+    char *abuf;			/* appends not written yet           */
+    int alen;
+} fcache_t;
+
+static fcache_t *fc_head = 0, *fc_tail = 0;
+static int fc_count = 0;
+static time_t fc_buffered_time;
+static char fc_block[FCACHE_BLOCK_SIZE];
+
+int fcache_buffered = 0;	/* bytes in all the append buffers */
+
+static int fc_hits = 0;
+static int fc_opens = 0;
+static int fc_indexes = 0;
+static int fc_appends = 0;
+static int fc_writes = 0;
+
+static void fc_unlink P1(fcache_t *, e)
+{
+    if (e->prev)
+	e->prev->next = e->next;
+    else
+	fc_head = e->next;
+    if (e->next)
+	e->next->prev = e->prev;
+    else
+	fc_tail = e->prev;
+}
+
+static void fc_push P1(fcache_t *, e)
+{
+    e->prev = 0;
+    e->next = fc_head;
+    if (fc_head)
+	fc_head->prev = e;
+    else
+	fc_tail = e;
+    fc_head = e;
+}
+
+/* find name, and make it the most recently used */
+static fcache_t *fc_find P1(char *, name)
+{
+    fcache_t *e;
+
+    for (e = fc_head; e; e = e->next) {
+	if (!strcmp(e->name, name)) {
+	    if (e != fc_head) {
+		fc_unlink(e);
+		fc_push(e);
+	    }
+	    return e;
+	}
+    }
+    return 0;
+}
+
+static int fc_current P2(fcache_t *, e, struct stat *, st)
+{
+    return e->dev == st->st_dev && e->ino == st->st_ino;
+}
+
+static int fc_unchanged P2(fcache_t *, e, struct stat *, st)
+{
+    return e->size == st->st_size && e->mtime == st->st_mtime
+#ifdef HAS_ST_MTIM
+	&& e->mtime_ns == st->st_mtim.tv_nsec
+#endif
+	;
+}
+
+static void fc_set_time P2(fcache_t *, e, struct stat *, st)
+{
+    e->size = st->st_size;
+    e->mtime = st->st_mtime;
+#ifdef HAS_ST_MTIM
+    e->mtime_ns = st->st_mtim.tv_nsec;
+#else
+    e->mtime_ns = 0;
+#endif
+}
+
+static void fc_drop_index P1(fcache_t *, e)
+{
+    if (e->lines) {
+	FREE(e->lines);
+	e->lines = 0;
+    }
+    e->num_lines = e->lines_size = 0;
+}
+
+/*
+ * Note the lines in n bytes of the file, starting at offset off.
+ */
+static void fc_index_data P4(fcache_t *, e, int, off, char *, buf, int, n)
+{
+    char *p, *end = buf + n;
+
+    for (p = buf; (p = (char *) memchr(p, '\n', end - p)); p++) {
+	if (++e->newlines % FCACHE_LINE_STEP)
+	    continue;
+	if (e->num_lines == e->lines_size) {
+	    e->lines_size *= 2;
+	    e->lines = RESIZE(e->lines, e->lines_size, int,
+			      TAG_FILE_CACHE, "fc_index_data");
+	}
+	e->lines[e->num_lines++] = off + (p - buf) + 1;
+    }
+}
+
+/* pread() all of n bytes, unless the file ends first */
+static int fc_pread P4(int, fd, char *, buf, int, n, int, off)
+{
+    int got = 0, r;
+
+    while (got < n) {
+	r = pread(fd, buf + got, n - got, off + got);
+	if (r == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (r == 0)
+	    break;
+	got += r;
+    }
+    return got;
+}
+
+static int fc_build_index P2(fcache_t *, e, struct stat *, st)
+{
+    int off, n = 0;
+
+    fc_drop_index(e);
+    e->lines_size = 16;
+    e->lines = CALLOCATE(e->lines_size, int, TAG_FILE_CACHE, "fc_build_index");
+    e->lines[0] = 0;
+    e->num_lines = 1;
+    e->newlines = 0;
+    for (off = 0; off < st->st_size; off += n) {
+	n = fc_pread(e->fd, fc_block, FCACHE_BLOCK_SIZE, off);
+	if (n <= 0)
+	    break;
+	fc_index_data(e, off, fc_block, n);
+    }
+    if (off != st->st_size) {
+	/* it changed while we were reading it */
+	fc_drop_index(e);
+	return 0;
+    }
+    fc_set_time(e, st);
+    fc_indexes++;
+    return 1;
+}
+
+/*
+ * Append n bytes to e's file.  If we know where its lines are, and it
+ * grows by just what we wrote, we still do afterwards.
+ */
+static void fc_write P3(fcache_t *, e, char *, buf, int, n)
+{
+    struct stat st;
+    int off = -1, r, done = 0;
+
+    if (e->lines && fstat(e->afd, &st) != -1 && fc_unchanged(e, &st))
+	off = st.st_size;
+    while (done < n) {
+	r = write(e->afd, buf + done, n - done);
+	if (r == -1) {
+	    if (errno == EINTR)
+		continue;
+	    debug_perror("write_file", e->name);
+	    break;
+	}
+	done += r;
+    }
+    fc_writes++;
+    if (e->lines) {
+	if (off != -1 && done == n && fstat(e->afd, &st) != -1
+	    && st.st_size == off + n) {
+	    fc_index_data(e, off, buf, n);
+	    fc_set_time(e, &st);
+	} else
+	    fc_drop_index(e);
+    }
+}
+
+static void fc_write_appends P1(fcache_t *, e)
+{
+    fc_write(e, e->abuf, e->alen);
+    fcache_buffered -= e->alen;
+    e->alen = 0;
+}
+
+static void fc_close P1(fcache_t *, e)
+{
+    if (e->alen)
+	fc_write_appends(e);
+    if (e->fd != -1)
+	close(e->fd);
+    if (e->afd != -1)
+	close(e->afd);
+    e->fd = e->afd = -1;
+    fc_drop_index(e);
+}
+
+static void fc_free P1(fcache_t *, e)
+{
+    fc_close(e);
+    fc_unlink(e);
+    FREE(e->name);
+    if (e->abuf)
+	FREE(e->abuf);
+    FREE(e);
+    fc_count--;
+}
+
+static fcache_t *fc_new P1(char *, name)
+{
+    fcache_t *e;
+
+    if (fc_count == FILE_CACHE_SIZE)
+	fc_free(fc_tail);
+    e = ALLOCATE(fcache_t, TAG_FILE_CACHE, "fc_new");
+    e->name = DXALLOC(strlen(name) + 1, TAG_FILE_CACHE, "fc_new");
+    strcpy(e->name, name);
+    e->fd = e->afd = -1;
+    e->writable = 0;
+    e->lines = 0;
+    e->num_lines = e->lines_size = 0;
+    e->abuf = 0;
+    e->alen = 0;
+    fc_push(e);
+    fc_count++;
+    return e;
+}
+
+/*
+ * A descriptor for name, which must already have been through
+ * check_valid_path(), and its stat() in st.  If writing, it is open for
+ * writing too, and the file is created if need be.  Returns -1 with
+ * errno set if the file can't be opened.  The cache owns the descriptor.
+ */
+int fcache_open P3(char *, name, struct stat *, st, int, writing)
+{
+    fcache_t *e;
+    int fd, err;
+
+    e = fc_find(name);
+    if (stat(name, st) == -1) {
+	err = errno;
+	if (e)
+	    fc_free(e);
+	errno = err;
+	if (!writing || err != ENOENT)
+	    return -1;
+	e = 0;
+    } else if (e) {
+	if (!fc_current(e, st))
+	    fc_close(e);
+	else if (e->fd != -1 && (e->writable || !writing)) {
+	    fc_hits++;
+	    if (writing)
+		fc_drop_index(e);
+	    return e->fd;
+	} else if (e->fd != -1) {
+	    close(e->fd);
+	    e->fd = -1;
+	}
+    }
+    fd = open(name, writing ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+    if (fd == -1)
+	return -1;
+    if (fstat(fd, st) == -1)
+	fatal("Could not stat an open file.\n");
+    if (!e)
+	e = fc_new(name);
+    else if (e->afd != -1 && !fc_current(e, st))
+	fc_close(e);
+    e->fd = fd;
+    e->writable = writing;
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    if (writing)
+	fc_drop_index(e);
+    fc_opens++;
+    return fd;
+}
+
+/*
+ * read_file() of name, which has been through check_valid_path().
+ */
+char *fcache_read_file P3(char *, name, int, start, int, len)
+{
+    struct stat st;
+    fcache_t *e;
+    int fd, size, off, end, want, n, k, whole = !len;
+    char *str, *p, *q;
+
+    if ((fd = fcache_open(name, &st, 0)) == -1 || (st.st_mode & S_IFDIR))
+	return 0;
+    e = fc_head;
+    size = st.st_size;
+    if (start < 1)
+	start = 1;
+    if (!size || (start == 1 && whole)) {
+	if (size > READ_FILE_MAX_SIZE)
+	    return 0;
+	str = new_string(size, "read_file: str");
+	if (fc_pread(fd, str, size, 0) != size) {
+	    FREE_MSTR(str);
+	    return 0;
+	}
+	str[size] = '\0';
+	return str;
+    }
+
+    if ((!e->lines || !fc_unchanged(e, &st)) && !fc_build_index(e, &st))
+	return 0;
+    if (start - 1 > e->newlines)
+	return 0;
+    /*
+     * find the start of the first line from the last indexed one
+     */
+    off = e->lines[(start - 1) / FCACHE_LINE_STEP];
+    for (k = (start - 1) % FCACHE_LINE_STEP; k; ) {
+	want = size - off;
+	if (want > FCACHE_BLOCK_SIZE)
+	    want = FCACHE_BLOCK_SIZE;
+	if ((n = fc_pread(fd, fc_block, want, off)) <= 0)
+	    return 0;
+	for (p = fc_block; k && (q = (char *) memchr(p, '\n', fc_block + n - p)); k--)
+	    p = q + 1;
+	off += k ? n : p - fc_block;
+    }
+    /*
+     * and read up to the first indexed line after the last one wanted
+     */
+    end = size;
+    if (!whole) {
+	k = (start - 1 + len + FCACHE_LINE_STEP - 1) / FCACHE_LINE_STEP;
+	if (k < e->num_lines)
+	    end = e->lines[k];
+    }
+    want = end - off;
+    if (want > READ_FILE_MAX_SIZE)
+	want = READ_FILE_MAX_SIZE;
+    str = new_string(want, "read_file: str");
+    if (fc_pread(fd, str, want, off) != want) {
+	FREE_MSTR(str);
+	return 0;
+    }
+    str[want] = '\0';
+    n = want;
+    if (!whole) {
+	for (p = str; (q = (char *) memchr(p, '\n', str + want - p)); p = q + 1) {
+	    if (!--len) {
+		n = q + 1 - str;
+		break;
+	    }
+	}
+    }
+    if ((whole || len) && off + want < size) {
+	/* tried to read more than READ_FILE_MAX_SIZE */
+	FREE_MSTR(str);
+	return 0;
+    }
+    if (memchr(str, '\0', n)) {
+	FREE_MSTR(str);
+	error("Attempted to read '\\0' into a string!\n");
+    }
+    if (n != want) {
+	str[n] = '\0';
+	str = extend_string(str, n);
+    }
+    return str;
+}
+
+/*
+ * write_file() appending to name, which has been through
+ * check_valid_path().  Returns 0 with errno set if the file can't be
+ * opened.
+ */
+int fcache_append P3(char *, name, char *, str, int, len)
+{
+    struct stat st;
+    fcache_t *e;
+    int fd;
+
+    fc_appends++;
+    e = fc_find(name);
+    if (!e || e->afd == -1 || stat(name, &st) == -1 || !fc_current(e, &st)) {
+	fd = open(name, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd == -1)
+	    return 0;
+	if (fstat(fd, &st) == -1)
+	    fatal("Could not stat an open file.\n");
+	if (!e)
+	    e = fc_new(name);
+	else if ((e->afd != -1 || e->fd != -1) && !fc_current(e, &st))
+	    fc_close(e);
+	else if (e->afd != -1)
+	    close(e->afd);
+	e->afd = fd;
+	e->dev = st.st_dev;
+	e->ino = st.st_ino;
+    }
+    if (e->alen + len > FCACHE_APPEND_SIZE && e->alen)
+	fc_write_appends(e);
+    if (len >= FCACHE_APPEND_SIZE) {
+	fc_write(e, str, len);
+	return 1;
+    }
+    if (!e->abuf)
+	e->abuf = DXALLOC(FCACHE_APPEND_SIZE, TAG_FILE_CACHE, "fcache_append");
+    memcpy(e->abuf + e->alen, str, len);
+    e->alen += len;
+    if (!fcache_buffered)
+	fc_buffered_time = time(0);
+    fcache_buffered += len;
+    return 1;
+}
+
+/*
+ * Close name, if we have it open; it is about to be removed or replaced.
+ */
+void fcache_forget P1(char *, name)
+{
+    fcache_t *e;
+
+    if ((e = fc_find(name)))
+	fc_free(e);
+}
+
+/*
+ * Write out everything write_file() has buffered.
+ */
+void fcache_sync()
+{
+    fcache_t *e;
+
+    for (e = fc_head; e && fcache_buffered; e = e->next)
+	if (e->alen)
+	    fc_write_appends(e);
+}
+
+/*
+ * Called from the backend; appends don't wait much more than a second.
+ */
+void fcache_tick()
+{
+    if (fcache_buffered && time(0) != fc_buffered_time)
+	fcache_sync();
+}
+
+void fcache_status P1(outbuffer_t *, ob)
+{
+    outbuf_addv(ob, "File cache: %d open   Hits: %d   Opens: %d   Indexed: %d   Appends: %d in %d writes, %d bytes waiting\n",
+		fc_count, fc_hits, fc_opens, fc_indexes, fc_appends,
+		fc_writes, fcache_buffered);
+}
+
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_fcache()
+{
+    fcache_t *e;
+
+    for (e = fc_head; e; e = e->next) {
+	DO_MARK(e, TAG_FILE_CACHE);
+	DO_MARK(e->name, TAG_FILE_CACHE);
+	if (e->lines)
+	    DO_MARK(e->lines, TAG_FILE_CACHE);
+	if (e->abuf)
+	    DO_MARK(e->abuf, TAG_FILE_CACHE);
+    }
+}
+#endif
+#endif
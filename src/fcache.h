@@ -0,0 +1,28 @@
+#ifndef FCACHE_H
+#define FCACHE_H
+
+#if defined(FILE_CACHE) && defined(HAS_PREAD) && !defined(WIN32) && !defined(LATTICE)
+#define USE_FILE_CACHE
+
+#define FCACHE_LINE_STEP	32	/* lines between index entries      */
+#define FCACHE_APPEND_SIZE	8192	/* write_file() buffer for each file */
+#define FCACHE_BLOCK_SIZE	65536	/* read at a time when indexing     */
+
+/*
+ * fcache.c
+ */
+extern int fcache_buffered;
+
+int fcache_open PROT((char *, struct stat *, int));
+char *fcache_read_file PROT((char *, int, int));
+int fcache_append PROT((char *, char *, int));
+void fcache_forget PROT((char *));
+void fcache_sync PROT((void));
+void fcache_tick PROT((void));
+void fcache_status PROT((outbuffer_t *));
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_fcache PROT((void));
+#endif
+#endif
+
+#endif
@@ -12,6 +12,7 @@
 #include "lex.h"
 #include "md.h"
 #include "port.h"
+#include "fcache.h"
 
 /* Removed due to hideousness: if you want to add it back, not that
  * we don't want redefinitions, and that some systems define major() in
@@ -362,6 +363,9 @@ int remove_file P1(char *, path)
 
     if (path == 0)
 	return 0;
+#ifdef USE_FILE_CACHE
+    fcache_forget(path);
+#endif
     if (unlink(path) == -1)
 	return 0;
     return 1;
@@ -472,9 +476,19 @@ int write_file P3(char *, file, char *, str, int, flags)
     char fmode[3];
 #endif
 
-    file = check_valid_path(file, current_object, "write_file", 1);
+    file = check_valid_path(file, current_object, "write_file",
+			    (flags & 1) ? 1 : 2);
     if (!file)
 	return 0;
+#ifdef USE_FILE_CACHE
+    if (!(flags & 1)) {
+	if (!fcache_append(file, str, strlen(str)))
+	    error("Wrong permissions for opening file /%s for %s.\n\"%s\"\n",
+		  file, "append", port_strerror(errno));
+	return 1;
+    }
+    fcache_forget(file);
+#endif
 #ifdef WIN32
     fmode[0] = (flags & 1) ? 'w' : 'a';
     fmode[1] = 't';
@@ -494,11 +508,13 @@ int write_file P3(char *, file, char *, str, int, flags)
 
 char *read_file P3(char *, file, int, start, int, len)
 {
+#ifndef USE_FILE_CACHE
     struct stat st;
     FILE *f;
     char *str, *end;
     register char *p, *p2;
     int size;
+#endif
 
     if (len < 0)
 	return 0;
@@ -506,6 +522,9 @@ char *read_file P3(char *, file, int, start, int, len)
 
     if (!file)
 	return 0;
+#ifdef USE_FILE_CACHE
+    return fcache_read_file(file, start, len);
+#else
 
     /*
      * file doesn't exist, or is really a directory
@@ -689,12 +708,17 @@ char *read_file P3(char *, file, int, start, int, len)
 
     fclose(f);
     return str;
+#endif
 }				/* read_file() */
 
 char *read_bytes P4(char *, file, int, start, int, len, int *, rlen)
 {
     struct stat st;
+#ifdef USE_FILE_CACHE
+    int fd;
+#else
     FILE *fp;
+#endif
     char *str;
     int size;
 
@@ -704,6 +728,10 @@ char *read_bytes P4(char *, file, int, start, int, len, int *, rlen)
 			    "read_bytes", 0);
     if (!file)
 	return 0;
+#ifdef USE_FILE_CACHE
+    if ((fd = fcache_open(file, &st, 0)) == -1)
+	return 0;
+#else
 #ifdef LATTICE
     if (stat(file, &st) == -1)
 	return 0;
@@ -714,6 +742,7 @@ char *read_bytes P4(char *, file, int, start, int, len, int *, rlen)
 #ifndef LATTICE
     if (fstat(fileno(fp), &st) == -1)
 	fatal("Could not stat an open file.\n");
+#endif
 #endif
     size = st.st_size;
     if (start < 0)
@@ -726,12 +755,19 @@ char *read_bytes P4(char *, file, int, start, int, len, int *, rlen)
 	return 0;
     }
     if (start >= size) {
+#ifndef USE_FILE_CACHE
 	fclose(fp);
+#endif
 	return 0;
     }
     if ((start + len) > size)
 	len = (size - start);
 
+#ifdef USE_FILE_CACHE
+    str = new_string(len, "read_bytes: str");
+
+    size = pread(fd, str, len, start);
+#else
     if ((size = fseek(fp, start, 0)) < 0)
 	return 0;
 
@@ -740,6 +776,7 @@ char *read_bytes P4(char *, file, int, start, int, len, int *, rlen)
     size = fread(str, 1, len, fp);
 
     fclose(fp);
+#endif
 
     if (size <= 0) {
 	FREE_MSTR(str);
@@ -758,7 +795,11 @@ int write_bytes P4(char *, file, int, start, char *, str, int, theLength)
 {
     struct stat st;
     int size;
+#ifdef USE_FILE_CACHE
+    int fd;
+#else
     FILE *fp;
+#endif
 
     file = check_valid_path(file, current_object, "write_bytes", 1);
 
@@ -766,6 +807,16 @@ int write_bytes P4(char *, file, int, start, char *, str, int, theLength)
 	return 0;
     if (theLength > MAX_BYTE_TRANSFER)
 	return 0;
+#ifdef USE_FILE_CACHE
+    if ((fd = fcache_open(file, &st, 1)) == -1)
+	return 0;
+    size = st.st_size;
+    if (start < 0)
+	start = size + start;
+    if (start < 0 || start > size)
+	return 0;
+    size = pwrite(fd, str, theLength, start);
+#else
     /* Under system V, it isn't possible change existing data in a file
      * opened for append, so it can't be opened for append.
      * opening for r+ won't create the file if it doesn't exist.
@@ -798,6 +849,7 @@ int write_bytes P4(char *, file, int, start, char *, str, int, theLength)
     size = fwrite(str, 1, theLength, fp);
 
     fclose(fp);
+#endif
 
     if (size <= 0) {
 	return 0;
@@ -853,6 +905,9 @@ int file_size P1(char *, file)
  * If the path was '/', then '.' is returned.
  * Otherwise, the returned path is temporarily allocated by apply(), which
  * means it will be deallocated at next apply().
+ * writeflg is 0 to read, 1 to write, and 2 for write_file() appending,
+ * which is the only use that doesn't need buffered appends written out
+ * first.
  */
 char *check_valid_path P4(char *, path, object_t *, call_object, char *, call_fun, int, writeflg)
 {
@@ -897,6 +952,10 @@ char *check_valid_path P4(char *, path, object_t *, call_object, char *, call_fu
 #ifndef LATTICE
     if (path[0] == '\0')
 	path = ".";
+#endif
+#ifdef USE_FILE_CACHE
+    if (fcache_buffered && writeflg != 2)
+	fcache_sync();
 #endif
     if (legal_path(path))
 	return path;
@@ -1042,6 +1101,10 @@ static int copy P2(char *, from, char *, to)
 #ifdef F_RENAME
 static int do_move P3(char *, from, char *, to, int, flag)
 {
+#ifdef USE_FILE_CACHE
+    fcache_forget(from);
+    fcache_forget(to);
+#endif
     if (lstat(from, &from_stats) != 0) {
 	error("/%s: lstat failed\n", from);
 	return 1;
@@ -1215,6 +1278,9 @@ int copy_file P2(char *, from, char *, to)
 	return -2;
 
     assign_svalue(&to_sv, &apply_ret_value);
+#ifdef USE_FILE_CACHE
+    fcache_forget(to);
+#endif
 
     from_fd = open(from, OPEN_READ);
     if (from_fd < 0)
@@ -47,9 +47,9 @@ string capitalize(string);
 string *explode(string, string);
 mixed implode(mixed *, string | function, void | mixed);
 #ifdef CALLOUT_HANDLES
-int call_out(string | function, int,...);
+int call_out(string | function, int | float,...);
 #else
-void call_out(string | function, int,...);
+void call_out(string | function, int | float,...);
 #endif
 int member_array(mixed, string | mixed *, void | int);
 int input_to(string | function,...);
@@ -206,6 +206,14 @@ void message(mixed, mixed, string | string * | object | object *,
     object *objects(void | string | function, void | object);
     string query_host_name();
     int query_idle(object);
+    int query_output_queue(object);
+#ifdef NET_STATS
+    mapping query_net_stats(object);
+#endif
+#ifdef MCCP
+    void compress_output(object, int);
+    int compressedp(object);
+#endif
     string query_ip_name(void | object);
     string query_ip_number(void | object);
     object query_snoop(object);
@@ -28,7 +28,7 @@ typedef struct {
 
 /* common header */
 typedef struct {
-    unsigned short ref;
+    unsigned int ref;
     short type;                 /* FP_* is used */
 #ifdef DEBUG
     int extra_ref;
@@ -78,3 +78,21 @@ whashstr P2(char *, s, int, maxn)
 
     return (oh << 8) + h;
 }
+
+/*
+ * FNV-1a over the whole string, for tables too big for the 16 bits that
+ * whashstr() gives; mask off as many low bits as needed.
+ */
+
+INLINE unsigned int
+fnv_hashstr P1(char *, s)
+{
+    register unsigned int h = 2166136261U;
+    register unsigned char *p = (unsigned char *) s;
+
+    while (*p) {
+	h ^= *p++;
+	h *= 16777619;
+    }
+    return h;
+}
@@ -6,5 +6,6 @@
  */
 int hashstr PROT((char *, int, int));
 int whashstr PROT((char *, int));
+unsigned int fnv_hashstr PROT((char *));
 
 #endif
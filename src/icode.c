@@ -26,6 +26,7 @@ static void i_generate_loop PROT((int, parse_node_t *, parse_node_t *,
 				  parse_node_t *));
 static void i_update_branch_list PROT((parse_node_t *));
 static int try_to_push PROT((int, int));
+static void fused_forward_branch PROT((void));
 
 /*
    this variable is used to properly adjust the 'break_sp' stack in
@@ -44,6 +45,28 @@ static int push_start;
 
 static parse_node_t *branch_list[3];
 
+/*
+ * Superinstructions.  A few very common short sequences are emitted as a
+ * single instruction (OPCPROF_2D's pair counts are the place to look for
+ * more candidates):
+ *
+ *   if (lv1 OP lv2)		local, local, branch_X   -> branch_locals
+ *   if (x == "str")		..., string, branch_X    -> branch_string
+ *   lv[x]			..., local, index        -> local_index
+ *   lv->member			local, member            -> local_member
+ *   gv->fun()			global, string, call_other -> global_call_other
+ *
+ * Only plain F_LOCAL nodes are fused; transfer_local and function
+ * parameters are left alone.
+ */
+#define IS_PLAIN_LOCAL(x) IS_NODE(x, NODE_OPCODE_1, F_LOCAL)
+
+static void
+fused_forward_branch() {
+    ins_short(current_forward_branch);
+    current_forward_branch = CURRENT_PROGRAM_SIZE - 2;
+}
+
 static void ins_real P1(double, l)
 {
     float f = (float)l;
@@ -329,6 +352,13 @@ i_generate_node P1(parse_node_t *, expr) {
 	i_generate_node(expr->l.expr);
 	expr = expr->r.expr;
     case NODE_BINARY_OP:
+	if (expr->v.number == F_INDEX && IS_PLAIN_LOCAL(expr->r.expr)) {
+	    i_generate_node(expr->l.expr);
+	    end_pushes();
+	    ins_byte(F_LOCAL_INDEX);
+	    ins_byte(expr->r.expr->l.number);
+	    break;
+	}
 	i_generate_node(expr->l.expr);
 	/* fall through */
     case NODE_UNARY_OP:
@@ -350,6 +380,13 @@ i_generate_node P1(parse_node_t *, expr) {
 	ins_byte(expr->type);
 	break;
     case NODE_UNARY_OP_1:
+	if (expr->v.number == F_MEMBER && IS_PLAIN_LOCAL(expr->r.expr)) {
+	    end_pushes();
+	    ins_byte(F_LOCAL_MEMBER);
+	    ins_byte(expr->r.expr->l.number);
+	    ins_byte(expr->l.number);
+	    break;
+	}
 	i_generate_node(expr->r.expr);
 	/* fall through */
     case NODE_OPCODE_1:
@@ -687,8 +724,32 @@ i_generate_node P1(parse_node_t *, expr) {
 	    int novalue_used = expr->v.number & NOVALUE_USED_FLAG;
 	    int f = expr->v.number & ~NOVALUE_USED_FLAG;
 	    
+#ifdef F_CALL_OTHER
+	    if (f == F_CALL_OTHER && num_call_other_sites < USHRT_MAX
+		&& expr->l.number == 2 && !(expr->r.expr->type & 1)
+		&& IS_NODE(expr->r.expr->v.expr, NODE_OPCODE_1, F_GLOBAL)
+		&& expr->r.expr->r.expr->v.expr->kind == NODE_STRING) {
+		end_pushes();
+		ins_byte(F_GLOBAL_CALL_OTHER);
+		ins_byte(expr->r.expr->v.expr->l.number);
+		ins_short(expr->r.expr->r.expr->v.expr->v.number);
+		ins_byte(2);
+		ins_short(num_call_other_sites++);
+		if (novalue_used)
+		    ins_byte(F_CONST0);
+		break;
+	    }
+#endif
 	    generate_expr_list(expr->r.expr);
 	    end_pushes();
+#ifdef F_CALL_OTHER
+	    /* give each call_other its own inline cache; see apply_low() */
+	    if (f == F_CALL_OTHER && num_call_other_sites < USHRT_MAX) {
+		ins_byte(F_CACHED_CALL_OTHER);
+		ins_byte(expr->l.number);
+		ins_short(num_call_other_sites++);
+	    } else
+#endif
 	    if (f < ONEARG_MAX) {
 		ins_byte(f);
 	    } else {
@@ -790,8 +851,35 @@ i_generate_if_branch P2(parse_node_t *, node, int, invert) {
 	}
     }
     if (generate_both) {
-	i_generate_node(node->l.expr);
-	i_generate_node(node->r.expr);
+	parse_node_t *l = node->l.expr, *r = node->r.expr;
+
+	if (IS_PLAIN_LOCAL(l) && IS_PLAIN_LOCAL(r)) {
+	    if (l->line && l->line != line_being_generated)
+		switch_to_line(l->line);
+	    end_pushes();
+	    ins_byte(F_BRANCH_LOCALS);
+	    ins_byte(branch);
+	    ins_byte(l->l.number);
+	    ins_byte(r->l.number);
+	    fused_forward_branch();
+	    return;
+	}
+	if ((branch == F_BRANCH_NE || branch == F_BRANCH_EQ) &&
+	    (l->kind == NODE_STRING || r->kind == NODE_STRING)) {
+	    if (r->kind != NODE_STRING) {
+		l = r;
+		r = node->l.expr;
+	    }
+	    i_generate_node(l);
+	    end_pushes();
+	    ins_byte(F_BRANCH_STRING);
+	    ins_byte(branch);
+	    ins_short(r->v.number);
+	    fused_forward_branch();
+	    return;
+	}
+	i_generate_node(l);
+	i_generate_node(r);
     } else {
 	i_generate_node(node);
     }
@@ -937,9 +1025,20 @@ optimize_icode P3(char *, start, char *, pc, char *, end) {
 	    pc += 4;
 	    break;
 	case F_SIMUL_EFUN:
+	case F_CACHED_CALL_OTHER:
 	case F_CALL_FUNCTION_BY_ADDRESS:
 	    pc += 3;
 	    break;
+	case F_GLOBAL_CALL_OTHER:
+	    pc += 6;
+	    break;
+	case F_BRANCH_LOCALS:
+	case F_BRANCH_STRING:
+	    pc += 5;
+	    break;
+	case F_LOCAL_MEMBER:
+	    pc += 2;
+	    break;
 	case F_BRANCH:
 	case F_BRANCH_WHEN_ZERO:
 	case F_BRANCH_WHEN_NON_ZERO:
@@ -1045,6 +1144,7 @@ optimize_icode P3(char *, start, char *, pc, char *, end) {
 	case F_WHILE_DEC:
 	case F_LOCAL:
 	case F_LOCAL_LVALUE:
+	case F_LOCAL_INDEX:
 	case F_SSCANF:
 	case F_PARSE_COMMAND:
 	case F_BYTE:
@@ -0,0 +1,9 @@
+/* flags for the second argument to save_object() */
+
+#define SAVE_ZEROS	1	/* save variables that are 0 as well */
+#define SAVE_BINARY	0x10000	/* use the binary save file format */
+
+/*
+ * Any other nonzero value still means SAVE_ZEROS, as it did before there
+ * were flags, so save_object(file, 2) saves zeros in the text format.
+ */
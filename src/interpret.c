@@ -18,6 +18,7 @@
 #include "qsort.h"
 #include "compiler.h"
 #include "regexp.h"
+#include "reclaim.h"
 
 #ifdef OPCPROF
 #include "opc.h"
@@ -59,6 +60,7 @@ static void do_trace_call PROT((int));
 void break_point PROT((void));
 INLINE_STATIC void do_loop_cond_number PROT((void));
 INLINE_STATIC void do_loop_cond_local PROT((void));
+INLINE_STATIC void push_variable PROT((svalue_t *));
 static void do_catch PROT((char *, unsigned short));
 #ifdef DEBUG
 int last_instructions PROT((void));
@@ -107,7 +109,7 @@ int function_index_offset;	/* Needed for inheritance */
 int variable_index_offset;	/* Needed for inheritance */
 int st_num_arg;
 
-static svalue_t start_of_stack[CFG_EVALUATOR_STACK_SIZE];
+svalue_t start_of_stack[CFG_EVALUATOR_STACK_SIZE];
 svalue_t *end_of_stack = start_of_stack + CFG_EVALUATOR_STACK_SIZE - 5;
 
 /* Used to throw an error to a catch */
@@ -302,6 +304,21 @@ INLINE_STATIC svalue_t *find_value P1(int, num)
 #define find_value(num) (&current_object->variables[num])
 #endif
 
+/*
+ * Push the value of a local or global variable, the way F_LOCAL and
+ * F_GLOBAL do: a variable that points to a destructed object is replaced
+ * with 0.
+ */
+INLINE_STATIC void push_variable P1(svalue_t *, s)
+{
+    if ((s->type == T_OBJECT) && (s->u.ob->flags & O_DESTRUCTED)) {
+	*++sp = const0;
+	assign_svalue(s, &const0);
+    } else {
+	assign_svalue_no_free(++sp, s);
+    }
+}
+
 INLINE void
 free_string_svalue P1(svalue_t *, v)
 {
@@ -623,6 +640,8 @@ INLINE void push_indexed_lvalue P1(int, code)
 		 if (code) ind = lv->u.arr->size - ind;
 		 if (ind >= lv->u.arr->size || ind < 0)
 		     error("Array index out of bounds\n");
+		 if (ARRAY_SHARED(lv->u.arr))
+		     unshare_array(lv->u.arr);
 		 sp->type = T_LVALUE;
 		 sp->u.lvalue = lv->u.arr->item + ind;
 		 break;
@@ -678,6 +697,8 @@ INLINE void push_indexed_lvalue P1(int, code)
 		if (code) ind = sp->u.arr->size - ind;
 		if (ind >= sp->u.arr->size || ind < 0)
 		    error("Array index out of bounds.\n");
+		if (ARRAY_SHARED(sp->u.arr))
+		    unshare_array(sp->u.arr);
 		sp->u.arr->ref--;
 		(--sp)->type = T_LVALUE;
 		sp->u.lvalue = (sp+1)->u.arr->item + ind;
@@ -743,6 +764,63 @@ INLINE void push_lvalue_range P1(int, code)
     sp->u.lvalue = &global_lvalue_range_sv;
 }
 
+/*
+ * Make room for fsize elements in place of ind1 .. ind2 - 1 of the array
+ * held by owner and return where they go; the caller fills them in.  An
+ * array that nothing else refers to is resized where it is, a shared one
+ * is copied.
+ */
+static svalue_t *resize_lvalue_range P5(svalue_t *, owner, int, ind1,
+					int, ind2, int, size, int, fsize)
+{
+    array_t *old_dv = owner->u.arr, *dv;
+    svalue_t *old_dptr, *dptr, *ret;
+    int n = size - ind2 + ind1 + fsize;
+
+    if (ARRAY_PRIVATE(old_dv) && n) {
+	for (dptr = old_dv->item + ind1; dptr < old_dv->item + ind2; dptr++)
+	    free_svalue(dptr, "resize_lvalue_range");
+	if (n < size)
+	    memmove(old_dv->item + ind1 + fsize, old_dv->item + ind2,
+		    (size - ind2) * sizeof(svalue_t));
+	dv = RESIZE_ARRAY(old_dv, n);
+	if (!dv)
+	    fatal("Out of memory.\n");
+	if (n > size)
+	    memmove(dv->item + ind1 + fsize, dv->item + ind2,
+		    (size - ind2) * sizeof(svalue_t));
+	dv->size = n;
+#ifdef ARRAY_STATS
+	total_array_size += (n - size) * sizeof(svalue_t);
+#endif
+#ifdef PACKAGE_MUDLIB_STATS
+	add_array_size(&dv->stats, n - size);
+#endif
+	owner->u.arr = dv;
+	return dv->item + ind1;
+    }
+
+    /* Need to reallocate the array */
+    old_dptr = old_dv->item;
+    dv = allocate_empty_array(n);
+    dptr = dv->item;
+
+    /* ind1 can range from 0 to sizeof(old_dv) */
+    while (ind1--) assign_svalue_no_free(dptr++, old_dptr++);
+    ret = dptr;
+
+    /* ind2 can range from 0 to sizeof(old_dv) */
+    old_dptr = old_dv->item + ind2;
+    dptr += fsize;
+    size -= ind2;
+
+    while (size--) assign_svalue_no_free(dptr++, old_dptr++);
+    free_array(old_dv);
+
+    owner->u.arr = dv;
+    return ret;
+}
+
 INLINE void copy_lvalue_range P1(svalue_t *, from)
 {
     int ind1, ind2, size, fsize;
@@ -756,7 +834,7 @@ INLINE void copy_lvalue_range P1(svalue_t *, from)
     switch(owner->type){
     case T_ARRAY:
 	{
-	    array_t *fv, *dv;
+	    array_t *fv;
 	    svalue_t *fptr, *dptr;
 	    if (from->type != T_ARRAY) error("Illegal rhs to array range lvalue\n");
 	    
@@ -764,9 +842,11 @@ INLINE void copy_lvalue_range P1(svalue_t *, from)
 	    fptr = fv->item;
 	    
 	    if ((fsize = fv->size) == ind2 - ind1){
+		if (ARRAY_SHARED(owner->u.arr))
+		    unshare_array(owner->u.arr);
 		dptr = (owner->u.arr)->item + ind1;
 		
-		if (fv->ref == 1){
+		if (ARRAY_PRIVATE(fv)){
 		    /* Transfer the svalues */
 		    while (fsize--){
 			free_svalue(dptr, "copy_lvalue_range : 1");
@@ -775,35 +855,18 @@ INLINE void copy_lvalue_range P1(svalue_t *, from)
 		    free_empty_array(fv);
 		} else {
 		    while (fsize--) assign_svalue(dptr++, fptr++);
-		    fv->ref--;
+		    free_array(fv);
 		}
 	    } else {
-		array_t *old_dv = owner->u.arr;
-		svalue_t *old_dptr = old_dv->item;
+		dptr = resize_lvalue_range(owner, ind1, ind2, size, fsize);
 		
-		/* Need to reallocate the array */
-		dv = allocate_empty_array(size - ind2 + ind1 + fsize);
-		dptr = dv->item;
-		
-		/* ind1 can range from 0 to sizeof(old_dv) */
-		while (ind1--) assign_svalue_no_free(dptr++, old_dptr++);
-		
-		if (fv->ref == 1){
+		if (ARRAY_PRIVATE(fv)){
 		    while (fsize--) *dptr++ = *fptr++;
 		    free_empty_array(fv);
 		} else {
 		    while (fsize--) assign_svalue_no_free(dptr++, fptr++);
-		    fv->ref--;
+		    free_array(fv);
 		}
-		
-		/* ind2 can range from 0 to sizeof(old_dv) */
-		old_dptr = old_dv->item + ind2;
-		size -= ind2;
-		
-		while (size--) assign_svalue_no_free(dptr++, old_dptr++);
-		free_array(old_dv);
-		
-		owner->u.arr = dv;
 	    }
 	    break;
 	}
@@ -883,7 +946,7 @@ INLINE void assign_lvalue_range P1(svalue_t *, from)
     switch(owner->type){
     case T_ARRAY:
 	{
-	    array_t *fv, *dv;
+	    array_t *fv;
 	    svalue_t *fptr, *dptr;
 	    if (from->type != T_ARRAY) error("Illegal rhs to array range lvalue\n");
 	    
@@ -891,29 +954,13 @@ INLINE void assign_lvalue_range P1(svalue_t *, from)
 	    fptr = fv->item;
 	    
 	    if ((fsize = fv->size) == ind2 - ind1){
+		if (ARRAY_SHARED(owner->u.arr))
+		    unshare_array(owner->u.arr);
 		dptr = (owner->u.arr)->item + ind1;
 		while (fsize--) assign_svalue(dptr++, fptr++);
 	    } else {
-		array_t *old_dv = owner->u.arr;
-		svalue_t *old_dptr = old_dv->item;
-		
-		/* Need to reallocate the array */
-		dv = allocate_empty_array(size - ind2 + ind1 + fsize);
-		dptr = dv->item;
-		
-		/* ind1 can range from 0 to sizeof(old_dv) */
-		while (ind1--) assign_svalue_no_free(dptr++, old_dptr++);
-		
+		dptr = resize_lvalue_range(owner, ind1, ind2, size, fsize);
 		while (fsize--) assign_svalue_no_free(dptr++, fptr++);
-		
-		/* ind2 can range from 0 to sizeof(old_dv) */
-		old_dptr = old_dv->item + ind2;
-		size -= ind2;
-		
-		while (size--) assign_svalue_no_free(dptr++, old_dptr++);
-		free_array(old_dv);
-		
-		owner->u.arr = dv;
 	    }
 	    break;
 	}
@@ -1753,7 +1800,42 @@ static char *previous_pc[60];
 static int last;
 #endif
 
-void
+/*
+ * Threaded dispatch.  With USE_COMPUTED_GOTO, and a compiler that can take
+ * the address of a label, each handler fetches the next instruction itself
+ * and jumps straight to its handler through dispatch_table, instead of
+ * going back round the loop and through the switch's range check.  The
+ * case labels are all still there, and the top of the loop is still used
+ * whenever eval_cost is about to run out, so the switch path is unchanged.
+ * Not used with DEBUG or any of the tracing and profiling options, which
+ * want to see every instruction go past the top of the loop.
+ */
+#if defined(USE_COMPUTED_GOTO) && defined(HAS_COMPUTED_GOTO) && \
+    !defined(DEBUG) && !defined(TRACE_CODE) && !defined(TRACE) && \
+    !defined(OPCPROF) && !defined(OPCPROF_2D)
+#  define THREADED_DISPATCH
+#  define CASE(x) case x: L_##x
+#  define DEFAULT default: L_default
+#  if defined(__GNUC__) && !defined(__clang__)
+/* keep gcc from merging all the copies of the dispatch back into one */
+#    define EVAL_INSTRUCTION_ATTR __attribute__((optimize("no-crossjumping")))
+#  endif
+#  define NEXT_INSTRUCTION \
+	if (eval_cost > 1) { \
+	    eval_cost--; \
+	    instruction = EXTRACT_UCHAR(pc++); \
+	    goto *dispatch_table[instruction]; \
+	} else break
+#else
+#  define CASE(x) case x
+#  define DEFAULT default
+#  define NEXT_INSTRUCTION break
+#endif
+#ifndef EVAL_INSTRUCTION_ATTR
+#  define EVAL_INSTRUCTION_ATTR
+#endif
+
+EVAL_INSTRUCTION_ATTR void
 eval_instruction P1(char *, p)
 {
 #ifdef DEBUG
@@ -1772,6 +1854,144 @@ eval_instruction P1(char *, p)
     static func_t *ooefun_table = efun_table - BASE;
 #endif
     static instr_t *instrs2 = instrs + ONEARG_MAX;
+#ifdef THREADED_DISPATCH
+#define T(x) [x] = &&L_##x
+    static void *dispatch_table[256] = {
+	[0 ... BASE - 1] = &&dispatch_switch,
+	[BASE ... 255] = &&L_default,
+	T(F_PUSH),
+	T(F_INC),
+	T(F_WHILE_DEC),
+	T(F_LOCAL_LVALUE),
+	T(F_NUMBER),
+	T(F_REAL),
+	T(F_BYTE),
+	T(F_NBYTE),
+#ifdef F_JUMP_WHEN_NON_ZERO
+	T(F_JUMP_WHEN_NON_ZERO),
+#endif
+	T(F_BRANCH),
+	T(F_BBRANCH),
+	T(F_BRANCH_NE),
+	T(F_BRANCH_GE),
+	T(F_BRANCH_LE),
+	T(F_BRANCH_EQ),
+	T(F_BBRANCH_LT),
+	T(F_BRANCH_LOCALS),
+	T(F_BRANCH_STRING),
+	T(F_BRANCH_WHEN_ZERO),
+	T(F_BRANCH_WHEN_NON_ZERO),
+	T(F_BBRANCH_WHEN_ZERO),
+	T(F_BBRANCH_WHEN_NON_ZERO),
+	T(F_LOR),
+	T(F_LAND),
+	T(F_LOOP_INCR),
+	T(F_LOOP_COND_LOCAL),
+	T(F_LOOP_COND_NUMBER),
+	T(F_TRANSFER_LOCAL),
+	T(F_LOCAL),
+	T(F_LT),
+	T(F_ADD),
+	T(F_VOID_ADD_EQ),
+	T(F_ADD_EQ),
+	T(F_AND),
+	T(F_AND_EQ),
+	T(F_FUNCTION_CONSTRUCTOR),
+	T(F_FOREACH),
+	T(F_NEXT_FOREACH),
+	T(F_EXIT_FOREACH),
+	T(F_EXPAND_VARARGS),
+	T(F_NEW_CLASS),
+	T(F_NEW_EMPTY_CLASS),
+	T(F_AGGREGATE),
+	T(F_AGGREGATE_ASSOC),
+	T(F_ASSIGN),
+	T(F_VOID_ASSIGN_LOCAL),
+	T(F_VOID_ASSIGN),
+	T(F_CALL_FUNCTION_BY_ADDRESS),
+	T(F_CALL_INHERITED),
+	T(F_COMPL),
+	T(F_CONST0),
+	T(F_CONST1),
+	T(F_PRE_DEC),
+	T(F_DEC),
+	T(F_DIVIDE),
+	T(F_DIV_EQ),
+	T(F_EQ),
+	T(F_GE),
+	T(F_GT),
+	T(F_GLOBAL),
+	T(F_PRE_INC),
+	T(F_MEMBER),
+	T(F_LOCAL_MEMBER),
+	T(F_MEMBER_LVALUE),
+	T(F_LOCAL_INDEX),
+	T(F_INDEX),
+	T(F_RINDEX),
+#ifdef F_JUMP_WHEN_ZERO
+	T(F_JUMP_WHEN_ZERO),
+#endif
+#ifdef F_JUMP
+	T(F_JUMP),
+#endif
+	T(F_LE),
+	T(F_LSH),
+	T(F_LSH_EQ),
+	T(F_MOD),
+	T(F_MOD_EQ),
+	T(F_MULTIPLY),
+	T(F_MULT_EQ),
+	T(F_NE),
+	T(F_NEGATE),
+	T(F_NOT),
+	T(F_OR),
+	T(F_OR_EQ),
+	T(F_PARSE_COMMAND),
+	T(F_POP_VALUE),
+	T(F_POST_DEC),
+	T(F_POST_INC),
+	T(F_GLOBAL_LVALUE),
+	T(F_INDEX_LVALUE),
+	T(F_RINDEX_LVALUE),
+	T(F_NN_RANGE_LVALUE),
+	T(F_RN_RANGE_LVALUE),
+	T(F_RR_RANGE_LVALUE),
+	T(F_NR_RANGE_LVALUE),
+	T(F_NN_RANGE),
+	T(F_RN_RANGE),
+	T(F_NR_RANGE),
+	T(F_RR_RANGE),
+	T(F_NE_RANGE),
+	T(F_RE_RANGE),
+	T(F_RETURN_ZERO),
+	T(F_RETURN),
+	T(F_RSH),
+	T(F_RSH_EQ),
+	T(F_SSCANF),
+	T(F_STRING),
+	T(F_SHORT_STRING),
+	T(F_SUBTRACT),
+	T(F_SUB_EQ),
+	T(F_SIMUL_EFUN),
+#ifdef F_CALL_OTHER
+	T(F_GLOBAL_CALL_OTHER),
+	T(F_CACHED_CALL_OTHER),
+#endif
+	T(F_SWITCH),
+	T(F_XOR),
+	T(F_XOR_EQ),
+	T(F_CATCH),
+	T(F_END_CATCH),
+	T(F_TIME_EXPRESSION),
+	T(F_END_TIME_EXPRESSION),
+	T(F_EFUN0),
+	T(F_EFUN1),
+	T(F_EFUN2),
+	T(F_EFUN3),
+	T(F_EFUNV),
+    };
+#undef T
+#endif
     
     IF_DEBUG(svalue_t *expected_stack);
 
@@ -1824,8 +2044,12 @@ eval_instruction P1(char *, p)
 	 * LPC must return a value. This does not apply to control
 	 * instructions, like F_JUMP.
 	 */
+#ifdef THREADED_DISPATCH
+	goto *dispatch_table[instruction];
+      dispatch_switch:
+#endif
 	switch (instruction) {
-	case F_PUSH:		/* Push a number of things onto the stack */
+	CASE(F_PUSH):		/* Push a number of things onto the stack */
 	    n = EXTRACT_UCHAR(pc++);
 	    while (n--) {
 		i = EXTRACT_UCHAR(pc++);
@@ -1861,8 +2085,8 @@ eval_instruction P1(char *, p)
 		    break;
 		}
 	    }
-	    break;
-	case F_INC:
+	    NEXT_INSTRUCTION;
+	CASE(F_INC):
 	    DEBUG_CHECK(sp->type != T_LVALUE,
 			"non-lvalue argument to ++\n");
 	    lval = (sp--)->u.lvalue;
@@ -1882,8 +2106,8 @@ eval_instruction P1(char *, p)
 	    default:
 		error("++ of non-numeric argument\n");
 	    }
-	    break;
-	case F_WHILE_DEC:
+	    NEXT_INSTRUCTION;
+	CASE(F_WHILE_DEC):
 	    {
 		svalue_t *s;
 
@@ -1902,27 +2126,27 @@ eval_instruction P1(char *, p)
 		    pc += 2;
 		}
 	    }
-	    break;
-	case F_LOCAL_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_LOCAL_LVALUE):
 	    (++sp)->type = T_LVALUE;
 	    sp->u.lvalue = fp + EXTRACT_UCHAR(pc++);
-	    break;
-	case F_NUMBER:
+	    NEXT_INSTRUCTION;
+	CASE(F_NUMBER):
 	    LOAD_INT(i, pc);
 	    push_number(i);
-	    break;
-	case F_REAL:
+	    NEXT_INSTRUCTION;
+	CASE(F_REAL):
 	    LOAD_FLOAT(real, pc);
 	    push_real(real);
-	    break;
-	case F_BYTE:
+	    NEXT_INSTRUCTION;
+	CASE(F_BYTE):
 	    push_number(EXTRACT_UCHAR(pc++));
-	    break;
-	case F_NBYTE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NBYTE):
 	    push_number(-((int)EXTRACT_UCHAR(pc++)));
-	    break;
+	    NEXT_INSTRUCTION;
 #ifdef F_JUMP_WHEN_NON_ZERO
-	case F_JUMP_WHEN_NON_ZERO:
+	CASE(F_JUMP_WHEN_NON_ZERO):
 	    if ((i = (sp->type == T_NUMBER)) && (sp->u.number == 0))
 		pc += 2;
 	    else {
@@ -1935,57 +2159,134 @@ eval_instruction P1(char *, p)
 	    } else {
 		pop_stack();
 	    }
-	    break;
+	    NEXT_INSTRUCTION;
 #endif
-	case F_BRANCH:		/* relative offset */
+	CASE(F_BRANCH):		/* relative offset */
 	    COPY_SHORT(&offset, pc);
 	    pc += offset;
-	    break;
-	case F_BBRANCH:		/* relative offset */
+	    NEXT_INSTRUCTION;
+	CASE(F_BBRANCH):		/* relative offset */
 	    COPY_SHORT(&offset, pc);
 	    pc -= offset;
-	    break;
-	case F_BRANCH_NE:
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_NE):
 	    f_ne();
 	    if ((sp--)->u.number) {
 		COPY_SHORT(&offset, pc);
 		pc += offset;
 	    } else
 		pc += 2;
-	    break;
-	case F_BRANCH_GE:
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_GE):
 	    f_ge();
 	    if ((sp--)->u.number) {
 		COPY_SHORT(&offset, pc);
 		pc += offset;
 	    } else
 		pc += 2;
-	    break;
-	case F_BRANCH_LE:
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_LE):
 	    f_le();
 	    if ((sp--)->u.number) {
 		COPY_SHORT(&offset, pc);
 		pc += offset;
 	    } else
 		pc += 2;
-	    break;
-	case F_BRANCH_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_EQ):
 	    f_eq();
 	    if ((sp--)->u.number) {
 		COPY_SHORT(&offset, pc);
 		pc += offset;
 	    } else
 		pc += 2;
-	    break;
-	case F_BBRANCH_LT:
+	    NEXT_INSTRUCTION;
+	CASE(F_BBRANCH_LT):
 	    f_lt();
 	    if ((sp--)->u.number) {
 		COPY_SHORT(&offset, pc);
 		pc -= offset;
 	    } else
 		pc += 2;
-	    break;
-	case F_BRANCH_WHEN_ZERO: /* relative offset */
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_LOCALS):
+	    {
+		svalue_t *s1, *s2;
+
+		n = EXTRACT_UCHAR(pc++);	/* F_BRANCH_NE, _GE, _LE or _EQ */
+		s1 = fp + EXTRACT_UCHAR(pc++);
+		s2 = fp + EXTRACT_UCHAR(pc++);
+		if (s1->type == T_NUMBER && s2->type == T_NUMBER) {
+		    switch (n) {
+		    case F_BRANCH_NE:
+			i = s1->u.number != s2->u.number;
+			break;
+		    case F_BRANCH_GE:
+			i = s1->u.number >= s2->u.number;
+			break;
+		    case F_BRANCH_LE:
+			i = s1->u.number <= s2->u.number;
+			break;
+		    default:
+			i = s1->u.number == s2->u.number;
+			break;
+		    }
+		} else {
+		    push_variable(s1);
+		    push_variable(s2);
+		    switch (n) {
+		    case F_BRANCH_NE:
+			f_ne();
+			break;
+		    case F_BRANCH_GE:
+			f_ge();
+			break;
+		    case F_BRANCH_LE:
+			f_le();
+			break;
+		    default:
+			f_eq();
+			break;
+		    }
+		    i = (sp--)->u.number;
+		}
+		if (i) {
+		    COPY_SHORT(&offset, pc);
+		    pc += offset;
+		} else
+		    pc += 2;
+	    }
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_STRING):
+	    {
+		char *str;
+
+		n = EXTRACT_UCHAR(pc++);	/* F_BRANCH_NE or F_BRANCH_EQ */
+		LOAD_SHORT(offset, pc);
+		str = current_prog->strings[offset];
+		if (sp->type == T_STRING) {
+		    /* shared strings are unique, so only the pointer counts */
+		    if (sp->u.string == str)
+			i = 1;
+		    else if (sp->subtype == STRING_SHARED)
+			i = 0;
+		    else
+			i = !strcmp(sp->u.string, str);
+		    free_string_svalue(sp--);
+		} else {
+		    i = 0;
+		    pop_stack();
+		}
+		if (n == F_BRANCH_NE)
+		    i = !i;
+		if (i) {
+		    COPY_SHORT(&offset, pc);
+		    pc += offset;
+		} else
+		    pc += 2;
+	    }
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_WHEN_ZERO): /* relative offset */
 	    if (sp->type == T_NUMBER) {
 		if (!((sp--)->u.number)) {
 		    COPY_SHORT(&offset, pc);
@@ -1994,8 +2295,8 @@ eval_instruction P1(char *, p)
 		}
 	    } else pop_stack();
 	    pc += 2;		/* skip over the offset */
-	    break;
-	case F_BRANCH_WHEN_NON_ZERO: /* relative offset */
+	    NEXT_INSTRUCTION;
+	CASE(F_BRANCH_WHEN_NON_ZERO): /* relative offset */
 	    if (sp->type == T_NUMBER) {
 		if (!((sp--)->u.number)) {
 		    pc += 2;
@@ -2004,8 +2305,8 @@ eval_instruction P1(char *, p)
 	    } else pop_stack();
 	    COPY_SHORT(&offset, pc);
 	    pc += offset;
-	    break;
-	case F_BBRANCH_WHEN_ZERO: /* relative backwards offset */
+	    NEXT_INSTRUCTION;
+	CASE(F_BBRANCH_WHEN_ZERO): /* relative backwards offset */
 	    if (sp->type == T_NUMBER) {
 		if (!((sp--)->u.number)) {
 		    COPY_SHORT(&offset, pc);
@@ -2014,8 +2315,8 @@ eval_instruction P1(char *, p)
 		}
 	    } else pop_stack();
 	    pc += 2;
-	    break;
-	case F_BBRANCH_WHEN_NON_ZERO: /* relative backwards offset */
+	    NEXT_INSTRUCTION;
+	CASE(F_BBRANCH_WHEN_NON_ZERO): /* relative backwards offset */
 	    if (sp->type == T_NUMBER) {
 		if (!((sp--)->u.number)) {
 		    pc += 2;
@@ -2024,8 +2325,8 @@ eval_instruction P1(char *, p)
 	    } else pop_stack();
 	    COPY_SHORT(&offset, pc);
 	    pc -= offset;
-	    break;
-	case F_LOR:
+	    NEXT_INSTRUCTION;
+	CASE(F_LOR):
 	    /* replaces F_DUP; F_BRANCH_WHEN_NON_ZERO; F_POP */
 	    if (sp->type == T_NUMBER) {
 		if (!sp->u.number) {
@@ -2036,8 +2337,8 @@ eval_instruction P1(char *, p)
 	    }
 	    COPY_SHORT(&offset, pc);
 	    pc += offset;
-	    break;
-	case F_LAND:
+	    NEXT_INSTRUCTION;
+	CASE(F_LAND):
 	    /* replaces F_DUP; F_BRANCH_WHEN_ZERO; F_POP */
 	    if (sp->type == T_NUMBER) {
 		if (!sp->u.number) {
@@ -2048,8 +2349,8 @@ eval_instruction P1(char *, p)
 		sp--;
 	    } else pop_stack();
 	    pc += 2;
-	    break;
-	case F_LOOP_INCR:	/* this case must be just prior to
+	    NEXT_INSTRUCTION;
+	CASE(F_LOOP_INCR):	/* this case must be just prior to
 				 * F_LOOP_COND */
 	    {
 		svalue_t *s;
@@ -2070,14 +2371,14 @@ eval_instruction P1(char *, p)
 		pc++;
 		do_loop_cond_number();
 	    }
-	    break;
-	case F_LOOP_COND_LOCAL:
+	    NEXT_INSTRUCTION;
+	CASE(F_LOOP_COND_LOCAL):
 	    do_loop_cond_local();
-	    break;
-	case F_LOOP_COND_NUMBER:
+	    NEXT_INSTRUCTION;
+	CASE(F_LOOP_COND_NUMBER):
 	    do_loop_cond_number();
-	    break;
-	case F_TRANSFER_LOCAL:
+	    NEXT_INSTRUCTION;
+	CASE(F_TRANSFER_LOCAL):
 	    {
 		svalue_t *s;
 		
@@ -2095,9 +2396,9 @@ eval_instruction P1(char *, p)
 		/* The optimizer has asserted this won't be used again.  Make
 		 * it look like a number to avoid double frees. */
 		s->type = T_NUMBER;
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_LOCAL:
+	CASE(F_LOCAL):
 	    {
 		svalue_t *s;
 		
@@ -2115,12 +2416,12 @@ eval_instruction P1(char *, p)
 		} else {
 		    assign_svalue_no_free(++sp, s);
 		}
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_LT:
+	CASE(F_LT):
 	    f_lt();
-	    break;
-	case F_ADD:
+	    NEXT_INSTRUCTION;
+	CASE(F_ADD):
 	    {
 		switch (sp->type) {
 		case T_BUFFER:
@@ -2206,6 +2507,12 @@ eval_instruction P1(char *, p)
 			if ((sp-1)->type == T_MAPPING) {
 			    mapping_t *map;
 			
+			    /* a left operand nothing else sees can be reused */
+			    if ((sp-1)->u.map->ref == 1) {
+				absorb_mapping((sp - 1)->u.map, sp->u.map);
+				free_mapping((sp--)->u.map);
+				break;
+			    }
 			    map = add_mapping((sp - 1)->u.map, sp->u.map);
 			    free_mapping((sp--)->u.map);
 			    free_mapping(sp->u.map);
@@ -2251,10 +2558,10 @@ eval_instruction P1(char *, p)
 		    error("Bad type argument to +.  Had %s and %s.\n",
 			  type_name((sp-1)->type), type_name(sp->type));
 		}
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_VOID_ADD_EQ:
-	case F_ADD_EQ:
+	CASE(F_VOID_ADD_EQ):
+	CASE(F_ADD_EQ):
 	    DEBUG_CHECK(sp->type != T_LVALUE,
 			"non-lvalue argument to +=\n");
 	    lval = sp->u.lvalue;
@@ -2321,6 +2628,7 @@ eval_instruction P1(char *, p)
 		else {
 		    /* add_array now frees the arrays */
 		    lval->u.arr = add_array(lval->u.arr, sp->u.arr);
+		    RECLAIM_STORE(lval);
 		}
 		break;
 	    case T_MAPPING:
@@ -2329,6 +2637,9 @@ eval_instruction P1(char *, p)
 		else {
 		    absorb_mapping(lval->u.map, sp->u.map);
 		    free_mapping(sp->u.map); /* free RHS */
+#ifdef RECLAIM_SLICE
+		    reclaim_note_container(lval);
+#endif
 		    /* LHS not freed because its being reused */
 		}
 		break;
@@ -2359,18 +2670,18 @@ eval_instruction P1(char *, p)
 		 */
 		sp--;
 	    }
-	    break;
-	case F_AND:
+	    NEXT_INSTRUCTION;
+	CASE(F_AND):
 	    f_and();
-	    break;
-	case F_AND_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_AND_EQ):
 	    f_and_eq();
-	    break;
-	case F_FUNCTION_CONSTRUCTOR:
+	    NEXT_INSTRUCTION;
+	CASE(F_FUNCTION_CONSTRUCTOR):
 	    f_function_constructor();
-	    break;
+	    NEXT_INSTRUCTION;
 
-	case F_FOREACH:
+	CASE(F_FOREACH):
 	    {
 		int flags = EXTRACT_UCHAR(pc++);
 
@@ -2397,8 +2708,9 @@ eval_instruction P1(char *, p)
 		} else {
 		    CHECK_TYPES(sp, T_ARRAY, 2, F_FOREACH);
 
+		    /* an index, as the loop may give the array a new store */
 		    (++sp)->type = T_NUMBER;
-		    sp->u.lvalue = (sp-1)->u.arr->item;
+		    sp->u.number = 0;
 		    sp->subtype = (sp-1)->u.arr->size;
 		}
 
@@ -2407,9 +2719,9 @@ eval_instruction P1(char *, p)
 		    sp->u.lvalue = find_value((int)(EXTRACT_UCHAR(pc++) + variable_index_offset));
 		else
 		    sp->u.lvalue = fp + EXTRACT_UCHAR(pc++);
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_NEXT_FOREACH:
+	CASE(F_NEXT_FOREACH):
 	    if ((sp-1)->type == T_LVALUE) {
 		/* mapping */
 		if ((sp-2)->subtype--) {
@@ -2431,7 +2743,8 @@ eval_instruction P1(char *, p)
 			sp->u.lvalue->subtype = 0;
 			sp->u.lvalue->u.number = *((sp-1)->u.lvalue_byte)++;
 		    } else {
-			assign_svalue(sp->u.lvalue, (sp-1)->u.lvalue++);
+			assign_svalue(sp->u.lvalue,
+				      (sp-2)->u.arr->item + (sp-1)->u.number++);
 		    }
 		    COPY_SHORT(&offset, pc);
 		    pc -= offset;
@@ -2440,7 +2753,7 @@ eval_instruction P1(char *, p)
 	    }
 	    pc += 2;
 	    /* fallthrough */
-	case F_EXIT_FOREACH:
+	CASE(F_EXIT_FOREACH):
 	    IF_DEBUG(stack_in_use_as_temporary--);
 	    if ((sp-1)->type == T_LVALUE) {
 		/* mapping */
@@ -2455,9 +2768,9 @@ eval_instruction P1(char *, p)
 		else
 		    free_array((sp--)->u.arr);
 	    }
-	    break;
+	    NEXT_INSTRUCTION;
 
-	case F_EXPAND_VARARGS:
+	CASE(F_EXPAND_VARARGS):
 	    {
 		svalue_t *s, *t;
 		array_t *arr;
@@ -2488,7 +2801,7 @@ eval_instruction P1(char *, p)
 			t--;
 		    }
 		    t = s + n - 1;
-		    if (arr->ref == 1) {
+		    if (ARRAY_PRIVATE(arr)) {
 			memcpy(s, arr->item, n * sizeof(svalue_t));
 			free_empty_array(arr);
 			break;
@@ -2498,26 +2811,26 @@ eval_instruction P1(char *, p)
 		    }
 		}
 		free_array(arr);
-		break;
+		NEXT_INSTRUCTION;
 	    }
 	    
-	case F_NEW_CLASS:
+	CASE(F_NEW_CLASS):
 	    {
 		array_t *cl;
 
 		cl = allocate_class(&current_prog->classes[EXTRACT_UCHAR(pc++)], 1);
 		push_refed_class(cl);
 	    }
-	    break;
-	case F_NEW_EMPTY_CLASS:
+	    NEXT_INSTRUCTION;
+	CASE(F_NEW_EMPTY_CLASS):
 	    {
 		array_t *cl;
 
  		cl = allocate_class(&current_prog->classes[EXTRACT_UCHAR(pc++)], 0);
 		push_refed_class(cl);
 	    }
-	    break;
-	case F_AGGREGATE:
+	    NEXT_INSTRUCTION;
+	CASE(F_AGGREGATE):
 	    {
 		array_t *v;
 		
@@ -2533,8 +2846,8 @@ eval_instruction P1(char *, p)
 		(++sp)->type = T_ARRAY;
 		sp->u.arr = v;
 	    }
-	    break;
-	case F_AGGREGATE_ASSOC:
+	    NEXT_INSTRUCTION;
+	CASE(F_AGGREGATE_ASSOC):
 	    {
 		mapping_t *m;
 		
@@ -2545,9 +2858,9 @@ eval_instruction P1(char *, p)
 		m = load_mapping_from_aggregate(sp -= offset, offset);
 		(++sp)->type = T_MAPPING;
 		sp->u.map = m;
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_ASSIGN:
+	CASE(F_ASSIGN):
 #ifdef DEBUG
 	    if (sp->type != T_LVALUE) fatal("Bad argument to F_ASSIGN\n");
 #endif
@@ -2568,6 +2881,7 @@ eval_instruction P1(char *, p)
 	    }
 	    default:
 		assign_svalue(sp->u.lvalue, sp - 1);
+		RECLAIM_STORE(sp->u.lvalue);
 		break;
 	    case T_LVALUE_RANGE:
 		assign_lvalue_range(sp - 1);
@@ -2575,8 +2889,8 @@ eval_instruction P1(char *, p)
 	    }
 	    sp--;		/* ignore lvalue */
 	    /* rvalue is already in the correct place */
-	    break;
-	case F_VOID_ASSIGN_LOCAL:
+	    NEXT_INSTRUCTION;
+	CASE(F_VOID_ASSIGN_LOCAL):
 	    if (sp->type != T_INVALID) {
 		lval = fp + EXTRACT_UCHAR(pc++);
 		free_svalue(lval, "F_VOID_ASSIGN_LOCAL");
@@ -2585,8 +2899,8 @@ eval_instruction P1(char *, p)
 		sp--;
 		pc++;
 	    }
-	    break;
-	case F_VOID_ASSIGN:
+	    NEXT_INSTRUCTION;
+	CASE(F_VOID_ASSIGN):
 #ifdef DEBUG
 	    if (sp->type != T_LVALUE) fatal("Bad argument to F_VOID_ASSIGN\n");
 #endif
@@ -2616,16 +2930,17 @@ eval_instruction P1(char *, p)
 		    {
 			free_svalue(lval, "F_VOID_ASSIGN : 3");
 			*lval = *sp--;
+			RECLAIM_STORE(lval);
 		    }
 		}
 	    } else sp--;
-	    break;
+	    NEXT_INSTRUCTION;
 #ifdef DEBUG
-	case F_BREAK_POINT:
+	CASE(F_BREAK_POINT):
 	    break_point();
-	    break;
+	    NEXT_INSTRUCTION;
 #endif
-	case F_CALL_FUNCTION_BY_ADDRESS:
+	CASE(F_CALL_FUNCTION_BY_ADDRESS):
 	    {
 		compiler_function_t *funp;
 		
@@ -2669,8 +2984,8 @@ eval_instruction P1(char *, p)
 		}
 #endif
 	    }
-	    break;
-	case F_CALL_INHERITED:
+	    NEXT_INSTRUCTION;
+	CASE(F_CALL_INHERITED):
 	    {
 		inherit_t *ip = current_prog->inherit + EXTRACT_UCHAR(pc++);
 		program_t *temp_prog = ip->prog;
@@ -2705,20 +3020,20 @@ eval_instruction P1(char *, p)
 		}
 #endif
 	    }
-	    break;
-	case F_COMPL:
+	    NEXT_INSTRUCTION;
+	CASE(F_COMPL):
 	    if (sp->type != T_NUMBER)
 		error("Bad argument to ~\n");
 	    sp->u.number = ~sp->u.number;
 	    sp->subtype = 0;
-	    break;
-	case F_CONST0:
+	    NEXT_INSTRUCTION;
+	CASE(F_CONST0):
 	    push_number(0);
-	    break;
-	case F_CONST1:
+	    NEXT_INSTRUCTION;
+	CASE(F_CONST1):
 	    push_number(1);
-	    break;
-	case F_PRE_DEC:
+	    NEXT_INSTRUCTION;
+	CASE(F_PRE_DEC):
 	    DEBUG_CHECK(sp->type != T_LVALUE, 
 			"non-lvalue argument to --\n");
 	    lval = sp->u.lvalue;
@@ -2743,8 +3058,8 @@ eval_instruction P1(char *, p)
 	    default:
 		error("-- of non-numeric argument\n");
 	    }
-	    break;
-	case F_DEC:
+	    NEXT_INSTRUCTION;
+	CASE(F_DEC):
 	    DEBUG_CHECK(sp->type != T_LVALUE,
 			"non-lvalue argument to --\n");
 	    lval = (sp--)->u.lvalue;
@@ -2764,8 +3079,8 @@ eval_instruction P1(char *, p)
 	    default:
 		error("-- of non-numeric argument\n");
 	    }
-	    break;
-	case F_DIVIDE:
+	    NEXT_INSTRUCTION;
+	CASE(F_DIVIDE):
 	    { 
 		switch((sp-1)->type|sp->type){
 		    
@@ -2805,20 +3120,20 @@ eval_instruction P1(char *, p)
 		    }
 		}
 	    }
-	    break;
-	case F_DIV_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_DIV_EQ):
 	    f_div_eq();
-	    break;
-	case F_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_EQ):
 	    f_eq();
-	    break;
-	case F_GE:
+	    NEXT_INSTRUCTION;
+	CASE(F_GE):
 	    f_ge();
-	    break;
-	case F_GT:
+	    NEXT_INSTRUCTION;
+	CASE(F_GT):
 	    f_gt();
-	    break;
-	case F_GLOBAL:
+	    NEXT_INSTRUCTION;
+	CASE(F_GLOBAL):
 	    {
 		svalue_t *s;
 		
@@ -2834,9 +3149,9 @@ eval_instruction P1(char *, p)
 		} else {
 		    assign_svalue_no_free(++sp, s);
 		}
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_PRE_INC:
+	CASE(F_PRE_INC):
 	    DEBUG_CHECK(sp->type != T_LVALUE,
 			"non-lvalue argument to ++\n");
 	    lval = sp->u.lvalue;
@@ -2861,8 +3176,8 @@ eval_instruction P1(char *, p)
 	    default:
 		error("++ of non-numeric argument\n");
 	    }
-	    break;
-	case F_MEMBER:
+	    NEXT_INSTRUCTION;
+	CASE(F_MEMBER):
 	    { 
 		array_t *arr;
 		 
@@ -2884,9 +3199,27 @@ eval_instruction P1(char *, p)
 		    sp->type = T_NUMBER;
 		    sp->u.number = 0;
 		}
-		break;
+		NEXT_INSTRUCTION;
+	    }
+	CASE(F_LOCAL_MEMBER):
+	    {
+		svalue_t *s;
+		array_t *arr;
+
+		s = fp + EXTRACT_UCHAR(pc++);
+		if (s->type != T_CLASS)
+		    error("Tried to take a member of something that isn't a class.\n");
+		i = EXTRACT_UCHAR(pc++);
+		arr = s->u.arr;
+		if (i >= arr->size) error("Class has no corresponding member.\n");
+		if (arr->item[i].type == T_OBJECT &&
+		    (arr->item[i].u.ob->flags & O_DESTRUCTED))
+		    *++sp = const0;
+		else
+		    assign_svalue_no_free(++sp, &arr->item[i]);
 	    }
-	case F_MEMBER_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_MEMBER_LVALUE):
 	    { 
 		array_t *arr;
 		 
@@ -2898,9 +3231,34 @@ eval_instruction P1(char *, p)
 		sp->type = T_LVALUE;
 		sp->u.lvalue = arr->item + i;
 		free_class(arr);
-		break;
+		NEXT_INSTRUCTION;
+	    }
+	CASE(F_LOCAL_INDEX):
+	    {
+		svalue_t *s;
+
+		/* the index is on the stack, the array or mapping is a local */
+		s = fp + EXTRACT_UCHAR(pc++);
+		if (s->type == T_ARRAY && sp->type == T_NUMBER &&
+		    sp->u.number >= 0 && sp->u.number < s->u.arr->size) {
+		    i = sp->u.number;
+		    assign_svalue_no_free(sp, &s->u.arr->item[i]);
+		} else if (s->type == T_MAPPING) {
+		    assign_svalue(sp, find_in_mapping(s->u.map, sp));
+		} else {
+		    /* anything else, including errors, the long way */
+		    push_variable(s);
+		    goto index_value;
+		}
+		if (sp->type == T_OBJECT && (sp->u.ob->flags & O_DESTRUCTED)) {
+		    free_object(sp->u.ob, "F_LOCAL_INDEX");
+		    sp->type = T_NUMBER;
+		    sp->u.number = 0;
+		}
 	    }
-	case F_INDEX:
+	    NEXT_INSTRUCTION;
+	CASE(F_INDEX):
+	  index_value:
 	    switch (sp->type) {
 	    case T_MAPPING:
 		{
@@ -2970,8 +3328,8 @@ eval_instruction P1(char *, p)
 		sp->type = T_NUMBER;
 		sp->u.number = 0;
 	    }
-	    break;
-	case F_RINDEX:
+	    NEXT_INSTRUCTION;
+	CASE(F_RINDEX):
 	    switch (sp->type) {
 	    case T_BUFFER:
 		{
@@ -3030,9 +3388,9 @@ eval_instruction P1(char *, p)
 		sp->type = T_NUMBER;
 		sp->u.number = 0;
 	    }
-	    break;
+	    NEXT_INSTRUCTION;
 #ifdef F_JUMP_WHEN_ZERO
-	case F_JUMP_WHEN_ZERO:
+	CASE(F_JUMP_WHEN_ZERO):
 	    if ((i = (sp->type == T_NUMBER)) && sp->u.number == 0) {
 		COPY_SHORT(&offset, pc);
 		pc = current_prog->program + offset;
@@ -3045,24 +3403,24 @@ eval_instruction P1(char *, p)
 	    } else {
 		pop_stack();
 	    }
-	    break;
+	    NEXT_INSTRUCTION;
 #endif
 #ifdef F_JUMP
-	case F_JUMP:
+	CASE(F_JUMP):
 	    COPY_SHORT(&offset, pc);
 	    pc = current_prog->program + offset;
-	    break;
+	    NEXT_INSTRUCTION;
 #endif
-	case F_LE:
+	CASE(F_LE):
 	    f_le();
-	    break;
-	case F_LSH:
+	    NEXT_INSTRUCTION;
+	CASE(F_LSH):
 	    f_lsh();
-	    break;
-	case F_LSH_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_LSH_EQ):
 	    f_lsh_eq();
-	    break;
-	case F_MOD:
+	    NEXT_INSTRUCTION;
+	CASE(F_MOD):
 	    {
 		CHECK_TYPES(sp - 1, T_NUMBER, 1, instruction);
 		CHECK_TYPES(sp, T_NUMBER, 2, instruction);
@@ -3070,11 +3428,11 @@ eval_instruction P1(char *, p)
 		    error("Modulus by zero.\n");
 		sp->u.number %= (sp+1)->u.number;
 	    }
-	    break;
-	case F_MOD_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_MOD_EQ):
 	    f_mod_eq();
-	    break;
-	case F_MULTIPLY:
+	    NEXT_INSTRUCTION;
+	CASE(F_MULTIPLY):
 	    {
 		switch((sp-1)->type|sp->type){
 		case T_NUMBER:
@@ -3121,14 +3479,14 @@ eval_instruction P1(char *, p)
 		    }
 		}
 	    }
-	    break;
-	case F_MULT_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_MULT_EQ):
 	    f_mult_eq();
-	    break;
-	case F_NE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NE):
 	    f_ne();
-	    break;
-	case F_NEGATE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NEGATE):
 	    if (sp->type == T_NUMBER) {
 		sp->subtype = 0;
 		sp->u.number = -sp->u.number;
@@ -3136,27 +3494,27 @@ eval_instruction P1(char *, p)
 		sp->u.real = -sp->u.real;
 	    else
 		error("Bad argument to unary minus\n");
-	    break;
-	case F_NOT:
+	    NEXT_INSTRUCTION;
+	CASE(F_NOT):
 	    if (sp->type == T_NUMBER) {
 		sp->subtype = 0;
 		sp->u.number = !sp->u.number;
 	    } else
 		assign_svalue(sp, &const0);
-	    break;
-	case F_OR:
+	    NEXT_INSTRUCTION;
+	CASE(F_OR):
 	    f_or();
-	    break;
-	case F_OR_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_OR_EQ):
 	    f_or_eq();
-	    break;
-	case F_PARSE_COMMAND:
+	    NEXT_INSTRUCTION;
+	CASE(F_PARSE_COMMAND):
 	    f_parse_command();
-	    break;
-	case F_POP_VALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_POP_VALUE):
 	    pop_stack();
-	    break;
-	case F_POST_DEC:
+	    NEXT_INSTRUCTION;
+	CASE(F_POST_DEC):
 	    DEBUG_CHECK(sp->type != T_LVALUE,
 			"non-lvalue argument to --\n");
 	    lval = sp->u.lvalue;
@@ -3180,8 +3538,8 @@ eval_instruction P1(char *, p)
 	    default:
 		error("-- of non-numeric argument\n");
 	    }
-	    break;
-	case F_POST_INC:
+	    NEXT_INSTRUCTION;
+	CASE(F_POST_INC):
 	    DEBUG_CHECK(sp->type != T_LVALUE,
 			"non-lvalue argument to ++\n");
 	    lval = sp->u.lvalue;
@@ -3205,49 +3563,49 @@ eval_instruction P1(char *, p)
 	    default:
 		error("++ of non-numeric argument\n");
 	    }
-	    break;
-	case F_GLOBAL_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_GLOBAL_LVALUE):
 	    (++sp)->type = T_LVALUE;
 	    sp->u.lvalue = find_value((int) (EXTRACT_UCHAR(pc++) +
 					     variable_index_offset));
-	    break;
-	case F_INDEX_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_INDEX_LVALUE):
 	    push_indexed_lvalue(0);
-	    break;
-	case F_RINDEX_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_RINDEX_LVALUE):
 	    push_indexed_lvalue(1);
-	    break;
-	case F_NN_RANGE_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NN_RANGE_LVALUE):
 	    push_lvalue_range(0x00);
-	    break;
-	case F_RN_RANGE_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_RN_RANGE_LVALUE):
 	    push_lvalue_range(0x10);
-	    break;
-	case F_RR_RANGE_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_RR_RANGE_LVALUE):
 	    push_lvalue_range(0x11);
-	    break;
-	case F_NR_RANGE_LVALUE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NR_RANGE_LVALUE):
 	    push_lvalue_range(0x01);
-	    break;
-	case F_NN_RANGE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NN_RANGE):
 	    f_range(0x00);
-	    break;
-	case F_RN_RANGE:
+	    NEXT_INSTRUCTION;
+	CASE(F_RN_RANGE):
 	    f_range(0x10);
-	    break;
-	case F_NR_RANGE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NR_RANGE):
 	    f_range(0x01);
-	    break;
-	case F_RR_RANGE:
+	    NEXT_INSTRUCTION;
+	CASE(F_RR_RANGE):
 	    f_range(0x11);
-	    break;
-	case F_NE_RANGE:
+	    NEXT_INSTRUCTION;
+	CASE(F_NE_RANGE):
 	    f_extract_range(0);
-	    break;
-	case F_RE_RANGE:
+	    NEXT_INSTRUCTION;
+	CASE(F_RE_RANGE):
 	    f_extract_range(1);
-	    break;
-	case F_RETURN_ZERO:
+	    NEXT_INSTRUCTION;
+	CASE(F_RETURN_ZERO):
 	    {
 		/*
 		 * Deallocate frame and return.
@@ -3272,10 +3630,9 @@ eval_instruction P1(char *, p)
 		/* The control stack was popped just before */
 		if (csp[1].framekind & FRAME_EXTERNAL)
 		    return;
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	    break;
-	case F_RETURN:
+	CASE(F_RETURN):
 	    {
 		svalue_t sv;
 		
@@ -3307,31 +3664,31 @@ eval_instruction P1(char *, p)
 		/* The control stack was popped just before */
 		if (csp[1].framekind & FRAME_EXTERNAL)
 		    return;
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_RSH:
+	CASE(F_RSH):
 	    f_rsh();
-	    break;
-	case F_RSH_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_RSH_EQ):
 	    f_rsh_eq();
-	    break;
-	case F_SSCANF:
+	    NEXT_INSTRUCTION;
+	CASE(F_SSCANF):
 	    f_sscanf();
-	    break;
-	case F_STRING:
+	    NEXT_INSTRUCTION;
+	CASE(F_STRING):
 	    LOAD_SHORT(offset, pc);
 	    DEBUG_CHECK1(offset >= current_prog->num_strings,
 			 "string %d out of range in F_STRING!\n",
 			 offset);
 	    push_shared_string(current_prog->strings[offset]);
-	    break;
-	case F_SHORT_STRING:
+	    NEXT_INSTRUCTION;
+	CASE(F_SHORT_STRING):
 	    DEBUG_CHECK1(EXTRACT_UCHAR(pc) >= current_prog->num_strings,
 			 "string %d out of range in F_STRING!\n",
 			 EXTRACT_UCHAR(pc));
 	    push_shared_string(current_prog->strings[EXTRACT_UCHAR(pc++)]);
-	    break;
-	case F_SUBTRACT:
+	    NEXT_INSTRUCTION;
+	CASE(F_SUBTRACT):
 	    {
 		i = (sp--)->type;
 		switch (i | sp->type) {
@@ -3368,12 +3725,12 @@ eval_instruction P1(char *, p)
 			error("Bad right type to -.\n");
 		    else error("Arguments to - do not have compatible types.\n");
 		}
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_SUB_EQ:
+	CASE(F_SUB_EQ):
 	    f_sub_eq();
-	    break;
-	case F_SIMUL_EFUN:
+	    NEXT_INSTRUCTION;
+	CASE(F_SIMUL_EFUN):
 	    {
 		unsigned short index;
 		int num_args;
@@ -3383,17 +3740,40 @@ eval_instruction P1(char *, p)
 		num_varargs = 0;
 		call_simul_efun(index, num_args);
 	    }
-	    break;
-	case F_SWITCH:
+	    NEXT_INSTRUCTION;
+#ifdef F_CALL_OTHER
+	CASE(F_GLOBAL_CALL_OTHER):
+	    /* push the object and function name, then as below */
+	    push_variable(find_value((int) (EXTRACT_UCHAR(pc++) + variable_index_offset)));
+	    LOAD_SHORT(offset, pc);
+	    push_shared_string(current_prog->strings[offset]);
+	    /* fall through */
+	CASE(F_CACHED_CALL_OTHER):
+	    {
+		unsigned short site;
+
+		st_num_arg = EXTRACT_UCHAR(pc++) + num_varargs;
+		num_varargs = 0;
+		LOAD_SHORT(site, pc);
+		CHECK_TYPES(sp - st_num_arg + 1, instrs[F_CALL_OTHER].type[0],
+			    1, F_CALL_OTHER);
+		CHECK_TYPES(sp - st_num_arg + 2, instrs[F_CALL_OTHER].type[1],
+			    2, F_CALL_OTHER);
+		call_other_site = call_other_cache(current_prog, site);
+		f_call_other();
+	    }
+	    NEXT_INSTRUCTION;
+#endif
+	CASE(F_SWITCH):
 	    f_switch();
-	    break;
-	case F_XOR:
+	    NEXT_INSTRUCTION;
+	CASE(F_XOR):
 	    f_xor();
-	    break;
-	case F_XOR_EQ:
+	    NEXT_INSTRUCTION;
+	CASE(F_XOR_EQ):
 	    f_xor_eq();
-	    break;
-	case F_CATCH:
+	    NEXT_INSTRUCTION;
+	CASE(F_CATCH):
 	    {
 		/*
 		 * Compute address of next instruction after the CATCH
@@ -3408,9 +3788,9 @@ eval_instruction P1(char *, p)
 		
 		pc = current_prog->program + offset;
 		
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_END_CATCH:
+	CASE(F_END_CATCH):
 	    {
 		free_svalue(&catch_value, "F_END_CATCH");
 		catch_value = const0;
@@ -3419,7 +3799,7 @@ eval_instruction P1(char *, p)
 		push_number(0);
 		return;		/* return to do_catch */
 	    }
-	case F_TIME_EXPRESSION:
+	CASE(F_TIME_EXPRESSION):
 	    {
 		long sec, usec;
 
@@ -3427,9 +3807,9 @@ eval_instruction P1(char *, p)
 		get_usec_clock(&sec, &usec);
 		push_number(sec);
 		push_number(usec);
-		break;
+		NEXT_INSTRUCTION;
 	    }
-	case F_END_TIME_EXPRESSION:
+	CASE(F_END_TIME_EXPRESSION):
 	    {
 		long sec, usec;
 		
@@ -3438,37 +3818,37 @@ eval_instruction P1(char *, p)
 		sp -= 2;
 		IF_DEBUG(stack_in_use_as_temporary--);
 		push_number(usec);
-		break;
+		NEXT_INSTRUCTION;
 	    }
 #define Instruction (instruction + ONEARG_MAX)
 #ifdef DEBUG
 #define CALL_THE_EFUN goto call_the_efun
 #else
-#define CALL_THE_EFUN (*oefun_table[instruction])(); continue
+#define CALL_THE_EFUN (*oefun_table[instruction])(); NEXT_INSTRUCTION
 #endif
-	case F_EFUN0:
+	CASE(F_EFUN0):
 	    st_num_arg = 0;
 	    instruction = EXTRACT_UCHAR(pc++);
 	    CALL_THE_EFUN;
-	case F_EFUN1:
+	CASE(F_EFUN1):
 	    st_num_arg = 1;
 	    instruction = EXTRACT_UCHAR(pc++);
 	    CHECK_TYPES(sp, instrs2[instruction].type[0], 1, Instruction);
 	    CALL_THE_EFUN;
-	case F_EFUN2:
+	CASE(F_EFUN2):
 	    st_num_arg = 2;
 	    instruction = EXTRACT_UCHAR(pc++);
 	    CHECK_TYPES(sp - 1, instrs2[instruction].type[0], 1, Instruction);
 	    CHECK_TYPES(sp, instrs2[instruction].type[1], 2, Instruction);
 	    CALL_THE_EFUN;
-	case F_EFUN3:
+	CASE(F_EFUN3):
 	    st_num_arg = 3;
 	    instruction = EXTRACT_UCHAR(pc++);
 	    CHECK_TYPES(sp - 2, instrs2[instruction].type[0], 1, Instruction);
 	    CHECK_TYPES(sp - 1, instrs2[instruction].type[1], 2, Instruction);
 	    CHECK_TYPES(sp, instrs2[instruction].type[2], 3, Instruction);
 	    CALL_THE_EFUN;
-	case F_EFUNV:
+	CASE(F_EFUNV):
 	    {
 		int i, num;
 		st_num_arg = EXTRACT_UCHAR(pc++) + num_varargs;
@@ -3480,13 +3860,13 @@ eval_instruction P1(char *, p)
 		}
 		CALL_THE_EFUN;
 	    }
-	default:
+	DEFAULT:
 	    /* optimized 1 arg efun */
 	    st_num_arg = 1;
 	    CHECK_TYPES(sp, instrs[instruction].type[0], 1, instruction);
 #ifndef DEBUG
 	    (*ooefun_table[instruction])();
-	    continue;
+	    NEXT_INSTRUCTION;
 #else
 	    instruction -= ONEARG_MAX;
 	call_the_efun:
@@ -3603,8 +3983,24 @@ unsigned int apply_low_call_others = 0;
 unsigned int apply_low_cache_hits = 0;
 unsigned int apply_low_slots_used = 0;
 unsigned int apply_low_collisions = 0;
+unsigned int call_other_site_hits = 0;
+unsigned int call_other_site_misses = 0;
+unsigned int call_other_sites_used = 0;
 #endif
 
+/*
+ * Besides the global cache, each call_other in a program has a few
+ * entries of its own (CALL_OTHER_CACHE_WAYS; see F_CACHED_CALL_OTHER).
+ * They are checked before the global one: a hit needs only the target's
+ * program to match and the function name pointer to be the same shared
+ * string the entry was filled with, so no hashing or strcmp() is done.
+ * Entries go stale by themselves when the target's program changes.
+ * Functions that aren't found are left to the global cache.
+ */
+#define CALL_OTHER_CACHE_WAYS 2
+
+struct cache_entry_s *call_other_site = 0;
+
 typedef struct cache_entry_s {
     int id;
     program_t *oprogp;
@@ -3618,6 +4014,41 @@ typedef struct cache_entry_s {
 
 static cache_entry_t cache[APPLY_CACHE_SIZE];
 
+/*
+ * The entries for call_other site 'site' of prog.
+ */
+cache_entry_t *call_other_cache P2(program_t *, prog, int, site)
+{
+    cache_entry_t *entries = prog->call_other_cache;
+
+    if (!entries) {
+	int n = prog->num_call_other_sites * CALL_OTHER_CACHE_WAYS;
+
+	entries = CALLOCATE(n, cache_entry_t, TAG_CALL_OTHER_CACHE,
+			    "call_other_cache");
+	memset(entries, 0, n * sizeof(cache_entry_t));
+	prog->call_other_cache = entries;
+#ifdef CACHE_STATS
+	call_other_sites_used += prog->num_call_other_sites;
+#endif
+    }
+    return entries + site * CALL_OTHER_CACHE_WAYS;
+}
+
+/*
+ * Remember a lookup at a call_other site, pushing out the entry that
+ * was used least recently.
+ */
+INLINE_STATIC void fill_call_other_site P2(cache_entry_t *, site,
+					   cache_entry_t *, entry)
+{
+    int i;
+
+    for (i = CALL_OTHER_CACHE_WAYS - 1; i > 0; i--)
+	site[i] = site[i - 1];
+    site[0] = *entry;
+}
+
 #ifdef DEBUGMALLOC_EXTENSIONS
 void mark_apply_low_cache() {
     int i;
@@ -3660,11 +4091,14 @@ int apply_low P3(char *, fun, object_t *, ob, int, num_arg)
     int ix, fio, vio;
     static int cache_mask = APPLY_CACHE_SIZE - 1;
     int local_call_origin = call_origin;
+    cache_entry_t *site = call_other_site;
+    int hit;
     IF_DEBUG(control_stack_t *save_csp);
     
     if (!local_call_origin)
 	local_call_origin = ORIGIN_DRIVER;
     call_origin = 0;
+    call_other_site = 0;
     ob->time_of_ref = current_time;	/* Used by the swapper */
     /*
      * This object will now be used, and is thus a target for reset later on
@@ -3699,15 +4133,39 @@ int apply_low P3(char *, fun, object_t *, ob, int, num_arg)
 #ifdef CACHE_STATS
     apply_low_call_others++;
 #endif
-    ix = (progp->id_number ^ (POINTER_INT) fun ^
-	  ((POINTER_INT) fun >> APPLY_CACHE_BITS)) & cache_mask;
-    entry = &cache[ix];
-    if ((entry->id == progp->id_number)
-	&& (entry->oprogp == progp)
-	&& (strcmp(entry->name, fun) == 0)) {
+    entry = 0;
+    if (site) {
+	for (ix = 0; ix < CALL_OTHER_CACHE_WAYS; ix++) {
+	    if (site[ix].oprogp == progp && site[ix].id == progp->id_number
+		&& site[ix].name == fun) {
+		entry = &site[ix];
+		break;
+	    }
+	}
+#ifdef CACHE_STATS
+	if (entry) {
+	    call_other_site_hits++;
+	    apply_low_cache_hits++;
+	} else
+	    call_other_site_misses++;
+#endif
+    }
+    if (!entry) {
+	ix = (progp->id_number ^ (POINTER_INT) fun ^
+	      ((POINTER_INT) fun >> APPLY_CACHE_BITS)) & cache_mask;
+	entry = &cache[ix];
+	hit = (entry->id == progp->id_number)
+	    && (entry->oprogp == progp)
+	    && (strcmp(entry->name, fun) == 0);
 #ifdef CACHE_STATS
-	apply_low_cache_hits++;
+	if (hit)
+	    apply_low_cache_hits++;
 #endif
+	if (hit && site && entry->progp && entry->name == fun)
+	    fill_call_other_site(site, entry);
+    } else
+	hit = 1;
+    if (hit) {
 	if (entry->progp) {
 	    compiler_function_t *funp = entry->progp->function_table + entry->index;
 	    int funflags = entry->oprogp->function_flags[funp->runtime_index + entry->function_index_offset];
@@ -3805,6 +4263,8 @@ int apply_low P3(char *, fun, object_t *, ob, int, num_arg)
 		entry->num_arg = fundefp->num_arg;
 		entry->num_local = fundefp->num_local;
 		entry->progp = current_prog;
+		if (site && sfun == fun)
+		    fill_call_other_site(site, entry);
 		previous_ob = current_object;
 		current_object = ob;
 		IF_DEBUG(save_csp = csp);
@@ -3966,7 +4426,7 @@ safe_apply P4(char *, fun, object_t *, ob, int, num_arg, int, where)
  */
 array_t *call_all_other P3(array_t *, v, char *, func, int, numargs)
 {
-    int size;
+    int size, n;
     svalue_t *tmp, *vptr, *rptr;
     array_t *ret;
     object_t *ob;
@@ -3979,7 +4439,9 @@ array_t *call_all_other P3(array_t *, v, char *, func, int, numargs)
 	too_deep_error = 1;
 	error("stack overflow\n");
     }
-    for (vptr = v->item, rptr = ret->item; size--; vptr++, rptr++) {
+    /* the calls may give v a new store, so find each element afresh */
+    for (n = 0, rptr = ret->item; n < size; n++, rptr++) {
+	vptr = v->item + n;
 	if (vptr->type == T_OBJECT) {
 	    ob = vptr->u.ob;
 	} else if (vptr->type == T_STRING) {
@@ -221,6 +221,8 @@ extern program_t *current_prog;
 extern short caller_type;
 extern char *pc;
 extern svalue_t *sp;
+extern svalue_t start_of_stack[];
+extern svalue_t *end_of_stack;
 extern svalue_t *fp;
 extern svalue_t catch_value;
 extern control_stack_t control_stack[CFG_MAX_CALL_DEPTH];
@@ -233,6 +235,9 @@ extern unsigned int apply_low_call_others;
 extern unsigned int apply_low_cache_hits;
 extern unsigned int apply_low_slots_used;
 extern unsigned int apply_low_collisions;
+extern unsigned int call_other_site_hits;
+extern unsigned int call_other_site_misses;
+extern unsigned int call_other_sites_used;
 extern int function_index_offset;
 extern int simul_efun_is_loading;
 extern program_t fake_prog;
@@ -292,6 +297,8 @@ void bad_argument PROT((svalue_t *, int, int, int));
 void check_for_destr PROT((array_t *));
 int is_static PROT((char *, object_t *));
 int apply_low PROT((char *, object_t *, int));
+extern struct cache_entry_s *call_other_site;
+struct cache_entry_s *call_other_cache PROT((program_t *, int));
 svalue_t *apply PROT((char *, object_t *, int, int));
 svalue_t *call_function_pointer PROT((funptr_t *, int));
 svalue_t *safe_call_function_pointer PROT((funptr_t *, int));
@@ -2229,6 +2229,11 @@ void init_num_args()
     add_instr_name("branch_le", 0, F_BRANCH_LE, -1);
     add_instr_name("branch_eq", 0, F_BRANCH_EQ, -1);
     add_instr_name("bbranch_lt", 0, F_BBRANCH_LT, -1);
+    add_instr_name("branch_locals", 0, F_BRANCH_LOCALS, -1);
+    add_instr_name("branch_string", 0, F_BRANCH_STRING, -1);
+    add_instr_name("local_index", 0, F_LOCAL_INDEX, T_ANY);
+    add_instr_name("local_member", 0, F_LOCAL_MEMBER, T_ANY);
+    add_instr_name("global_call_other", 0, F_GLOBAL_CALL_OTHER, T_ANY);
     add_instr_name("bbranch_when_zero", 0, F_BBRANCH_WHEN_ZERO, -1);
     add_instr_name("bbranch_when_non_zero", 0, F_BBRANCH_WHEN_NON_ZERO, -1);
     add_instr_name("branch_when_zero", 0, F_BRANCH_WHEN_ZERO, -1);
@@ -2,7 +2,7 @@
 #define LPC_H
 
 typedef struct {
-    unsigned short ref;
+    unsigned int ref;
 } refed_t;
 
 union u {
@@ -15,6 +15,8 @@
 #include "main.h"
 #include "compile_file.h"
 #include "socket_efuns.h"
+#include "poller.h"
+#include "resolver.h"
 
 port_def_t external_port[5];
 
@@ -322,9 +324,16 @@ int main P2(int, argc, char **, argv)
     _tzset();
 #endif
 
+    init_poller();
+
 #ifndef NO_IP_DEMON
+#ifdef RESOLVER
+    if (!no_ip_demon)
+	init_resolver();
+#else
     if (!no_ip_demon && ADDR_SERVER_IP)
 	init_addr_server(ADDR_SERVER_IP, ADDR_SERVER_PORT);
+#endif
 #endif				/* NO_IP_DEMON */
 
     eval_cost = max_cost;	/* needed for create() functions */
@@ -481,19 +490,10 @@ char *int_string_unlink P1(char *, str)
     mbt = ((malloc_block_t *)str) - 1;
     mbt->ref--;
     
-    if (mbt->size == USHRT_MAX) {
-	int l = strlen(str + USHRT_MAX) + USHRT_MAX; /* ouch */
-
-	newmbt = (malloc_block_t *)DXALLOC(l + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, desc);
-	memcpy((char *)(newmbt + 1), (char *)(mbt + 1), l+1);
-	newmbt->size = USHRT_MAX;
-	ADD_NEW_STRING(USHRT_MAX, sizeof(malloc_block_t));
-    } else {
-	newmbt = (malloc_block_t *)DXALLOC(mbt->size + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, desc);
-	memcpy((char *)(newmbt + 1), (char *)(mbt + 1), mbt->size+1);
-	newmbt->size = mbt->size;
-	ADD_NEW_STRING(mbt->size, sizeof(malloc_block_t));
-    }
+    newmbt = (malloc_block_t *)DXALLOC(MSTR_CAPACITY((int) mbt->size) + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, desc);
+    memcpy((char *)(newmbt + 1), (char *)(mbt + 1), mbt->size+1);
+    newmbt->size = mbt->size;
+    ADD_NEW_STRING(mbt->size, sizeof(malloc_block_t));
     newmbt->ref = 1;
     CHECK_STRING_STATS;
     
@@ -59,6 +59,15 @@ int outbuf_extend PROT((outbuffer_t *, int));
 #endif
 #define TAG_INPUT_TO	    (TAG_PERMANENT + 38)
 #define TAG_SOCKETS	    (TAG_PERMANENT + 39)
+#define TAG_POLLER	    (TAG_PERMANENT + 50)
+#define TAG_CALL_OTHER_CACHE (TAG_PERMANENT + 51)
+#define TAG_RECLAIM	    (TAG_PERMANENT + 52)
+#define TAG_MESSAGE_CHUNK   (TAG_PERMANENT + 53)
+#define TAG_MESSAGE_LINK    (TAG_PERMANENT + 54)
+#define TAG_INPUT_BUFFER    (TAG_PERMANENT + 55)
+#define TAG_MCCP	    (TAG_PERMANENT + 56)
+#define TAG_RESOLVER	    (TAG_PERMANENT + 57)
+#define TAG_FILE_CACHE	    (TAG_PERMANENT + 58)
 
 #define TAG_STRING          (TAG_DATA + 40)
 #define TAG_MALLOC_STRING   (TAG_DATA + 41)
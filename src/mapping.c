@@ -5,6 +5,7 @@
 #include "lpc_incl.h"
 #include "debug.h" /* added by Truilkan */
 #include "md.h"
+#include "reclaim.h"
 
 int num_mappings = 0;
 int total_mapping_size = 0;
@@ -21,69 +22,315 @@ int total_mapping_nodes = 0;
  *   after the one Perl uses in hash.c - 92/07/08 - by Truilkan@TMI
  * - Beek reduced mem usage and improved speed 95/09/08; Sym optimized this
  *   at some point as well.
+ * - replaced the chained hash table with inline node storage plus an
+ *   open addressing index for large mappings.
  */
 
 /*
-  growMap: based on hash.c:hsplit() from Larry Wall's Perl.
+  Layout (see mapping.h): the nodes of a mapping are packed into a chain of
+  chunks, the first of which is allocated along with the mapping itself,
+  so a small mapping is a single block which is searched linearly.  Once a
+  mapping holds more than MAP_SMALL entries it also gets an index: an open
+  addressing table of (hash, node) slots using linear probing, which is
+  kept at most 3/4 full and doubled as needed.
+
+  Nodes stay in insertion order.  Deleting one leaves a hole (a node whose
+  key is T_INVALID) which iteration skips; holes at the end are dropped
+  at once, and the rest are squeezed out once they outnumber the live
+  nodes.  That is done by compact_mappings() from the backend, as nothing
+  else may move nodes: LPC code can hold lvalues into a mapping, or be
+  running from a loop over it (filter()), while it deletes from it.
+*/
 
-  growMap doubles the size of the hash table.  It is called when FILL_PERCENT
-  of the buckets in the hash table contain values.  This routine is
-  efficient since the entries in the table don't need to be rehashed (even
-  though the entries are redistributed across the both halves of the hash
-  table).
+/*
+  map_hash: spread the bits of a key (a number, or a shared string, object,
+  etc. pointer) over the whole word.  Pointers have their low bits clear,
+  and close groups of numbers are common, so both need mixing before
+  being masked down to an index slot.
 */
 
-INLINE_STATIC int node_hash P1(mapping_node_t *, mn) {
+unsigned int map_hash P1(POINTER_INT, x)
+{
+    unsigned long h = (unsigned long) x;
+
+    if (sizeof(h) > 4)
+	h ^= (h >> 16) >> 16;
+    h = (h ^ (h >> 16)) * 0x45d9f3bUL;
+    h = (h ^ (h >> 16)) * 0x45d9f3bUL;
+    return (unsigned int) (h ^ (h >> 16));
+}
+
+INLINE_STATIC unsigned int node_hash P1(mapping_node_t *, mn) {
     return MAP_POINTER_HASH(mn->values[0].u.number);
 }
 
-INLINE int growMap P1(mapping_t *, m)
+/* the hash is only needed once a mapping has an index */
+#define node_key_hash(m, mn) ((m)->index ? node_hash(mn) : 0)
+
+/* smallest index (a power of 2) that holds n entries below 3/4 full */
+static unsigned int map_index_size P1(int, n)
 {
-	int oldsize = m->table_size + 1;
-	int newsize = oldsize << 1;
-	int i;
-	mapping_node_t **a, **b, **eltp, *elt;
-
-	if (newsize > MAX_TABLE_SIZE) 
-		return 0;
-	/* resize the hash table to be twice the old size */
-	m->table = a = RESIZE(m->table, newsize, mapping_node_t *, TAG_MAP_TBL, "growMap");
-	if (!a) {
-	    /*
-	      We couldn't grow the hash table.  Rather than die, we just
-	      accept the performance hit resulting from having an overfull
-	      table.
-	      This trick won't work.  m->table is now zero. -Beek
-	      */
-	    m->unfilled = m->table_size;
-	    return 0;
+    unsigned int size = MAP_SMALL << 1;
+
+    while (size < (unsigned int) n * 2)
+	size <<= 1;
+    return size;
+}
+
+INLINE_STATIC void
+map_index_insert P3(mapping_t *, m, unsigned int, h, mapping_node_t *, node)
+{
+    map_slot_t *idx = m->index;
+    unsigned int i = h & m->mask;
+
+    while (idx[i].node)
+	i = (i + 1) & m->mask;
+    idx[i].hash = h;
+    idx[i].node = node;
+}
+
+/* find the slot pointing at node, which must be in the index */
+INLINE_STATIC unsigned int
+map_index_slot P2(mapping_t *, m, mapping_node_t *, node)
+{
+    map_slot_t *idx = m->index;
+    unsigned int i = node_hash(node) & m->mask;
+
+    while (idx[i].node != node)
+	i = (i + 1) & m->mask;
+    return i;
+}
+
+/*
+  map_index_remove: empty slot i, shifting back any later entries of the
+  same probe run which would otherwise become unreachable.
+*/
+
+static void
+map_index_remove P2(mapping_t *, m, unsigned int, i)
+{
+    map_slot_t *idx = m->index;
+    unsigned int mask = m->mask, j = i, k;
+
+    for (;;) {
+	j = (j + 1) & mask;
+	if (!idx[j].node)
+	    break;
+	k = idx[j].hash & mask;
+	/* entries whose home slot lies in (i, j] have to stay put */
+	if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	idx[i] = idx[j];
+	i = j;
+    }
+    idx[i].node = 0;
+}
+
+static void
+map_drop_index P1(mapping_t *, m)
+{
+    if (m->index) {
+	total_mapping_size -= sizeof(map_slot_t) * (m->mask + 1);
+	FREE((char *) m->index);
+	m->index = 0;
+	m->mask = 0;
+    }
+}
+
+static void
+map_index_build P2(mapping_t *, m, unsigned int, slots)
+{
+    map_chunk_t *c;
+    mapping_node_t *elt;
+
+    debug(1024,("mapping.c: map_index_build ptr = %x, size = %d\n", m, slots));
+    map_drop_index(m);
+    m->index = CALLOCATE(slots, map_slot_t, TAG_MAP_TBL, "map_index_build");
+    if (!m->index)
+	error("Out of memory\n");
+    memset(m->index, 0, slots * sizeof(map_slot_t));
+    m->mask = slots - 1;
+    total_mapping_size += sizeof(map_slot_t) * slots;
+    MAP_FOREACH(m, c, elt)
+	map_index_insert(m, node_hash(elt), elt);
+}
+
+/*
+  map_append: add a node for key (with hash h, which is ignored if m has
+  no index) at the end of the mapping, taking over the reference to key.
+  The value is set to 0.  The caller must have checked that key isn't in
+  the mapping already.
+*/
+
+INLINE_STATIC mapping_node_t *
+map_append P3(mapping_t *, m, svalue_t *, key, unsigned int, h)
+{
+    map_chunk_t *c = m->last;
+    mapping_node_t *node;
+
+    if (m->count >= MAX_MAPPING_SIZE) {
+	debug(128,("mapping.c: too full\n"));
+	mapping_too_large();
+    }
+    if (c->used == c->size) {
+	/* chunks emptied by deletions are kept around for reuse */
+	if (!c->next) {
+	    int size = c->size << 1;
+	    map_chunk_t *nc;
+
+	    if (size < MAP_SMALL) size = MAP_SMALL;
+	    if (size > MAP_CHUNK_MAX) size = MAP_CHUNK_MAX;
+	    nc = (map_chunk_t *) DXALLOC(CHUNKSIZE(size), TAG_MAP_NODE_BLOCK,
+					 "map_append");
+	    if (!nc)
+		error("Out of memory\n");
+	    nc->next = 0;
+	    nc->prev = c;
+	    nc->size = size;
+	    nc->used = 0;
+	    c->next = nc;
+	    total_mapping_size += CHUNKSIZE(size);
 	}
-	/* hash table doubles in size -- keep track of the memory used */
-	total_mapping_size += sizeof(mapping_node_t *) * oldsize;
-	debug(1024,("mapping.c: growMap ptr = %x, size = %d\n", m, newsize));
-	m->unfilled = oldsize * (unsigned)FILL_PERCENT / (unsigned)100;
-	m->table_size = newsize - 1;
-	/* zero out the new storage area (2nd half of table) */
-	memset(a += oldsize, 0, oldsize * sizeof(mapping_node_t *));
-	i = oldsize;
-	while (a--, i--){
-	    if ((elt = *a)) {
-		eltp = a, b = a + oldsize;
-		do {
-		    if (node_hash(elt) & oldsize){
-			*eltp = elt->next;
-			if (!(elt->next = *b)) m->unfilled--;
-			*b = elt;   
-			elt = *eltp;
-		    }
-		    else elt = *(eltp = &elt->next);
-		} while (elt);
-		if (!*a) m->unfilled++;
-	    }
+	c = m->last = c->next;
+    }
+    node = c->nodes + c->used++;
+    node->values[0] = *key;
+    node->values[1] = const0u;
+    m->count++;
+    total_mapping_nodes++;
+#ifdef PACKAGE_MUDLIB_STATS
+    add_array_size(&m->stats, 2);
+#endif
+
+    if (m->index) {
+	if ((unsigned int) m->count * 4 > (m->mask + 1) * 3)
+	    map_index_build(m, (m->mask + 1) << 1);
+	else
+	    map_index_insert(m, h, node);
+    } else if (m->count > MAP_SMALL)
+	map_index_build(m, map_index_size(m->count));
+    return node;
+}
+
+/*
+  map_unlink: remove node from the mapping without freeing its svalues.
+  No other node moves.
+*/
+
+static void
+map_unlink P2(mapping_t *, m, mapping_node_t *, node)
+{
+    map_chunk_t *c = m->last;
+
+    if (m->index)
+	map_index_remove(m, map_index_slot(m, node));
+    node->values[0].type = T_INVALID;
+    m->deleted++;
+    /* holes at the end can go right away */
+    while (c->used && MAP_NODE_DELETED(c->nodes + c->used - 1)) {
+	c->used--;
+	m->deleted--;
+	if (!c->used && c->prev)
+	    c = m->last = c->prev;
+    }
+    m->count--;
+    total_mapping_nodes--;
+#ifdef PACKAGE_MUDLIB_STATS
+    add_array_size(&m->stats, -2);
+#endif
+    if (m->count <= MAP_SMALL / 2)
+	map_drop_index(m);
+}
+
+/*
+  map_compact: close up the holes left by deleted nodes, keeping the order.
+  This moves nodes, so it must not be done while lvalues into the mapping
+  may be held or the mapping is being iterated over; see map_compact_later().
+*/
+
+static void
+map_compact P1(mapping_t *, m)
+{
+    map_chunk_t *c, *dc = &m->store->first;
+    mapping_node_t *elt, *dst = dc->nodes;
+
+    debug(1024,("mapping.c: map_compact ptr = %x, holes = %d\n", m, m->deleted));
+    /* the destination never passes the node being read */
+    MAP_FOREACH(m, c, elt) {
+	if (dst == dc->nodes + dc->size) {
+	    dc->used = dc->size;
+	    dc = dc->next;
+	    dst = dc->nodes;
 	}
-	return 1;
+	*dst++ = *elt;
+    }
+    dc->used = dst - dc->nodes;
+    m->last = dc;
+    for (c = dc->next; c; c = c->next)
+	c->used = 0;
+    m->deleted = 0;
+    if (m->index)
+	map_index_build(m, map_index_size(m->count));
 }
 
+/*
+  map_compact_later: have m compacted by the next compact_mappings().  The
+  list holds a reference, so m stays valid until then.  Deleting a run of
+  keys from one mapping only puts it on the list once.
+*/
+
+static mapping_t **compact_list;
+static int compact_count, compact_size;
+
+void
+map_compact_later P1(mapping_t *, m)
+{
+    if (compact_count && compact_list[compact_count - 1] == m)
+	return;
+    if (compact_count == compact_size) {
+	if (compact_size) {
+	    compact_size <<= 1;
+	    compact_list = RESIZE(compact_list, compact_size, mapping_t *,
+				  TAG_MAPPING, "map_compact_later");
+	} else {
+	    compact_size = 16;
+	    compact_list = CALLOCATE(compact_size, mapping_t *,
+				     TAG_MAPPING, "map_compact_later");
+	}
+    }
+    m->ref++;
+    compact_list[compact_count++] = m;
+}
+
+/*
+  compact_mappings: called from the backend, when no LPC code is running.
+*/
+
+void
+compact_mappings()
+{
+    mapping_t *m;
+
+    while (compact_count) {
+	m = compact_list[--compact_count];
+	/* not worth it if we hold the last reference */
+	if (m->ref > 1 && m->deleted > m->count && !MAP_SHARED(m))
+	    map_compact(m);
+	free_mapping(m);
+    }
+}
+
+#ifdef DEBUGMALLOC_EXTENSIONS
+void
+mark_compact_mappings()
+{
+    int i;
+
+    for (i = 0; i < compact_count; i++)
+	compact_list[i]->extra_ref++;
+}
+#endif
+
 /*
   mapTraverse: iterate over the mapping, calling function 'func(elt, extra)'
   for each element 'elt'.  This is an attempt to encapsulate some of the
@@ -98,55 +345,77 @@ mapping_t *m;
 int (*func) PROT((mapping_t *, mapping_node_t *, void *));
 void *extra;
 {
-	mapping_node_t *elt, *nelt;
-	int j = (int) m->table_size;
-	
+	map_chunk_t *c;
+	mapping_node_t *elt;
+
 	debug(128,("mapTraverse %x\n", m));
-	do {
-	    for (elt = m->table[j]; elt; elt = nelt){
-		nelt = elt->next;
-		if ((*func)(m, elt, extra)) return m;
-	    }
-	} while (j--);
+	MAP_FOREACH(m, c, elt) {
+	    if ((*func)(m, elt, extra)) return m;
+	}
 	return m;
 }
 
 /* free_mapping */
- 
-INLINE void
-dealloc_mapping P1(mapping_t *, m)
+
+static void
+free_map_block P1(mapping_t *, m)
 {
-	debug(1024,("mapping.c: actual free of %x\n", m));
 	num_mappings--;
-	{
-	    int j = m->table_size, c = m->count;
-	    mapping_node_t *elt, *nelt, **a = m->table;
-	    
-	    total_mapping_size -= (sizeof(mapping_t) +
-				   sizeof(mapping_node_t *) * (j+1) +
-				   sizeof(mapping_node_t) * c);
-	    total_mapping_nodes -= c;
-#ifdef PACKAGE_MUDLIB_STATS
-	    add_array_size (&m->stats, - (c << 1));
-#endif
+	total_mapping_size -= MAPSIZE(m->first.size);
+	FREE((char *) m);
+}
 
-	    do {
-		for (elt = a[j]; elt; elt = nelt){
-		    nelt = elt->next;
-		    free_svalue(elt->values + 1, "free_mapping");
-		    free_svalue(elt->values, "free_mapping");
-		    free_node(elt);
+/*
+  map_release: m no longer uses its body; free it if nothing else does.
+  The last mapping using a body is the one whose header describes it.
+*/
 
-		}
-	    } while (j--);
-	
+static void
+map_release P1(mapping_t *, m)
+{
+	mapping_t *s = m->store;
+	map_chunk_t *c, *nc;
+	mapping_node_t *elt;
+
+	if (--s->shares)
+	    return;
+	total_mapping_nodes -= m->count;
+	MAP_FOREACH(m, c, elt) {
+	    free_svalue(elt->values + 1, "free_mapping");
+	    free_svalue(elt->values, "free_mapping");
+	}
 
-	    debug(2048, ("in free_mapping: before table\n"));
-	    FREE((char *)a);
+	debug(2048, ("in free_mapping: before chunks\n"));
+	for (c = s->first.next; c; c = nc) {
+	    nc = c->next;
+	    total_mapping_size -= CHUNKSIZE(c->size);
+	    FREE((char *) c);
+	}
+	map_drop_index(m);
+	if (s == m)
+	    return;
+	/* a body m was given by unshare_mapping(), or of one since freed */
+	if (!s->ref)
+	    free_map_block(s);
+	else {
+	    /* s has a body of its own now */
+	    s->first.next = 0;
+	    s->first.used = 0;
 	}
+}
 
-	debug(2048, ("in free_mapping: after table\n"));
-	FREE((char *) m);
+INLINE void
+dealloc_mapping P1(mapping_t *, m)
+{
+	debug(1024,("mapping.c: actual free of %x\n", m));
+	RECLAIM_FORGET(m);
+#ifdef PACKAGE_MUDLIB_STATS
+	add_array_size (&m->stats, - (m->count << 1));
+#endif
+	map_release(m);
+	/* other mappings may still be using m's first chunk */
+	if (!m->shares)
+	    free_map_block(m);
 	debug(2048, ("in free_mapping: after m\n"));
 	debug(64,("mapping.c: free_mapping end\n"));
 }
@@ -161,146 +430,180 @@ free_mapping P1(mapping_t *, m)
 	dealloc_mapping(m);
 }
 
-static mapping_node_t *free_nodes = 0;
-mapping_node_block_t *mapping_node_blocks = 0;
-
-#ifdef DEBUGMALLOC_EXTENSIONS
-void mark_mapping_node_blocks() {
-    mapping_node_block_t *mnb = mapping_node_blocks;
-
-    while (mnb) {
-	DO_MARK(mnb, TAG_MAP_NODE_BLOCK);
-	mnb = mnb->next;
-    }
-}
-#endif
-
-mapping_node_t *new_map_node() {
-    mapping_node_block_t *mnb;
-    mapping_node_t *ret;
-    int i;
-
-    if ((ret = free_nodes)) {
-	free_nodes = ret->next;
-    } else {
-	mnb = ALLOCATE(mapping_node_block_t, TAG_MAP_NODE_BLOCK, "new_map_node");
-	mnb->next = mapping_node_blocks;
-	mapping_node_blocks = mnb;
-	mnb->nodes[MNB_SIZE - 1].next = 0;
-	for (i = MNB_SIZE - 1; i--; )
-	    mnb->nodes[i].next = &mnb->nodes[i+1];
-	ret = &mnb->nodes[0];
-	free_nodes = &mnb->nodes[1];
-    }
-    return ret;
-} 
-
-void free_node P1(mapping_node_t *, mn) {
-    mn->next = free_nodes;
-    free_nodes = mn;
-}
-
 /* allocate_mapping(int n)
    
-   call with n == 0 if you will be doing many deletions from the map.
-   call with n == "approx. # of insertions you plan to do" if you won't be
-   doing many deletions from the map.
+   n is the number of entries the mapping is expected to hold; that many
+   nodes are allocated along with the mapping (MAP_INITIAL if n is 0).
 */
  
 INLINE mapping_t *
 allocate_mapping P1(int, n)
 {
 	mapping_t *newmap;
-	mapping_node_t **a;
 
 	if (n > MAX_MAPPING_SIZE) n = MAX_MAPPING_SIZE;
-	newmap = ALLOCATE(mapping_t, TAG_MAPPING, "allocate_mapping: 1");
+	if (n <= 0) n = MAP_INITIAL;
+	/* leave small mappings a little room to grow in place */
+	else if (n < MAP_SMALL)
+	    n = (n + MAP_INITIAL - 1) & ~(MAP_INITIAL - 1);
+	newmap = (mapping_t *) DXALLOC(MAPSIZE(n), TAG_MAPPING, "allocate_mapping");
 	debug(1024,("mapping.c: allocate_mapping begin, newmap = %x\n", newmap));
 	if (newmap == NULL) 
 	    error("Allocate_mapping - out of memory.\n");
 
-	if (n > MAP_HASH_TABLE_SIZE) {
-	    n |= n >> 1;
-	    n |= n >> 2;
-	    n |= n >> 4;
-	    if (n & 0xff00) n |= n >> 8;
-	    newmap->table_size = n++;
-	}
-	else newmap->table_size = (n = MAP_HASH_TABLE_SIZE) - 1;
-	/* The size is actually 1 higher */
-	newmap->unfilled = n * (unsigned)FILL_PERCENT /(unsigned)100;
-	a = newmap->table = 
-	    (mapping_node_t **)DXALLOC(n *= sizeof(mapping_node_t *),
-				    TAG_MAP_TBL, "allocate_mapping: 3");
-	if (!a)
-	    error("Allocate_mapping 2 - out of memory.\n");
-	/* zero out the hash table */
-	memset(a, 0, n);
-	total_mapping_size += sizeof(mapping_t) + n;
+	total_mapping_size += MAPSIZE(n);
 	newmap->ref = 1;
 	newmap->count = 0;
+	newmap->deleted = 0;
+	newmap->mask = 0;
+	newmap->index = 0;
+	newmap->last = &newmap->first;
+	newmap->store = newmap;
+	newmap->shares = 1;
+	newmap->first.next = newmap->first.prev = 0;
+	newmap->first.size = n;
+	newmap->first.used = 0;
 #ifdef PACKAGE_MUDLIB_STATS
 	if (current_object) {
 	  assign_stats (&newmap->stats, current_object);
-	  add_array_size (&newmap->stats, n << 1);
 	} else {
 	  null_stats (&newmap->stats);
 	}
 #endif
 	num_mappings++;
+	if (n > MAP_SMALL)
+	    map_index_build(newmap, map_index_size(n));
 	debug(64,("mapping.c: allocate_mapping end\n"));
 	return newmap;
 }
 
 /*
-  copyMapping: make a copy of a mapping
+  map_copy_body: a new mapping with a copy of m's nodes, and room for at
+  least size entries.  The nodes aren't counted in its stats.
 */
 
-INLINE mapping_t *
-copyMapping P1(mapping_t *,m)
+static mapping_t *
+map_copy_body P2(mapping_t *, m, int, size)
 {
     mapping_t *newmap;
-    int k = m->table_size;
-    mapping_node_t *elt, *nelt, **a, **b = m->table, **c;
-
-    newmap = ALLOCATE(mapping_t, TAG_MAPPING, "copy_mapping: 1");
-    if (newmap == NULL) error("copyMapping - out of memory.\n");
-    newmap->table_size = k++;
-    newmap->unfilled = m->unfilled;
-    newmap->ref = 1;
-    c = newmap->table = CALLOCATE(k, mapping_node_t *, TAG_MAP_TBL, "copy_mapping: 2");
-    if (!c){
-	FREE((char *) newmap);
-	error("copyMapping 2 - out of memory.\n");
+    map_chunk_t *c;
+    mapping_node_t *elt, *node;
+
+    newmap = allocate_mapping(size > m->count ? size : m->count);
+    /* everything fits in the first chunk */
+    node = newmap->first.nodes;
+    MAP_FOREACH(m, c, elt) {
+	assign_svalue_no_free(node->values, elt->values);
+	assign_svalue_no_free(node->values + 1, elt->values + 1);
+	if (newmap->index)
+	    map_index_insert(newmap, node_hash(node), node);
+	node++;
     }
-    total_mapping_nodes += (newmap->count = m->count);
-    memset(c, 0, k * sizeof(mapping_node_t *));
-    total_mapping_size += (sizeof(mapping_t) +
-			   sizeof(mapping_node_t *) * k +
-			   sizeof(mapping_node_t) * m->count);
+    newmap->first.used = newmap->count = m->count;
+    total_mapping_nodes += m->count;
+    return newmap;
+}
 
+/*
+  copyMapping: make a copy of a mapping, with room for at least size
+  entries
+*/
+
+INLINE mapping_t *
+copyMapping P2(mapping_t *, m, int, size)
+{
+    mapping_t *newmap;
+
+    newmap = map_copy_body(m, size);
+#ifdef PACKAGE_MUDLIB_STATS
+    add_array_size (&newmap->stats, m->count << 1);
+#endif
+    return newmap;
+}
+
+/*
+  map_view: a new mapping which uses m's body rather than a copy of it.
+*/
+
+static mapping_t *
+map_view P1(mapping_t *, m)
+{
+    mapping_t *v;
+
+    v = (mapping_t *) DXALLOC(MAPSIZE(1), TAG_MAPPING, "map_view");
+    if (v == NULL)
+	error("Allocate_mapping - out of memory.\n");
+    total_mapping_size += MAPSIZE(1);
+    num_mappings++;
+    v->ref = 1;
+    v->count = m->count;
+    v->deleted = m->deleted;
+    v->mask = m->mask;
+    v->index = m->index;
+    v->last = m->last;
+    v->store = m->store;
+    v->store->shares++;
+    v->shares = 0;
+    v->first.next = v->first.prev = 0;
+    v->first.size = 1;
+    v->first.used = 0;
 #ifdef PACKAGE_MUDLIB_STATS
     if (current_object) {
-	assign_stats (&newmap->stats, current_object);
-	add_array_size (&newmap->stats, m->count << 1);
+	assign_stats (&v->stats, current_object);
+    } else {
+	null_stats (&v->stats);
     }
-    else null_stats (&newmap->stats);
+    add_array_size (&v->stats, m->count << 1);
 #endif
-    num_mappings++;
-    while (k--){
-	if ((elt = b[k])) {
-	    a = c + k;
-	    do {
-		nelt = new_map_node();
-
-		assign_svalue_no_free(nelt->values, elt->values);
-		assign_svalue_no_free(nelt->values + 1, elt->values + 1);
-		nelt->next = *a;
-		*a = nelt;
-	    } while ((elt = elt->next));
-	}
+    return v;
+}
+
+/*
+  share_mapping: a copy of m for copy(), which shares m's body until one of
+  them is changed.  Returns 0 if m has arrays, classes, mappings, buffers
+  or functions in it, which copy() has to copy in turn.
+*/
+
+mapping_t *
+share_mapping P1(mapping_t *, m)
+{
+    map_chunk_t *c;
+    mapping_node_t *elt;
+
+    MAP_FOREACH(m, c, elt) {
+	if ((elt->values[0].type | elt->values[1].type) &
+	    (T_ARRAY | T_CLASS | T_MAPPING | T_BUFFER | T_FUNCTION))
+	    return 0;
     }
-    return newmap;
+    /* small ones are as quick to copy */
+    if (m->count <= MAP_SMALL)
+	return copyMapping(m, 0);
+    return map_view(m);
+}
+
+/*
+  unshare_mapping: give m a body of its own, if the one it has is shared.
+  m itself stays where it is, so every reference to it sees the change
+  that follows.
+*/
+
+void
+unshare_mapping P1(mapping_t *, m)
+{
+    mapping_t *h;
+
+    if (!MAP_SHARED(m))
+	return;
+    debug(1024,("mapping.c: unshare_mapping ptr = %x\n", m));
+    h = map_copy_body(m, 0);
+    /* h only exists as m's body */
+    h->ref = 0;
+    map_release(m);
+    m->store = h;
+    m->deleted = 0;
+    m->mask = h->mask;
+    m->index = h->index;
+    m->last = h->last;
 }
 
 INLINE int
@@ -357,7 +660,7 @@ restore_hash_string P2(char **, val, svalue_t *, sv)
  * svalue_t_to_int: Converts an svalue into an integer index.
  */
 
-INLINE int
+INLINE unsigned int
 svalue_to_int P1(svalue_t *, v)
 {
     if (v->type == T_STRING && v->subtype != STRING_SHARED) {
@@ -366,13 +669,26 @@ svalue_to_int P1(svalue_t *, v)
 	v->subtype = STRING_SHARED;
 	v->u.string = p;
     }
-    /* The bottom bits of pointers tend to be bad ... 
-     * Note that this means close groups of numbers don't hash particularly
-     * well, but then one wonders why they aren't using an array ...
-     */
     return MAP_POINTER_HASH(v->u.number);
 }
 
+/*
+ * map_key: make a key suitable for looking up in m; returns its hash if
+ * m has an index.
+ */
+
+INLINE_STATIC unsigned int
+map_key P2(mapping_t *, m, svalue_t *, v)
+{
+    if (v->type == T_STRING && v->subtype != STRING_SHARED) {
+	char *p = make_shared_string(v->u.string);
+	free_string_svalue(v);
+	v->subtype = STRING_SHARED;
+	v->u.string = p;
+    }
+    return m->index ? MAP_POINTER_HASH(v->u.number) : 0;
+}
+
 int msameval P2(svalue_t *, arg1, svalue_t *, arg2) {
     switch (arg1->type | arg2->type) {
     case T_NUMBER:
@@ -384,26 +700,74 @@ int msameval P2(svalue_t *, arg1, svalue_t *, arg2) {
     }
 }
 
+/*
+ * map_find: return the node for key, whose hash is h, or 0.
+ */
+
+INLINE_STATIC mapping_node_t *
+map_find P3(mapping_t *, m, svalue_t *, key, unsigned int, h)
+{
+	if (m->index) {
+	    map_slot_t *s, *idx = m->index;
+	    unsigned int i = h & m->mask;
+
+	    while ((s = idx + i)->node) {
+		if (s->hash == h && msameval(s->node->values, key))
+		    return s->node;
+		i = (i + 1) & m->mask;
+	    }
+	} else {
+	    map_chunk_t *c;
+	    mapping_node_t *elt;
+
+	    /* equal keys always have equal u.number bits, which is a
+	       cheaper test than msameval() */
+	    MAP_FOREACH(m, c, elt) {
+		if (elt->values->u.number == key->u.number &&
+		    msameval(elt->values, key))
+		    return elt;
+	    }
+	}
+	return (mapping_node_t *)0;
+}
+
 /*
  * node_find_in_mapping: Like find_for_insert(), but doesn't attempt
- * to add anything if a value is not found.  The returned pointer won't
- * necessarily have any meaningful value.
+ * to add anything if a value is not found.
  */
 
 INLINE mapping_node_t *
 node_find_in_mapping P2(mapping_t *, m, svalue_t *, lv)
 {
-	int i;
-	mapping_node_t *elt, **a = m->table;
- 
 	debug(1,("mapping.c: find_in_mapping\n"));
+	return map_find(m, lv, map_key(m, lv));
+}
 
-	i = svalue_to_int(lv) & m->table_size;
-	for (elt = a[i]; elt; elt = elt->next) {
-		if (msameval(elt->values, lv))
-			return elt;
-	}
-	return (mapping_node_t *)0;
+/*
+ * new_map_node: add a node for key, which must not be in the mapping yet.
+ * The node takes over the reference to key; its value is 0.
+ */
+
+mapping_node_t *
+new_map_node P2(mapping_t *, m, svalue_t *, key)
+{
+	return map_append(m, key, map_key(m, key));
+}
+
+/*
+ * mapping_delete_node: remove a node of the mapping, freeing its key
+ * and value.
+ */
+
+void mapping_delete_node P2(mapping_t *, m, mapping_node_t *, node)
+{
+	svalue_t key, value;
+
+	key = node->values[0];
+	value = node->values[1];
+	map_unlink(m, node);
+	free_svalue(&value, "mapping_delete");
+	free_svalue(&key, "mapping_delete");
 }
 
 /*
@@ -412,31 +776,18 @@ node_find_in_mapping P2(mapping_t *, m, svalue_t *, lv)
 
 INLINE void mapping_delete P2(mapping_t *,m, svalue_t *,lv)
 {
-	int i = svalue_to_int(lv) & m->table_size;
-	mapping_node_t **prev = m->table + i, *elt;
-
-	if ((elt = *prev)) {
-	    do {
-		if (msameval(elt->values, lv)){
-		    if (!(*prev = elt->next) && !m->table[i]){
-			m->unfilled++;
-			debug(1024,("mapping delete: bucket empty, unfilled = \n",
-				    m->unfilled));
-		    }
-		    m->count--;
-		    total_mapping_nodes--;
-		    total_mapping_size -= sizeof(mapping_node_t);
-		    debug(1024,("mapping delete: count = \n", m->count));
-		    free_svalue(elt->values + 1, "mapping_delete");
-		    free_svalue(elt->values, "mapping_delete");
-		    free_node(elt);
-		    return;
-
-		}
-		prev = &(elt->next);
-	    } while ((elt = elt->next));
+	mapping_node_t *elt = map_find(m, lv, map_key(m, lv));
 
-	} 
+	if (elt && MAP_SHARED(m)) {
+	    unshare_mapping(m);
+	    elt = map_find(m, lv, map_key(m, lv));
+	}
+	if (elt) {
+	    mapping_delete_node(m, elt);
+	    debug(1024,("mapping delete: count = %d\n", m->count));
+	    if (m->deleted > m->count)
+		map_compact_later(m);
+	}
 }
  
 /*
@@ -449,52 +800,25 @@ INLINE void mapping_delete P2(mapping_t *,m, svalue_t *,lv)
 INLINE svalue_t *
 find_for_insert P3(mapping_t *, m, svalue_t *, lv, int, doTheFree)
 {
-	int oi = svalue_to_int(lv);
-	unsigned short i = oi & m->table_size;
-	mapping_node_t *n, *newnode, **a = m->table + i;
+	unsigned int h;
+	mapping_node_t *n;
+	svalue_t key;
  
-	debug(128,("mapping.c: hashed to %d\n", i));
-	if ((n = *a)) {
-	    do {
-		if (msameval(lv, n->values)) {
-		    /* normally, the f_assign would free the old value */
-		    debug(128,("mapping.c: found %x\n", n->values));
-		    if (doTheFree) free_svalue(n->values + 1, "find_for_insert");
-		    return n->values + 1;
-		}
-	    } while ((n = n->next));
-	    debug(128,("mapping.c: didn't find %x\n", lv));
-	    n = *a;
-	}
-	else if (!(--m->unfilled)){
-	    int size = m->table_size + 1;
-
-	    if (growMap(m)){ 
-		if (oi & size) i |= size;
-		n = *(a = m->table + i);
-	    } else {
-		error("Out of memory\n");
-	    }
+	unshare_mapping(m);
+	h = map_key(m, lv);
+	if ((n = map_find(m, lv, h))) {
+	    /* normally, the f_assign would free the old value */
+	    debug(128,("mapping.c: found %x\n", n->values));
+	    if (doTheFree) free_svalue(n->values + 1, "find_for_insert");
+	    return n->values + 1;
 	}
-
-	if (++m->count > MAX_MAPPING_SIZE) {
-		m->count--;
-		debug(128,("mapping.c: too full\n", lv));
-		mapping_too_large();
+	debug(128,("mapping.c: didn't find %x\n", lv));
+	if (m->count >= MAX_MAPPING_SIZE) {
+	    debug(128,("mapping.c: too full\n"));
+	    mapping_too_large();
 	}
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size (&m->stats, 2);
-#endif
-	total_mapping_size += sizeof(mapping_node_t);
-	debug(128,("mapping.c: allocated a node\n"));
-	newnode = new_map_node();
-	assign_svalue_no_free(newnode->values, lv);
-	/* insert at head of bucket */
-	(*a = newnode)->next = n;
-	lv = newnode->values + 1;
-	*lv = const0u;
-	total_mapping_nodes++;
-	return lv;
+	assign_svalue_no_free(&key, lv);
+	return map_append(m, &key, h)->values + 1;
 }
  
 #ifdef F_UNIQUE_MAPPING
@@ -509,7 +833,7 @@ typedef struct unique_node_s {
 typedef struct unique_m_list_s {
     unique_node_t **utable;
     struct unique_m_list_s *next;
-    unsigned short mask;
+    unsigned int mask;
 } unique_m_list_t;
 
 static unique_m_list_t *g_u_m_list = 0;
@@ -541,13 +865,12 @@ void f_unique_mapping PROT((void))
 {
     unique_m_list_t *nlist;
     svalue_t *arg = sp - st_num_arg + 1, *sv;
-    unique_node_t **table, *uptr, *nptr;
+    unique_node_t **table, *uptr;
     array_t *v = arg->u.arr, *ret;
-    unsigned short oi, i, numkeys = 0, mask, size;
+    unsigned int i, numkeys = 0, mask, size;
     unsigned short num_arg = st_num_arg;
-    unsigned short nmask;
     mapping_t *m;
-    mapping_node_t **mtable, *elt;
+    mapping_node_t *elt;
     int *ind, j;
     function_to_call_t ftc;
     
@@ -566,7 +889,8 @@ void f_unique_mapping PROT((void))
         size |= size >> 1;
         size |= size >> 2;
         size |= size >> 4;
-        if (size & 0xff00) size |= size >> 8;
+        size |= size >> 8;
+        size |= size >> 16;
         mask = size++;
     } else mask = (size = MAP_HASH_TABLE_SIZE) - 1;
 
@@ -588,7 +912,7 @@ void f_unique_mapping PROT((void))
     while (size--) {
         push_svalue(v->item + size);
 	sv = call_efun_callback(&ftc, 1);
-        i = (oi = svalue_to_int(sv)) & mask;
+        i = svalue_to_int(sv) & mask;
         if ((uptr = table[i])) {
             do {
                 if (msameval(&uptr->key, sv)) {
@@ -611,72 +935,29 @@ void f_unique_mapping PROT((void))
         }
     }
 
-    m = allocate_mapping(nmask = numkeys << 1);
-    mtable = m->table;
-    numkeys = 0;
-
-    if (nmask > MAP_HASH_TABLE_SIZE){
-        nmask |= nmask >> 1;
-        nmask |= nmask >> 2;
-        nmask |= nmask >> 4;
-        if (size & 0xff00) nmask |= nmask >> 8;
-    } else nmask = MAP_HASH_TABLE_SIZE - 1;
+    m = allocate_mapping(numkeys);
     j = mask;
     sv = v->item;
 
     do {
-        if ((uptr = table[j])) {
-            do {
-                nptr = uptr->next;
-		oi = MAP_POINTER_HASH(uptr->key.u.number);
-                i = oi & nmask;
-                if (!mtable[i] && !(--m->unfilled)) {
-                    if (growMap(m)) {
-                        mtable = m->table;
-                        nmask <<= 1;
-                        nmask--;
-                    } else {
-			do {
-			    do {
-				nptr = uptr->next;
-				free_svalue(&uptr->key, "f_unique_mapping");
-				FREE((char *) uptr->indices);
-				FREE((char *) uptr);
-			    } while ((uptr = nptr));
-			    uptr = table[--j];
-			} while (j >= 0);
-#ifdef PACKAGE_MUDLIB_STATS
-                        add_array_size(&m->stats, numkeys << 1);
-#endif
-                        total_mapping_size += sizeof(mapping_node_t) * (m->count = numkeys);
-                        total_mapping_nodes += numkeys;
-                        free_mapping(m);
-                        error("Out of memory\n");
-                    }
-                }
-
-                elt = ALLOCATE(mapping_node_t, 105,"f_unique_mapping:6");
-                *elt->values = uptr->key;
-                (elt->values + 1)->type = T_ARRAY;
-                ret = (elt->values + 1)->u.arr = allocate_empty_array(size = uptr->count);
-                ind = uptr->indices;
-                while (size--) {
-                    assign_svalue_no_free(ret->item + size, sv + ind[size]);
-                }
-                elt->next = mtable[i];
-                mtable[i] = elt;
-                FREE((char *) ind);
-                FREE((char *) uptr);
-                numkeys++;
-            } while ((uptr = nptr));
+        while ((uptr = table[j])) {
+	    elt = map_append(m, &uptr->key, m->index ?
+			     MAP_POINTER_HASH(uptr->key.u.number) : 0);
+	    /* the key now belongs to m; keep the table valid for the
+	       error handler */
+	    table[j] = uptr->next;
+	    ind = uptr->indices;
+	    size = uptr->count;
+	    FREE((char *) uptr);
+	    (elt->values + 1)->type = T_ARRAY;
+	    ret = (elt->values + 1)->u.arr = allocate_empty_array(size);
+	    while (size--) {
+		assign_svalue_no_free(ret->item + size, sv + ind[size]);
+	    }
+	    FREE((char *) ind);
         }
     } while (j--);
 
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&m->stats, numkeys << 1);
-#endif
-    total_mapping_size += sizeof(mapping_node_t) * (m->count = numkeys);
-    total_mapping_nodes += numkeys;
     FREE((char *) table);
     g_u_m_list = g_u_m_list->next;
     FREE((char *) nlist);
@@ -690,72 +971,34 @@ void f_unique_mapping PROT((void))
 
 /*
  * load_mapping_from_aggregate: Create a new mapping, loading from an
- * array of svalues. Format of data: LHS RHS LHS2 RHS2... (uses hash table)
+ * array of svalues. Format of data: LHS RHS LHS2 RHS2...
  */
 
 INLINE mapping_t *
 load_mapping_from_aggregate P2(svalue_t *,sp, int, n)
 {
 	mapping_t *m;
-	int mask, i, oi, count = 0;
-	mapping_node_t **a, *elt, *elt2; 
+	mapping_node_t *elt;
+	unsigned int h;
  
 	debug(128,("mapping.c: load_mapping_from_aggregate begin, size = %d\n", n));
 	m = allocate_mapping(n >> 1);
 	if (!n) return m;
-	mask = m->table_size;
-	a = m->table;
 	do {
-	    i = (oi = svalue_to_int(++sp)) & mask;
-	    if ((elt2 = elt = a[i])) {
-		do {
-		    if (msameval(sp, elt->values)) {
-			free_svalue(sp++, "load_mapping_from_aggregate: duplicate key");
-			free_svalue(elt->values+1, "load_mapping_from_aggregate");
-			*(elt->values+1) = *sp;
-			break;
-		    }
-		} while ((elt = elt->next));
-		if (elt) continue;
-	    }
-	    else if (!(--m->unfilled)){
-		if (growMap(m)){
-		    a = m->table;
-		    if (oi & ++mask) elt2 = a[i |= mask];
-		    mask <<= 1;
-		    mask--;
-		} else{
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_array_size(&m->stats, count << 1);
-#endif
-		    total_mapping_size += sizeof(mapping_node_t) * (m->count = count);
-		    total_mapping_nodes += count;
-		    free_mapping(m);
-		    error("Out of memory\n");
-		}
+	    h = map_key(m, ++sp);
+	    if ((elt = map_find(m, sp, h))) {
+		free_svalue(sp++, "load_mapping_from_aggregate: duplicate key");
+		free_svalue(elt->values+1, "load_mapping_from_aggregate");
+		*(elt->values+1) = *sp;
+		continue;
 	    }
-
-	    if (++count > MAX_MAPPING_SIZE){
-#ifdef PACKAGE_MUDLIB_STATS
-		add_array_size(&m->stats, (--count) << 1);
-#endif
-		total_mapping_size += sizeof(mapping_node_t) * (m->count = count);
-		total_mapping_nodes += count;
-		
+	    if (m->count >= MAX_MAPPING_SIZE) {
 		free_mapping(m);
 		mapping_too_large();
 	    }
-
-	    elt = new_map_node();
-	    *elt->values = *sp++;
+	    elt = map_append(m, sp++, h);
 	    *(elt->values + 1) = *sp;
-	    (a[i] = elt)->next = elt2;
 	} while (n -= 2);
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&m->stats, count << 1);
-#endif
-	total_mapping_size += sizeof(mapping_node_t) * (m->count = count);
-	total_mapping_nodes += count;
 	debug(128,("mapping.c: load_mapping_from_aggregate end\n"));
 	return m;
 }
@@ -765,33 +1008,25 @@ load_mapping_from_aggregate P2(svalue_t *,sp, int, n)
 INLINE svalue_t *
 find_in_mapping P2(mapping_t *, m, svalue_t *,lv)
 {
-	int i = svalue_to_int(lv) & m->table_size;
-	mapping_node_t *n = m->table[i];
-
-	while (n){
-	    if (msameval(n->values, lv)) return n->values + 1;
-	    n = n->next;
-	}
+	mapping_node_t *n = map_find(m, lv, map_key(m, lv));
 
-	return &const0u;
+	return n ? n->values + 1 : &const0u;
 }
 
 svalue_t *
 find_string_in_mapping P2(mapping_t *, m, char *, p)
 {
     char *ss = findstring(p);
-    int i;
+    svalue_t key;
     mapping_node_t *n;
     
     if (!ss) return &const0u;
-    i = MAP_POINTER_HASH(ss);
-    n = m->table[i & m->table_size];
-    
-    while (n) {
-	if (n->values->type == T_STRING && n->values->u.string == ss)
-	    return n->values + 1;
-	n = n->next;
-    }
+    key.type = T_STRING;
+    key.subtype = STRING_SHARED;
+    key.u.string = ss;
+    n = map_find(m, &key, m->index ? MAP_POINTER_HASH(ss) : 0);
+    if (n && n->values->type == T_STRING)
+	return n->values + 1;
     return &const0u;
 }
 
@@ -802,147 +1037,26 @@ find_string_in_mapping P2(mapping_t *, m, char *, p)
 INLINE_STATIC void
 add_to_mapping P3(mapping_t *,m1, mapping_t *,m2, int, free_flag)
 {
-    int mask = m1->table_size, j = m2->table_size;
-    int count = m1->count;
-    int i, oi;
-    mapping_node_t *elt1, *elt2, *newnode, *n;
-    mapping_node_t **a1 = m1->table, **a2 = m2->table;
-    svalue_t *sv;
-
-    do {
-	for (elt2 = a2[j]; elt2; elt2 = elt2->next){
-	    i = (oi = node_hash(elt2)) & mask;
-	    sv = elt2->values;
-	    if ((n = elt1 = a1[i])) {
-		do {
-		    if (msameval(sv, elt1->values)){
-			assign_svalue(elt1->values + 1, sv + 1);
-			break; 
-		    }
-		} while ((elt1 = elt1->next));
-		if (elt1) continue;
-	    } else if (!(--m1->unfilled)){
-		if (growMap(m1)){
-		    a1 = m1->table;
-		    if (oi & ++mask) n = a1[i |= mask];
-		    mask <<= 1;
-		    mask--;
-		} else{
-		    count -= m1->count;
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_array_size(&m1->stats, count << 1);
-#endif
-		    total_mapping_size += count * sizeof(mapping_node_t);
-		    total_mapping_nodes += count;
-		    m1->count += count;
-		    if (free_flag) free_mapping(m1);
-		    error("Out of memory\n");
-		}
-	    }
-	    if (++count > MAX_MAPPING_SIZE){
-		if (count -= m1->count + 1){	
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_array_size(&m1->stats, count << 1);
-#endif
-		    total_mapping_size += count * sizeof(mapping_node_t);
-		    total_mapping_nodes += count;
-		}
-		m1->count += count;
-		mapping_too_large();
-	    }
-
-	    newnode = new_map_node();
-	    assign_svalue_no_free(newnode->values, elt2->values);
-	    assign_svalue_no_free(newnode->values+1,elt2->values+1);
-	    (a1[i] = newnode)->next = n;
+    map_chunk_t *c;
+    mapping_node_t *elt1, *elt2;
+    svalue_t key;
+    unsigned int h;
+
+    unshare_mapping(m1);
+    MAP_FOREACH(m2, c, elt2) {
+	h = node_key_hash(m1, elt2);
+	if ((elt1 = map_find(m1, elt2->values, h))) {
+	    assign_svalue(elt1->values + 1, elt2->values + 1);
+	    continue;
 	}
-    } while (j--);
-
-    if (count -= m1->count){
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&m1->stats, count << 1);
-#endif
-	total_mapping_size += count * sizeof(mapping_node_t);
-	total_mapping_nodes += count;
-    }
-
-    m1->count += count;
-}
-
-/* 
-    unique_add_to_mapping : adds m2 to m1 but doesn't do anything
-		            if they have common keys 
-*/
-
-INLINE_STATIC void
-unique_add_to_mapping P3(mapping_t *,m1, mapping_t *,m2, int,free_flag)
-{
-    int mask = m1->table_size, j = m2->table_size;
-    int count = m1->count;
-    int i, oi;
-    mapping_node_t *elt1, *elt2, *newnode, *n;
-    mapping_node_t **a1 = m1->table, **a2 = m2->table;
-    svalue_t *sv;
-
-    do {
-	for (elt2 = a2[j]; elt2; elt2 = elt2->next){
-	    i = (oi = node_hash(elt2)) & mask;
-	    sv = elt2->values;
-	    if ((n = elt1 = a1[i])) {
-		do {
-		    if (msameval(sv, elt1->values)) break;
-		} while ((elt1 = elt1->next));
-		if (elt1) continue;
-	    }
-	    else if (!(--m1->unfilled)){
-		if (growMap(m1)){
-		    a1 = m1->table;
-		    if (oi & ++mask) n = a1[i |= mask];
-		    mask <<= 1;
-		    mask--;
-		} else{
-		    ++m1->unfilled;
-		    count -= m1->count;
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_array_size(&m1->stats, count << 1);
-#endif
-		    total_mapping_size += count * sizeof(mapping_node_t);
-		    total_mapping_nodes += count;
-		    m1->count += count;
-		    if (free_flag) free_mapping(m1);
-
-		    error("Out of memory\n");
-		}
-	    }
-
-	    if (++count > MAX_MAPPING_SIZE){
-		if (count -= m1->count + 1){
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_array_size(&m1->stats, count << 1);
-#endif
-		    total_mapping_size += count * sizeof(mapping_node_t);
-		    total_mapping_nodes += count;
-		}
-		m1->count += count;
-		mapping_too_large();
-	    }
-
-	    newnode = new_map_node();
-	    assign_svalue_no_free(newnode->values, elt2->values);
-	    assign_svalue_no_free(newnode->values+1,elt2->values+1);
-	    (a1[i] = newnode)->next = n;
+	if (m1->count >= MAX_MAPPING_SIZE) {
+	    if (free_flag) free_mapping(m1);
+	    mapping_too_large();
 	}
-    } while (j--);
-
-    if (count -= m1->count){
-#ifdef PACKAGE_MUDLIB_STATS
-	add_array_size(&m1->stats, count << 1);
-#endif
-	total_mapping_size += count * sizeof(mapping_node_t);
-	total_mapping_nodes += count;
+	assign_svalue_no_free(&key, elt2->values);
+	elt1 = map_append(m1, &key, h);
+	assign_svalue_no_free(elt1->values + 1, elt2->values + 1);
     }
-
-    m1->count += count;
 }
 
 INLINE void
@@ -954,7 +1068,7 @@ mapping_t *m1, *m2;
 
 /*
    add_mapping: returns a new mapping that contains everything
-   in two old mappings.  (uses hash table)
+   in two old mappings.
 */
 
 INLINE mapping_t *
@@ -963,19 +1077,13 @@ add_mapping P2(mapping_t *,m1, mapping_t *,m2)
 	mapping_t *newmap;
  
 	debug(128,("mapping.c: add_mapping begin: %x, %x\n", m1, m2));
-	if (m1->count >= m2->count){
-	    if (m2->count){
-		add_to_mapping(newmap = copyMapping(m1), m2, 1);
-		return newmap;
-	    }
-	    else return copyMapping(m1);
-	}
-	else if (m1->count){
-	    unique_add_to_mapping(newmap = copyMapping(m2), m1, 1);
-	    return newmap;
-	}   
-	else return copyMapping(m2);
+	if (!m2->count)
+	    return copyMapping(m1, 0);
+	/* m1's keys come first, m2's values win */
+	newmap = copyMapping(m1, m1->count + m2->count);
+	add_to_mapping(newmap, m2, 1);
 	debug(128,("mapping.c: add_mapping end\n"));
+	return newmap;
 }
 
 /*
@@ -988,29 +1096,26 @@ void
 map_mapping P2(svalue_t *, arg, int, num_arg)
 {
     mapping_t *m = arg->u.map;
-    mapping_node_t **a, *elt;
-    int j = m->table_size;
+    map_chunk_t *c;
+    mapping_node_t *elt;
     svalue_t *ret;
     function_to_call_t ftc;
     
     process_efun_callback(1, &ftc, F_MAP);
 
-    m = copyMapping(m);
+    m = copyMapping(m, 0);
     (++sp)->type = T_MAPPING;
     sp->u.map = m;
 
-    a = m->table;
     debug(1,("mapping.c: map_mapping\n"));
-    do {
-	for (elt = a[j]; elt ; elt = elt->next){
-	    push_svalue(elt->values);
-	    push_svalue(elt->values+1);
-	    ret = call_efun_callback(&ftc, 2);
-	    if (ret) assign_svalue(elt->values+1, ret);
-	    else break;
-	}
-    } while (j--);
-
+    MAP_FOREACH(m, c, elt) {
+	push_svalue(elt->values);
+	push_svalue(elt->values+1);
+	ret = call_efun_callback(&ftc, 2);
+	if (ret) assign_svalue(elt->values+1, ret);
+	else goto done;
+    }
+  done:
     sp--;
     pop_n_elems(num_arg);
     (++sp)->type = T_MAPPING;	
@@ -1023,11 +1128,9 @@ void
 filter_mapping P2(svalue_t *, arg, int, num_arg)
 {
     mapping_t *m = arg->u.map, *newmap;
-    mapping_node_t **a, *elt;
-    mapping_node_t **b, *newnode, *n;
-    int j = m->table_size, count = 0, size;
-    svalue_t *ret;
-    unsigned short tb_index;
+    map_chunk_t *c;
+    mapping_node_t *elt, *newnode;
+    svalue_t *ret, key;
     function_to_call_t ftc;
     
     process_efun_callback(1, &ftc, F_FILTER);
@@ -1035,63 +1138,26 @@ filter_mapping P2(svalue_t *, arg, int, num_arg)
     newmap = allocate_mapping(0);
     (++sp)->type = T_MAPPING;
     sp->u.map = newmap;
-    b = newmap->table;
-    size = newmap->table_size;
+    /* the function may change m, which mustn't free the nodes we're on */
+    (++sp)->type = T_MAPPING;
+    sp->u.map = m = map_view(m);
 
-    a = m->table;
     debug(1,("mapping.c: filter_mapping\n"));
-    do {
-	for (elt = a[j]; elt ; elt = elt->next){
-	    push_svalue(elt->values);
-	    push_svalue(elt->values+1);
-	    ret = call_efun_callback(&ftc, 2);
-	    if (!ret) break;
-	    else if (ret->type != T_NUMBER || ret->u.number) {
-		tb_index = node_hash(elt) & size;
-		b = newmap->table + tb_index;
-		if (!(n = *b) && !(--newmap->unfilled)) {
-		    if (growMap(newmap)){
-			size = newmap->table_size;
-			tb_index = node_hash(elt) & size;
-			n = *(b = newmap->table + tb_index);
-		    } else {
-#ifdef PACKAGE_MUDLIB_STATS
-			add_array_size(&newmap->stats, count << 1);
-#endif
-			total_mapping_size += count * sizeof(mapping_node_t);
-			total_mapping_nodes += count;
-			newmap->count = count;
-			error("Out of memory in filter_mapping\n");
-		    }
-		}
-		if (++count > MAX_MAPPING_SIZE){
-		    count--;
-#ifdef PACKAGE_MUDLIB_STATS
-		    add_array_size(&newmap->stats, count << 1);
-#endif
-		    total_mapping_size += count * sizeof(mapping_node_t);
-                    total_mapping_nodes += count;
-		    newmap->count = count;
-		    mapping_too_large();
-		}
-
-		newnode = new_map_node();
-		assign_svalue_no_free(newnode->values, elt->values);
-		assign_svalue_no_free(newnode->values+1, elt->values+1);
-		(*b = newnode)->next = n;
-	    }
+    MAP_FOREACH(m, c, elt) {
+	push_svalue(elt->values);
+	push_svalue(elt->values+1);
+	ret = call_efun_callback(&ftc, 2);
+	if (!ret) goto done;
+	else if (ret->type != T_NUMBER || ret->u.number) {
+	    if (newmap->count >= MAX_MAPPING_SIZE)
+		mapping_too_large();
+	    assign_svalue_no_free(&key, elt->values);
+	    newnode = map_append(newmap, &key, node_key_hash(newmap, elt));
+	    assign_svalue_no_free(newnode->values+1, elt->values+1);
 	}
-    } while (j--);
-
-    if (count){
-#ifdef PACKAGE_MUDLIB_STATS
-        add_array_size(&newmap->stats, count << 1);
-#endif
-        total_mapping_size += count * sizeof(mapping_node_t);
-        total_mapping_nodes += count;
-	newmap->count += count;
     }
-
+  done:
+    free_mapping((sp--)->u.map);
     sp--;
     pop_n_elems(num_arg);
     (++sp)->type = T_MAPPING;	
@@ -1104,45 +1170,27 @@ filter_mapping P2(svalue_t *, arg, int, num_arg)
 INLINE mapping_t *
 compose_mapping P3(mapping_t *,m1, mapping_t *,m2, unsigned short,flag)
 {
-	mapping_node_t *elt, *elt2, **a, **b = m2->table, **prev;
-	unsigned short j = m1->table_size, deleted = 0;
-	unsigned short mask = m2->table_size;
+	map_chunk_t *c;
+	mapping_node_t *elt, *elt2;
 	svalue_t *sv;
 
 	debug(1,("mapping.c: compose_mapping\n"));
-	if (flag) m1 = copyMapping(m1);
-	a = m1->table;
-
-	do {
-	    if ((elt = *(prev = a))) {
-		do {
-		    sv = elt->values + 1;
-		    if ((elt2 = b[svalue_to_int(sv) & mask])) {
-			do {
-			    if (msameval(sv, elt2->values)) {
-				assign_svalue(sv, elt2->values + 1);
-				break;
-			    }
-			} while ((elt2 = elt2->next));
-		    }
-		    if (!elt2) {
-			if (!(*prev = elt->next) && !(*a)) m1->unfilled++;
-			deleted++;
-			free_svalue(sv--, "compose_mapping");
-			free_svalue(sv, "compose_mapping");
-			free_node(elt);
-		    } else {
-			prev = &(elt->next);
-		    }
-		} while ((elt = *prev));
-	    }
-	} while (a++, j--);
-
-
-	if (deleted) {
-	    m1->count -= deleted;
-	    total_mapping_nodes -= deleted;
-	    total_mapping_size -= deleted * sizeof(mapping_node_t);
+	if (flag) m1 = copyMapping(m1, 0);
+	else unshare_mapping(m1);
+
+	MAP_FOREACH(m1, c, elt) {
+	    sv = elt->values + 1;
+	    if ((elt2 = map_find(m2, sv, map_key(m2, sv))))
+		assign_svalue(sv, elt2->values + 1);
+	    else
+		mapping_delete_node(m1, elt);
+	}
+	if (m1->deleted > m1->count) {
+	    /* nobody else can see a new copy yet */
+	    if (flag)
+		map_compact(m1);
+	    else
+		map_compact_later(m1);
 	}
 
 	if (flag) return m1;
@@ -1156,18 +1204,16 @@ array_t *
 mapping_indices P1(mapping_t *,m)
 {
 	array_t *v;
-	int j = m->table_size;
-	mapping_node_t *elt, **a = m->table;
+	map_chunk_t *c;
+	mapping_node_t *elt;
 	svalue_t *sv;
 
 	debug(128,("mapping_indices: size = %d\n",m->count));
 
 	v = allocate_empty_array(m->count);
 	sv = v->item;
-	do {
-	    for (elt = a[j]; elt; elt = elt->next)
-		assign_svalue_no_free(sv++, elt->values);
-	} while (j--);
+	MAP_FOREACH(m, c, elt)
+	    assign_svalue_no_free(sv++, elt->values);
 	return v;
 }
 
@@ -1177,18 +1223,16 @@ array_t *
 mapping_values P1(mapping_t *,m)
 {
 	array_t *v;
-	int j = m->table_size;
-	mapping_node_t *elt, **a = m->table;
+	map_chunk_t *c;
+	mapping_node_t *elt;
 	svalue_t *sv;
 
 	debug(128,("mapping_indices: size = %d\n",m->count));
 
 	v = allocate_empty_array(m->count);
 	sv = v->item;
-	do {
-	    for (elt = a[j]; elt; elt = elt->next)
-		assign_svalue_no_free(sv++, elt->values + 1);
-	} while (j--);
+	MAP_FOREACH(m, c, elt)
+	    assign_svalue_no_free(sv++, elt->values + 1);
 	return v;
 }
 
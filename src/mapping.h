@@ -3,41 +3,91 @@
 #ifndef _MAPPING_H
 #define _MAPPING_H
 
-#define MAP_POINTER_HASH(x) (((POINTER_INT)x) >> 4)
+#define MAP_POINTER_HASH(x) map_hash((POINTER_INT)(x))
 
 typedef struct mapping_node_s {
-    struct mapping_node_s *next;
     svalue_t values[2];
 } mapping_node_t;
 
-#define MNB_SIZE 256
+/*
+ * Nodes live in chunks which are never moved or shrunk while the mapping
+ * is alive, so a pointer to a value stays good across later insertions
+ * (the interpreter may hold several lvalues into one mapping at once).
+ * The first chunk is allocated together with the mapping itself; further
+ * chunks double in size up to MAP_CHUNK_MAX nodes.
+ *
+ * Nodes are kept in insertion order, which is the order keys(), values(),
+ * foreach and save_object() see.  A deleted node is left in place with a
+ * key of type T_INVALID until the mapping is compacted, which is put off
+ * until compact_mappings() runs between backend cycles, since it moves
+ * nodes.
+ *
+ * The chunks, the index and the nodes in them are the mapping's body.
+ * copy() can give a mapping a view of the body of another one (its store)
+ * instead of copying it, in the same way as arrays share their elements
+ * (see array.h); a shared body (MAP_SHARED()) is never changed, and
+ * unshare_mapping() gives a mapping a body of its own first.  The header
+ * fields describing the body (count to last) are copied into each mapping
+ * using it, and are only changed once it is no longer shared.
+ */
+typedef struct map_chunk_s {
+    struct map_chunk_s *next, *prev;
+    int size;			/* # of nodes allocated */
+    int used;			/* # of nodes in use */
+    mapping_node_t nodes[1];
+} map_chunk_t;
 
-typedef struct mapping_node_block_s {
-    struct mapping_node_block_s *next;
-    mapping_node_t nodes[MNB_SIZE];
-} mapping_node_block_t;
+/*
+ * Mappings with more than MAP_SMALL entries get an open addressing index
+ * (linear probing) of hash values and node pointers; smaller ones are
+ * searched linearly.
+ */
+typedef struct map_slot_s {
+    unsigned int hash;
+    mapping_node_t *node;	/* 0 if the slot is empty */
+} map_slot_t;
 
-#define MAX_TABLE_SIZE 32768
-#define MAP_HASH_TABLE_SIZE 8	/* must be a power of 2 */
-#define FILL_PERCENT 80		/* must not be larger than 99 */
+#define MAP_SMALL 8
+#define MAP_INITIAL 4		/* nodes when no size is given */
+#define MAP_CHUNK_MAX 1024
+#define MAP_HASH_TABLE_SIZE 8	/* unique_mapping() table; a power of 2 */
 
-#define MAPSIZE(size) sizeof(mapping_t)
+#define MAPSIZE(size) (sizeof(mapping_t) + sizeof(mapping_node_t) * ((size) - 1))
+#define CHUNKSIZE(size) (sizeof(map_chunk_t) + sizeof(mapping_node_t) * ((size) - 1))
 
 typedef struct mapping_s {
-    unsigned short ref;		/* how many times this map has been
+    unsigned int ref;		/* how many times this map has been
 				 * referenced */
 #ifdef DEBUG
     int extra_ref;
 #endif
-    mapping_node_t **table;	/* the hash table */
-    unsigned short table_size;	/* # of buckets in hash table == power of 2 */
-    unsigned short unfilled;	/* # of buckets among 80% of total buckets that do not have entries */
     int count;			/* total # of nodes actually in mapping  */
+    int deleted;		/* # of deleted nodes not yet compacted */
+    unsigned int mask;		/* # of index slots - 1 */
+    map_slot_t *index;		/* 0 for small mappings */
+    map_chunk_t *last;		/* chunk new nodes are added to */
+    struct mapping_s *store;	/* the mapping whose first is ours */
+    unsigned int shares;	/* # of mappings whose store this is */
 #ifdef PACKAGE_MUDLIB_STATS
     statgroup_t stats;		/* creators of the mapping */
 #endif
+    map_chunk_t first;		/* must be last */
 } mapping_t;
 
+#define MAP_NODE_DELETED(n) ((n)->values[0].type == T_INVALID)
+
+/* m's body is seen by other mappings too, and mustn't be changed */
+#define MAP_SHARED(m) ((m)->store->shares > 1)
+
+/*
+ * visit every node of a mapping in order; c and elt must not be changed
+ * in the body.  The current node may be deleted with mapping_delete_node().
+ */
+#define MAP_FOREACH(m, c, elt) \
+    for (c = &(m)->store->first; c; c = c->next) \
+	for (elt = c->nodes; elt < c->nodes + c->used; elt++) \
+	    if (!MAP_NODE_DELETED(elt))
+
 typedef struct finfo_s {
     char *func;
     object_t *obj;
@@ -68,20 +118,25 @@ extern int num_mappings;
 extern int total_mapping_size;
 extern int total_mapping_nodes;
 
+unsigned int map_hash PROT((POINTER_INT));
 int msameval PROT((svalue_t *, svalue_t *));
 int mapping_save_size PROT((mapping_t *));
 INLINE mapping_t *mapTraverse PROT((mapping_t *, int (*) (mapping_t *, mapping_node_t *, void *), void *));
 INLINE mapping_t *load_mapping_from_aggregate PROT((svalue_t *, int));
 INLINE mapping_t *allocate_mapping PROT((int));
+INLINE mapping_t *copyMapping PROT((mapping_t *, int));
+mapping_t *share_mapping PROT((mapping_t *));
+void unshare_mapping PROT((mapping_t *));
 INLINE void free_mapping PROT((mapping_t *));
 INLINE svalue_t *find_in_mapping PROT((mapping_t *, svalue_t *));
 svalue_t *find_string_in_mapping PROT((mapping_t *, char *));
 INLINE svalue_t *find_for_insert PROT((mapping_t *, svalue_t *, int));
+INLINE mapping_node_t *node_find_in_mapping PROT((mapping_t *, svalue_t *));
 INLINE void absorb_mapping PROT((mapping_t *, mapping_t *));
 INLINE void mapping_delete PROT((mapping_t *, svalue_t *));
 INLINE mapping_t *add_mapping PROT((mapping_t *, mapping_t *));
-mapping_node_t *new_map_node PROT((void));
-void free_node PROT((mapping_node_t *));
+mapping_node_t *new_map_node PROT((mapping_t *, svalue_t *));
+void mapping_delete_node PROT((mapping_t *, mapping_node_t *));
 void map_mapping PROT((svalue_t *, int));
 void filter_mapping PROT((svalue_t *, int));
 INLINE mapping_t *compose_mapping PROT((mapping_t *, mapping_t *, unsigned short));
@@ -90,7 +145,11 @@ array_t *mapping_values PROT((mapping_t *));
 array_t *mapping_each PROT((mapping_t *));
 char *save_mapping PROT((mapping_t *));
 void dealloc_mapping PROT((mapping_t *));
-void mark_mapping_node_blocks PROT((void));
+void map_compact_later PROT((mapping_t *));
+void compact_mappings PROT((void));
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_compact_mappings PROT((void));
+#endif
 
 void add_mapping_pair PROT((mapping_t *, char *, int));
 void add_mapping_string PROT((mapping_t *, char *, char *));
@@ -8,6 +8,9 @@
 #include "simul_efun.h"
 #include "swap.h"
 #include "call_out.h"
+#include "reclaim.h"
+#include "resolver.h"
+#include "fcache.h"
 #include "mapping.h"
 #ifdef PACKAGE_SOCKETS
 #include "socket_efuns.h"
@@ -569,6 +572,7 @@ void check_all_blocks P1(int, flag) {
     buffer_t *buf;
     funptr_t *fp;
     mapping_node_t *node;
+    map_chunk_t *chunk;
     program_t *prog;
     sentence_t *sent;
     char *ptr;
@@ -637,7 +641,7 @@ void check_all_blocks P1(int, flag) {
 
 		    str = (char *)(msbl + 1);
 		    msbl->extra_ref = 0;
-		    if (msbl->size != USHRT_MAX && msbl->size != strlen(str)) {
+		    if (msbl->size != strlen(str)) {
 			outbuf_addv(&out, "Malloc'ed string length is incorrect: %s %04x '%s': is: %i should be: %i\n", entry->desc, (int)entry->tag, str, msbl->size, strlen(str));
 		    }
 		    break;
@@ -711,8 +715,8 @@ void check_all_blocks P1(int, flag) {
 	if (blocks[TAG_MAPPING & 0xff] != num_mappings)
 	    outbuf_addv(&out, "WARNING: num_mappings is: %i should be: %i\n",
 			num_mappings, blocks[TAG_MAPPING & 0xff]);
-	if (blocks[TAG_MAP_TBL & 0xff] != num_mappings)
-	    outbuf_addv(&out, "WARNING: %i tables for %i mappings\n",
+	if (blocks[TAG_MAP_TBL & 0xff] > num_mappings)
+	    outbuf_addv(&out, "WARNING: %i indexes for %i mappings\n",
 			blocks[TAG_MAP_TBL & 0xff], num_mappings);
 	if (blocks[TAG_INTERACTIVE & 0xff] != total_users)
 	    outbuf_addv(&out, "WATNING: total_users is: %i should be: %i\n",
@@ -731,8 +735,23 @@ void check_all_blocks P1(int, flag) {
 	/* now do a mark and sweep check to see what should be alloc'd */
 	for (i = 0; i < max_users; i++)
 	    if (all_users[i]) {
+		message_link_t *link;
+
 		DO_MARK(all_users[i], TAG_INTERACTIVE);
+		DO_MARK(all_users[i]->text, TAG_INPUT_BUFFER);
+#ifdef MCCP
+		if (all_users[i]->mccp) {
+		    DO_MARK(all_users[i]->mccp, TAG_MCCP);
+		    DO_MARK(all_users[i]->mccp->out, TAG_MCCP);
+		}
+#endif
 		all_users[i]->ob->extra_ref++;
+		for (link = all_users[i]->message_head; link; link = link->next) {
+		    DO_MARK(link, TAG_MESSAGE_LINK);
+		    /* chunks can be on more than one queue */
+		    if (!(PTR_TO_NODET(link->chunk)->tag & TAG_MARKED))
+			DO_MARK(link->chunk, TAG_MESSAGE_CHUNK);
+		}
 		if (all_users[i]->input_to) {
 		    all_users[i]->input_to->ob->extra_ref++;
 		    DO_MARK(all_users[i]->input_to, TAG_SENTENCE);
@@ -779,9 +798,18 @@ void check_all_blocks P1(int, flag) {
 	mark_iptable();
 	mark_stack();
 	mark_call_outs();
+	mark_compact_mappings();
+#ifdef RECLAIM_SLICE
+	mark_reclaim();
+#endif
+#ifdef RESOLVER
+	mark_resolver();
+#endif
+#ifdef USE_FILE_CACHE
+	mark_fcache();
+#endif
 	mark_simuls();
 	mark_apply_low_cache();
-	mark_mapping_node_blocks();
 	mark_config();
 	
 	mark_svalue(&apply_ret_value);
@@ -828,27 +856,36 @@ void check_all_blocks P1(int, flag) {
 		    break;
 		case TAG_ARRAY:
 		    vec = NODET_TO_PTR(entry, array_t *);
-		    if (entry->size != sizeof(array_t) + sizeof(svalue_t[1]) * (vec->size - 1))
+		    if (entry->size != ARRAY_SIZE(vec->nown))
 			outbuf_addv(&out, "array size doesn't match block size: %s %04x\n", entry->desc, (int)entry->tag);
-		    for (i = 0; i < vec->size; i++) mark_svalue(&vec->item[i]);
+		    /* elements are marked once, by the array they belong to */
+		    if (vec->shares)
+			for (i = 0; i < vec->nown; i++) mark_svalue(&vec->own[i]);
 		    break;
 		case TAG_CLASS:
 		    vec = NODET_TO_PTR(entry, array_t *);
-		    if (entry->size != sizeof(array_t) + sizeof(svalue_t[1]) * (vec->size - 1))
+		    if (entry->size != ARRAY_SIZE(vec->size))
 			outbuf_addv(&out, "class size doesn't match block size: %s %04x\n", entry->desc, (int)entry->tag);
 		    for (i = 0; i < vec->size; i++) mark_svalue(&vec->item[i]);
 		    break;
 		case TAG_MAPPING:		
 		    map = NODET_TO_PTR(entry, mapping_t *);
-		    DO_MARK(map->table, TAG_MAP_TBL);
-		    
-		    i = map->table_size;
-		    do {
-			for (node = map->table[i]; node; node = node->next) {
-			    mark_svalue(node->values);
-			    mark_svalue(node->values + 1);
-			}
-		    } while (i--);
+		    /* mappings sharing a body share its index */
+		    if (map->index &&
+			!(PTR_TO_NODET(map->index)->tag & TAG_MARKED))
+			DO_MARK(map->index, TAG_MAP_TBL);
+		    /* the rest is marked once, by the mapping it belongs to */
+		    if (!map->shares)
+			break;
+		    for (chunk = map->first.next; chunk; chunk = chunk->next)
+			DO_MARK(chunk, TAG_MAP_NODE_BLOCK);
+		    for (chunk = &map->first; chunk; chunk = chunk->next)
+			for (node = chunk->nodes;
+			     node < chunk->nodes + chunk->used; node++)
+			    if (!MAP_NODE_DELETED(node)) {
+				mark_svalue(node->values);
+				mark_svalue(node->values + 1);
+			    }
 		    break;
 		case TAG_OBJECT:
 		    ob = NODET_TO_PTR(entry, object_t *);
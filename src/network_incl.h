@@ -83,6 +83,10 @@
 #  define OS_socket_read(r, b, l) read(r, b, l)
 #  define OS_socket_close(f) close(f)
 #  define OS_socket_ioctl(f, w, a) ioctl(f, w, (caddr_t)a)
+#  if defined(HAS_ACCEPT4) && defined(SOCK_NONBLOCK)
+/* only prototyped by glibc for _GNU_SOURCE */
+extern int accept4 PROT((int, struct sockaddr *, socklen_t *, int));
+#  endif
 #endif
 
 #endif
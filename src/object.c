@@ -11,6 +11,10 @@
 #include "port.h"
 #include "file.h"
 #include "hash.h"
+#include "include/save.h"
+#ifdef HAS_MMAP
+#include <sys/mman.h>
+#endif
 
 #define too_deep_save_error() \
     error("Mappings and/or arrays nested too deep (%d) for save_object\n",\
@@ -85,18 +89,17 @@ INLINE int svalue_save_size P1(svalue_t *, v)
 
     case T_MAPPING:
 	{
-	    mapping_node_t **a = v->u.map->table, *elt;
-	    int j = v->u.map->table_size, size = 0;
+	    map_chunk_t *c;
+	    mapping_node_t *elt;
+	    int size = 0;
 
 	    if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH){
                 too_deep_save_error();
 	    }
-	    do {
-		for (elt = a[j]; elt; elt = elt->next){
-		    size += svalue_save_size(elt->values) +
-			    svalue_save_size(elt->values+1);
-		}
-	    } while (j--);
+	    MAP_FOREACH(v->u.map, c, elt) {
+		size += svalue_save_size(elt->values) +
+			svalue_save_size(elt->values+1);
+	    }
 	    save_svalue_depth--;
 	    return size + 5;
 	}
@@ -205,19 +208,17 @@ INLINE void save_svalue P2(svalue_t *, v, char **, buf)
 
     case T_MAPPING:
 	{
-	    int j = v->u.map->table_size;
-	    mapping_node_t **a = v->u.map->table, *elt;
+	    map_chunk_t *c;
+	    mapping_node_t *elt;
 
 	    *(*buf)++ = '(';
 	    *(*buf)++ = '[';
-	    do {
-		for (elt = a[j]; elt; elt = elt = elt->next){
-		    save_svalue(elt->values, buf);
-		    *(*buf)++ = ':';
-		    save_svalue(elt->values + 1, buf);
-		    *(*buf)++ = ',';
-		}
-	    } while (j--);
+	    MAP_FOREACH(v->u.map, c, elt) {
+		save_svalue(elt->values, buf);
+		*(*buf)++ = ':';
+		save_svalue(elt->values + 1, buf);
+		*(*buf)++ = ',';
+	    }
 
 	    *(*buf)++ = ']';
 	    *(*buf)++ = ')';
@@ -567,26 +568,14 @@ static int parse_numeric P3(char **, cpp, char, c, svalue_t *, dest)
     }
 }
 
-INLINE_STATIC void add_map_stats P2(mapping_t *, m, int, count)
-{
-    total_mapping_nodes += count;
-    total_mapping_size += count * sizeof(mapping_node_t);
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&m->stats, count << 1);
-#endif
-    m->count = count;
-}
-
-int growMap PROT((mapping_t *));
-
 static int
 restore_mapping P2(char **,str, svalue_t *, sv)
 {
-    int size, i, mask, oi, count = 0;
+    int size;
     char c;
     mapping_t *m;
     svalue_t key, value;
-    mapping_node_t **a, *elt, *elt2;
+    mapping_node_t *elt;
     char *cp = *str;
     int err;
 
@@ -599,9 +588,8 @@ restore_mapping P2(char **,str, svalue_t *, sv)
 	sv->type = T_MAPPING;
 	return 0;
     }
-    m = allocate_mapping(size >> 1); /* have to clean up after this or */
-    a = m->table;                    /* we'll leak */
-    mask = m->table_size;
+    m = allocate_mapping(size >> 1); /* have to clean up after this or
+					we'll leak */
     
     while (1) {
 	switch (c = *cp++) {
@@ -648,7 +636,6 @@ restore_mapping P2(char **,str, svalue_t *, sv)
 	    
 	case ']':
 	    *str = ++cp;
-	    add_map_stats(m, count);
 	    sv->type = T_MAPPING;
 	    sv->u.map = m;
 	    return 0;
@@ -721,66 +708,39 @@ restore_mapping P2(char **,str, svalue_t *, sv)
 
 	/* both key and value are valid, referenced svalues */
 
-	oi = MAP_POINTER_HASH(key.u.number);
-	i = oi & mask;
-	if ((elt2 = elt = a[i])) {
-	    do {
-		/* This should never happen, but don't bail on it */
-		if (msameval(&key, elt->values)) {
-		    free_svalue(&key, "restore_mapping: duplicate key");
-		    free_svalue(elt->values+1, "restore_mapping: replaced value");
-		    *(elt->values+1) = value;
-		    break;
-		}
-	    } while ((elt = elt->next));
-	    if (elt)
-		continue;
-	} else if (!(--m->unfilled)){
-	    if (growMap(m)){
-		a = m->table;
-		if (oi & ++mask) elt2 = a[i |= mask];
-		mask <<= 1;
-		mask--;
-	    } else {
-		add_map_stats(m, count);
-		free_mapping(m);
-		free_svalue(&key, "restore_mapping: out of memory");
-		free_svalue(&value, "restore_mapping: out of memory");
-		error("Out of memory\n");
-	    }
+	if ((elt = node_find_in_mapping(m, &key))) {
+	    /* This should never happen, but don't bail on it */
+	    free_svalue(&key, "restore_mapping: duplicate key");
+	    free_svalue(elt->values+1, "restore_mapping: replaced value");
+	    *(elt->values+1) = value;
+	    continue;
 	}
 	
-	if (++count > MAX_MAPPING_SIZE) {
-	    add_map_stats(m, count -1);
+	if (m->count >= MAX_MAPPING_SIZE) {
 	    free_mapping(m);
 	    free_svalue(&key, "restore_mapping: mapping too large");
 	    free_svalue(&value, "restore_mapping: mapping too large");
 	    mapping_too_large();
 	}
 	
-	elt = new_map_node();
-	*elt->values = key;
+	elt = new_map_node(m, &key);
 	*(elt->values + 1) = value;
-	(a[i] = elt)->next = elt2;
     }
 
     /* something went wrong */
  value_numeral_error:
     free_svalue(&key, "restore_mapping: numeral value error");
  key_numeral_error:
-    add_map_stats(m, count);
     free_mapping(m);
     return ROB_NUMERAL_ERROR;
  generic_value_error:
     free_svalue(&key, "restore_mapping: generic value error");
  generic_key_error:
-    add_map_stats(m, count);
     free_mapping(m);
     return ROB_MAPPING_ERROR;
  value_error:
     free_svalue(&key, "restore_mapping: value error");
  key_error:
-    add_map_stats(m, count);
     free_mapping(m);
     return err;
 }
@@ -1212,11 +1172,471 @@ restore_object_from_buff P3(object_t *, ob, char *, theBuff,
     }
 }
 
+#ifdef BINARY_SAVE_EXTENSION
+/*
+ * Binary save files.
+ *
+ * The file starts with BIN_MAGIC and a version byte, then the program
+ * name, then one entry per variable: its name and its value.  Names and
+ * strings are length-prefixed and arrays, classes and mappings start
+ * with their element count, so restoring never has to scan ahead or
+ * unescape anything.  Lengths and counts are unsigned varints (seven
+ * bits a byte, low bits first); integers are zigzag encoded varints so
+ * small negative numbers stay short too.
+ *
+ *   name:    <len> bytes
+ *   value:   BIN_ZERO
+ *            BIN_INT <zigzag>
+ *            BIN_REAL <4 bytes, little-endian IEEE single>
+ *            BIN_STRING <len> bytes
+ *            BIN_ARRAY <n> n values
+ *            BIN_CLASS <n> n values
+ *            BIN_MAPPING <n> n pairs of key, value
+ */
+#define BIN_MAGIC	"\0MOB"
+#define BIN_MAGIC_LEN	4
+#define BIN_VERSION	1
+
+#define BIN_ZERO	0
+#define BIN_INT		1
+#define BIN_REAL	2
+#define BIN_STRING	3
+#define BIN_ARRAY	4
+#define BIN_CLASS	5
+#define BIN_MAPPING	6
+
+/* files smaller than this are read() rather than mmap()ed */
+#define BIN_MMAP_MIN	65536
+
+static unsigned char *bin_buf;
+static int bin_len, bin_size;
+
+static void
+bin_need P1(int, n)
+{
+    if (bin_len + n <= bin_size)
+	return;
+    if (!bin_size)
+	bin_size = 4096;
+    while (bin_len + n > bin_size)
+	bin_size <<= 1;
+    if (bin_buf)
+	bin_buf = (unsigned char *) DREALLOC(bin_buf, bin_size, TAG_TEMPORARY,
+					     "bin_need");
+    else
+	bin_buf = (unsigned char *) DXALLOC(bin_size, TAG_TEMPORARY,
+					    "bin_need");
+}
+
+/* caller has made room for 5 bytes */
+#define BIN_PUT_VARINT(x) \
+    do { \
+	UINT32 _x = (x); \
+	while (_x > 0x7f) { \
+	    bin_buf[bin_len++] = (_x & 0x7f) | 0x80; \
+	    _x >>= 7; \
+	} \
+	bin_buf[bin_len++] = _x; \
+    } while (0)
+
+static void
+bin_put_bytes P2(char *, str, int, len)
+{
+    bin_need(len + 5);
+    BIN_PUT_VARINT(len);
+    memcpy(bin_buf + bin_len, str, len);
+    bin_len += len;
+}
+
+/*
+ * Returns 1 if v is nested more than MAX_SAVE_SVALUE_DEPTH deep, in which
+ * case what has been written is of no use.
+ */
+static int
+bin_save_svalue P1(svalue_t *, v)
+{
+    int i;
+
+    bin_need(6);
+    switch (v->type) {
+    case T_NUMBER:
+	if (!v->u.number) {
+	    bin_buf[bin_len++] = BIN_ZERO;
+	    return 0;
+	}
+	bin_buf[bin_len++] = BIN_INT;
+	BIN_PUT_VARINT(((UINT32) v->u.number << 1) ^ (v->u.number >> 31));
+	return 0;
+
+    case T_REAL:
+	{
+	    UINT32 x;
+
+	    bin_buf[bin_len++] = BIN_REAL;
+	    memcpy(&x, &v->u.real, 4);
+	    bin_buf[bin_len++] = x;
+	    bin_buf[bin_len++] = x >> 8;
+	    bin_buf[bin_len++] = x >> 16;
+	    bin_buf[bin_len++] = x >> 24;
+	    return 0;
+	}
+
+    case T_STRING:
+	bin_buf[bin_len++] = BIN_STRING;
+	bin_put_bytes(v->u.string, SVALUE_STRLEN(v));
+	return 0;
+
+    case T_ARRAY:
+    case T_CLASS:
+	if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH)
+	    return 1;
+	bin_buf[bin_len++] = (v->type == T_ARRAY ? BIN_ARRAY : BIN_CLASS);
+	BIN_PUT_VARINT(v->u.arr->size);
+	for (i = 0; i < v->u.arr->size; i++)
+	    if (bin_save_svalue(v->u.arr->item + i))
+		return 1;
+	save_svalue_depth--;
+	return 0;
+
+    case T_MAPPING:
+	{
+	    map_chunk_t *c;
+	    mapping_node_t *elt;
+
+	    if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH)
+		return 1;
+	    bin_buf[bin_len++] = BIN_MAPPING;
+	    BIN_PUT_VARINT(v->u.map->count);
+	    MAP_FOREACH(v->u.map, c, elt) {
+		if (bin_save_svalue(elt->values)
+		    || bin_save_svalue(elt->values + 1))
+		    return 1;
+	    }
+	    save_svalue_depth--;
+	    return 0;
+	}
+
+    default:
+	/* objects, functions and buffers are saved as 0, as in text files */
+	bin_buf[bin_len++] = BIN_ZERO;
+	return 0;
+    }
+}
+
+static void
+bin_save_object_recurse P4(program_t *, prog, svalue_t **, svp, int, type,
+			   int, save_zeros)
+{
+    int i, start, value;
+
+    for (i = 0; i < prog->num_inherited; i++)
+	bin_save_object_recurse(prog->inherit[i].prog, svp,
+				prog->inherit[i].type_mod | type, save_zeros);
+    if (type & NAME_STATIC) {
+	(*svp) += prog->num_variables_defined;
+	return;
+    }
+    for (i = 0; i < prog->num_variables_defined; i++) {
+	if (prog->variable_types[i] & NAME_STATIC) {
+	    (*svp)++;
+	    continue;
+	}
+	start = bin_len;
+	bin_put_bytes(prog->variable_table[i], strlen(prog->variable_table[i]));
+	value = bin_len;
+	save_svalue_depth = 0;
+	if (bin_save_svalue((*svp)++))
+	    too_deep_save_error();
+	if (!save_zeros && bin_len == value + 1 && bin_buf[value] == BIN_ZERO)
+	    bin_len = start;
+    }
+}
+
+static int
+bin_save_object P3(object_t *, ob, int, save_zeros, FILE *, f)
+{
+    svalue_t *v = ob->variables;
+    int ret;
+
+    bin_len = 0;
+    bin_need(BIN_MAGIC_LEN + 1);
+    memcpy(bin_buf, BIN_MAGIC, BIN_MAGIC_LEN);
+    bin_buf[BIN_MAGIC_LEN] = BIN_VERSION;
+    bin_len = BIN_MAGIC_LEN + 1;
+    bin_put_bytes(ob->prog->name, strlen(ob->prog->name));
+    bin_save_object_recurse(ob->prog, &v, 0, save_zeros);
+
+    ret = (fwrite(bin_buf, 1, bin_len, f) == bin_len);
+    if (!ret)
+	debug_perror("save_object: fwrite", 0);
+    /* don't hang on to the buffer for the biggest file ever saved */
+    if (bin_size > 65536) {
+	FREE(bin_buf);
+	bin_buf = 0;
+	bin_size = 0;
+    }
+    return ret;
+}
+
+typedef struct {
+    unsigned char *p, *end;
+    int depth;
+} bin_reader_t;
+
+#define BIN_LEFT(r) ((r)->end - (r)->p)
+
+static int
+bin_get_varint P2(bin_reader_t *, r, UINT32 *, ret)
+{
+    UINT32 x = 0;
+    int shift = 0;
+    unsigned char c;
+
+    do {
+	if (r->p == r->end || shift > 28)
+	    return 0;
+	c = *r->p++;
+	x |= (UINT32) (c & 0x7f) << shift;
+	shift += 7;
+    } while (c & 0x80);
+    *ret = x;
+    return 1;
+}
+
+static int
+bin_get_name P3(bin_reader_t *, r, char *, buf, int, size)
+{
+    UINT32 len;
+
+    if (!bin_get_varint(r, &len) || len >= size || BIN_LEFT(r) < len)
+	return 0;
+    memcpy(buf, r->p, len);
+    buf[len] = '\0';
+    r->p += len;
+    return 1;
+}
+
+/*
+ * Read one value into *v, which is left as 0 on an error.  Mapping keys
+ * that are strings have to be shared strings.
+ */
+static int
+bin_restore_svalue P3(bin_reader_t *, r, svalue_t *, v, int, is_key)
+{
+    UINT32 n, i;
+    int err;
+
+    *v = const0;
+    if (!BIN_LEFT(r))
+	return ROB_GENERAL_ERROR;
+    switch (*r->p++) {
+    case BIN_ZERO:
+	return 0;
+
+    case BIN_INT:
+	if (!bin_get_varint(r, &n))
+	    return ROB_NUMERAL_ERROR;
+	v->u.number = (int) ((n >> 1) ^ -(n & 1));
+	return 0;
+
+    case BIN_REAL:
+	if (BIN_LEFT(r) < 4)
+	    return ROB_NUMERAL_ERROR;
+	n = r->p[0] | (r->p[1] << 8) | (r->p[2] << 16) | ((UINT32) r->p[3] << 24);
+	r->p += 4;
+	memcpy(&v->u.real, &n, 4);
+	v->type = T_REAL;
+	return 0;
+
+    case BIN_STRING:
+	if (!bin_get_varint(r, &n) || BIN_LEFT(r) < n ||
+	    memchr(r->p, '\0', n))
+	    return ROB_STRING_ERROR;
+	v->type = T_STRING;
+	if (is_key) {
+	    char buf[256];
+
+	    if (n < sizeof(buf)) {
+		memcpy(buf, r->p, n);
+		buf[n] = '\0';
+		v->u.string = make_shared_string(buf);
+	    } else {
+		char *tmp = new_string(n, "bin_restore_svalue");
+
+		memcpy(tmp, r->p, n);
+		tmp[n] = '\0';
+		v->u.string = make_shared_string(tmp);
+		FREE_MSTR(tmp);
+	    }
+	    v->subtype = STRING_SHARED;
+	} else {
+	    v->u.string = new_string(n, "bin_restore_svalue");
+	    memcpy(v->u.string, r->p, n);
+	    v->u.string[n] = '\0';
+	    v->subtype = STRING_MALLOC;
+	}
+	r->p += n;
+	return 0;
+
+    case BIN_ARRAY:
+    case BIN_CLASS:
+	{
+	    array_t *arr;
+	    int is_class = (r->p[-1] == BIN_CLASS);
+
+	    err = (is_class ? ROB_CLASS_ERROR : ROB_ARRAY_ERROR);
+	    /* every element takes at least a byte */
+	    if (!bin_get_varint(r, &n) || n > BIN_LEFT(r) ||
+		n > max_array_size || r->depth >= MAX_SAVE_SVALUE_DEPTH)
+		return err;
+	    arr = (is_class ? allocate_class_by_size(n) : allocate_array(n));
+	    r->depth++;
+	    for (i = 0; i < n; i++)
+		if ((err = bin_restore_svalue(r, arr->item + i, 0))) {
+		    if (is_class)
+			free_class(arr);
+		    else
+			free_array(arr);
+		    return err;
+		}
+	    r->depth--;
+	    v->type = (is_class ? T_CLASS : T_ARRAY);
+	    v->u.arr = arr;
+	    return 0;
+	}
+
+    case BIN_MAPPING:
+	{
+	    mapping_t *m;
+	    svalue_t key, *dest;
+
+	    if (!bin_get_varint(r, &n) || n > BIN_LEFT(r) / 2 ||
+		n > MAX_MAPPING_SIZE || r->depth >= MAX_SAVE_SVALUE_DEPTH)
+		return ROB_MAPPING_ERROR;
+	    m = allocate_mapping(n);
+	    r->depth++;
+	    for (i = 0; i < n; i++) {
+		if ((err = bin_restore_svalue(r, &key, 1))) {
+		    free_mapping(m);
+		    return err;
+		}
+		dest = find_for_insert(m, &key, 1);
+		free_svalue(&key, "bin_restore_svalue");
+		if ((err = bin_restore_svalue(r, dest, 0))) {
+		    free_mapping(m);
+		    return err;
+		}
+	    }
+	    r->depth--;
+	    v->type = T_MAPPING;
+	    v->u.map = m;
+	    return 0;
+	}
+    }
+    return ROB_GENERAL_ERROR;
+}
+
+/*
+ * buf holds a whole binary save file of len bytes.  On an error, the
+ * message is copied into errbuf and 0 returned, so the caller can clean
+ * up the buffer before calling error().
+ */
+static int
+bin_restore_object P5(object_t *, ob, unsigned char *, buf, int, len,
+		      int, noclear, char *, errbuf)
+{
+    bin_reader_t r;
+    char var[100];
+    svalue_t val;
+    UINT32 n;
+    int idx;
+    unsigned short t;
+
+    r.p = buf + BIN_MAGIC_LEN;
+    r.end = buf + len;
+    r.depth = 0;
+    if (!BIN_LEFT(&r) || *r.p++ != BIN_VERSION) {
+	strcpy(errbuf, "restore_object(): Unknown binary save file version.\n");
+	return 0;
+    }
+    /* skip the name of the program the file was saved from */
+    if (!bin_get_varint(&r, &n) || BIN_LEFT(&r) < n) {
+	strcpy(errbuf, "restore_object(): Illegal file format.\n");
+	return 0;
+    }
+    r.p += n;
+    while (BIN_LEFT(&r)) {
+	if (!bin_get_name(&r, var, sizeof(var))) {
+	    strcpy(errbuf, "restore_object(): Illegal file format.\n");
+	    return 0;
+	}
+	if (bin_restore_svalue(&r, &val, 0)) {
+	    sprintf(errbuf, "restore_object(): Illegal binary format while restoring %s.\n", var);
+	    return 0;
+	}
+	idx = find_global_variable(ob->prog, var, &t);
+	if (idx == -1 || (t & NAME_STATIC)) {
+	    free_svalue(&val, "bin_restore_object");
+	    continue;
+	}
+	/* without noclear the variable has already been zeroed */
+	if (noclear)
+	    free_svalue(&ob->variables[idx], "bin_restore_object");
+	ob->variables[idx] = val;
+    }
+    return 1;
+}
+
+/*
+ * The same encoding for a single value, as sent by MUD_BINARY sockets.
+ * The value goes after 'reserve' bytes left free for the caller, and the
+ * buffer (which the caller must FREE()) is returned with the length of
+ * the value in *lenp.  Returns 0 if the value is nested too deep.
+ */
+char *save_svalue_binary P3(svalue_t *, v, int, reserve, int *, lenp)
+{
+    char *ret;
+
+    bin_len = 0;
+    bin_need(reserve);
+    bin_len = reserve;
+    save_svalue_depth = 0;
+    if (bin_save_svalue(v))
+	return 0;
+    ret = (char *) bin_buf;
+    *lenp = bin_len - reserve;
+    bin_buf = 0;
+    bin_size = 0;
+    return ret;
+}
+
+/*
+ * Returns 0 if buf holds exactly one value, which is put in *v.
+ */
+int restore_svalue_binary P3(char *, buf, int, len, svalue_t *, v)
+{
+    bin_reader_t r;
+
+    r.p = (unsigned char *) buf;
+    r.end = r.p + len;
+    r.depth = 0;
+    if (bin_restore_svalue(&r, v, 0))
+	return 1;
+    if (BIN_LEFT(&r)) {
+	free_svalue(v, "restore_svalue_binary");
+	*v = const0;
+	return 1;
+    }
+    return 0;
+}
+#endif
+
 /*
  * Save an object to a file.
  * The routine checks with the function "valid_write()" in /obj/master.c
  * to assertain that the write is legal.
- * If 'save_zeros' is set, 0 valued variables will be saved
+ * If 'save_zeros' is set, 0 valued variables will be saved (any flag to
+ * save_object() besides SAVE_BINARY)
  */
 static int save_object_recurse P5(program_t *, prog, svalue_t **,
 				  svp, int, type, int, save_zeros,
@@ -1259,30 +1679,65 @@ static int save_object_recurse P5(program_t *, prog, svalue_t **,
 
 int sel = -1;
 
+/*
+ * Work out the name of a save file: strip any .c and save extension
+ * from file, and add the right one.  *binary is set if the name asked
+ * for the binary format, and decides which extension is added.
+ */
+static char *
+save_file_name P3(char *, file, int *, binary, char *, what)
+{
+    char *name, *ext;
+    int len;
+
+    len = strlen(file);
+    if (len >= 2 && file[len-2] == '.' && file[len - 1] == 'c')
+	len -= 2;
+
+    if (sel == -1) sel = strlen(SAVE_EXTENSION);
+#ifdef BINARY_SAVE_EXTENSION
+    if (len >= strlen(BINARY_SAVE_EXTENSION) &&
+	strncmp(file + len - strlen(BINARY_SAVE_EXTENSION),
+		BINARY_SAVE_EXTENSION, strlen(BINARY_SAVE_EXTENSION)) == 0) {
+	len -= strlen(BINARY_SAVE_EXTENSION);
+	*binary = 1;
+    } else
+#endif
+    if (len >= sel && strncmp(file + len - sel, SAVE_EXTENSION, sel) == 0)
+	len -= sel;
+
+#ifdef BINARY_SAVE_EXTENSION
+    ext = (*binary ? BINARY_SAVE_EXTENSION : SAVE_EXTENSION);
+#else
+    ext = SAVE_EXTENSION;
+#endif
+    name = new_string(len + strlen(ext), what);
+    strncpy(name, file, len);
+    strcpy(name + len, ext);
+    return name;
+}
+
 int
-save_object P3(object_t *, ob, char *, file, int, save_zeros)
+save_object P3(object_t *, ob, char *, file, int, flags)
 {
     char *name;
     static char tmp_name[256];
-    int len;
     FILE *f;
-    int success;
+    int success, binary, save_zeros;
     svalue_t *v;
 
     if (ob->flags & O_DESTRUCTED)
         return 0;
 
-    len = strlen(file);
-    if (file[len-2] == '.' && file[len - 1] == 'c')
-	len -= 2;
+    save_zeros = (flags & ~SAVE_BINARY) != 0;
 
-    if (sel == -1) sel = strlen(SAVE_EXTENSION);
-    if (strcmp(file + len - sel, SAVE_EXTENSION) == 0)
-	len -= sel;
-    
-    name = new_string(len + strlen(SAVE_EXTENSION), "save_object");
-    strcpy(name, file);
-    strcpy(name + len, SAVE_EXTENSION);
+#ifdef BINARY_SAVE_EXTENSION
+    binary = (flags & SAVE_BINARY) ||
+	strcmp(SAVE_EXTENSION, BINARY_SAVE_EXTENSION) == 0;
+#else
+    binary = 0;
+#endif
+    name = save_file_name(file, &binary, "save_object");
 
     push_malloced_string(name);    /* errors */
 
@@ -1297,12 +1752,21 @@ save_object P3(object_t *, ob, char *, file, int, save_zeros)
      */
     sprintf(tmp_name, "%.250s.tmp", file);
 
-    if (!(f = fopen(tmp_name, "w")) || fprintf(f, "#/%s\n", ob->prog->name) < 0) {
-        error("Could not open /%s for a save.\n", tmp_name);
-    }
+#ifdef BINARY_SAVE_EXTENSION
+    if (binary) {
+	if (!(f = fopen(tmp_name, "wb")))
+	    error("Could not open /%s for a save.\n", tmp_name);
+	success = bin_save_object(ob, save_zeros, f);
+    } else
+#endif
+    {
+	if (!(f = fopen(tmp_name, "w")) || fprintf(f, "#/%s\n", ob->prog->name) < 0) {
+	    error("Could not open /%s for a save.\n", tmp_name);
+	}
 
-    v = ob->variables;
-    success = save_object_recurse(ob->prog, &v, 0, save_zeros, f);
+	v = ob->variables;
+	success = save_object_recurse(ob->prog, &v, 0, save_zeros, f);
+    }
 
     if (fclose(f) < 0) {
 	debug_perror("save_object", file);
@@ -1391,25 +1855,20 @@ static void clear_non_statics P1(object_t *, ob) {
 int restore_object P3(object_t *, ob, char *, file, int, noclear)
 {
     char *name, *theBuff;
-    int len, i;
+    int i, binary = 0;
     FILE *f;
     object_t *save = current_object;
     struct stat st;
+#ifdef BINARY_SAVE_EXTENSION
+    char path[1024], alt[1024], magic[BIN_MAGIC_LEN];
+    struct stat alt_st;
+    char *ext, *other;
+#endif
 
     if (ob->flags & O_DESTRUCTED)
         return 0;
 
-    len = strlen(file);
-    if (file[len-2] == '.' && file[len - 1] == 'c')
-	len -= 2;
-    
-    if (sel == -1) sel = strlen(SAVE_EXTENSION);
-    if (strcmp(file + len - sel, SAVE_EXTENSION) == 0)
-	len -= sel;
-
-    name = new_string(len + strlen(SAVE_EXTENSION), "restore_object");
-    strncpy(name, file, len);
-    strcpy(name + len, SAVE_EXTENSION);
+    name = save_file_name(file, &binary, "restore_object");
 
     push_malloced_string(name);    /* errors */
 
@@ -1417,6 +1876,31 @@ int restore_object P3(object_t *, ob, char *, file, int, noclear)
     free_string_svalue(sp--);
     if (!file) error("Denied read permission in restore_object().\n");
 
+#ifdef BINARY_SAVE_EXTENSION
+    /*
+     * If there's a save file in the other format which is newer than the
+     * one asked for (or that one doesn't exist), read that instead, so
+     * text save files keep working after a mud starts saving binary ones
+     * and the other way around.
+     */
+    ext = (binary ? BINARY_SAVE_EXTENSION : SAVE_EXTENSION);
+    other = (binary ? SAVE_EXTENSION : BINARY_SAVE_EXTENSION);
+    i = strlen(file) - strlen(ext);
+    if (strcmp(ext, other) && strlen(file) < sizeof(path) &&
+	i + strlen(other) < sizeof(alt)) {
+	/* file may point at check_valid_path()'s buffer */
+	strcpy(path, file);
+	file = path;
+	strncpy(alt, file, i);
+	strcpy(alt + i, other);
+	if (stat(alt, &alt_st) != -1 &&
+	    (stat(file, &st) == -1 || alt_st.st_mtime > st.st_mtime) &&
+	    (name = check_valid_path(alt, ob, "restore_object", 0)) &&
+	    strlen(name) < sizeof(path))
+	    strcpy(path, name);
+    }
+#endif
+
 #ifdef LATTICE
     f = NULL;
     if ((stat(file, &st) == -1) || !(f = fopen(file, "r"))) {
@@ -1433,6 +1917,53 @@ int restore_object P3(object_t *, ob, char *, file, int, noclear)
         (void)fclose(f);
         return 0;
     }
+
+#ifdef BINARY_SAVE_EXTENSION
+    if (i > BIN_MAGIC_LEN && fread(magic, 1, BIN_MAGIC_LEN, f) == BIN_MAGIC_LEN
+	&& memcmp(magic, BIN_MAGIC, BIN_MAGIC_LEN) == 0) {
+	unsigned char *buf = 0;
+	char errbuf[256];
+	int ok, mapped = 0;
+
+#ifdef HAS_MMAP
+	if (i >= BIN_MMAP_MIN) {
+	    buf = (unsigned char *) mmap(0, i, PROT_READ, MAP_PRIVATE,
+					 fileno(f), 0);
+	    if (buf == (unsigned char *) MAP_FAILED)
+		buf = 0;
+	    else
+		mapped = 1;
+	}
+#endif
+	if (!buf) {
+	    buf = (unsigned char *) DXALLOC(i, TAG_TEMPORARY, "restore_object: 5");
+	    rewind(f);
+	    if (fread(buf, 1, i, f) != i) {
+		FREE(buf);
+		fclose(f);
+		error("restore_object(): Could not read /%s.\n", file);
+	    }
+	}
+	fclose(f);
+
+	current_object = ob;
+	if (!noclear)
+	    clear_non_statics(ob);
+	ok = bin_restore_object(ob, buf, i, noclear, errbuf);
+	current_object = save;
+#ifdef HAS_MMAP
+	if (mapped)
+	    munmap((char *) buf, i);
+	else
+#endif
+	    FREE(buf);
+	if (!ok)
+	    error("%s", errbuf);
+	return 1;
+    }
+    rewind(f);
+#endif
+
     theBuff = DXALLOC(i + 1, TAG_TEMPORARY, "restore_object: 4");
 #ifdef WIN32
     i = read(_fileno(f), theBuff, i);
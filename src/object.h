@@ -66,26 +66,28 @@ typedef struct sentence_s {
 
 #ifdef LPC_TO_C
 typedef struct { /* has to be the same as object_t below */
-    unsigned short ref;
+    unsigned int ref;
     unsigned short flags;
 #ifdef DEBUG
     unsigned int extra_ref;
 #endif
     char *name;
     struct object_s *next_hash;
+    unsigned int name_hash;
     void (**jump_table)();
     struct string_switch_entry_s **string_switch_tables;
 } lpc_object_t;
 #endif
 
 typedef struct object_s {
-    unsigned short ref;		/* Reference count. */
+    unsigned int ref;		/* Reference count. */
     unsigned short flags;	/* Bits or'ed together from above */
 #ifdef DEBUG
     unsigned int extra_ref;	/* Used to check ref count. */
 #endif
     char *name;
     struct object_s *next_hash;
+    unsigned int name_hash;	/* Full hash of name, see otable.c */
     /* the fields above must match lpc_object_t */
     int load_time;		/* time when this object was created */
 #ifndef NO_RESET
@@ -101,6 +103,7 @@ typedef struct object_s {
     struct object_s *super;	/* Which object surround us ? */
 #endif
     struct interactive_s *interactive;	/* Data about an interactive user */
+    struct heart_beat_s *heart_beat;	/* Entry on the heart beat wheel */
 #ifndef NO_LIGHT
     short total_light;
 #endif
@@ -159,6 +162,10 @@ void bufcat PROT((char **, char *));
 INLINE int svalue_save_size PROT((svalue_t *));
 INLINE void save_svalue PROT((svalue_t *, char **));
 INLINE int restore_svalue PROT((char *, svalue_t *));
+#ifdef BINARY_SAVE_EXTENSION
+char *save_svalue_binary PROT((svalue_t *, int, int *));
+int restore_svalue_binary PROT((char *, int, svalue_t *));
+#endif
 int save_object PROT((object_t *, char *, int));
 char *save_variable PROT((svalue_t *));
 int restore_object PROT((object_t *, char *, int));
@@ -20,6 +20,11 @@ operator bbranch_when_zero, bbranch_when_non_zero, bbranch;
 
 operator branch_ne, branch_ge, branch_le, branch_eq, bbranch_lt;
 
+/* superinstructions; see icode.c */
+operator branch_locals, branch_string;
+operator local_index, local_member;
+operator global_call_other;
+
 operator foreach, next_foreach, exit_foreach;
 operator loop_cond_local, loop_cond_number;
 operator loop_incr;
@@ -62,6 +67,7 @@ operator not, negate, compl;
 
 operator function_constructor;
 operator simul_efun;
+operator cached_call_other;
 
 operator sscanf;
 operator parse_command;
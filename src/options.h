@@ -387,6 +387,20 @@
  */
 #define SAVE_EXTENSION ".o"
 
+/* BINARY_SAVE_EXTENSION: if defined, save_object() can write a binary
+ *   save file instead of the text one.  These are quicker to write and
+ *   much quicker to restore, but can't be read or edited by hand.  A
+ *   binary file is written when the SAVE_BINARY bit of the flag argument
+ *   is set (see <save.h>), or the file name given ends in this
+ *   extension; it gets this extension rather than SAVE_EXTENSION.  If
+ *   both extensions are the same, every save is binary.
+ *
+ *   restore_object() reads either kind of file.  If there is a file with
+ *   the other extension that is newer than the one asked for, it reads
+ *   that one, so switching formats doesn't lose any saves.
+ */
+#define BINARY_SAVE_EXTENSION ".ob"
+
 /* NO_ANSI: define if you wish to disallow users from typing in commands that
  *   contain ANSI escape sequences.  Defining NO_ANSI causes all escapes
  *   (ASCII 27) to be replaced with a space ' ' before the string is passed
@@ -642,25 +656,128 @@
  */
 #define HEARTBEAT_INTERVAL 2000000
 
-/* 
- * CALLOUT_CYCLE_SIZE: This is the number of slots in the call_out list.
- * It should be approximately the average number of active call_outs, or
- * a few times smaller.  It should also be a power of 2, and also be relatively
- * prime to any common call_out lengths.  If all this is too confusing, 32
- * isn't a bad number :-)
- */
-#define CALLOUT_CYCLE_SIZE 32
-
 /* LARGEST_PRINTABLE_STRING: defines the size of the vsprintf() buffer in
  *   comm.c's add_message(). Instead of blindly making this value larger,
  *   mudlib should be coded to not send huge strings to users.
  */
 #define LARGEST_PRINTABLE_STRING 8192
 
-/* MESSAGE_BUFFER_SIZE: determines the size of the buffer for output that
- *   is sent to users.
+/* MESSAGE_BUFFER_SIZE: output to users is queued in chunks of this size
+ *   (longer messages get a chunk of their own) until the connection can
+ *   take it.
+ *
+ * MESSAGE_HIGH_WATER: once a user has more than this many bytes of output
+ *   waiting, the driver stops reading and running their commands until
+ *   the queue drains, rather than throwing the output away.  Use
+ *   query_output_queue() to see how much is waiting for a user.
+ *
+ * MESSAGE_QUEUE_LIMIT: a connection with this much output waiting isn't
+ *   reading at all, and is closed.
  */
 #define MESSAGE_BUFFER_SIZE 4096
+#define MESSAGE_HIGH_WATER 65536
+#define MESSAGE_QUEUE_LIMIT 1048576
+
+/* USER_COMMANDS_PER_PASS: each time round the backend loop, users with
+ *   commands waiting take turns to run them one at a time, and each user
+ *   runs at most this many.  Someone pasting a page of text can't hold up
+ *   everyone else, or the heart beats, for long.
+ */
+#define USER_COMMANDS_PER_PASS 10
+
+/* LISTEN_BACKLOG: how many new connections the system will hold on each
+ *   external port until the driver gets round to accepting them.  Your
+ *   OS may silently cap this (somaxconn on Linux).
+ *
+ * LOGONS_PER_PASS: connections are accepted as fast as they arrive, but
+ *   connect() and logon() are only called in the master for this many of
+ *   them each time round the backend loop; the rest wait their turn.
+ *   When everyone reconnects at once after a reboot, the game keeps
+ *   running instead of stalling until the whole crowd is logged on.
+ *
+ * MAX_PENDING_LOGONS: if this many connections are already waiting to
+ *   log on, new ones are closed straight away.
+ */
+#define LISTEN_BACKLOG 1024
+#define LOGONS_PER_PASS 20
+#define MAX_PENDING_LOGONS 1024
+
+/* NET_STATS: keep counters for each connection (bytes in and out,
+ *   commands, writes, short writes, output thrown away, and the most
+ *   output ever waiting), which query_net_stats() returns, and which
+ *   mud_status(1) sums up for everyone connected.  They are only a few
+ *   additions per read or write, so there is no reason to turn this off.
+ */
+#define NET_STATS
+
+/* MCCP: support the Mud Client Compression Protocol (telnet option
+ *   COMPRESS2) on telnet ports.  Once a client has agreed to it,
+ *   everything sent to that client is compressed with zlib.  Ignored if
+ *   configure doesn't find zlib.  compress_output() turns it on and
+ *   off for a user, and compressedp() says whether it is on.  The amount
+ *   of output compressed, and the time spent doing it, are in
+ *   mud_status(1).
+ *
+ * MCCP_OFFER: offer compression to every telnet connection as it logs in,
+ *   instead of leaving it to the mudlib to call compress_output().
+ */
+#define MCCP
+#define MCCP_OFFER
+
+/* USE_EPOLL: on systems that have epoll() (Linux 2.6 and later), use it
+ *   instead of select() to wait for network activity.  The cost of each
+ *   pass through the backend then depends on how many connections are
+ *   active rather than how many exist, and there is no FD_SETSIZE limit
+ *   on the number of users and sockets.  Ignored if configure doesn't
+ *   find epoll.
+ */
+#define USE_EPOLL
+
+/* RESOLVER: look up host names (for query_ip_name() and resolve()) in the
+ *   driver itself, by asking a name server over UDP without waiting for
+ *   the answer, instead of through the separate addr_server program.
+ *   The name server is given by a "name server : <ip> [port]" line in the
+ *   config file, or else is the first one in /etc/resolv.conf; the
+ *   address server settings are not used.  Up to RESOLVER_CACHE_SIZE
+ *   answers are kept for as long as the name server says they're good.
+ */
+#define RESOLVER
+#define RESOLVER_CACHE_SIZE 1024
+
+/* FILE_CACHE: keep the last FILE_CACHE_SIZE files used by read_file(),
+ *   read_bytes(), write_bytes() and write_file() open, instead of opening
+ *   and closing them on every call.  Files that read_file() is asked for
+ *   a range of lines in get an index of where every so many lines start,
+ *   so later ranges don't have to be found by reading from the top.
+ *   Appends by write_file() are buffered, and written out at least once
+ *   a second, or before anything else looks at any file.  A file changed
+ *   or replaced by something outside the driver is noticed by its size,
+ *   modification time and inode.  Each file kept open can use two file
+ *   descriptors.  Not available on Windows.
+ */
+#define FILE_CACHE
+#define FILE_CACHE_SIZE 32
+
+/* USE_COMPUTED_GOTO: with gcc (or another compiler that supports goto *),
+ *   have the interpreter jump straight from one instruction to the
+ *   handler for the next through a table of label addresses, rather than
+ *   going back through the big switch in eval_instruction().  Compiled
+ *   LPC code is the same either way.  Ignored if configure finds the
+ *   compiler can't do it, and when DEBUG or any of the tracing or
+ *   profiling options are defined.
+ */
+#define USE_COMPUTED_GOTO
+
+/* RECLAIM_SLICE: if defined, the driver does the work of reclaim_objects()
+ *   a bit at a time from the backend loop, looking at about this many
+ *   values per slice, and starting a fresh walk through all objects every
+ *   RECLAIM_INTERVAL seconds.  It also frees arrays, classes and mappings
+ *   that are only referenced by each other (a = ({ 0 }); a[0] = a; ...),
+ *   which would otherwise never be freed.  mud_status(1) shows how much
+ *   work the slices are doing and how long they take.
+ */
+#define RECLAIM_SLICE 2000
+#define RECLAIM_INTERVAL 60
 
 /* APPLY_CACHE_BITS: defines the number of bits to use in the call_other cache
  *   (in interpret.c).  Somewhere between six (6) and ten (10) is probably
@@ -4,6 +4,7 @@
 #include "comm.h"
 #include "hash.h"
 #include "simul_efun.h"
+#include "backend.h"
 
 /*
  * Object name hash table.  Object names are unique, so no special
@@ -12,6 +13,11 @@
  * cant move them to the head of the hash chain, for example.
  *
  * Note: if you change an object name, you must remove it and reenter it.
+ *
+ * OTABLE_SIZE is only the initial size; the table doubles whenever there
+ * are more objects than chains.  Each object keeps the full hash of its
+ * name in name_hash, so a lookup only does a strcmp() when the hashes
+ * match, and growing the table doesn't need to rehash any names.
  */
 
 static int otable_size;
@@ -19,11 +25,6 @@ static int otable_size_minus_one;
 
 static object_t *find_obj_n PROT((char *));
 
-/*
- * Object hash function, ripped off from stralloc.c.
- */
-#define ObjHash(s) whashstr(s, 40) & otable_size_minus_one
-
 /*
  * hash table - list of pointers to heads of object chains.
  * Each object in chain has a pointer, next_hash, to the next object.
@@ -31,6 +32,20 @@ static object_t *find_obj_n PROT((char *));
 
 static object_t **obj_table = 0;
 
+/*
+ * The last few times the table grew, for show_otable_status().
+ */
+#define OTABLE_HISTORY 8
+
+static struct {
+    int time;
+    int size;
+    int objects;
+} otable_history[OTABLE_HISTORY];
+static int otable_grows = 0;
+
+static int objs_in_table = 0;
+
 void init_otable()
 {
     int x, y;
@@ -47,20 +62,59 @@ void init_otable()
 	obj_table[x] = 0;
 }
 
+/*
+ * Double the number of chains.  Each old chain splits into two new ones;
+ * the order of the objects on each is kept, since precompiled entries
+ * must stay behind real ones.
+ */
+static void grow_otable()
+{
+    object_t **new_table, *ob;
+    object_t **lo, **hi;
+    int x, new_size = otable_size * 2;
+
+    new_table = CALLOCATE(new_size, object_t *, TAG_OBJ_TBL, "grow_otable");
+    for (x = 0; x < otable_size; x++) {
+	lo = &new_table[x];
+	hi = &new_table[x + otable_size];
+	for (ob = obj_table[x]; ob; ob = ob->next_hash) {
+	    if (ob->name_hash & otable_size) {
+		*hi = ob;
+		hi = &ob->next_hash;
+	    } else {
+		*lo = ob;
+		lo = &ob->next_hash;
+	    }
+	}
+	*lo = *hi = 0;
+    }
+    FREE(obj_table);
+    obj_table = new_table;
+    otable_size = new_size;
+    otable_size_minus_one = new_size - 1;
+
+    x = otable_grows++ % OTABLE_HISTORY;
+    otable_history[x].time = current_time;
+    otable_history[x].size = new_size;
+    otable_history[x].objects = objs_in_table;
+}
+
 /*
  * Looks for obj in table, moves it to head.
  */
 
 static int obj_searches = 0, obj_probes = 0, objs_found = 0;
 
-/* A global.  *shhhh* don't tell. */
+/* Globals.  *shhhh* don't tell. */
 static int h;
+static unsigned int full_h;
 
 static object_t *find_obj_n P1(char *, s)
 {
     object_t *curr, *prev;
 
-    h = ObjHash(s);
+    full_h = fnv_hashstr(s);
+    h = full_h & otable_size_minus_one;
     curr = obj_table[h];
     prev = 0;
 
@@ -68,7 +122,8 @@ static object_t *find_obj_n P1(char *, s)
 
     while (curr) {
 	obj_probes++;
-	if (!strcmp(curr->name, s)) {	/* found it */
+	if (curr->name_hash == full_h && !strcmp(curr->name, s)) {
+	    /* found it */
 	    if (prev) {		/* not at head of list */
 		prev->next_hash = curr->next_hash;
 		curr->next_hash = obj_table[h];
@@ -91,13 +146,13 @@ static object_t *find_obj_n P1(char *, s)
  * guaranteed to be behind the real entry if a real entry exists.
  */
 
-static int objs_in_table = 0;
-
 void enter_object_hash P1(object_t *, ob)
 {
     object_t *s;
 
-    s = find_obj_n(ob->name); /* This sets h */
+    if (objs_in_table >= otable_size)
+	grow_otable();
+    s = find_obj_n(ob->name); /* This sets h and full_h */
 
 #ifdef DEBUG
     /* when these reload, the new copy comes in before the old goes out */
@@ -114,6 +169,7 @@ void enter_object_hash P1(object_t *, ob)
     }
 #endif
 
+    ob->name_hash = full_h;
     ob->next_hash = obj_table[h];
     obj_table[h] = ob;
     objs_in_table++;
@@ -128,8 +184,11 @@ void enter_object_hash_at_end P1(object_t *, ob)
     object_t *s;
     object_t **op;
     
-    s = find_obj_n(ob->name); /* This sets h */
+    if (objs_in_table >= otable_size)
+	grow_otable();
+    s = find_obj_n(ob->name); /* This sets h and full_h */
 
+    ob->name_hash = full_h;
     ob->next_hash = 0;
 
     op = &obj_table[h];
@@ -162,14 +221,15 @@ void remove_object_hash P1(object_t *, ob)
 
 #ifdef LPC_TO_C
 void remove_precompiled_hashes P1(char *, name) {
-    int h = ObjHash(name);
+    unsigned int hash = fnv_hashstr(name);
     object_t **p;
     object_t *curr;
     
-    p = &obj_table[h];
+    p = &obj_table[hash & otable_size_minus_one];
     
     while (*p) {
-	if (((*p)->flags & O_COMPILED_PROGRAM) && !strcmp((*p)->name, name)) {
+	if (((*p)->flags & O_COMPILED_PROGRAM) && (*p)->name_hash == hash
+	    && !strcmp((*p)->name, name)) {
 	    curr = *p;
 	    FREE(curr->name);
 	    FREE(curr);
@@ -207,12 +267,12 @@ static char sbuf[100];
 
 int show_otable_status P2(outbuffer_t *, out, int, verbose)
 {
-    int starts;
+    int starts, i, x;
 
     if (verbose == 1) {
 	outbuf_add(out, "Object name hash table status:\n");
 	outbuf_add(out, "------------------------------\n");
-	sprintf(sbuf, "%10.2f", objs_in_table / (float) OTABLE_SIZE);
+	sprintf(sbuf, "%10.2f", objs_in_table / (float) otable_size);
 	outbuf_addv(out, "Average hash chain length:       %s\n", sbuf);
 	sprintf(sbuf, "%10.2f", (float) obj_probes / obj_searches);
 	outbuf_addv(out, "Average search length:           %s\n", sbuf);
@@ -220,13 +280,25 @@ int show_otable_status P2(outbuffer_t *, out, int, verbose)
 		    obj_searches - user_obj_lookups, objs_found - user_obj_found);
 	outbuf_addv(out, "External lookups (succeeded):    %lu (%lu)\n",
 		    user_obj_lookups, user_obj_found);
+	outbuf_addv(out, "Table size:                      %d (grown %d times)\n",
+		    otable_size, otable_grows);
+	i = otable_grows > OTABLE_HISTORY ? otable_grows - OTABLE_HISTORY : 0;
+	for (; i < otable_grows; i++) {
+	    time_t when;
+
+	    x = i % OTABLE_HISTORY;
+	    when = otable_history[x].time;
+	    outbuf_addv(out, "  grew to %8d at %d objects, %s",
+			otable_history[x].size, otable_history[x].objects,
+			ctime(&when));
+	}
     }
-    starts = (int) OTABLE_SIZE *sizeof(object_t *) +
+    starts = (int) otable_size *sizeof(object_t *) +
                 objs_in_table * sizeof(object_t);
 
     if (!verbose) {
 	outbuf_addv(out, "Obj table overhead:\t\t%8d %8d\n",
-		    OTABLE_SIZE * sizeof(object_t *), starts);
+		    otable_size * sizeof(object_t *), starts);
     }
     return starts;
 }
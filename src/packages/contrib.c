@@ -186,53 +186,62 @@ f_set_prompt PROT((void)) {
 #ifdef F_COPY
 static int depth;
 
-void deep_copy_svalue PROT((svalue_t *, svalue_t *));
-
-array_t *deep_copy_array P1( array_t *, arg ) {
-    array_t *vec;
+/*
+ * Arrays and mappings are only duplicated when something else can see
+ * them.  One with a single reference (a temporary, or one reachable only
+ * through a container that has just been copied) is kept, and copying
+ * carries on with its contents.  One with nothing but plain values in it
+ * is given a copy that shares its elements until either is changed.
+ * Returns 0 if there is nothing in the copy left to copy.
+ */
+static int unshare_container P1(svalue_t *, sv)
+{
+    array_t *arr;
+    mapping_t *map;
     int i;
-    
-    vec = allocate_empty_array(arg->size);
-    for (i = 0; i < arg->size; i++)
-	deep_copy_svalue(&arg->item[i], &vec->item[i]);
-    return vec;
-}
 
-int doCopy P3( mapping_t *, map, mapping_node_t *, elt, mapping_t *, dest) {
-    svalue_t *sp;
-    
-    sp = find_for_insert(dest, &elt->values[0], 1);
-    if (!sp) {
-	mapping_too_large();
-	return 1;
+    switch (sv->type) {
+    case T_CLASS:
+	if ((arr = sv->u.arr)->ref > 1) {
+	    sv->u.arr = allocate_class_by_size(arr->size);
+	    for (i = arr->size; i--; )
+		assign_svalue_no_free(&sv->u.arr->item[i], &arr->item[i]);
+	    arr->ref--;
+	}
+	break;
+    case T_ARRAY:
+	if ((arr = sv->u.arr)->ref > 1) {
+	    if ((sv->u.arr = share_array(arr))) {
+		arr->ref--;
+		return 0;
+	    }
+	    sv->u.arr = copy_array(arr);
+	    arr->ref--;
+	}
+	break;
+    case T_MAPPING:
+	if ((map = sv->u.map)->ref > 1) {
+	    if ((sv->u.map = share_mapping(map))) {
+		map->ref--;
+		return 0;
+	    }
+	    sv->u.map = copyMapping(map, 0);
+	    map->ref--;
+	}
+	break;
     }
-    
-    deep_copy_svalue(&elt->values[1], sp);
-    return 0;
+    return 1;
 }
 
-mapping_t *deep_copy_mapping P1( mapping_t *, arg ) {
-    mapping_t *map;
-    
-    map = allocate_mapping( 0 ); /* this should be fixed.  -Beek */
-    mapTraverse( arg, (int (*)()) doCopy, map);
-    return map;
-}
+static void deep_copy_in_place P1(svalue_t *, sv)
+{
+    map_chunk_t *c;
+    mapping_node_t *elt;
+    int i;
 
-void deep_copy_svalue P2(svalue_t *, from, svalue_t *, to) {
-    switch (from->type) {
+    switch (sv->type) {
     case T_ARRAY:
     case T_CLASS:
-	depth++;
-	if (depth > MAX_SAVE_SVALUE_DEPTH) {
-	    depth = 0;
-	    error("Mappings, arrays and/or classes nested too deep (%d) for copy()\n",
-		  MAX_SAVE_SVALUE_DEPTH);
-	}
-	*to = *from;
-	to->u.arr = deep_copy_array( from->u.arr );
-	depth--;
-	break;
     case T_MAPPING:
 	depth++;
 	if (depth > MAX_SAVE_SVALUE_DEPTH) {
@@ -240,23 +249,26 @@ void deep_copy_svalue P2(svalue_t *, from, svalue_t *, to) {
 	    error("Mappings, arrays and/or classes nested too deep (%d) for copy()\n",
 		  MAX_SAVE_SVALUE_DEPTH);
 	}
-	*to = *from;
-	to->u.map = deep_copy_mapping( from->u.map );
+	/* a copy sharing its contents has only plain values in it */
+	if (unshare_container(sv)) {
+	    if (sv->type == T_MAPPING) {
+		/* keys are compared by identity, so they stay shared */
+		MAP_FOREACH(sv->u.map, c, elt)
+		    deep_copy_in_place(&elt->values[1]);
+	    } else {
+		for (i = 0; i < sv->u.arr->size; i++)
+		    deep_copy_in_place(&sv->u.arr->item[i]);
+	    }
+	}
 	depth--;
 	break;
-    default:
-	assign_svalue_no_free( to, from );
     }
 }
 
 void f_copy PROT((void))
 {
-    svalue_t ret;
-    
     depth = 0;
-    deep_copy_svalue(sp, &ret);
-    free_svalue(sp, "f_copy");
-    *sp = ret;
+    deep_copy_in_place(sp);
 }
 #endif    
 
@@ -457,8 +469,8 @@ f_terminal_colour P2( int, num_arg, int, instruction)
     char *instr, *cp, *savestr, *deststr, **parts;
     int num, i, j, k, col, space, *lens, maybe_at_end;
     int space_garbage;
-    mapping_node_t *elt, **mtab;
-    int tmp;
+    mapping_node_t *elt;
+    svalue_t key;
     int wrap = 0;
     int indent = 0;
 
@@ -535,28 +547,26 @@ f_terminal_colour P2( int, num_arg, int, instruction)
     /* Could keep track of the lens as we create parts, removing the need
        for a strlen() below */
     lens = CALLOCATE(num, int, TAG_TEMPORARY, "f_terminal_colour: lens");
-    mtab = sp->u.map->table;
+    key.type = T_STRING;
+    key.subtype = STRING_SHARED;
 
     /* Do the the pointer replacement and calculate the lengths */
     col = 0;
     space = 0;
     maybe_at_end = 0;
-    for (j = i = 0, k = sp->u.map->table_size; i < num; i++) {
+    for (j = i = 0; i < num; i++) {
 	int len;
 	    
 	if ((cp = findstring(parts[i]))) {
-	    tmp = MAP_POINTER_HASH(cp);
-	    for (elt = mtab[tmp & k]; elt; elt = elt->next)
-		if ( elt->values->type == T_STRING && 
-		     (elt->values + 1)->type == T_STRING &&
-		     cp == elt->values->u.string) {
-		    parts[i] = (elt->values + 1)->u.string;
-		    /* Negative indicates don't count for wrapping */
-		    len = SVALUE_STRLEN(elt->values + 1);
-		    if (wrap) len = -len;
-		    break;
-		}
-	    if (!elt)
+	    key.u.string = cp;
+	    elt = node_find_in_mapping(sp->u.map, &key);
+	    if (elt && elt->values->type == T_STRING && 
+		(elt->values + 1)->type == T_STRING) {
+		parts[i] = (elt->values + 1)->u.string;
+		/* Negative indicates don't count for wrapping */
+		len = SVALUE_STRLEN(elt->values + 1);
+		if (wrap) len = -len;
+	    } else
 		len = SHARED_STRLEN(cp);
 	} else {
 	    len = strlen(parts[i]);
@@ -1584,16 +1594,17 @@ static int memory_share P1(svalue_t *, sv) {
 	break;
     case T_ARRAY:
     case T_CLASS:
-	/* first svalue is stored inside the array struct, so sizeof(array_t)
-	 * includes one svalue.
-	 */
-	subtotal = sizeof(array_t) - sizeof(svalue_t);
+	subtotal = 0;
 	for (i = 0; i < sv->u.arr->size; i++)
 	    subtotal += memory_share(&sv->u.arr->item[i]);
+	/* elements shared with other arrays are split between them */
+	subtotal = ARRAY_SIZE(0) + subtotal/sv->u.arr->store->shares;
 	return total + subtotal/sv->u.arr->ref;
     case T_MAPPING:
-	subtotal = sizeof(mapping_t);
+	subtotal = 0;
 	mapTraverse(sv->u.map, node_share, &subtotal);
+	/* so are nodes shared with other mappings */
+	subtotal = sizeof(mapping_t) + subtotal/sv->u.map->store->shares;
 	return total + subtotal/sv->u.map->ref;
     case T_FUNCTION:
     {
@@ -39,11 +39,14 @@ int external_start P5(int, which, char *, args,
 	lpc_socks[fd].owner_ob = current_object;
 	lpc_socks[fd].release_ob = NULL;
 	lpc_socks[fd].r_buf = NULL;
+	lpc_socks[fd].r_size = 0;
 	lpc_socks[fd].r_off = 0;
 	lpc_socks[fd].r_len = 0;
-	lpc_socks[fd].w_buf = NULL;
+	lpc_socks[fd].w_head = NULL;
+	lpc_socks[fd].w_tail = NULL;
 	lpc_socks[fd].w_off = 0;
 	lpc_socks[fd].w_len = 0;
+	update_socket_poll(fd);
 
 	current_object->flags |= O_EFUN_SOCKET;
 	return fd;
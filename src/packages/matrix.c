@@ -80,6 +80,8 @@ void f_translate PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = final_matrix[i];
     }
@@ -125,6 +127,8 @@ void f_scale PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = final_matrix[i];
     }
@@ -161,6 +165,8 @@ void f_rotate_x PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = final_matrix[i];
     }
@@ -197,6 +203,8 @@ void f_rotate_y PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = final_matrix[i];
     }
@@ -233,6 +241,8 @@ void f_rotate_z PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = final_matrix[i];
     }
@@ -273,6 +283,8 @@ void f_lookat_rotate PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = lookat_matrix[i];
     }
@@ -318,6 +330,8 @@ void f_lookat_rotate2 PROT((void))
     /*
      * convert float matrix to vec matrix.
      */
+    if (ARRAY_SHARED(matrix))
+	unshare_array(matrix);
     for (i = 0; i < 16; i++) {
 	matrix->item[i].u.real = lookat_matrix[i];
     }
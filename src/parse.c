@@ -1214,6 +1214,8 @@ prepos_parse P4(array_t *, warr, int *, cix_in, int *, fail, svalue_t *, prepos)
 	parse_ret.u.number = 0;
 	*fail = 1;
     } else if (parr != gPrepos_list) {
+	if (ARRAY_SHARED(parr))
+	    unshare_array(parr);
 	parse_ret = parr->item[0];
 	parr->item[0] = parr->item[pix];
 	parr->item[pix] = parse_ret;
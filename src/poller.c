@@ -0,0 +1,285 @@
+/*
+ * poller.c -- descriptor readiness for the backend loop.
+ *
+ * The driver used to rebuild a pair of select() masks from every port,
+ * user and efun socket on each pass through backend(), and then scan all
+ * of them again to find out which were ready.  Here interest is kept per
+ * descriptor and only changed when a connection's state changes, so the
+ * cost of a pass depends on the number of descriptors that are actually
+ * ready rather than on the number that exist.
+ *
+ * With USE_EPOLL (and a system that has it) the interest set lives in the
+ * kernel; otherwise a pair of master fd_sets is maintained and select()
+ * is used as before.
+ */
+#include "std.h"
+#include "network_incl.h"
+#include "lpc_incl.h"
+#include "file.h"
+#include "poller.h"
+
+#if defined(USE_EPOLL) && defined(HAS_EPOLL)
+#  define POLL_EPOLL
+#  include <sys/epoll.h>
+#endif
+
+poll_fd_t *poll_fds = 0;
+int poll_fds_size = 0;
+poll_event_t *poll_events = 0;
+int poll_num_fds = 0;
+int poll_waits = 0;
+int poll_ready = 0;
+int poll_changes = 0;
+
+#ifdef POLL_EPOLL
+char *poll_method = "epoll";
+
+static int epoll_fd = -1;
+static struct epoll_event *epoll_buf = 0;
+#else
+char *poll_method = "select";
+
+static fd_set poll_readset, poll_writeset;
+static int poll_max_fd = -1;
+#endif
+
+/*
+ * Make sure the descriptor table covers fd.
+ */
+static int grow_poll_fds P1(int, fd)
+{
+    int i, newsize;
+
+    if (fd < poll_fds_size)
+	return 1;
+#ifndef POLL_EPOLL
+    if (fd >= FD_SETSIZE)
+	return 0;
+#endif
+    newsize = poll_fds_size ? poll_fds_size : 64;
+    while (newsize <= fd)
+	newsize *= 2;
+#ifndef POLL_EPOLL
+    if (newsize > FD_SETSIZE)
+	newsize = FD_SETSIZE;
+#endif
+
+    if (poll_fds) {
+	poll_fds = RESIZE(poll_fds, newsize, poll_fd_t, TAG_POLLER, "grow_poll_fds");
+	poll_events = RESIZE(poll_events, newsize, poll_event_t, TAG_POLLER, "grow_poll_fds");
+#ifdef POLL_EPOLL
+	epoll_buf = RESIZE(epoll_buf, newsize, struct epoll_event, TAG_POLLER, "grow_poll_fds");
+#endif
+    } else {
+	poll_fds = CALLOCATE(newsize, poll_fd_t, TAG_POLLER, "grow_poll_fds");
+	poll_events = CALLOCATE(newsize, poll_event_t, TAG_POLLER, "grow_poll_fds");
+#ifdef POLL_EPOLL
+	epoll_buf = CALLOCATE(newsize, struct epoll_event, TAG_POLLER, "grow_poll_fds");
+#endif
+    }
+    for (i = poll_fds_size; i < newsize; i++) {
+	poll_fds[i].kind = PK_NONE;
+	poll_fds[i].events = 0;
+	poll_fds[i].which = -1;
+    }
+    poll_fds_size = newsize;
+    return 1;
+}
+
+void init_poller()
+{
+#ifdef POLL_EPOLL
+    epoll_fd = epoll_create(64);
+    if (epoll_fd == -1) {
+	debug_perror("init_poller: epoll_create", 0);
+	exit(11);
+    }
+    /* external_start() forks; the child has no business with this */
+    fcntl(epoll_fd, F_SETFD, FD_CLOEXEC);
+#else
+    FD_ZERO(&poll_readset);
+    FD_ZERO(&poll_writeset);
+#endif
+    grow_poll_fds(0);
+}
+
+#ifdef POLL_EPOLL
+static int epoll_update P3(int, fd, int, op, int, events)
+{
+    struct epoll_event ev;
+
+    ev.events = 0;
+    if (events & POLL_READ)
+	ev.events |= EPOLLIN;
+    if (events & POLL_WRITE)
+	ev.events |= EPOLLOUT;
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd, op, fd, &ev);
+}
+#else
+static void select_update P2(int, fd, int, events)
+{
+    if (events & POLL_READ)
+	FD_SET(fd, &poll_readset);
+    else
+	FD_CLR(fd, &poll_readset);
+    if (events & POLL_WRITE)
+	FD_SET(fd, &poll_writeset);
+    else
+	FD_CLR(fd, &poll_writeset);
+}
+#endif
+
+/*
+ * Register fd as belonging to table entry 'which' of the given kind, with
+ * the given interest.  Returns 0 if the descriptor can't be watched.
+ */
+int poll_set P4(int, fd, int, kind, int, which, int, events)
+{
+    poll_fd_t *pfd;
+
+    if (fd < 0 || !grow_poll_fds(fd))
+	return 0;
+    pfd = &poll_fds[fd];
+#ifdef POLL_EPOLL
+    if (pfd->kind == PK_NONE) {
+	if (epoll_update(fd, EPOLL_CTL_ADD, events) == -1) {
+	    debug_perror("poll_set: epoll_ctl", 0);
+	    return 0;
+	}
+    } else if (pfd->events != events) {
+	if (epoll_update(fd, EPOLL_CTL_MOD, events) == -1) {
+	    debug_perror("poll_set: epoll_ctl", 0);
+	    return 0;
+	}
+    }
+#else
+    select_update(fd, events);
+    if (fd > poll_max_fd)
+	poll_max_fd = fd;
+#endif
+    if (pfd->kind == PK_NONE)
+	poll_num_fds++;
+    pfd->kind = kind;
+    pfd->which = which;
+    pfd->events = events;
+    return 1;
+}
+
+/*
+ * Change the interest of an fd that is already registered.  This is
+ * called every time output is queued, so it must be cheap when nothing
+ * changes.
+ */
+void poll_modify P2(int, fd, int, events)
+{
+    poll_fd_t *pfd;
+
+    if (fd < 0 || fd >= poll_fds_size)
+	return;
+    pfd = &poll_fds[fd];
+    if (pfd->kind == PK_NONE || pfd->events == events)
+	return;
+#ifdef POLL_EPOLL
+    if (epoll_update(fd, EPOLL_CTL_MOD, events) == -1) {
+	debug_perror("poll_modify: epoll_ctl", 0);
+	return;
+    }
+#else
+    select_update(fd, events);
+#endif
+    pfd->events = events;
+    poll_changes++;
+}
+
+/*
+ * Forget about fd.  Must be called before the descriptor is closed, since
+ * a forked child (external_start) may keep the underlying socket alive.
+ */
+void poll_remove P1(int, fd)
+{
+    poll_fd_t *pfd;
+
+    if (fd < 0 || fd >= poll_fds_size)
+	return;
+    pfd = &poll_fds[fd];
+    if (pfd->kind == PK_NONE)
+	return;
+#ifdef POLL_EPOLL
+    /* may fail with EBADF if the fd is already gone; that's fine */
+    epoll_update(fd, EPOLL_CTL_DEL, 0);
+#else
+    select_update(fd, 0);
+    while (poll_max_fd >= 0 && (poll_max_fd == fd ||
+				poll_fds[poll_max_fd].kind == PK_NONE))
+	poll_max_fd--;
+#endif
+    poll_num_fds--;
+    pfd->kind = PK_NONE;
+    pfd->events = 0;
+    pfd->which = -1;
+}
+
+/*
+ * Wait for something to happen.  Fills poll_events[] and returns the
+ * number of entries, or -1 (e.g. EINTR from SIGALRM).
+ */
+int poll_wait P1(struct timeval *, timeout)
+{
+    int nb, i;
+#ifdef POLL_EPOLL
+    int ms;
+
+    ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    nb = epoll_wait(epoll_fd, epoll_buf, poll_fds_size, ms);
+    for (i = 0; i < nb; i++) {
+	int ev = 0;
+
+	if (epoll_buf[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+	    ev |= POLL_READ;
+	if (epoll_buf[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+	    ev |= POLL_WRITE;
+	poll_events[i].fd = epoll_buf[i].data.fd;
+	poll_events[i].events = ev;
+    }
+#else
+    fd_set readmask, writemask;
+
+    readmask = poll_readset;
+    writemask = poll_writeset;
+#ifndef hpux
+    nb = select(poll_max_fd + 1, &readmask, &writemask, (fd_set *) 0, timeout);
+#else
+    nb = select(poll_max_fd + 1, (int *) &readmask, (int *) &writemask,
+		(int *) 0, timeout);
+#endif
+    if (nb > 0) {
+	int fd, n = 0;
+
+	for (fd = 0; fd <= poll_max_fd && n < nb; fd++) {
+	    int ev = 0;
+
+	    if (FD_ISSET(fd, &readmask))
+		ev |= POLL_READ;
+	    if (FD_ISSET(fd, &writemask))
+		ev |= POLL_WRITE;
+	    if (ev) {
+		poll_events[n].fd = fd;
+		poll_events[n++].events = ev;
+	    }
+	}
+	nb = n;
+    }
+#endif
+    poll_waits++;
+    if (nb > 0)
+	poll_ready += nb;
+    return nb;
+}
+
+void poll_status P1(outbuffer_t *, ob)
+{
+    outbuf_addv(ob, "Poller: %s   Descriptors: %d   Waits: %d   Ready events: %d   Changes: %d\n",
+		poll_method, poll_num_fds, poll_waits, poll_ready, poll_changes);
+}
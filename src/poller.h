@@ -0,0 +1,54 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+/*
+ * Interest flags for poll_set(), and the readiness flags returned in
+ * poll_events[].
+ */
+#define POLL_READ	1
+#define POLL_WRITE	2
+
+/*
+ * What kind of descriptor an fd is; tells process_io() which handler
+ * gets the event.  'which' is an index into the table for that kind
+ * (external_port[], all_users[], lpc_socks[]).
+ */
+#define PK_NONE		0
+#define PK_EXTERNAL_PORT 1
+#define PK_USER		2
+#define PK_LPC_SOCKET	3
+#define PK_ADDR_SERVER	4
+
+typedef struct {
+    short kind;
+    short events;		/* interest currently registered */
+    int which;
+} poll_fd_t;
+
+typedef struct {
+    int fd;
+    int events;			/* POLL_READ and/or POLL_WRITE */
+} poll_event_t;
+
+/*
+ * poller.c
+ */
+extern poll_fd_t *poll_fds;
+extern int poll_fds_size;
+extern poll_event_t *poll_events;
+extern char *poll_method;
+extern int poll_num_fds;
+extern int poll_waits;
+extern int poll_ready;
+extern int poll_changes;
+
+void init_poller PROT((void));
+int poll_set PROT((int, int, int, int));
+void poll_modify PROT((int, int));
+void poll_remove PROT((int));
+int poll_wait PROT((struct timeval *));
+void poll_status PROT((outbuffer_t *));
+
+#define POLL_KIND(fd) ((fd) < poll_fds_size ? poll_fds[fd].kind : PK_NONE)
+
+#endif
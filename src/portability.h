@@ -220,4 +220,9 @@ void SocketPerror(char *str, char *file);
 #define OPEN_READ O_RDONLY
 #endif
 
+/* MCCP needs zlib */
+#if defined(MCCP) && !defined(HAS_ZLIB)
+#undef MCCP
+#endif
+
 #endif				/* _PORT_H */
@@ -51,6 +51,8 @@ void deallocate_program P1(program_t *, progp)
 	remove_line_swap(progp);
     if (progp->file_info)
 	FREE(progp->file_info);
+    if (progp->call_other_cache)
+	FREE(progp->call_other_cache);
     
     FREE((char *) progp);
 }
@@ -156,16 +156,16 @@ typedef struct {
 typedef struct program_s {
     char *name;			/* Name of file that defined prog */
     int flags;
-    unsigned short ref;			/* Reference count */
-    unsigned short func_ref;
+    unsigned int ref;			/* Reference count */
+    unsigned int func_ref;
+    int id_number;		/* used to associate information with this
+				 * prog block without needing to increase the
+				 * reference count     */
 #ifdef DEBUG
     int extra_ref;		/* Used to verify ref count */
     int extra_func_ref;
 #endif
     char *program;		/* The binary instructions */
-    int id_number;		/* used to associate information with this
-				 * prog block without needing to increase the
-				 * reference count     */
     unsigned char *line_info;   /* Line number information */
     unsigned short *file_info;
     int line_swap_index;	/* Where line number info is swapped */
@@ -184,6 +184,8 @@ typedef struct program_s {
     int total_size;		/* Sum of all data in this struct */
     int heart_beat;		/* Index of the heart beat function. -1 means
 				 * no heart beat */
+    /* inline caches for the call_other sites; allocated when first used */
+    struct cache_entry_s *call_other_cache;
     /*
      * The types of function arguments are saved where 'argument_types'
      * points. It can be a variable number of arguments, so allocation is
@@ -208,6 +210,7 @@ typedef struct program_s {
     unsigned short num_variables_total;
     unsigned short num_variables_defined;
     unsigned short num_inherited;
+    unsigned short num_call_other_sites;
 } program_t;
 
 extern int total_num_prog_blocks;
@@ -10,6 +10,7 @@
 #include "include/runtime_config.h"
 #include "lpc_incl.h"
 #include "main.h"
+#include "resolver.h"
 
 #define MAX_LINE_LENGTH 120
 
@@ -232,6 +233,10 @@ void set_defaults P1(char *, filename)
     
     scan_config_line("address server port : %d\n",
 		     &CONFIG_INT(__ADDR_SERVER_PORT__), 0);
+#ifdef RESOLVER
+    if (scan_config_line("name server : %[^\n]", tmp, 0))
+	name_server = alloc_cstring(tmp, "config file: ns");
+#endif
 
     scan_config_line("time to clean up : %d\n",
 		     &CONFIG_INT(__TIME_TO_CLEAN_UP__), 1);
@@ -3,26 +3,41 @@
  * loops through all variables in all objects looking for the possibility
  * of freeing up destructed objects (that are still hanging around because
  * of references) -- coded by Blackthorn@Genocide Feb. 1993
+ *
+ * With RECLAIM_SLICE defined, the same walk is also done a little at a
+ * time from the backend, and arrays, classes and mappings that have been
+ * stored inside one another are checked for reference cycles that nothing
+ * else points to any more.
  */
 
 #include "std.h"
 #include "lpc_incl.h"
+#include "backend.h"
+#include "port.h"
 #include "reclaim.h"
 
 #define MAX_RECURSION 25
+/*
+ * values looked at per variable by reclaim_slice(); keeps cyclic data from
+ * taking forever.  reclaim_objects() always finishes the job.
+ */
+#define MAX_VARIABLE_WORK 100000
 
 static void gc_mapping PROT((mapping_t *));
 static void check_svalue PROT((svalue_t *));
 
 static int cleaned, nested;
+static int work, work_limit;
 
 static void
 check_svalue P1(svalue_t *, v)
 {
     register int idx;
 
+    work++;
     nested++;
-    if (nested > MAX_RECURSION) {
+    if (nested > MAX_RECURSION || (work_limit && work > work_limit)) {
+	nested--;
 	return;
     }
     switch (v->type) {
@@ -61,46 +76,489 @@ gc_mapping P1(mapping_t *, m)
      * just call check_svalue() b/c the hash would be wrong and the '0'
      * element we add would be unreferenceable (in most cases)
      */
-    mapping_node_t **prev, *elt;
-    int j = (int) m->table_size;
-
-    do {
-	prev = m->table + j;
-	while ((elt = *prev)) {
-	    if (elt->values[0].type == T_OBJECT) {
-		if (elt->values[0].u.ob->flags & O_DESTRUCTED) {
-		    free_object(elt->values[0].u.ob, "gc_mapping");
-		    
-		    /* found one, do a map_delete() */
-		    if (!(*prev = elt->next) && !m->table[j])
-			m->unfilled++;
-		    cleaned++;
-		    m->count--;
-		    total_mapping_nodes--;
-		    total_mapping_size -= sizeof(mapping_node_t);
-		    free_svalue(elt->values + 1, "gc_mapping");
-		    free_node(elt);
-		    continue;
-		}
-	    } else {
-		/* in case the key is a mapping or something */
-		check_svalue(elt->values);
+    map_chunk_t *c;
+    mapping_node_t *elt;
+    /* a shared body can't be changed, so its keys wait for a later pass */
+    int shared = MAP_SHARED(m);
+
+    MAP_FOREACH(m, c, elt) {
+	if (elt->values[0].type == T_OBJECT) {
+	    if ((elt->values[0].u.ob->flags & O_DESTRUCTED) && !shared) {
+		/* found one, do a map_delete() */
+		cleaned++;
+		mapping_delete_node(m, elt);
+		continue;
 	    }
-	    check_svalue(elt->values+1);
-	    prev = &(elt->next);
+	} else {
+	    /* in case the key is a mapping or something */
+	    check_svalue(elt->values);
 	}
-    } while (j--);
+	check_svalue(elt->values+1);
+    }
+    if (m->deleted > m->count)
+	map_compact_later(m);
 }
 
-int reclaim_objects()
+static void
+check_object P2(object_t *, ob, int, limit)
 {
     int i;
+
+    if (ob->prog)
+	for (i = 0; i < (int) ob->prog->num_variables_total; i++) {
+	    work_limit = (limit ? work + limit : 0);
+	    check_svalue(&ob->variables[i]);
+	}
+}
+
+#ifdef RECLAIM_SLICE
+/*
+ * Cycle collection.
+ *
+ * A cycle of arrays, classes and mappings can only be closed by storing
+ * one of them into a slot of another, so every time a container is
+ * stored somewhere other than a variable, it is remembered as a
+ * candidate (see reclaim_note_store()).  The candidate table doesn't hold
+ * a reference, so that a container nothing else shares can still be
+ * changed in place; instead a container is taken out of the table when it
+ * is freed (RECLAIM_FORGET), and resize_array() puts back one it moves.
+ *
+ * Each candidate is checked by trial deletion: walk everything reachable
+ * from it, count how many of each container's references come from
+ * inside the walk, and mark as live any container with more references
+ * than that, along with everything it reaches.  Whatever is left is only
+ * referenced by itself, and is freed by emptying each container and then
+ * dropping them.  Function pointers and objects aren't walked into, so
+ * anything referenced from one counts as live.
+ */
+#define MAX_CYCLE_NODES 1024
+#define MAX_CYCLE_WORK  10000
+
+#define IS_CONTAINER(v) ((v)->type & (T_ARRAY | T_CLASS | T_MAPPING))
+#define CONTAINER_EMPTY(v) ((v)->type == T_MAPPING ? !(v)->u.map->count \
+			    : !(v)->u.arr->size)
+#define PTR_HASH(p) ((((POINTER_INT)(p)) >> 4) ^ (((POINTER_INT)(p)) >> 12))
+
+typedef struct {
+    svalue_t sv;
+    int internal;		/* references from inside the walk */
+    char live;
+} gc_node_t;
+
+static gc_node_t gc_nodes[MAX_CYCLE_NODES];
+static short gc_index[2 * MAX_CYCLE_NODES];
+static short gc_stack[MAX_CYCLE_NODES];
+static int gc_num, gc_overflow, gc_sp, gc_start;
+
+static svalue_t *cand_table;
+static int cand_size, cand_scan;
+int reclaim_candidates;
+
+/*
+ * The next object for the walk through obj_list to look at;
+ * destruct_object() moves it on if that object goes away.
+ */
+object_t *reclaim_next;
+static int walking, next_pass;
+
+static int slices, passes, cycles_freed, containers_freed, candidates_checked;
+static int total_cleaned, max_work;
+static long total_work, total_usec, max_usec;
+
+static int
+cand_find P1(void *, p)
+{
+    int i = PTR_HASH(p) & (cand_size - 1);
+
+    if (!cand_size)
+	return -1;
+    while (cand_table[i].u.refed) {
+	if (cand_table[i].u.refed == p)
+	    return i;
+	i = (i + 1) & (cand_size - 1);
+    }
+    return -1;
+}
+
+static void
+cand_insert P1(svalue_t *, v)
+{
+    int i = PTR_HASH(v->u.refed) & (cand_size - 1);
+
+    while (cand_table[i].u.refed)
+	i = (i + 1) & (cand_size - 1);
+    cand_table[i] = *v;
+}
+
+static void
+cand_grow()
+{
+    svalue_t *old = cand_table;
+    int i, old_size = cand_size;
+
+    cand_size = (old_size ? old_size * 2 : 64);
+    cand_table = CALLOCATE(cand_size, svalue_t, TAG_RECLAIM, "cand_grow");
+    for (i = 0; i < cand_size; i++)
+	cand_table[i].u.refed = 0;
+    for (i = 0; i < old_size; i++)
+	if (old[i].u.refed)
+	    cand_insert(&old[i]);
+    if (old)
+	FREE(old);
+}
+
+/* remove slot i, shifting back any entries that probed past it */
+static void
+cand_delete P1(int, i)
+{
+    int j = i, k;
+
+    for (;;) {
+	j = (j + 1) & (cand_size - 1);
+	if (!cand_table[j].u.refed)
+	    break;
+	k = PTR_HASH(cand_table[j].u.refed) & (cand_size - 1);
+	if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	cand_table[i] = cand_table[j];
+	i = j;
+    }
+    cand_table[i].u.refed = 0;
+    reclaim_candidates--;
+}
+
+/*
+ * Called after an array, class or mapping has been stored through the
+ * lvalue lv.  Stores into local and global variables can't close a cycle
+ * and are ignored.
+ */
+void
+reclaim_note_store P1(svalue_t *, lv)
+{
+    if (lv >= start_of_stack && lv < end_of_stack)
+	return;
+    if (current_object && current_object->prog &&
+	lv >= current_object->variables &&
+	lv < current_object->variables + current_object->prog->num_variables_total)
+	return;
+    reclaim_note_container(lv);
+}
+
+/* remember v, which has just had something stored in it or into it */
+void
+reclaim_note_container P1(svalue_t *, v)
+{
+    if (CONTAINER_EMPTY(v))
+	return;
+    if (cand_find(v->u.refed) != -1)
+	return;
+    if (reclaim_candidates * 2 >= cand_size)
+	cand_grow();
+    cand_insert(v);
+    reclaim_candidates++;
+}
+
+/* returns the type p was remembered as, or 0 */
+int
+reclaim_forget P1(void *, p)
+{
+    int i, type;
+
+    if ((i = cand_find(p)) == -1)
+	return 0;
+    type = cand_table[i].type;
+    cand_delete(i);
+    return type;
+}
+
+void
+reclaim_renote P2(int, type, void *, p)
+{
+    svalue_t v;
+
+    v.type = type;
+    v.u.refed = (refed_t *) p;
+    reclaim_note_container(&v);
+}
+
+static int
+gc_find P1(void *, p)
+{
+    int i = PTR_HASH(p) & (2 * MAX_CYCLE_NODES - 1);
+
+    while (gc_index[i]) {
+	if (gc_nodes[gc_index[i] - 1].sv.u.refed == p)
+	    return gc_index[i] - 1;
+	i = (i + 1) & (2 * MAX_CYCLE_NODES - 1);
+    }
+    return -1;
+}
+
+static int
+gc_add P1(svalue_t *, v)
+{
+    int i = PTR_HASH(v->u.refed) & (2 * MAX_CYCLE_NODES - 1);
+
+    while (gc_index[i]) {
+	if (gc_nodes[gc_index[i] - 1].sv.u.refed == v->u.refed)
+	    return gc_index[i] - 1;
+	i = (i + 1) & (2 * MAX_CYCLE_NODES - 1);
+    }
+    if (gc_num == MAX_CYCLE_NODES) {
+	gc_overflow = 1;
+	return -1;
+    }
+    gc_index[i] = gc_num + 1;
+    gc_nodes[gc_num].sv = *v;
+    gc_nodes[gc_num].internal = 0;
+    gc_nodes[gc_num].live = 0;
+    return gc_num++;
+}
+
+/* first pass counts internal references, second propagates liveness */
+static void
+gc_visit P2(svalue_t *, v, int, propagate)
+{
+    int i;
+
+    work++;
+    if (!IS_CONTAINER(v) || CONTAINER_EMPTY(v))
+	return;
+    if (!propagate) {
+	if ((i = gc_add(v)) != -1)
+	    gc_nodes[i].internal++;
+    } else if ((i = gc_find(v->u.refed)) != -1 && !gc_nodes[i].live) {
+	gc_nodes[i].live = 1;
+	gc_stack[gc_sp++] = i;
+    }
+}
+
+static void
+gc_scan P2(int, n, int, propagate)
+{
+    svalue_t *v = &gc_nodes[n].sv;
+    map_chunk_t *c;
+    mapping_node_t *elt;
+    int j;
+
+    /* don't start on something too big to finish */
+    if (!propagate && work - gc_start + (v->type == T_MAPPING ?
+	    v->u.map->count + v->u.map->deleted : v->u.arr->size)
+	    > MAX_CYCLE_WORK) {
+	gc_overflow = 1;
+	return;
+    }
+    if (v->type == T_MAPPING) {
+	MAP_FOREACH(v->u.map, c, elt) {
+	    gc_visit(elt->values, propagate);
+	    gc_visit(elt->values + 1, propagate);
+	}
+    } else {
+	for (j = 0; j < v->u.arr->size; j++)
+	    gc_visit(v->u.arr->item + j, propagate);
+    }
+}
+
+static void
+gc_empty P1(svalue_t *, v)
+{
+    map_chunk_t *c;
+    mapping_node_t *elt;
+    svalue_t tmp;
+    int j;
+
+    /*
+     * what a shared body or store holds can't be part of a cycle, and other
+     * containers still see it
+     */
+    if (v->type == T_MAPPING ? MAP_SHARED(v->u.map) : ARRAY_SHARED(v->u.arr))
+	return;
+    if (v->type == T_MAPPING) {
+	/* the keys are zeroed too, so the mapping must not be searched
+	   again before it is freed */
+	MAP_FOREACH(v->u.map, c, elt) {
+	    tmp = elt->values[0];
+	    elt->values[0] = const0u;
+	    free_svalue(&tmp, "gc_empty");
+	    tmp = elt->values[1];
+	    elt->values[1] = const0u;
+	    free_svalue(&tmp, "gc_empty");
+	}
+    } else {
+	for (j = 0; j < v->u.arr->size; j++) {
+	    tmp = v->u.arr->item[j];
+	    v->u.arr->item[j] = const0u;
+	    free_svalue(&tmp, "gc_empty");
+	}
+    }
+}
+
+/*
+ * Check one candidate.  It has already been taken out of the table.
+ */
+static void
+collect_cycles P1(svalue_t *, root)
+{
+    int i;
+
+    candidates_checked++;
+    if (CONTAINER_EMPTY(root))
+	return;
+
+    memset(gc_index, 0, sizeof(gc_index));
+    gc_num = gc_overflow = 0;
+    gc_start = work;
+    gc_add(root);
+    for (i = 0; i < gc_num; i++) {
+	gc_scan(i, 0);
+	/* too big to look at all at once; assume it's in use */
+	if (gc_overflow)
+	    return;
+    }
+
+    gc_sp = 0;
+    for (i = 0; i < gc_num; i++) {
+	if (gc_nodes[i].sv.u.refed->ref > gc_nodes[i].internal) {
+	    gc_nodes[i].live = 1;
+	    gc_stack[gc_sp++] = i;
+	}
+    }
+    while (gc_sp && !gc_nodes[0].live)
+	gc_scan(gc_stack[--gc_sp], 1);
+    if (gc_nodes[0].live)
+	return;
+
+    /*
+     * Everything not live is garbage.  Hold a ref on each one so none of
+     * them goes away while the others are being emptied.
+     */
+    for (i = 0; i < gc_num; i++)
+	if (!gc_nodes[i].live)
+	    gc_nodes[i].sv.u.refed->ref++;
+    for (i = 0; i < gc_num; i++)
+	if (!gc_nodes[i].live) {
+	    gc_empty(&gc_nodes[i].sv);
+	    containers_freed++;
+	}
+    for (i = 0; i < gc_num; i++)
+	if (!gc_nodes[i].live)
+	    free_svalue(&gc_nodes[i].sv, "collect_cycles");
+    cycles_freed++;
+}
+
+static int
+next_candidate P1(svalue_t *, ret)
+{
+    if (!reclaim_candidates)
+	return 0;
+    while (!cand_table[cand_scan].u.refed)
+	cand_scan = (cand_scan + 1) & (cand_size - 1);
+    *ret = cand_table[cand_scan];
+    cand_delete(cand_scan);
+    return 1;
+}
+
+/* is there anything for reclaim_slice() to do? */
+int
+reclaim_pending()
+{
+    return reclaim_candidates || walking || current_time >= next_pass;
+}
+
+/*
+ * Called from the backend loop.  Checks cycle candidates, then carries on
+ * the walk through object variables, until about RECLAIM_SLICE values
+ * have been looked at.  A new walk is started every RECLAIM_INTERVAL
+ * seconds.
+ */
+void
+reclaim_slice()
+{
+    svalue_t v;
+    long sec, usec, sec2, usec2;
+
+    if (!reclaim_pending())
+	return;
+
+    get_usec_clock(&sec, &usec);
+    work = cleaned = nested = 0;
+
+    while (work < RECLAIM_SLICE && next_candidate(&v))
+	collect_cycles(&v);
+
+    if (work < RECLAIM_SLICE && (walking || current_time >= next_pass)) {
+	if (!walking) {
+	    reclaim_next = obj_list;
+	    walking = 1;
+	    next_pass = current_time + RECLAIM_INTERVAL;
+	}
+	while (reclaim_next && work < RECLAIM_SLICE) {
+	    check_object(reclaim_next, MAX_VARIABLE_WORK);
+	    reclaim_next = reclaim_next->next_all;
+	}
+	if (!reclaim_next) {
+	    walking = 0;
+	    passes++;
+	}
+    }
+
+    get_usec_clock(&sec2, &usec2);
+    usec = (sec2 - sec) * 1000000 + usec2 - usec;
+    slices++;
+    total_work += work;
+    total_usec += usec;
+    total_cleaned += cleaned;
+    if (work > max_work)
+	max_work = work;
+    if (usec > max_usec)
+	max_usec = usec;
+}
+
+int reclaim_status P2(outbuffer_t *, ob, int, verbose)
+{
+    if (verbose == 1) {
+	outbuf_add(ob, "Reclaim information:\n");
+	outbuf_add(ob, "--------------------\n");
+	outbuf_addv(ob, "Slices: %d, passes: %d, values per slice: %d avg, %d max\n",
+		    slices, passes, slices ? (int) (total_work / slices) : 0,
+		    max_work);
+	outbuf_addv(ob, "Pause time: %ld usec total, %ld avg, %ld max\n",
+		    total_usec, slices ? total_usec / slices : 0, max_usec);
+	outbuf_addv(ob, "Destructed references cleaned: %d\n", total_cleaned);
+	outbuf_addv(ob, "Cycle candidates: %d pending, %d checked, %d cycles (%d containers) freed\n",
+		    reclaim_candidates, candidates_checked, cycles_freed,
+		    containers_freed);
+    } else {
+	if (verbose != -1)
+	    outbuf_addv(ob, "reclaim:\t\t\t%8d %8d (%d slices, %ld usec)\n",
+			reclaim_candidates, cand_size * sizeof(svalue_t), slices,
+			total_usec);
+    }
+    return (int) (cand_size * sizeof(svalue_t));
+}
+
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_reclaim()
+{
+    if (cand_table)
+	DO_MARK(cand_table, TAG_RECLAIM);
+}
+#endif
+#endif
+
+int reclaim_objects()
+{
     object_t *ob;
+#ifdef RECLAIM_SLICE
+    svalue_t v;
+#endif
 
     cleaned = nested = 0;
     for (ob = obj_list; ob; ob = ob->next_all)
-	if (ob->prog)
-	    for (i = 0; i < (int) ob->prog->num_variables_total; i++)
-		check_svalue(&ob->variables[i]);
+	check_object(ob, 0);
+#ifdef RECLAIM_SLICE
+    while (next_candidate(&v))
+	collect_cycles(&v);
+#endif
     return cleaned;
 }
@@ -6,4 +6,37 @@
  */
 int reclaim_objects PROT((void));
 
+#ifdef RECLAIM_SLICE
+/* longest the backend sleeps while reclaim_slice() has work, in usec */
+#define RECLAIM_WAIT 10000
+
+extern int reclaim_candidates;
+extern object_t *reclaim_next;
+
+void reclaim_slice PROT((void));
+int reclaim_pending PROT((void));
+void reclaim_note_store PROT((svalue_t *));
+void reclaim_note_container PROT((svalue_t *));
+int reclaim_forget PROT((void *));
+void reclaim_renote PROT((int, void *));
+int reclaim_status PROT((outbuffer_t *, int));
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_reclaim PROT((void));
+#endif
+
+/* lv has just been assigned to; see if that could have made a cycle */
+#define RECLAIM_STORE(lv) SAFE( \
+    if ((lv)->type & (T_ARRAY | T_CLASS | T_MAPPING)) \
+	reclaim_note_store(lv); \
+)
+/* the array, class or mapping p is about to be freed */
+#define RECLAIM_FORGET(p) SAFE( \
+    if (reclaim_candidates) \
+	reclaim_forget(p); \
+)
+#else
+#define RECLAIM_STORE(lv)
+#define RECLAIM_FORGET(p)
+#endif
+
 #endif
@@ -0,0 +1,829 @@
+/*
+ * resolver.c -- host name lookups without the address server.
+ *
+ * The driver used to hand every lookup to a separate addr_server process
+ * over a TCP connection, which did them one at a time with the blocking
+ * gethostbyname() and gethostbyaddr().  One slow name server held up
+ * every lookup queued behind it, and the driver kept only a small fixed
+ * table of answers with no notion of when they went stale.
+ *
+ * Here the driver talks to a name server itself over UDP.  Any number of
+ * queries (up to RESOLVER_MAX_PENDING) can be outstanding at once; a
+ * second request for something already being looked up waits for the
+ * same answer instead of asking again.  Answers are kept, for as long as
+ * the name server says they are good, in a cache of RESOLVER_CACHE_SIZE
+ * entries from which the least recently used is dropped when it is full.
+ *
+ * All callbacks to resolve() are made from resolver_run() in the backend,
+ * never from inside the efun, even when the answer is already known.
+ */
+#include "std.h"
+#include "network_incl.h"
+#include "lpc_incl.h"
+#include "socket_ctrl.h"
+#include "port.h"
+#include "file.h"
+#include "debug.h"
+#include "hash.h"
+#include "md.h"
+#include "poller.h"
+#include "resolver.h"
+
+#ifdef RESOLVER
+
+#define T_A	1
+#define T_PTR	12
+
+#define DNS_HEADER	12
+#define DNS_PACKET	512
+#define DNS_NAME	256
+
+typedef struct dns_waiter_s {
+    struct dns_waiter_s *next;
+    object_t *ob;
+    char *call_back;
+    char *name, *number;	/* filled in when the answer is known */
+    int key;
+} dns_waiter_t;
+
+typedef struct dns_entry_s {
+    struct dns_entry_s *hash_next;
+    struct dns_entry_s *lru_prev, *lru_next;
+    char *key;			/* the number for T_PTR, the name for T_A */
+    char *answer;		/* 0 if there isn't one */
+    short type;
+    short tries;
+    int id;			/* of the query in flight; -1 if none */
+    long expires;
+    long sent;			/* when the query was last sent */
+    long start_sec, start_usec;
+    dns_waiter_t *waiters;
+} dns_entry_t;
+
+char *name_server = 0;
+
+static int resolver_fd = -1;
+static struct sockaddr_in server_addr;
+
+static dns_entry_t **dns_table = 0;
+static int dns_table_size;
+static dns_entry_t *lru_head = 0, *lru_tail = 0;
+static int cache_count = 0;
+
+static dns_entry_t *pending[RESOLVER_MAX_PENDING];
+static int num_pending = 0;
+
+static dns_waiter_t *ready_head = 0, *ready_tail = 0;
+static int next_key = 0;
+
+static int stat_lookups, stat_hits, stat_joined, stat_queries;
+static int stat_retries, stat_timeouts, stat_answers, stat_not_found;
+static int stat_failed, stat_stray;
+static double total_latency;
+static long max_latency;
+
+static void send_query PROT((dns_entry_t *));
+static void finish_lookup PROT((dns_entry_t *, char *, long));
+
+static void
+read_resolv_conf P2(char *, host, int, size)
+{
+    FILE *f;
+    char line[256], addr[64];
+    int len;
+
+    if (!(f = fopen("/etc/resolv.conf", "r")))
+	return;
+    while (fgets(line, sizeof(line), f)) {
+	if (sscanf(line, " nameserver %63s", addr) == 1 && !strchr(addr, ':')) {
+	    len = strlen(addr);
+	    if (len > size - 1)
+		len = size - 1;
+	    memcpy(host, addr, len);
+	    host[len] = 0;
+	    break;
+	}
+    }
+    fclose(f);
+}
+
+void init_resolver()
+{
+    char host[64];
+    int port = 53;
+    int i;
+
+    strcpy(host, "127.0.0.1");
+    if (name_server) {
+	if (sscanf(name_server, "%63s %d", host, &port) < 1) {
+	    debug_message("Bad name server '%s'; using 127.0.0.1.\n",
+			  name_server);
+	    strcpy(host, "127.0.0.1");
+	}
+    } else
+	read_resolv_conf(host, sizeof(host));
+
+    for (dns_table_size = 16; dns_table_size < RESOLVER_CACHE_SIZE; )
+	dns_table_size <<= 1;
+    dns_table = CALLOCATE(dns_table_size, dns_entry_t *, TAG_RESOLVER,
+			  "init_resolver");
+    for (i = 0; i < dns_table_size; i++)
+	dns_table[i] = 0;
+
+    memset((char *) &server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons((u_short) port);
+    if ((server_addr.sin_addr.s_addr = inet_addr(host)) == -1) {
+	debug_message("Name server must be given as an IP number, not '%s'.\n",
+		      host);
+	return;
+    }
+    if ((resolver_fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+	debug_perror("init_resolver: socket", 0);
+	return;
+    }
+    if (set_socket_nonblocking(resolver_fd, 1) == -1) {
+	debug_perror("init_resolver: set_socket_nonblocking", 0);
+	OS_socket_close(resolver_fd);
+	resolver_fd = -1;
+	return;
+    }
+    /* connected, so only the server's replies get through */
+    if (connect(resolver_fd, (struct sockaddr *) &server_addr,
+		sizeof(server_addr)) == -1) {
+	debug_perror("init_resolver: connect", 0);
+	OS_socket_close(resolver_fd);
+	resolver_fd = -1;
+	return;
+    }
+    poll_set(resolver_fd, PK_ADDR_SERVER, 0, POLL_READ);
+    debug_message("Using name server %s port %d\n", host, port);
+}
+
+/*
+ * The cache.  Keys are shared strings, so they are compared by address.
+ */
+static dns_entry_t *
+find_entry P2(char *, key, int, type)
+{
+    dns_entry_t *e;
+
+    if (!(key = findstring(key)))
+	return 0;
+    for (e = dns_table[fnv_hashstr(key) & (dns_table_size - 1)]; e;
+	 e = e->hash_next)
+	if (e->key == key && e->type == type)
+	    return e;
+    return 0;
+}
+
+static void
+lru_unlink P1(dns_entry_t *, e)
+{
+    if (e->lru_prev)
+	e->lru_prev->lru_next = e->lru_next;
+    else
+	lru_head = e->lru_next;
+    if (e->lru_next)
+	e->lru_next->lru_prev = e->lru_prev;
+    else
+	lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = 0;
+}
+
+static void
+lru_push P1(dns_entry_t *, e)
+{
+    e->lru_prev = 0;
+    e->lru_next = lru_head;
+    if (lru_head)
+	lru_head->lru_prev = e;
+    else
+	lru_tail = e;
+    lru_head = e;
+}
+
+static void
+free_entry P1(dns_entry_t *, e)
+{
+    dns_entry_t **ep;
+
+    for (ep = &dns_table[fnv_hashstr(e->key) & (dns_table_size - 1)];
+	 *ep != e; ep = &(*ep)->hash_next)
+	;
+    *ep = e->hash_next;
+    free_string(e->key);
+    if (e->answer)
+	free_string(e->answer);
+    FREE(e);
+}
+
+static dns_entry_t *
+new_entry P2(char *, key, int, type)
+{
+    dns_entry_t *e;
+    int h;
+
+    e = ALLOCATE(dns_entry_t, TAG_RESOLVER, "new_entry");
+    e->key = make_shared_string(key);
+    e->answer = 0;
+    e->type = type;
+    e->tries = 0;
+    e->id = -1;
+    e->expires = 0;
+    e->waiters = 0;
+    e->lru_prev = e->lru_next = 0;
+    h = fnv_hashstr(e->key) & (dns_table_size - 1);
+    e->hash_next = dns_table[h];
+    dns_table[h] = e;
+    return e;
+}
+
+/*
+ * Start a query for e, or join the one already in flight.  Returns 0 if
+ * there is no room for another query.
+ */
+static int
+start_lookup P1(dns_entry_t *, e)
+{
+    int slot;
+
+    if (e->id != -1) {
+	stat_joined++;
+	return 1;
+    }
+    if (resolver_fd == -1 || num_pending == RESOLVER_MAX_PENDING)
+	return 0;
+    slot = random_number(RESOLVER_MAX_PENDING);
+    while (pending[slot])
+	slot = (slot + 1) & (RESOLVER_MAX_PENDING - 1);
+    pending[slot] = e;
+    num_pending++;
+    /* the slot is in the low bits; the rest is there to be guessed */
+    e->id = (random_number(65536 / RESOLVER_MAX_PENDING)
+	     * RESOLVER_MAX_PENDING) | slot;
+    e->tries = 0;
+    if (e->lru_prev || lru_head == e) {
+	lru_unlink(e);
+	cache_count--;
+    }
+    get_usec_clock(&e->start_sec, &e->start_usec);
+    send_query(e);
+    return 1;
+}
+
+static int
+put_name P3(unsigned char *, p, unsigned char *, end, char *, name)
+{
+    unsigned char *start = p, *len;
+
+    while (*name) {
+	len = p++;
+	while (*name && *name != '.') {
+	    if (p == end)
+		return 0;
+	    *p++ = *name++;
+	}
+	if (p - len - 1 == 0 || p - len - 1 > 63)
+	    return 0;
+	*len = p - len - 1;
+	if (*name)
+	    name++;
+    }
+    if (p == end)
+	return 0;
+    *p++ = 0;
+    return p - start;
+}
+
+/* the name asked about for e: the key, or its in-addr.arpa form */
+static void
+query_name P2(dns_entry_t *, e, char *, name)
+{
+    int len;
+
+    if (e->type == T_PTR) {
+	unsigned int a, b, c, d;
+
+	sscanf(e->key, "%u.%u.%u.%u", &a, &b, &c, &d);
+	sprintf(name, "%u.%u.%u.%u.in-addr.arpa", d, c, b, a);
+    } else {
+	len = strlen(e->key);
+	if (len > DNS_NAME - 1)
+	    len = DNS_NAME - 1;
+	memcpy(name, e->key, len);
+	name[len] = 0;
+    }
+}
+
+/* names compare without regard to case or a trailing dot */
+static int
+same_name P2(char *, a, char *, b)
+{
+    while (*a && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+	a++;
+	b++;
+    }
+    if (*a == '.' && !a[1])
+	a++;
+    if (*b == '.' && !b[1])
+	b++;
+    return !*a && !*b;
+}
+
+static void
+send_query P1(dns_entry_t *, e)
+{
+    unsigned char buf[DNS_PACKET];
+    char name[DNS_NAME];
+    unsigned char *p;
+    int n;
+    long sec, usec;
+
+    query_name(e, name);
+
+    memset((char *) buf, 0, DNS_HEADER);
+    buf[0] = e->id >> 8;
+    buf[1] = e->id & 0xff;
+    buf[2] = 0x01;		/* recursion desired */
+    buf[5] = 1;			/* one question */
+    p = buf + DNS_HEADER;
+    n = put_name(p, buf + DNS_PACKET - 4, name);
+    /* resolve_callback() has already checked the name */
+    p += n;
+    *p++ = 0;
+    *p++ = e->type;
+    *p++ = 0;
+    *p++ = 1;			/* class IN */
+
+    get_usec_clock(&sec, &usec);
+    e->sent = sec;
+    e->tries++;
+    stat_queries++;
+    if (OS_socket_write(resolver_fd, (char *) buf, p - buf) == -1) {
+	/* nothing listening, usually; it will be tried again */
+	debug(512, ("send_query: %s\n", port_strerror(errno)));
+    }
+}
+
+/*
+ * Read a possibly compressed name starting at off into buf.  Returns the
+ * offset just past the name as it appears at off, or -1 if it is bad.
+ */
+static int
+get_name P5(unsigned char *, msg, int, len, int, off, char *, buf, int, size)
+{
+    int end = -1, jumps = 0, n, used = 0;
+
+    while (1) {
+	if (off >= len)
+	    return -1;
+	n = msg[off];
+	if ((n & 0xc0) == 0xc0) {
+	    if (off + 1 >= len || ++jumps > 16)
+		return -1;
+	    if (end == -1)
+		end = off + 2;
+	    off = ((n & 0x3f) << 8) | msg[off + 1];
+	    continue;
+	}
+	if (n & 0xc0)
+	    return -1;
+	off++;
+	if (!n)
+	    break;
+	if (off + n > len || used + n + 1 >= size)
+	    return -1;
+	if (used)
+	    buf[used++] = '.';
+	memcpy(buf + used, msg + off, n);
+	used += n;
+	off += n;
+    }
+    buf[used] = 0;
+    return end == -1 ? off : end;
+}
+
+static void
+handle_reply P2(unsigned char *, msg, int, len)
+{
+    dns_entry_t *e;
+    char name[DNS_NAME], asked[DNS_NAME];
+    char *answer = 0;
+    int id, qd, an, off, type, rdlen;
+    long ttl, min_ttl = RESOLVER_MAX_TTL;
+
+    if (len < DNS_HEADER) {
+	stat_stray++;
+	return;
+    }
+    id = (msg[0] << 8) | msg[1];
+    e = pending[id & (RESOLVER_MAX_PENDING - 1)];
+    if (!e || e->id != id || !(msg[2] & 0x80)) {
+	stat_stray++;
+	return;
+    }
+    /*
+     * The ID is only 16 bits, so also insist that the reply repeats the
+     * question we asked before believing anything in it.
+     */
+    qd = (msg[4] << 8) | msg[5];
+    an = (msg[6] << 8) | msg[7];
+    if (qd != 1
+	|| (off = get_name(msg, len, DNS_HEADER, name, sizeof(name))) == -1
+	|| off + 4 > len)
+	goto bad;
+    query_name(e, asked);
+    if (!same_name(name, asked)
+	|| ((msg[off] << 8) | msg[off + 1]) != e->type
+	|| ((msg[off + 2] << 8) | msg[off + 3]) != 1)
+	goto bad;
+    off += 4;
+    if ((msg[3] & 0x0f) == 3) {
+	/* no such name */
+	stat_not_found++;
+	finish_lookup(e, 0, RESOLVER_NEGATIVE_TTL);
+	return;
+    }
+    if (msg[3] & 0x0f) {
+	stat_failed++;
+	finish_lookup(e, 0, RESOLVER_FAIL_TTL);
+	return;
+    }
+    while (an-- && !answer) {
+	if ((off = get_name(msg, len, off, name, sizeof(name))) == -1
+	    || off + 10 > len)
+	    goto bad;
+	type = (msg[off] << 8) | msg[off + 1];
+	ttl = ((long) msg[off + 4] << 24) | (msg[off + 5] << 16)
+	    | (msg[off + 6] << 8) | msg[off + 7];
+	rdlen = (msg[off + 8] << 8) | msg[off + 9];
+	off += 10;
+	if (off + rdlen > len)
+	    goto bad;
+	/* a CNAME on the way counts towards how long the answer is good */
+	if (ttl >= 0 && ttl < min_ttl)
+	    min_ttl = ttl;
+	if (type == e->type) {
+	    if (type == T_A && rdlen == 4) {
+		sprintf(name, "%d.%d.%d.%d", msg[off], msg[off + 1],
+			msg[off + 2], msg[off + 3]);
+		answer = name;
+	    } else if (type == T_PTR
+		       && get_name(msg, len, off, name, sizeof(name)) != -1)
+		answer = name;
+	}
+	off += rdlen;
+    }
+    if (!answer) {
+	stat_not_found++;
+	finish_lookup(e, 0, RESOLVER_NEGATIVE_TTL);
+	return;
+    }
+    if (min_ttl < RESOLVER_MIN_TTL)
+	min_ttl = RESOLVER_MIN_TTL;
+    stat_answers++;
+    finish_lookup(e, answer, min_ttl);
+    return;
+
+  bad:
+    stat_stray++;
+}
+
+void resolver_handler()
+{
+    unsigned char buf[DNS_PACKET];
+    int n, i;
+
+    /* don't let a flood of packets keep us here */
+    for (i = 0; i < 64; i++) {
+	n = OS_socket_read(resolver_fd, (char *) buf, sizeof(buf));
+	if (n == -1) {
+#ifdef EWOULDBLOCK
+	    if (errno != EWOULDBLOCK && errno != EAGAIN)
+#else
+	    if (errno != EAGAIN)
+#endif
+		debug(512, ("resolver_handler: %s\n", port_strerror(errno)));
+	    return;
+	}
+	handle_reply(buf, n);
+    }
+}
+
+static void
+ready_waiter P1(dns_waiter_t *, w)
+{
+    w->next = 0;
+    if (ready_tail)
+	ready_tail->next = w;
+    else
+	ready_head = w;
+    ready_tail = w;
+}
+
+/*
+ * Put the answer (or its absence) into the cache, and queue the callbacks
+ * of everyone waiting for it.
+ */
+static void
+finish_lookup P3(dns_entry_t *, e, char *, answer, long, ttl)
+{
+    dns_waiter_t *w, *next;
+    long sec, usec, latency;
+
+    pending[e->id & (RESOLVER_MAX_PENDING - 1)] = 0;
+    num_pending--;
+    e->id = -1;
+
+    get_usec_clock(&sec, &usec);
+    latency = (sec - e->start_sec) * 1000000 + usec - e->start_usec;
+    total_latency += latency;
+    if (latency > max_latency)
+	max_latency = latency;
+
+    /*
+     * If the name server didn't answer, keep any older answer rather than
+     * forgetting it.
+     */
+    if (answer || ttl != RESOLVER_FAIL_TTL) {
+	if (e->answer)
+	    free_string(e->answer);
+	e->answer = answer ? make_shared_string(answer) : 0;
+    }
+    e->expires = sec + ttl;
+
+    for (w = e->waiters; w; w = next) {
+	next = w->next;
+	if (e->type == T_PTR) {
+	    w->name = e->answer;
+	    w->number = e->key;
+	} else {
+	    w->name = e->key;
+	    w->number = e->answer;
+	}
+	if (w->name)
+	    ref_string(w->name);
+	if (w->number)
+	    ref_string(w->number);
+	ready_waiter(w);
+    }
+    e->waiters = 0;
+
+    lru_push(e);
+    if (++cache_count > RESOLVER_CACHE_SIZE) {
+	e = lru_tail;
+	lru_unlink(e);
+	cache_count--;
+	free_entry(e);
+    }
+}
+
+/*
+ * Find the entry for key, looking it up if it isn't known or has gone
+ * stale.  Returns 0 if it can't be looked up.
+ */
+static dns_entry_t *
+lookup P2(char *, key, int, type)
+{
+    dns_entry_t *e;
+    long sec, usec;
+
+    if (!dns_table)
+	return 0;
+    stat_lookups++;
+    if (!(e = find_entry(key, type)))
+	e = new_entry(key, type);
+    else if (e->id == -1) {
+	get_usec_clock(&sec, &usec);
+	if (e->expires > sec) {
+	    stat_hits++;
+	    lru_unlink(e);
+	    lru_push(e);
+	    return e;
+	}
+    }
+    if (!start_lookup(e)) {
+	if (e->id == -1 && !e->lru_prev && lru_head != e)
+	    free_entry(e);
+	return 0;
+    }
+    return e;
+}
+
+/*
+ * Look up the name of a user's address as they log in, for
+ * query_ip_name().
+ */
+void resolve_ip_name P1(char *, number)
+{
+    lookup(number, T_PTR);
+}
+
+/*
+ * The name for an address, if there is one in the cache.  A stale one is
+ * still returned while it is looked up again.
+ */
+char *resolved_ip_name P1(char *, number)
+{
+    dns_entry_t *e;
+
+    if (!dns_table || !(e = find_entry(number, T_PTR)))
+	return 0;
+    return e->answer;
+}
+
+static int
+valid_name P1(char *, name)
+{
+    unsigned char buf[DNS_NAME];
+
+    return *name && strlen(name) < DNS_NAME - 16 && put_name(buf, buf + DNS_NAME, name);
+}
+
+/*
+ * resolve(): look up a name or a number, and call back call_back in the
+ * current object with (name, number, key) when the answer is known.
+ */
+int resolve_callback P2(char *, name, char *, call_back)
+{
+    dns_waiter_t *w;
+    dns_entry_t *e = 0;
+    int type;
+
+    w = ALLOCATE(dns_waiter_t, TAG_RESOLVER, "resolve_callback");
+    w->ob = current_object;
+    add_ref(current_object, "resolve_callback");
+    w->call_back = make_shared_string(call_back);
+    w->name = w->number = 0;
+    if (++next_key <= 0)
+	next_key = 1;
+    w->key = next_key;
+
+    type = (inet_addr(name) != -1 && isdigit(*name)) ? T_PTR : T_A;
+    if (valid_name(name))
+	e = lookup(name, type);
+    if (!e) {
+	stat_failed++;
+	if (type == T_PTR)
+	    w->number = make_shared_string(name);
+	else
+	    w->name = make_shared_string(name);
+	ready_waiter(w);
+    } else if (e->id != -1) {
+	dns_waiter_t **wp;
+
+	/* callbacks are made in the order resolve() was called */
+	for (wp = &e->waiters; *wp; wp = &(*wp)->next)
+	    ;
+	w->next = 0;
+	*wp = w;
+    } else {
+	if (type == T_PTR) {
+	    w->name = e->answer;
+	    w->number = e->key;
+	} else {
+	    w->name = e->key;
+	    w->number = e->answer;
+	}
+	if (w->name)
+	    ref_string(w->name);
+	if (w->number)
+	    ref_string(w->number);
+	ready_waiter(w);
+    }
+    return w->key;
+}
+
+int resolver_pending()
+{
+    return num_pending;
+}
+
+int resolver_ready()
+{
+    return ready_head != 0;
+}
+
+static void
+free_waiter P1(dns_waiter_t *, w)
+{
+    free_object(w->ob, "free_waiter");
+    free_string(w->call_back);
+    if (w->name)
+	free_string(w->name);
+    if (w->number)
+	free_string(w->number);
+    FREE(w);
+}
+
+/*
+ * Called from the backend: send again the queries that haven't been
+ * answered, give up on those that have been tried enough, and make the
+ * callbacks that are due.
+ */
+void resolver_run()
+{
+    dns_waiter_t *w;
+    long sec, usec;
+    int i;
+
+    if (num_pending) {
+	get_usec_clock(&sec, &usec);
+	for (i = 0; i < RESOLVER_MAX_PENDING; i++) {
+	    if (!pending[i] || sec - pending[i]->sent < RESOLVER_RETRY)
+		continue;
+	    if (pending[i]->tries < RESOLVER_TRIES) {
+		stat_retries++;
+		send_query(pending[i]);
+	    } else {
+		stat_timeouts++;
+		finish_lookup(pending[i], 0, RESOLVER_FAIL_TTL);
+	    }
+	}
+    }
+
+    while ((w = ready_head)) {
+	if (!(ready_head = w->next))
+	    ready_tail = 0;
+	if (!(w->ob->flags & O_DESTRUCTED)) {
+	    if (w->name)
+		push_shared_string(w->name);
+	    else
+		push_undefined();
+	    if (w->number)
+		push_shared_string(w->number);
+	    else
+		push_undefined();
+	    push_number(w->key);
+	    safe_apply(w->call_back, w->ob, 3, ORIGIN_DRIVER);
+	}
+	free_waiter(w);
+    }
+}
+
+int resolver_status P2(outbuffer_t *, ob, int, verbose)
+{
+    int done = stat_answers + stat_not_found + stat_failed + stat_timeouts;
+    int size = cache_count * sizeof(dns_entry_t)
+	+ dns_table_size * sizeof(dns_entry_t *);
+
+    if (verbose == 1) {
+	outbuf_addv(ob, "Name server lookups: %d (%d cached, %d joined), %d pending\n",
+		    stat_lookups, stat_hits, stat_joined, num_pending);
+	outbuf_addv(ob, "Queries: %d sent, %d retried, %d timed out, %d stray replies\n",
+		    stat_queries, stat_retries, stat_timeouts, stat_stray);
+	outbuf_addv(ob, "Replies: %d answered, %d no such name, %d failed\n",
+		    stat_answers, stat_not_found, stat_failed);
+	outbuf_addv(ob, "Cache hit rate: %.1f%%, latency: %.0f usec avg, %ld max\n",
+		    stat_lookups ? 100.0 * stat_hits / stat_lookups : 0.0,
+		    done ? total_latency / done : 0.0, max_latency);
+	outbuf_addv(ob, "Cache: %d of %d entries\n", cache_count,
+		    RESOLVER_CACHE_SIZE);
+    } else {
+	if (verbose != -1)
+	    outbuf_addv(ob, "Resolver cache:\t\t\t%8d %8d\n",
+			cache_count, size);
+    }
+    return size;
+}
+
+#ifdef DEBUGMALLOC_EXTENSIONS
+static void
+mark_waiter P1(dns_waiter_t *, w)
+{
+    DO_MARK(w, TAG_RESOLVER);
+    w->ob->extra_ref++;
+    EXTRA_REF(BLOCK(w->call_back))++;
+    if (w->name)
+	EXTRA_REF(BLOCK(w->name))++;
+    if (w->number)
+	EXTRA_REF(BLOCK(w->number))++;
+}
+
+void mark_resolver()
+{
+    dns_entry_t *e;
+    dns_waiter_t *w;
+    int i;
+
+    if (name_server)
+	DO_MARK(name_server, TAG_STRING);
+    if (!dns_table)
+	return;
+    DO_MARK(dns_table, TAG_RESOLVER);
+    for (i = 0; i < dns_table_size; i++) {
+	for (e = dns_table[i]; e; e = e->hash_next) {
+	    DO_MARK(e, TAG_RESOLVER);
+	    EXTRA_REF(BLOCK(e->key))++;
+	    if (e->answer)
+		EXTRA_REF(BLOCK(e->answer))++;
+	    for (w = e->waiters; w; w = w->next)
+		mark_waiter(w);
+	}
+    }
+    for (w = ready_head; w; w = w->next)
+	mark_waiter(w);
+}
+#endif
+#endif
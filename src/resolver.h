@@ -0,0 +1,32 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#ifdef RESOLVER
+#define RESOLVER_MAX_PENDING	256	/* lookups in flight; a power of 2 */
+#define RESOLVER_RETRY		2	/* seconds before asking again     */
+#define RESOLVER_TRIES		3	/* times to ask before giving up   */
+#define RESOLVER_MIN_TTL	5	/* bounds on how long answers are  */
+#define RESOLVER_MAX_TTL	86400	/* kept, in seconds                */
+#define RESOLVER_NEGATIVE_TTL	300	/* how long "no such name" is kept */
+#define RESOLVER_FAIL_TTL	30	/* and no answer at all            */
+
+/*
+ * resolver.c
+ */
+extern char *name_server;
+
+void init_resolver PROT((void));
+void resolver_handler PROT((void));
+int resolver_pending PROT((void));
+int resolver_ready PROT((void));
+void resolver_run PROT((void));
+void resolve_ip_name PROT((char *));
+char *resolved_ip_name PROT((char *));
+int resolve_callback PROT((char *, char *));
+int resolver_status PROT((outbuffer_t *, int));
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_resolver PROT((void));
+#endif
+#endif
+
+#endif
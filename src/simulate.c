@@ -16,6 +16,8 @@
 #include "ed.h"
 #include "file.h"
 #include "packages/parser.h"
+#include "fcache.h"
+#include "reclaim.h"
 
 /*
  * 'inherit_file' is used as a flag. If it is set to a string
@@ -397,6 +399,11 @@ object_t *int_load_object P1(char *, lname)
 	error("Filenames with consecutive /'s in them aren't allowed (%s).\n",
 	      lname);
 
+#ifdef USE_FILE_CACHE
+    /* it may have just been written with write_file() */
+    if (fcache_buffered)
+	fcache_sync();
+#endif
     /*
      * First check that the c-file exists.
      */
@@ -1086,6 +1093,11 @@ void destruct_object P1(object_t *, ob)
      * Now remove us out of the list of all objects. This must be done last,
      * because an error in the above code would halt execution.
      */
+#ifdef RECLAIM_SLICE
+    /* don't leave reclaim_slice() pointing at us */
+    if (reclaim_next == ob)
+	reclaim_next = ob->next_all;
+#endif
     removed = 0;
     for (pp = &obj_list; *pp; pp = &(*pp)->next_all) {
 	if (*pp != ob)
@@ -2117,6 +2129,9 @@ void fatal P1V(char *, fmt)
 	    push_undefined();
 	}
 	apply_master_ob(APPLY_CRASH, 3);
+#ifdef USE_FILE_CACHE
+	fcache_sync();
+#endif
 	debug_message("crash() in master called successfully.  Aborting.\n");
     }
     /* Make sure we don't trap our abort() */
@@ -2418,6 +2433,9 @@ void shutdownMudOS P1(int, exit_code)
 	if (all_users[i] && !(all_users[i]->iflags & CLOSING))
 	    flush_message(all_users[i]);
     }
+#ifdef USE_FILE_CACHE
+    fcache_sync();
+#endif
 #ifdef LATTICE
     signal(SIGUSR1, SIG_IGN);
     signal(SIGTERM, SIG_IGN);
@@ -16,6 +16,10 @@
 #include "comm.h"
 #include "eoperators.h"
 #include "file.h"
+#include "poller.h"
+#ifndef WINSOCK
+#include <sys/uio.h>
+#endif
 
 #ifdef PACKAGE_SOCKETS
 
@@ -24,12 +28,18 @@
 #define SC_DO_CALLBACK	2
 #define SC_FINAL_CLOSE  4
 
+/* most queued messages handed to one writev() */
+#define MAX_SOCKET_IOVEC 16
+
 lpc_socket_t *lpc_socks = 0;
 int max_lpc_socks = 0;
 
 static int socket_name_to_sin PROT((char *, struct sockaddr_in *));
 static char *inet_address PROT((struct sockaddr_in *));
 
+/* what's been read from a STREAM socket, on its way to the callback */
+static char read_buf[READ_BUF_SIZE];
+
 /*
  * check permission
  */
@@ -85,15 +95,40 @@ int more_lpc_sockets()
 	lpc_socks[i].write_callback.s = 0;
 	lpc_socks[i].close_callback.s = 0;
 	lpc_socks[i].r_buf = NULL;
+	lpc_socks[i].r_size = 0;
 	lpc_socks[i].r_off = 0;
 	lpc_socks[i].r_len = 0;
-	lpc_socks[i].w_buf = NULL;
+	lpc_socks[i].w_head = NULL;
+	lpc_socks[i].w_tail = NULL;
 	lpc_socks[i].w_off = 0;
 	lpc_socks[i].w_len = 0;
     }
     return max_lpc_socks - 10;
 }
 
+/*
+ * Tell the poller what we are waiting for on a socket.  Must be called
+ * whenever the state, S_WACCEPT or S_BLOCKED changes.
+ */
+int update_socket_poll P1(int, which)
+{
+    lpc_socket_t *lpc_sock = &lpc_socks[which];
+    int events = 0;
+
+    if (lpc_sock->state == CLOSED) {
+	poll_remove(lpc_sock->fd);
+	return 1;
+    }
+    if (lpc_sock->state != FLUSHING && !(lpc_sock->flags & S_WACCEPT))
+	events |= POLL_READ;
+    if (lpc_sock->flags & S_BLOCKED)
+	events |= POLL_WRITE;
+    if (POLL_KIND(lpc_sock->fd) == PK_NONE)
+	return poll_set(lpc_sock->fd, PK_LPC_SOCKET, which, events);
+    poll_modify(lpc_sock->fd, events);
+    return 1;
+}
+
 /*
  * Set the callbacks for a socket
  */
@@ -213,6 +248,13 @@ socket_create P3(enum socket_mode, mode, svalue_t *, read_callback, svalue_t *,
     } else if (mode == DATAGRAM_BINARY) {
 	binary = 1;
 	mode = DATAGRAM;
+    } else if (mode == MUD_BINARY) {
+#ifdef BINARY_SAVE_EXTENSION
+	binary = 1;
+	mode = MUD;
+#else
+	return EEMODENOTSUPP;
+#endif
     }
     switch (mode) {
 
@@ -247,6 +289,10 @@ socket_create P3(enum socket_mode, mode, svalue_t *, read_callback, svalue_t *,
 	    OS_socket_close(fd);
 	    return EENONBLOCK;
 	}
+	if (!poll_set(fd, PK_LPC_SOCKET, i, POLL_READ)) {
+	    OS_socket_close(fd);
+	    return EESOCKET;
+	}
 	lpc_socks[i].fd = fd;
 	lpc_socks[i].flags = S_HEADER;
 
@@ -266,9 +312,11 @@ socket_create P3(enum socket_mode, mode, svalue_t *, read_callback, svalue_t *,
 	lpc_socks[i].owner_ob = current_object;
 	lpc_socks[i].release_ob = NULL;
 	lpc_socks[i].r_buf = NULL;
+	lpc_socks[i].r_size = 0;
 	lpc_socks[i].r_off = 0;
 	lpc_socks[i].r_len = 0;
-	lpc_socks[i].w_buf = NULL;
+	lpc_socks[i].w_head = NULL;
+	lpc_socks[i].w_tail = NULL;
 	lpc_socks[i].w_off = 0;
 	lpc_socks[i].w_len = 0;
 
@@ -389,6 +437,7 @@ socket_accept P3(int, fd, svalue_t *, read_callback, svalue_t *, write_callback)
 	return EENOTLISTN;
 
     lpc_socks[fd].flags &= ~S_WACCEPT;
+    update_socket_poll(fd);
 
     len = sizeof(sin);
     accept_fd = accept(lpc_socks[fd].fd, (struct sockaddr *) & sin, (int *) &len);
@@ -403,7 +452,15 @@ socket_accept P3(int, fd, svalue_t *, read_callback, svalue_t *, write_callback)
 	    return EEACCEPT;
 	}
     }
+    /* not inherited from the listening socket everywhere */
+    if (set_socket_nonblocking(accept_fd, 1) == -1) {
+	socket_perror("socket_accept: set_socket_nonblocking", 0);
+	OS_socket_close(accept_fd);
+	return EENONBLOCK;
+    }
     i = find_new_socket();
+    if (i >= 0 && !poll_set(accept_fd, PK_LPC_SOCKET, i, POLL_READ))
+	i = EESOCKET;
     if (i >= 0) {
 	fd_set wmask;
 	struct timeval t;
@@ -413,16 +470,20 @@ socket_accept P3(int, fd, svalue_t *, read_callback, svalue_t *, write_callback)
 	lpc_socks[i].flags = S_HEADER |
 	    (lpc_socks[fd].flags & S_BINARY);
 
-	FD_ZERO(&wmask);
-	FD_SET(accept_fd, &wmask);
-	t.tv_sec = 0;
-	t.tv_usec = 0;
+	/* beyond FD_SETSIZE, just let the poller tell us when it's writable */
+	if (accept_fd < FD_SETSIZE) {
+	    FD_ZERO(&wmask);
+	    FD_SET(accept_fd, &wmask);
+	    t.tv_sec = 0;
+	    t.tv_usec = 0;
 #ifndef hpux
-	nb = select(FD_SETSIZE, (fd_set *) 0, &wmask, (fd_set *) 0, &t);
+	    nb = select(accept_fd + 1, (fd_set *) 0, &wmask, (fd_set *) 0, &t);
 #else
-	nb = select(FD_SETSIZE, (int *) 0, (int *) &wmask, (int *) 0, &t);
+	    nb = select(accept_fd + 1, (int *) 0, (int *) &wmask, (int *) 0, &t);
 #endif
-	if (!(FD_ISSET(accept_fd, &wmask)))
+	    if (!(FD_ISSET(accept_fd, &wmask)))
+		lpc_socks[i].flags |= S_BLOCKED;
+	} else
 	    lpc_socks[i].flags |= S_BLOCKED;
 
 	lpc_socks[i].mode = lpc_socks[fd].mode;
@@ -432,9 +493,11 @@ socket_accept P3(int, fd, svalue_t *, read_callback, svalue_t *, write_callback)
 	lpc_socks[i].owner_ob = NULL;
 	lpc_socks[i].release_ob = NULL;
 	lpc_socks[i].r_buf = NULL;
+	lpc_socks[i].r_size = 0;
 	lpc_socks[i].r_off = 0;
 	lpc_socks[i].r_len = 0;
-	lpc_socks[i].w_buf = NULL;
+	lpc_socks[i].w_head = NULL;
+	lpc_socks[i].w_tail = NULL;
 	lpc_socks[i].w_off = 0;
 	lpc_socks[i].w_len = 0;
 
@@ -456,6 +519,7 @@ socket_accept P3(int, fd, svalue_t *, read_callback, svalue_t *, write_callback)
 	set_read_callback(i, read_callback);
 	set_write_callback(i, write_callback);
 	copy_close_callback(i, fd);
+	update_socket_poll(i);
 
 	current_object->flags |= O_EFUN_SOCKET;
 
@@ -535,18 +599,62 @@ socket_connect P4(int, fd, char *, name, svalue_t *, read_callback, svalue_t *,
     }
     lpc_socks[fd].state = DATA_XFER;
     lpc_socks[fd].flags |= S_BLOCKED;
+    update_socket_poll(fd);
 
     return EESUCCESS;
 }
 
+/*
+ * A block for a message of len bytes.
+ */
+static sock_buf_t *
+new_socket_buf P1(int, len)
+{
+    sock_buf_t *sb;
+
+    sb = (sock_buf_t *) DMALLOC(sizeof(sock_buf_t) + len + 1, TAG_TEMPORARY,
+				"new_socket_buf");
+    if (sb == NULL)
+	fatal("Out of memory");
+    sb->data = (char *) (sb + 1);
+    sb->len = len;
+    return sb;
+}
+
+static void
+free_socket_bufs P1(int, fd)
+{
+    sock_buf_t *sb;
+
+    while ((sb = lpc_socks[fd].w_head)) {
+	lpc_socks[fd].w_head = sb->next;
+	FREE(sb);
+    }
+    lpc_socks[fd].w_tail = NULL;
+    lpc_socks[fd].w_off = 0;
+    lpc_socks[fd].w_len = 0;
+    if (lpc_socks[fd].r_buf != NULL)
+	FREE(lpc_socks[fd].r_buf);
+    lpc_socks[fd].r_buf = NULL;
+    lpc_socks[fd].r_size = 0;
+    lpc_socks[fd].r_off = 0;
+    lpc_socks[fd].r_len = 0;
+}
+
 /*
  * Write a message on an LPC efun socket
+ *
+ * On MUD and STREAM sockets, whatever can't be sent straight away is
+ * queued and sent as the socket becomes writable; the write callback is
+ * called once the queue is empty.  Further messages are queued behind it
+ * until there are MAX_SOCKET_QUEUE bytes waiting.
  */
 int
 socket_write P3(int, fd, svalue_t *, message, char *, name)
 {
     int len, off;
     char *buf, *p;
+    sock_buf_t *sb = NULL;
     struct sockaddr_in sin;
 
     if (fd < 0 || fd >= max_lpc_socks)
@@ -566,7 +674,7 @@ socket_write P3(int, fd, svalue_t *, message, char *, name)
 	    return EENOTCONN;
 	if (name != NULL)
 	    return EEBADADDR;
-	if (lpc_socks[fd].flags & S_BLOCKED)
+	if (lpc_socks[fd].w_len >= MAX_SOCKET_QUEUE)
 	    return EEALREADY;
     }
 
@@ -579,39 +687,45 @@ socket_write P3(int, fd, svalue_t *, message, char *, name)
 	    return EETYPENOTSUPP;
 
 	default:
+#ifdef BINARY_SAVE_EXTENSION
+	    if (lpc_socks[fd].flags & S_BINARY) {
+		/* encoded straight into a block, after the header */
+		buf = save_svalue_binary(message, sizeof(sock_buf_t) + 4, &len);
+		if (!buf)
+		    return EEBADDATA;
+		sb = (sock_buf_t *) buf;
+		sb->data = buf + sizeof(sock_buf_t);
+		sb->len = len + 4;
+		*(INT_32 *) sb->data = htonl((long) len);
+		break;
+	    }
+#endif
 	    save_svalue_depth = 0;
 	    len = svalue_save_size(message);
 	    if (save_svalue_depth > MAX_SAVE_SVALUE_DEPTH) {
 		return EEBADDATA;
 	    }
-	    buf = (char *)
-		DMALLOC(len + 5, TAG_TEMPORARY, "socket_write: default");
-	    if (buf == NULL)
-		fatal("Out of memory");
-	    *(INT_32 *) buf = htonl((long) len);
-	    len += 4;
-	    buf[4] = '\0';
-	    p = buf + 4;
+	    sb = new_socket_buf(len + 4);
+	    *(INT_32 *) sb->data = htonl((long) len);
+	    sb->data[4] = '\0';
+	    p = sb->data + 4;
 	    save_svalue(message, &p);
 	    break;
 	}
+	buf = sb->data;
+	len = sb->len;
 	break;
 
     case STREAM:
 	switch (message->type) {
 	case T_BUFFER:
+	    /* only what doesn't go straight away gets copied */
+	    buf = (char *) message->u.buf->item;
 	    len = message->u.buf->size;
-	    buf = (char *) DMALLOC(len, TAG_TEMPORARY, "socket_write: T_BUFFER");
-	    if (buf == NULL)
-		fatal("Out of memory");
-	    memcpy(buf, message->u.buf->item, len);
 	    break;
 	case T_STRING:
+	    buf = message->u.string;
 	    len = SVALUE_STRLEN(message);
-	    buf = (char *) DMALLOC(len + 1, TAG_TEMPORARY, "socket_write: T_STRING");
-	    if (buf == NULL)
-		fatal("Out of memory");
-	    strcpy(buf, message->u.string);
 	    break;
 	case T_ARRAY:
 	    {
@@ -619,9 +733,8 @@ socket_write P3(int, fd, svalue_t *, message, char *, name)
 		svalue_t *el;
 
 		len = message->u.arr->size * sizeof(int);
-		buf = (char *) DMALLOC(len + 1, TAG_TEMPORARY, "socket_write: T_ARRAY");
-		if (buf == NULL)
-		    fatal("Out of memory");
+		sb = new_socket_buf(len);
+		buf = sb->data;
 		el = message->u.arr->item;
 		limit = len / sizeof(int);
 		for (i = 0; i < limit; i++) {
@@ -675,33 +788,51 @@ socket_write P3(int, fd, svalue_t *, message, char *, name)
 	return EEMODENOTSUPP;
     }
 
-    off = OS_socket_write(lpc_socks[fd].fd, buf, len);
-    if (off == -1) {
-	FREE(buf);
-	switch (socket_errno) {
+    /* nothing is queued unless S_BLOCKED is set */
+    off = 0;
+    if (!(lpc_socks[fd].flags & S_BLOCKED)) {
+	off = OS_socket_write(lpc_socks[fd].fd, buf, len);
+	if (off == -1) {
+	    switch (socket_errno) {
 #ifdef WINSOCK
-	case WSAEWOULDBLOCK:
-	    return EEWOULDBLOCK;
+	    case WSAEWOULDBLOCK:
 #else
-	case EWOULDBLOCK:
-	    return EEWOULDBLOCK;
+	    case EWOULDBLOCK:
 #endif
+		off = 0;
+		break;
 
-	default:
-	    socket_perror("socket_write: send", 0);
-	    return EESEND;
+	    default:
+		if (sb)
+		    FREE(sb);
+		socket_perror("socket_write: send", 0);
+		return EESEND;
+	    }
+	}
+	if (off == len) {
+	    if (sb)
+		FREE(sb);
+	    return EESUCCESS;
 	}
     }
-    if (off < len) {
-	lpc_socks[fd].flags |= S_BLOCKED;
-	lpc_socks[fd].w_buf = buf;
+    if (!sb) {
+	sb = new_socket_buf(len - off);
+	memcpy(sb->data, buf + off, len - off);
+	len -= off;
+	off = 0;
+    }
+    sb->next = NULL;
+    if (lpc_socks[fd].w_tail)
+	lpc_socks[fd].w_tail->next = sb;
+    else {
+	lpc_socks[fd].w_head = sb;
 	lpc_socks[fd].w_off = off;
-	lpc_socks[fd].w_len = len - off;
-	return EECALLBACK;
     }
-    FREE(buf);
-
-    return EESUCCESS;
+    lpc_socks[fd].w_tail = sb;
+    lpc_socks[fd].w_len += len - off;
+    lpc_socks[fd].flags |= S_BLOCKED;
+    update_socket_poll(fd);
+    return EECALLBACK;
 }
 
 static void
@@ -723,6 +854,107 @@ call_callback P3(int, fd, int, what, int, num_arg) {
     }
 }
 
+/*
+ * Read what there is on a MUD mode socket, and pass each complete message
+ * to the read callback.  Returns 1 when there is no more to do for now,
+ * otherwise what recv() returned, or 0 if a message had a bad length.
+ *
+ * Messages are read into r_buf, which is made big enough for the whole of
+ * the one being read as soon as its length is known, so a large one is
+ * read straight into place rather than by growing the buffer a piece at a
+ * time.
+ */
+static int
+socket_read_mud P1(int, fd)
+{
+    lpc_socket_t *s;
+    svalue_t value;
+    INT_32 len;
+    int cc, want, avail, reads;
+    char *msg, c;
+
+    for (reads = 0; reads < 16; reads++) {
+	s = &lpc_socks[fd];
+	while ((avail = s->r_len - s->r_off) >= 4) {
+	    memcpy((char *) &len, s->r_buf + s->r_off, 4);
+	    len = ntohl(len);
+	    if (len <= 0 || len > MAX_BYTE_TRANSFER)
+		return 0;
+	    if (avail < len + 4)
+		break;
+	    debug(8192, ("read_socket_handler: read svalue, len %d\n", len));
+	    msg = s->r_buf + s->r_off + 4;
+	    s->r_off += len + 4;
+	    value = const0;
+	    push_number(fd);
+#ifdef BINARY_SAVE_EXTENSION
+	    if (s->flags & S_BINARY) {
+		if (restore_svalue_binary(msg, len, &value) == 0)
+		    *(++sp) = value;
+		else
+		    push_undefined();
+	    } else
+#endif
+	    {
+		/* this may be the start of the next message */
+		c = msg[len];
+		msg[len] = '\0';
+		if (restore_svalue(msg, &value) == 0)
+		    *(++sp) = value;
+		else
+		    push_undefined();
+		msg[len] = c;
+	    }
+	    debug(8192, ("read_socket_handler: apply read callback\n"));
+	    call_callback(fd, S_READ_FP, 2);
+	    /* which can close the socket, or move lpc_socks */
+	    s = &lpc_socks[fd];
+	    if (s->state != DATA_XFER || s->r_buf == NULL)
+		return 1;
+	}
+
+	/* keep the part of a message there is at the front */
+	if (s->r_off == s->r_len && s->r_size > READ_BUF_SIZE + 1) {
+	    /* don't hang on to the space a big one needed */
+	    FREE(s->r_buf);
+	    s->r_buf = NULL;
+	    s->r_size = s->r_off = s->r_len = 0;
+	} else if (s->r_off) {
+	    avail = s->r_len - s->r_off;
+	    if (avail)
+		memmove(s->r_buf, s->r_buf + s->r_off, avail);
+	    s->r_off = 0;
+	    s->r_len = avail;
+	}
+	want = READ_BUF_SIZE;
+	if (s->r_len >= 4) {
+	    memcpy((char *) &len, s->r_buf, 4);
+	    len = ntohl(len) + 4 - s->r_len;
+	    if (len > want)
+		want = len;
+	}
+	/* room for a '\0' after the last message, too */
+	if (s->r_size < s->r_len + want + 1) {
+	    s->r_size = s->r_len + want + 1;
+	    if (s->r_buf)
+		s->r_buf = (char *) DREALLOC(s->r_buf, s->r_size, TAG_TEMPORARY,
+					     "socket_read_mud");
+	    else
+		s->r_buf = (char *) DMALLOC(s->r_size, TAG_TEMPORARY,
+					    "socket_read_mud");
+	    if (s->r_buf == NULL)
+		fatal("Out of memory");
+	}
+	cc = recv(s->fd, s->r_buf + s->r_len, want, 0);
+	if (cc <= 0)
+	    return cc;
+	debug(8192, ("read_socket_handler: read %d bytes\n", cc));
+	s->r_len += cc;
+    }
+    /* the rest can wait until we've been round the backend again */
+    return 1;
+}
+
 /*
  * Handle LPC efun socket read select events
  */
@@ -731,7 +963,6 @@ socket_read_select_handler P1(int, fd)
 {
     int cc = 0, addrlen;
     char buf[BUF_SIZE], addr[ADDR_BUF_SIZE];
-    svalue_t value;
     struct sockaddr_in sin;
 
     debug(8192, ("read_socket_handler: fd %d state %d\n",
@@ -783,6 +1014,7 @@ socket_read_select_handler P1(int, fd)
 	    debug(8192, ("read_socket_handler: apply\n"));
 	    call_callback(fd, S_READ_FP, 3);
 	    return;
+	case MUD_BINARY:	/* socket_create() turns it into MUD */
 #ifdef DEBUG
 	    /* shut up gcc */
 	case STREAM_BINARY:
@@ -795,6 +1027,7 @@ socket_read_select_handler P1(int, fd)
     case LISTEN:
 	debug(8192, ("read_socket_handler: apply read callback\n"));
 	lpc_socks[fd].flags |= S_WACCEPT;
+	update_socket_poll(fd);
 	push_number(fd);
 	call_callback(fd, S_READ_FP, 1);
 	return;
@@ -807,64 +1040,17 @@ socket_read_select_handler P1(int, fd)
 
 	case MUD:
 	    debug(8192, ("read_socket_handler: DATA_XFER MUD\n"));
-	    if (lpc_socks[fd].flags & S_HEADER) {
-		cc = recv(lpc_socks[fd].fd, (char *) &lpc_socks[fd].r_len +
-			  lpc_socks[fd].r_off, 4 -
-			  lpc_socks[fd].r_off, 0);
-		if (cc <= 0)
-		    break;
-		debug(8192, ("read_socket_handler: read %d bytes\n", cc));
-		lpc_socks[fd].r_off += cc;
-		if (lpc_socks[fd].r_off != 4)
-		    return;
-		debug(8192, ("read_socket_handler: read header\n"));
-		lpc_socks[fd].flags &= ~S_HEADER;
-		lpc_socks[fd].r_off = 0;
-		lpc_socks[fd].r_len = ntohl(lpc_socks[fd].r_len);
-		if (lpc_socks[fd].r_len <= 0 || lpc_socks[fd].r_len > MAX_BYTE_TRANSFER)
-		    break;
-		lpc_socks[fd].r_buf = (char *)
-		    DMALLOC(lpc_socks[fd].r_len + 1, TAG_TEMPORARY, "socket_read_select_handler");
-		if (lpc_socks[fd].r_buf == NULL)
-		    fatal("Out of memory");
-		debug(8192, ("read_socket_handler: svalue len is %d\n",
-			     lpc_socks[fd].r_len));
-	    }
-	    if (lpc_socks[fd].r_off < lpc_socks[fd].r_len) {
-		cc = recv(lpc_socks[fd].fd, lpc_socks[fd].r_buf +
-			  lpc_socks[fd].r_off, lpc_socks[fd].r_len -
-			  lpc_socks[fd].r_off, 0);
-		if (cc <= 0)
-		    break;
-		debug(8192, ("read_socket_handler: read %d bytes\n", cc));
-		lpc_socks[fd].r_off += cc;
-		if (lpc_socks[fd].r_off != lpc_socks[fd].r_len)
-		    return;
-		debug(8192, ("read_socket_handler: read svalue\n"));
-	    }
-	    lpc_socks[fd].r_buf[lpc_socks[fd].r_len] = '\0';
-	    value = const0;
-	    push_number(fd);
-	    if (restore_svalue(lpc_socks[fd].r_buf, &value) == 0)
-		*(++sp) = value;
-	    else
-		push_undefined();
-	    FREE(lpc_socks[fd].r_buf);
-	    lpc_socks[fd].flags |= S_HEADER;
-	    lpc_socks[fd].r_buf = NULL;
-	    lpc_socks[fd].r_off = 0;
-	    lpc_socks[fd].r_len = 0;
-	    debug(8192, ("read_socket_handler: apply read callback\n"));
-	    call_callback(fd, S_READ_FP, 2);
-	    return;
+	    if ((cc = socket_read_mud(fd)) > 0)
+		return;
+	    break;
 
 	case STREAM:
 	    debug(8192, ("read_socket_handler: DATA_XFER STREAM\n"));
-	    cc = OS_socket_read(lpc_socks[fd].fd, buf, sizeof(buf) - 1);
+	    cc = OS_socket_read(lpc_socks[fd].fd, read_buf, sizeof(read_buf) - 1);
 	    if (cc <= 0)
 		break;
 	    debug(8192, ("read_socket_handler: read %d bytes\n", cc));
-	    buf[cc] = '\0';
+	    read_buf[cc] = '\0';
 	    push_number(fd);
 	    if (lpc_socks[fd].flags & S_BINARY) {
 		buffer_t *b;
@@ -872,17 +1058,18 @@ socket_read_select_handler P1(int, fd)
 		b = allocate_buffer(cc);
 		if (b) {
 		    b->ref--;
-		    memcpy(b->item, buf, cc);
+		    memcpy(b->item, read_buf, cc);
 		    push_buffer(b);
 		} else {
 		    push_number(0);
 		}
 	    } else {
-		copy_and_push_string(buf);
+		copy_and_push_string(read_buf);
 	    }
 	    debug(8192, ("read_socket_handler: apply read callback\n"));
 	    call_callback(fd, S_READ_FP, 2);
 	    return;
+	case MUD_BINARY:	/* socket_create() turns it into MUD */
 #ifdef DEBUG
 	    /* shut up gcc */
 	case STREAM_BINARY:
@@ -928,36 +1115,62 @@ socket_read_select_handler P1(int, fd)
 void
 socket_write_select_handler P1(int, fd)
 {
-    int cc;
+    lpc_socket_t *s = &lpc_socks[fd];
+    sock_buf_t *sb;
+    int cc, want, written;
+#ifndef WINSOCK
+    struct iovec iov[MAX_SOCKET_IOVEC];
+    int n;
+#endif
 
     debug(8192, ("write_socket_handler: fd %d state %d\n",
 		 fd, lpc_socks[fd].state));
 
-    if ((lpc_socks[fd].flags & S_BLOCKED) == 0)
+    if ((s->flags & S_BLOCKED) == 0)
 	return;
 
-    if (lpc_socks[fd].w_buf != NULL) {
-	cc = OS_socket_write(lpc_socks[fd].fd, 
-			     lpc_socks[fd].w_buf + lpc_socks[fd].w_off,
-			     lpc_socks[fd].w_len);
+    /* send as many queued messages at a time as writev() will take */
+    while ((sb = s->w_head)) {
+#ifndef WINSOCK
+	iov[0].iov_base = sb->data + s->w_off;
+	iov[0].iov_len = want = sb->len - s->w_off;
+	for (n = 1; n < MAX_SOCKET_IOVEC && (sb = sb->next); n++) {
+	    iov[n].iov_base = sb->data;
+	    iov[n].iov_len = sb->len;
+	    want += sb->len;
+	}
+	cc = writev(s->fd, iov, n);
+#else
+	want = sb->len - s->w_off;
+	cc = OS_socket_write(s->fd, sb->data + s->w_off, want);
+#endif
 	if (cc == -1) {
-	    if (lpc_socks[fd].state == FLUSHING &&
+	    if (s->state == FLUSHING &&
 		errno != EINTR) {
 		/* give up on errors writing to closing sockets */
-		lpc_socks[fd].flags &= ~S_BLOCKED;
+		s->flags &= ~S_BLOCKED;
 		socket_close(fd, SC_FORCE | SC_FINAL_CLOSE);
 	    }
 	    return;
 	}
-	lpc_socks[fd].w_off += cc;
-	lpc_socks[fd].w_len -= cc;
-	if (lpc_socks[fd].w_len != 0)
+	s->w_len -= cc;
+	written = cc;
+	while ((sb = s->w_head) && cc >= sb->len - s->w_off) {
+	    cc -= sb->len - s->w_off;
+	    s->w_off = 0;
+	    s->w_head = sb->next;
+	    FREE(sb);
+	}
+	if (!s->w_head)
+	    s->w_tail = NULL;
+	else
+	    s->w_off += cc;
+	/* a short write means the socket is full */
+	if (s->w_head && written < want)
 	    return;
-	FREE(lpc_socks[fd].w_buf);
-	lpc_socks[fd].w_buf = NULL;
-	lpc_socks[fd].w_off = 0;
     }
     lpc_socks[fd].flags &= ~S_BLOCKED;
+    update_socket_poll(fd);
     if (lpc_socks[fd].state == FLUSHING) {
 	socket_close(fd, SC_FORCE | SC_FINAL_CLOSE);
 	return;
@@ -999,16 +1212,15 @@ socket_close P2(int, fd, int, flags)
 	 * it is closed, but we really finish up later.
 	 */
 	lpc_socks[fd].state = FLUSHING;
+	update_socket_poll(fd);
 	return EESUCCESS;
     }
     
+    poll_remove(lpc_socks[fd].fd);
     while (OS_socket_close(lpc_socks[fd].fd) == -1 && socket_errno == EINTR)
 	;	/* empty while */
     lpc_socks[fd].state = CLOSED;
-    if (lpc_socks[fd].r_buf != NULL)
-	FREE(lpc_socks[fd].r_buf);
-    if (lpc_socks[fd].w_buf != NULL)
-	FREE(lpc_socks[fd].w_buf);
+    free_socket_bufs(fd);
 
     debug(8192, ("socket_close: closed fd %d\n", fd));
     return EESUCCESS;
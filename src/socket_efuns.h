@@ -11,7 +11,7 @@
 #include "network_incl.h"
 
 enum socket_mode {
-    MUD, STREAM, DATAGRAM, STREAM_BINARY, DATAGRAM_BINARY
+    MUD, STREAM, DATAGRAM, STREAM_BINARY, DATAGRAM_BINARY, MUD_BINARY
 };
 enum socket_state {
     CLOSED, FLUSHING, UNBOUND, BOUND, LISTEN, DATA_XFER
@@ -19,6 +19,18 @@ enum socket_state {
 
 #define	BUF_SIZE	2048	/* max reliable packet size	   */
 #define ADDR_BUF_SIZE	64	/* max length of address string    */
+#define READ_BUF_SIZE	65536	/* most read from a stream at once */
+#define MAX_SOCKET_QUEUE 65536	/* more writes wait (EEALREADY)    */
+
+/*
+ * A message waiting to be written.  data usually points just past the
+ * header, in the same block.
+ */
+typedef struct sock_buf_s {
+    struct sock_buf_s *next;
+    char *data;
+    int len;
+} sock_buf_t;
 
 typedef struct {
     int fd;
@@ -33,12 +45,14 @@ typedef struct {
     union string_or_func read_callback;
     union string_or_func write_callback;
     union string_or_func close_callback;
-    char *r_buf;
-    int r_off;
-    long r_len;
-    char *w_buf;
-    int w_off;
-    int w_len;
+    char *r_buf;		/* MUD mode: messages read so far, */
+    int r_size;			/* of this size,                   */
+    int r_off;			/* from here                       */
+    int r_len;			/* to here                         */
+    sock_buf_t *w_head;		/* waiting to be written,          */
+    sock_buf_t *w_tail;
+    int w_off;			/* from here in w_head             */
+    int w_len;			/* bytes in all                    */
 } lpc_socket_t;
 
 extern lpc_socket_t *lpc_socks;
@@ -61,6 +75,7 @@ void assign_socket_owner PROT((svalue_t *, object_t *));
 object_t *get_socket_owner PROT((int));
 void dump_socket_status PROT((outbuffer_t *));
 void close_referencing_sockets PROT((object_t *));
+int update_socket_poll PROT((int));
 int get_socket_address PROT((int, char *, int *));
 int socket_bind PROT((int, int));
 int socket_create PROT((enum socket_mode, svalue_t *, svalue_t *));
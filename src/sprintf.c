@@ -131,7 +131,7 @@ typedef unsigned int format_info;
 
 #define ADD_CHAR(x) {\
   outbuf_addchar(&obuff, x);\
-  if (obuff.real_size == USHRT_MAX) ERROR(ERR_BUFF_OVERFLOW); \
+  if (obuff.real_size == max_string_length) ERROR(ERR_BUFF_OVERFLOW); \
 }
 
 #define GET_NEXT_ARG {\
@@ -408,10 +408,11 @@ void svalue_to_string P5(svalue_t *, obj, outbuffer_t *, outbuf, int, indent, in
 	    outbuf_add(outbuf, "([ /* sizeof() == ");
 	    numadd(outbuf, obj->u.map->count);
 	    outbuf_add(outbuf, " */\n");
-	    for (i = 0; i <= (int) (obj->u.map->table_size); i++) {
+	    {
+		map_chunk_t *c;
 		mapping_node_t *elm;
 
-		for (elm = obj->u.map->table[i]; elm; elm = elm->next) {
+		MAP_FOREACH(obj->u.map, c, elm) {
 		    svalue_to_string(&(elm->values[0]), outbuf, indent + 2, 0, 0);
 		    outbuf_add(outbuf, " : ");
 		    svalue_to_string(&(elm->values[1]), outbuf, indent + 4, 1, 1);
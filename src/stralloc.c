@@ -33,8 +33,8 @@ void bp PROT((void)) {
  * that is, if you want to avoid space leaks...
  *
  * Current overhead:
- *	sizeof(block_t) per string (string pointer, next pointer, and a short
- *  for refs). Strings are nearly all fairly short, so this is a significant
+ *	sizeof(block_t) per string (the hash, and ints for size and refs),
+ *  plus a table slot. Strings are nearly all fairly short, so this is a significant
  *  overhead - there is also the 4 byte malloc overhead and the fact that
  *  malloc generally allocates blocks which are a power of 2 (should write my
  *	own best-fit malloc specialised to strings); then again, GNU malloc
@@ -61,90 +61,237 @@ int search_len = 0;
 int num_str_searches = 0;
 #endif
 
-#define StrHash(s) (whashstr((s), 20) & (htable_size_minus_one))
+/*
+ * The table is open addressed with linear probing; each slot is just a
+ * pointer to the block, and the block keeps the full hash of its string,
+ * so probing only does a strcmp() when the hashes match, and a string
+ * being freed is found by comparing pointers without hashing it again.
+ *
+ * When the table gets 3/4 full a table twice the size is allocated and
+ * becomes the one strings are added to.  Entries are moved over from the
+ * old one a few slots at a time on each lookup, so there is never a pause
+ * to rehash everything; until it's empty, lookups that miss the new table
+ * also look in the old one.  The old table is always emptied a whole
+ * cluster (run of full slots) at a time, which leaves the probe sequences
+ * of everything still in it intact.
+ *
+ * HTABLE_SIZE (from the config file) is the initial size, rounded up to
+ * a power of 2.
+ */
 
-#define hfindblock(s, h) sfindblock(s, h = StrHash(s))
-#define findblock(s) sfindblock(s, StrHash(s))
+#define STR_MIGRATE_STEP 16
 
-INLINE_STATIC block_t *sfindblock PROT((char *, int));
+static block_t **str_table = 0;		/* strings are added here */
+static unsigned int str_table_mask;
+static int str_table_size;
+static int str_table_used;
 
-/*
- * hash table - list of pointers to heads of string chains.
- * Each string in chain has a pointer to the next string and a
- * reference count (char *, int) stored just before the start of the string.
- * HTABLE_SIZE is in config.h, and should be a prime, probably between
- * 1000 and 5000.
- */
+static block_t **old_str_table = 0;	/* being emptied into str_table */
+static unsigned int old_str_table_mask;
+static int old_str_table_size;
+static int old_str_table_used;
+static int str_migrate_pos;		/* next slot to empty */
+static int str_migrate_left;		/* slots still to look at */
 
-static block_t **base_table = (block_t **) 0;
-static int htable_size;
-static int htable_size_minus_one;
+static int str_table_bytes = 0;
+static int str_table_grows = 0;
 
-INLINE_STATIC block_t *alloc_new_string PROT((char *, int));
+INLINE_STATIC block_t *findblock PROT((char *, unsigned int));
+INLINE_STATIC block_t *alloc_new_string PROT((char *, unsigned int));
 static void checked PROT((char *, char *));
 
+/*
+ * whashstr() only gives 16 bits and looks at the first 20 characters,
+ * which is far too little for a large table full of path names.
+ */
+#define str_hash(s) fnv_hashstr(s)
+
+static block_t **alloc_str_table P1(int, size)
+{
+    block_t **table;
+    int x;
+
+    table = CALLOCATE(size, block_t *, TAG_STR_TBL, "alloc_str_table");
+    for (x = 0; x < size; x++)
+	table[x] = 0;
+    str_table_bytes += sizeof(block_t *) * size;
+    return table;
+}
+
 void init_strings()
 {
-    int x, y;
+    int y;
 
     /* ensure that htable size is a power of 2 */
     y = HTABLE_SIZE;
-    for (htable_size = 1; htable_size < y; htable_size *= 2)
+    for (str_table_size = 1; str_table_size < y; str_table_size *= 2)
 	;
-    htable_size_minus_one = htable_size - 1;
-    base_table = CALLOCATE(htable_size, block_t *, 
-			   TAG_STR_TBL, "init_strings");
-#ifdef STRING_STATS
-    overhead_bytes += (sizeof(block_t *) * htable_size);
-#endif
+    str_table_mask = str_table_size - 1;
+    str_table = alloc_str_table(str_table_size);
+}
 
-    for (x = 0; x < htable_size; x++) {
-	base_table[x] = 0;
-    }
+/*
+ * Put a block that is known not to be there yet into the current table.
+ */
+INLINE_STATIC void insert_block P1(block_t *, b)
+{
+    unsigned int i = HASH(b) & str_table_mask;
+
+    while (str_table[i])
+	i = (i + 1) & str_table_mask;
+    str_table[i] = b;
+    str_table_used++;
 }
 
 /*
- * Looks for a string in the table.  If it finds it, returns a pointer to
- * the start of the string part, and moves the entry for the string to
- * the head of the pointer chain.  One thing (blech!) - puts the previous
- * pointer on the hash chain into fs_prev.
+ * Move at least 'n' slots worth of the old table over, stopping at the
+ * end of a cluster.
  */
+static void migrate_strings P1(int, n)
+{
+    block_t *b;
 
+    while (str_migrate_left > 0) {
+	b = old_str_table[str_migrate_pos];
+	if (b) {
+	    insert_block(b);
+	    old_str_table[str_migrate_pos] = 0;
+	    old_str_table_used--;
+	} else if (n <= 0)
+	    break;
+	str_migrate_pos = (str_migrate_pos + 1) & old_str_table_mask;
+	str_migrate_left--;
+	n--;
+    }
+    if (!str_migrate_left || !old_str_table_used) {
+	FREE(old_str_table);
+	str_table_bytes -= sizeof(block_t *) * old_str_table_size;
+	old_str_table = 0;
+	old_str_table_size = 0;
+    }
+}
+
+static void grow_str_table()
+{
+    /* can't have two migrations going at once */
+    if (old_str_table)
+	migrate_strings(old_str_table_size);
+    old_str_table = str_table;
+    old_str_table_size = str_table_size;
+    old_str_table_mask = str_table_mask;
+    old_str_table_used = str_table_used;
+    /* start just past an empty slot, i.e. at the start of a cluster */
+    for (str_migrate_pos = 0; old_str_table[str_migrate_pos];
+	 str_migrate_pos++)
+	;
+    str_migrate_left = old_str_table_size;
+
+    str_table_size *= 2;
+    str_table_mask = str_table_size - 1;
+    str_table_used = 0;
+    str_table = alloc_str_table(str_table_size);
+    str_table_grows++;
+}
+
+/*
+ * Looks for a string in the table, given its hash.
+ */
 INLINE_STATIC block_t *
-        sfindblock P2(char *, s, int, h)
+findblock P2(char *, s, unsigned int, h)
 {
-    block_t *curr, *prev;
+    block_t *b;
+    unsigned int i;
 
-    curr = base_table[h];
-    prev = NULL;
 #ifdef STRING_STATS
     num_str_searches++;
 #endif
+    if (old_str_table)
+	migrate_strings(STR_MIGRATE_STEP);
 
-    while (curr) {
+    i = h & str_table_mask;
+    while ((b = str_table[i])) {
 #ifdef STRING_STATS
 	search_len++;
 #endif
-	if (*(STRING(curr)) == *s && !strcmp(STRING(curr), s)) {	/* found it */
-	    if (prev) {		/* not at head of list */
-		NEXT(prev) = NEXT(curr);
-		NEXT(curr) = base_table[h];
-		base_table[h] = curr;
-	    }
-	    return (curr);	/* pointer to string */
+	if (HASH(b) == h && !strcmp(STRING(b), s))
+	    return b;
+	i = (i + 1) & str_table_mask;
+    }
+    if (old_str_table) {
+	i = h & old_str_table_mask;
+	while ((b = old_str_table[i])) {
+#ifdef STRING_STATS
+	    search_len++;
+#endif
+	    if (HASH(b) == h && !strcmp(STRING(b), s))
+		return b;
+	    i = (i + 1) & old_str_table_mask;
 	}
-	prev = curr;
-	curr = NEXT(curr);
     }
     return ((block_t *) 0);	/* not found */
 }
 
+/*
+ * Empty slot i of a table, moving back anything further along the
+ * cluster that could live there, so probes never have to step over
+ * holes.
+ */
+static void delete_slot P3(block_t **, table, unsigned int, mask,
+			   unsigned int, i)
+{
+    block_t *c;
+    unsigned int j, k;
+
+    table[i] = 0;
+    j = i;
+    for (;;) {
+	j = (j + 1) & mask;
+	if (!(c = table[j]))
+	    break;
+	k = HASH(c) & mask;
+	if (((j - k) & mask) >= ((j - i) & mask)) {
+	    table[i] = c;
+	    table[j] = 0;
+	    i = j;
+	}
+    }
+}
+
+/*
+ * Take a block out of whichever table it is in.  Returns 0 if it isn't
+ * there.
+ */
+static int remove_block P1(block_t *, b)
+{
+    block_t *c;
+    unsigned int i;
+
+    i = HASH(b) & str_table_mask;
+    while ((c = str_table[i]) && c != b)
+	i = (i + 1) & str_table_mask;
+    if (c) {
+	delete_slot(str_table, str_table_mask, i);
+	str_table_used--;
+	return 1;
+    }
+    if (!old_str_table)
+	return 0;
+    i = HASH(b) & old_str_table_mask;
+    while ((c = old_str_table[i]) && c != b)
+	i = (i + 1) & old_str_table_mask;
+    if (!c)
+	return 0;
+    delete_slot(old_str_table, old_str_table_mask, i);
+    old_str_table_used--;
+    return 1;
+}
+
 char *
      findstring P1(char *, s)
 {
     block_t *b;
 
-    if ((b = findblock(s))) {
+    if ((b = findblock(s, str_hash(s)))) {
 	return STRING(b);
     } else {
 	return (NULL);
@@ -154,7 +301,7 @@ char *
 /* alloc_new_string: Make a space for a string.  */
 
 INLINE_STATIC block_t *
-alloc_new_string P2(char *, string, int, h)
+alloc_new_string P2(char *, string, unsigned int, h)
 {
     block_t *b;
     int len = strlen(string);
@@ -168,10 +315,12 @@ alloc_new_string P2(char *, string, int, h)
     strncpy(STRING(b), string, len);
     STRING(b)[len] = '\0';	/* strncpy doesn't put on \0 if 'from' too
 				 * long */
-    SIZE(b) = (len > USHRT_MAX ? USHRT_MAX : len);
+    SIZE(b) = len;
     REFS(b) = 1;
-    NEXT(b) = base_table[h];
-    base_table[h] = b;
+    HASH(b) = h;
+    if ((str_table_used + 1) * 4 > str_table_size * 3)
+	grow_str_table();
+    insert_block(b);
     ADD_NEW_STRING(SIZE(b), sizeof(block_t));
     ADD_STRING(SIZE(b));
     return (b);
@@ -181,9 +330,9 @@ char *
      make_shared_string P1(char *, str)
 {
     block_t *b;
-    int h;
+    unsigned int h = str_hash(str);
 
-    b = hfindblock(str, h);	/* hfindblock macro sets h = StrHash(s) */
+    b = findblock(str, h);
     if (!b) {
 	b = alloc_new_string(str, h);
     } else {
@@ -206,7 +355,7 @@ ref_string P1(char *, str)
 
     b = BLOCK(str);
 #ifdef DEBUG
-    if (b != findblock(str)) {
+    if (b != findblock(str, str_hash(str))) {
 	fatal("stralloc.c: called ref_string on non-shared string: %s.\n", str);
     }
 #endif				/* defined(DEBUG) */
@@ -237,14 +386,13 @@ checked P2(char *, s, char *, str)
 void
 free_string P1(char *, str)
 {
-    block_t **prev, *b;
-    int h;
+    block_t *b;
 
     b = BLOCK(str);
-    DEBUG_CHECK1(b != findblock(str),"stralloc.c: free_string called on non-shared string: %s.\n", str);
+    DEBUG_CHECK1(b != findblock(str, str_hash(str)),"stralloc.c: free_string called on non-shared string: %s.\n", str);
     
     /*
-     * if a string has been ref'd USHRT_MAX times then we assume that its used
+     * if a string has been ref'd UINT_MAX times then we assume that its used
      * often enough to justify never freeing it.
      */
     if (!REFS(b))
@@ -257,21 +405,13 @@ free_string P1(char *, str)
     if (REFS(b) > 0)
 	return;
 
-    h = StrHash(str);
-    prev = base_table + h;
-    while ((b = *prev)) {
-	if (STRING(b) == str) {
-	    *prev = NEXT(b);
-	    break;
-	}
-	prev = &(NEXT(b));
-    }
-
 #ifdef DEBUG
-    if (!b) {
+    if (!remove_block(b)) {
 	checked("free_string: not found in string table!", str);
 	return;
     }
+#else
+    remove_block(b);
 #endif
     SUB_NEW_STRING(SIZE(b), sizeof(block_t));
     FREE(b);
@@ -281,23 +421,55 @@ free_string P1(char *, str)
 void
 deallocate_string P1(char *, str)
 {
-    int h;
-    block_t *b, **prev;
-
-    h = StrHash(str);
-    prev = base_table + h;
-    while ((b = *prev)) {
-	if (STRING(b) == str) {
-	    *prev = NEXT(b);
-	    break;
-	}
-	prev = &(NEXT(b));
-    }
-    DEBUG_CHECK1(!b,"stralloc.c: deallocate_string called on non-shared string: %s.\n", str);
+    block_t *b = BLOCK(str);
+#ifdef DEBUG
+    int found = remove_block(b);
+
+    DEBUG_CHECK1(!found,"stralloc.c: deallocate_string called on non-shared string: %s.\n", str);
+#else
+    remove_block(b);
+#endif
 
     FREE(b);
 }
 
+#ifdef STRING_STATS
+/*
+ * How many probes it takes to find each string that is in the table.
+ */
+static void probe_histogram P1(outbuffer_t *, out)
+{
+    static int limits[] = { 1, 2, 3, 4, 8, 16, 32, 64 };
+#define NUM_LIMITS (sizeof(limits) / sizeof(limits[0]))
+    int counts[NUM_LIMITS + 1];
+    int i, j, n, longest = 0;
+
+    for (j = 0; j <= NUM_LIMITS; j++)
+	counts[j] = 0;
+    for (i = 0; i < str_table_size; i++) {
+	if (!str_table[i])
+	    continue;
+	n = ((i - HASH(str_table[i])) & str_table_mask) + 1;
+	if (n > longest)
+	    longest = n;
+	for (j = 0; j < NUM_LIMITS && n > limits[j]; j++)
+	    ;
+	counts[j]++;
+    }
+    outbuf_add(out, "Probe lengths:");
+    for (j = 0; j < NUM_LIMITS; j++) {
+	if (j && limits[j] > limits[j - 1] + 1)
+	    outbuf_addv(out, " %d-%d: %d", limits[j - 1] + 1, limits[j],
+			counts[j]);
+	else
+	    outbuf_addv(out, " %d: %d", limits[j], counts[j]);
+    }
+    outbuf_addv(out, " >%d: %d (longest %d)\n", limits[NUM_LIMITS - 1],
+		counts[NUM_LIMITS], longest);
+#undef NUM_LIMITS
+}
+#endif
+
 int
 add_string_status P2(outbuffer_t *, out, int, verbose)
 {
@@ -308,16 +480,25 @@ add_string_status P2(outbuffer_t *, out, int, verbose)
     }
     if (verbose != -1)
 	outbuf_addv(out, "All strings:\t\t\t%7d %8d + %d overhead\n",
-	      num_distinct_strings, bytes_distinct_strings, overhead_bytes);
+	      num_distinct_strings, bytes_distinct_strings,
+	      overhead_bytes + str_table_bytes);
     if (verbose == 1) {
 	outbuf_addv(out, "Total asked for\t\t\t%8d %8d\n",
 		    allocd_strings, allocd_bytes);
 	outbuf_addv(out, "Space actually required/total string bytes %d%%\n",
-	    (bytes_distinct_strings + overhead_bytes) * 100 / allocd_bytes);
+	    (bytes_distinct_strings + overhead_bytes + str_table_bytes) * 100
+		    / allocd_bytes);
 	outbuf_addv(out, "Searches: %d    Average search length: %6.3f\n",
 		  num_str_searches, (double) search_len / num_str_searches);
+	outbuf_addv(out, "Table size: %d (%d%% full), grown %d times",
+		    str_table_size, str_table_used * 100 / str_table_size,
+		    str_table_grows);
+	if (old_str_table)
+	    outbuf_addv(out, ", %d left to move", old_str_table_used);
+	outbuf_add(out, "\n");
+	probe_histogram(out);
     }
-    return (bytes_distinct_strings + overhead_bytes);
+    return (bytes_distinct_strings + overhead_bytes + str_table_bytes);
 #else
     if (verbose)
 	outbuf_add(out, "<String statistics disabled, no information available>\n");
@@ -353,32 +534,42 @@ char *int_new_string P1(int, size)
     }
 #endif
     
-    mbt = (malloc_block_t *)DXALLOC(size + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, tag);
-    if (size < USHRT_MAX) {
-	mbt->size = size;
-	ADD_NEW_STRING(size, sizeof(malloc_block_t));
-    } else {
-	mbt->size = USHRT_MAX;
-	ADD_NEW_STRING(USHRT_MAX, sizeof(malloc_block_t));
-    }
+    mbt = (malloc_block_t *)DXALLOC(MSTR_CAPACITY(size) + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, tag);
+    mbt->size = size;
+    ADD_NEW_STRING(size, sizeof(malloc_block_t));
     mbt->ref = 1;
     ADD_STRING(mbt->size);
     CHECK_STRING_STATS;
     return (char *)(mbt + 1);
 }
 
+/*
+ * The capacity of a string with n characters: n rounded up to a multiple
+ * of the largest power of 2 that is at most n / 8.
+ */
+int mstr_capacity P1(int, n)
+{
+    int step = n >> 3;
+
+    step |= step >> 1;
+    step |= step >> 2;
+    step |= step >> 4;
+    step |= step >> 8;
+    step |= step >> 16;
+    step = (step >> 1) + 1;
+    return (n + step - 1) & ~(step - 1);
+}
+
 char *extend_string P2(char *, str, int, len) {
-    malloc_block_t *mbt;
+    malloc_block_t *mbt = MSTR_BLOCK(str);
 #ifdef STRING_STATS
     int oldsize = MSTR_SIZE(str);
 #endif
 
-    mbt = (malloc_block_t *)DREALLOC(MSTR_BLOCK(str), len + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, "extend_string");
-    if (len < USHRT_MAX) {
-	mbt->size = len;
-    } else {
-	mbt->size = USHRT_MAX;
-    }
+    /* the block only has to be reallocated when the capacity changes */
+    if (MSTR_CAPACITY(len) != MSTR_CAPACITY((int) mbt->size))
+	mbt = (malloc_block_t *)DREALLOC(mbt, MSTR_CAPACITY(len) + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, "extend_string");
+    mbt->size = len;
     ADD_STRING_SIZE(mbt->size - oldsize);
     CHECK_STRING_STATS;
     
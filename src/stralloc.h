@@ -51,18 +51,27 @@ typedef struct malloc_block_s {
 #ifdef DEBUGMALLOC_EXTENSIONS
     int extra_ref;
 #endif
-    unsigned short size;
-    unsigned short ref;
+    unsigned int size;
+    unsigned int ref;
 } malloc_block_t;
 
+/*
+ * A malloced string MSTR_SPARE_MIN characters or longer is allocated with
+ * room to grow by up to an eighth, so appending to one that is referenced
+ * only once (s += t) just reallocates it now and then.  The room follows
+ * from the length alone: the block always holds MSTR_CAPACITY(size) + 1
+ * characters.
+ */
+#define MSTR_SPARE_MIN 128
+#define MSTR_CAPACITY(n) ((n) < MSTR_SPARE_MIN ? (n) : mstr_capacity(n))
+
 #define MSTR_BLOCK(x) (((malloc_block_t *)(x)) - 1) 
 #define MSTR_EXTRA_REF(x) (MSTR_BLOCK(x)->extra_ref)
 #define MSTR_REF(x) (MSTR_BLOCK(x)->ref)
 #define MSTR_SIZE(x) (MSTR_BLOCK(x)->size)
 #define MSTR_UPDATE_SIZE(x, y) SAFE(\
 				    ADD_STRING_SIZE(y - MSTR_SIZE(x));\
-				    MSTR_BLOCK(x)->size = \
-				    (y > USHRT_MAX ? USHRT_MAX : y);\
+				    MSTR_BLOCK(x)->size = y;\
 				)
 
 #define FREE_MSTR(x) SAFE(\
@@ -79,12 +88,12 @@ typedef struct malloc_block_s {
  * sv->subtype is STRING_MALLOC or STRING_SHARED, and runs significantly
  * faster.
  */
-#define COUNTED_STRLEN(x) ((svalue_strlen_size = MSTR_SIZE(x)), svalue_strlen_size != USHRT_MAX ? svalue_strlen_size : strlen((x)+USHRT_MAX)+USHRT_MAX)
+#define COUNTED_STRLEN(x) (svalue_strlen_size = MSTR_SIZE(x))
 /* return the number of references to a STRING_MALLOC or STRING_SHARED 
    string */
 #define COUNTED_REF(x)    MSTR_REF(x)
 
-/* ref == 0 means the string has been referenced USHRT_MAX times and is
+/* ref == 0 means the string has been referenced UINT_MAX times and is
    immortal */
 #define INC_COUNTED_REF(x) if (MSTR_REF(x)) MSTR_REF(x)++;
 /* This is a conditional expression that evaluates to zero if the block
@@ -92,16 +101,16 @@ typedef struct malloc_block_s {
 #define DEC_COUNTED_REF(x) (!(MSTR_REF(x) == 0 || --MSTR_REF(x) > 0))
 
 typedef struct block_s {
-    struct block_s *next;	/* next block in the hash chain */
-#if defined(DEBUGMALLOC_EXTENSIONS) || (SIZEOF_PTR == 8)
+    unsigned int hash;		/* full hash of the string */
+#ifdef DEBUGMALLOC_EXTENSIONS
     int extra_ref;
 #endif
     /* these two must be last */
-    unsigned short size;	/* length of the string */
-    unsigned short refs;	/* reference count    */
+    unsigned int size;		/* length of the string */
+    unsigned int refs;		/* reference count    */
 } block_t;
 
-#define NEXT(x) (x)->next
+#define HASH(x) (x)->hash
 #define REFS(x) (x)->refs
 #define EXTRA_REF(x) (x)->extra_ref
 #define SIZE(x) (x)->size
@@ -132,6 +141,7 @@ void deallocate_string PROT((char *));
 int add_string_status PROT((outbuffer_t *, int));
 
 char *extend_string PROT((char *, int));
+int mstr_capacity PROT((int));
 
 extern int svalue_strlen_size;
 
@@ -312,6 +312,11 @@ locate_out P1(program_t *, prog)
 		      prog->argument_types, prog->type_start);
     }
 #endif
+    /* the inline caches are only pointers into live programs */
+    if (prog->call_other_cache) {
+	FREE(prog->call_other_cache);
+	prog->call_other_cache = 0;
+    }
     prog->program = (char *)DIFF(prog->program, prog);
     prog->function_table = (compiler_function_t *)DIFF(prog->function_table, prog);
     prog->function_flags = (unsigned short *)DIFF(prog->function_flags, prog);
@@ -0,0 +1,58 @@
+/*
+ * bench/copy.c -- copy() of the things a mudlib copies to hand out or to
+ * guard against changes: a room's inventory, a stats table and a list of
+ * names.  Each is timed copied and thrown away, and copied and then
+ * changed once.
+ */
+
+#define ROUNDS	20000
+#define TRIES	5
+
+int cpu() {
+    mapping r = rusage();
+
+    return r["utime"] + r["stime"];
+}
+
+/* microseconds per copy(), the best of TRIES runs of ROUNDS */
+void run(string what, mixed thing, mixed key, int write) {
+    int i, n, t, best;
+    mixed c;
+
+    for (n = 0; n < TRIES; n++) {
+	t = cpu();
+	for (i = 0; i < ROUNDS; i++) {
+	    c = copy(thing);
+	    if (write)
+		c[key] = i;
+	}
+	t = cpu() - t;
+	if (!n || t < best)
+	    best = t;
+    }
+    debug_message(sprintf("%-32s %-10s %8.2f us\n", what,
+			  write ? "and change" : "only",
+			  best * 1000 / to_float(ROUNDS)));
+}
+
+int main() {
+    object *inventory = allocate(500);
+    mapping stats = ([ ]);
+    string *names = allocate(2000);
+    int i;
+
+    for (i = 0; i < sizeof(inventory); i++)
+	inventory[i] = new("/clone/thing");
+    for (i = 0; i < 200; i++)
+	stats["stat" + i] = i;
+    for (i = 0; i < sizeof(names); i++)
+	names[i] = "name" + i;
+
+    run("inventory, 500 objects", inventory, 0, 0);
+    run("inventory, 500 objects", inventory, 0, 1);
+    run("stats, 200 entries", stats, "stat0", 0);
+    run("stats, 200 entries", stats, "stat0", 1);
+    run("names, 2000 strings", names, 0, 0);
+    run("names, 2000 strings", names, 0, 1);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * bench/files.c -- the file efuns used the way a mudlib uses them: many
+ * small appends to a log, and lines or bytes read from here and there in
+ * a file too big to read_file() whole.
+ */
+
+#define APPENDS	20000
+#define CALLS	2000
+#define LINE	"this is a line of about seventy characters, like most log lines\n"
+
+int cpu() {
+    mapping r = rusage();
+
+    return r["utime"] + r["stime"];
+}
+
+void report(string what, int ms) {
+    debug_message(sprintf("%-34s %6d ms\n", what, ms));
+}
+
+int main() {
+    int i, t, lines;
+    string log = "/tmp/files.log", big = "/tmp/files.big", s;
+
+    mkdir("/tmp");
+    rm(log);
+    rm(big);
+
+    t = cpu();
+    for (i = 0; i < APPENDS; i++)
+	write_file(log, i + ": " + LINE);
+    report(sprintf("%d appends", APPENDS), cpu() - t);
+
+    /* about 14 MB */
+    s = "";
+    for (i = 0; i < 1000; i++)
+	s += LINE;
+    for (i = 0; i < 200; i++)
+	write_file(big, s);
+    lines = 200 * 1000;
+
+    t = cpu();
+    for (i = 0; i < CALLS; i++)
+	s = read_file(log, 1 + (i * 7919) % APPENDS, 1);
+    report(sprintf("%d single-line reads", CALLS), cpu() - t);
+    if (s != (((CALLS - 1) * 7919) % APPENDS) + ": " + LINE)
+	debug_message("read_file() of the log returned the wrong line\n");
+
+    t = cpu();
+    for (i = 0; i < CALLS; i++)
+	s = read_file(big, lines - CALLS + i, 2);
+    report(sprintf("%d reads near the end of 14MB", CALLS), cpu() - t);
+    if (s != LINE + LINE)
+	debug_message("read_file() of the big file returned the wrong lines\n");
+
+    t = cpu();
+    for (i = 0; i < CALLS; i++)
+	s = read_bytes(big, (i * 7919) % (lines - 1) * strlen(LINE), 100);
+    report(sprintf("%d read_bytes()", CALLS), cpu() - t);
+    if (strlen(s) != 100)
+	debug_message("read_bytes() returned the wrong number of bytes\n");
+    return 0;
+}
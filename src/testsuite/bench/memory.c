@@ -0,0 +1,28 @@
+/*
+ * bench/memory.c -- how much memory a world of 20000 objects takes: each
+ * has a name, a description, a list of ids, a stats mapping and an
+ * inventory.  Prints the driver's string, array and mapping figures from
+ * mud_status() and the process's peak resident size.
+ */
+
+#define THINGS	20000
+
+object *things = ({ });
+
+int main() {
+    int i;
+    object ob;
+
+    for (i = 0; i < THINGS; i++) {
+	ob = new("/clone/thing");
+	ob->setup(i, i % 10 ? ({ }) : things[<9..]);
+	things += ({ ob });
+    }
+    foreach (string line in explode(mud_status(0), "\n"))
+	foreach (string what in ({ "Objects:", "Arrays:", "Mappings:",
+				   "All strings:", "Total:" }))
+	    if (strsrch(line, what) != -1)
+		debug_message(line + "\n");
+    debug_message(sprintf("maxrss: %d kB\n", rusage()["maxrss"]));
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * bench/save.c -- save_object() and restore_object() in the text and
+ * binary formats.  The object holds a 5000-entry mapping of the sort a
+ * player or a daemon keeps: short string keys, each with an array of a
+ * number, a string and a small mapping.
+ */
+
+#define ENTRIES	5000
+#define ROUNDS	50
+#define TRIES	5
+
+mapping data;
+string *names;
+int counter;
+
+int cpu() {
+    mapping r = rusage();
+
+    return r["utime"] + r["stime"];
+}
+
+void fill() {
+    int i;
+
+    data = ([ ]);
+    names = ({ });
+    for (i = 0; i < ENTRIES; i++) {
+	data["key" + i] = ({ i, "value number " + i, ([ "n" : i, "x" : -i ]) });
+	names += ({ "name" + i });
+    }
+    counter = ENTRIES;
+}
+
+/* the best of TRIES runs of ROUNDS saves and restores of file */
+void run(string file) {
+    int i, n, save, restore, best_save, best_restore;
+
+    for (n = 0; n < TRIES; n++) {
+	fill();
+	save = cpu();
+	for (i = 0; i < ROUNDS; i++)
+	    save_object(file);
+	save = cpu() - save;
+
+	restore = cpu();
+	for (i = 0; i < ROUNDS; i++)
+	    restore_object(file);
+	restore = cpu() - restore;
+
+	if (!n || save < best_save)
+	    best_save = save;
+	if (!n || restore < best_restore)
+	    best_restore = restore;
+    }
+    if (sizeof(data) != ENTRIES || data["key42"][2]["x"] != -42)
+	debug_message(file + ": restored the wrong thing\n");
+    debug_message(sprintf("%-16s %8d bytes  save %5.2f ms  restore %5.2f ms\n",
+			  file, file_size(file), best_save / to_float(ROUNDS),
+			  best_restore / to_float(ROUNDS)));
+}
+
+int main() {
+    mkdir("/tmp");
+    run("/tmp/save.o");
+    run("/tmp/save.ob");
+    return 0;
+}
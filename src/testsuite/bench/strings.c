@@ -0,0 +1,52 @@
+/*
+ * bench/strings.c -- building long strings with +=, as a mudlib does for
+ * a room description, a who list or a file it is about to write.
+ */
+
+#define TRIES	5
+#define LINE	"this is a line of about seventy characters, like most output\n"
+
+int cpu() {
+    mapping r = rusage();
+
+    return r["utime"] + r["stime"];
+}
+
+/*
+ * The best of TRIES runs of building size bytes from piece; each run
+ * builds 2 MB worth so that small sizes are measurable.
+ */
+void build(string what, string piece, int size) {
+    int i, j, n, t, best, reps = 2000000 / size;
+    string s;
+
+    for (n = 0; n < TRIES; n++) {
+	t = cpu();
+	for (j = 0; j < reps; j++) {
+	    s = "";
+	    for (i = 0; strlen(s) < size; i++)
+		s += piece;
+	}
+	t = cpu() - t;
+	if (!n || t < best)
+	    best = t;
+    }
+    debug_message(sprintf("%-36s %8.2f ms\n", what, best / to_float(reps)));
+}
+
+int main() {
+    string s;
+    mixed err;
+
+    build("100 KB, a line at a time", LINE, 100000);
+    build("1 MB, a line at a time", LINE, 1000000);
+    build("1 MB, eight characters at a time", "abcdefgh", 1000000);
+
+    s = "";
+    while (strlen(s) < 200000)
+	s += LINE;
+    err = catch(s = sprintf("%s%s", s, "x"));
+    debug_message(sprintf("%-36s %s\n", "sprintf() of 200 KB",
+			  err ? "error: " + err : "ok"));
+    return 0;
+}
@@ -0,0 +1,18 @@
+/*
+ * clone/thing.c -- an object with the sort of variables every object in
+ * a mudlib has, for bench/memory.
+ */
+
+string name, short_desc;
+string *ids;
+mapping stats;
+object *inventory;
+
+void setup(int n, object *carried) {
+    name = "thing" + n;
+    short_desc = "a thing numbered " + n;
+    ids = ({ "thing", name, "object" });
+    stats = ([ "str" : n % 20, "dex" : n % 17, "con" : n % 13,
+	       "int" : n % 11, "weight" : 10 + n % 7 ]);
+    inventory = carried;
+}
@@ -0,0 +1,73 @@
+/*
+ * clone/user.c -- the object for each connection to the test suite.
+ */
+
+void logon() {
+    write("Welcome to the driver test suite.\n");
+    enable_commands();
+    add_action("cmd_say", "say");
+    add_action("cmd_spam", "spam");
+#ifdef __MCCP__
+    add_action("cmd_compressed", "compressed");
+#endif
+    add_action("cmd_logonwork", "logonwork");
+    add_action("cmd_netstats", "netstats");
+    add_action("cmd_quit", "quit");
+    add_action("cmd_shutdown", "shutdown");
+}
+
+int cmd_say(string str) {
+    write("You say: " + (str || "") + "\n");
+    return 1;
+}
+
+/* spam <n>: n numbered lines of output */
+int cmd_spam(string str) {
+    int i, n;
+
+    if (!str || sscanf(str, "%d", n) != 1)
+	n = 100;
+    for (i = 0; i < n; i++)
+	write(sprintf("line %d of %d: the quick brown fox jumps over the lazy dog\n",
+		      i, n));
+    return 1;
+}
+
+#ifdef __MCCP__
+int cmd_compressed(string str) {
+    write("compressed: " + compressedp(this_object()) + "\n");
+    return 1;
+}
+#endif
+
+/* logonwork <n>: see master::set_logon_work() */
+int cmd_logonwork(string str) {
+    int n;
+
+    sscanf(str || "0", "%d", n);
+    master()->set_logon_work(n);
+    write("logon work: " + n + "\n");
+    return 1;
+}
+
+/* netstats: the new connection counters from mud_status(1) */
+int cmd_netstats(string str) {
+    foreach (string line in explode(mud_status(1), "\n"))
+	if (sscanf(line, "Connections accepted:%*s") == 1) {
+	    write(line + "\n");
+	    return 1;
+	}
+    write("Connections accepted: not counted by this driver\n");
+    return 1;
+}
+
+int cmd_quit(string str) {
+    write("Bye.\n");
+    destruct(this_object());
+    return 1;
+}
+
+int cmd_shutdown(string str) {
+    shutdown(0);
+    return 1;
+}
@@ -0,0 +1,60 @@
+/*
+ * master.c -- the master object for the driver test suite.
+ *
+ * Everything is allowed; the suite is only ever run on a private port.
+ */
+
+string get_root_uid() { return "Root"; }
+string get_bb_uid() { return "Backbone"; }
+string creator_file(string file) { return "Root"; }
+string domain_file(string file) { return "Root"; }
+string author_file(string file) { return "Root"; }
+
+int valid_read(string file, mixed ob, string fun) { return 1; }
+int valid_write(string file, mixed ob, string fun) { return 1; }
+int valid_seteuid(object ob, string euid) { return 1; }
+int valid_socket(object ob, string fun, mixed *info) { return 1; }
+int valid_override(string file, string name) { return 1; }
+int valid_shadow(object ob) { return 1; }
+int valid_link(string from, string to) { return 1; }
+int valid_save_binary(string file) { return 1; }
+
+string *epilog(int load_empty) { return ({ }); }
+void preload(string file) { load_object(file); }
+
+/*
+ * tools/logon_storm.py sets this to make each connect() cost some time,
+ * as a real mudlib's would.
+ */
+int logon_work;
+
+void set_logon_work(int work) { logon_work = work; }
+
+object connect(int port) {
+    int i;
+
+    for (i = 0; i < logon_work; i++)
+	;
+    return new("/clone/user");
+}
+
+void log_error(string file, string message) { debug_message(message); }
+
+void error_handler(mapping error, int caught) {
+    if (caught)
+	return;
+    debug_message(sprintf("%s%s line %d\n", error["error"],
+			  error["program"] || "", error["line"]));
+}
+
+/*
+ * driver etc/config.test -f<file>: load /<file> and call its main().  The
+ * driver shuts down afterwards unless main() returns nonzero, in which
+ * case the object calls shutdown() itself when it is done.
+ */
+void flag(string file) {
+    int keep;
+
+    if (catch(keep = load_object("/" + file)->main()) || !keep)
+	shutdown(0);
+}
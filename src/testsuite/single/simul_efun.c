@@ -0,0 +1,4 @@
+/*
+ * simul_efun.c -- the test suite has no simulated efuns of its own, so
+ * that what is measured is the driver.
+ */
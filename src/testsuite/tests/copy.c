@@ -0,0 +1,173 @@
+/*
+ * tests/copy.c -- copy() and slices of arrays and mappings, which may
+ * share their elements with the original until one of them is changed.
+ * Every way of changing one is tried, and the other must not see it.  The
+ * driver exits with status 1 if anything was wrong.
+ */
+
+int failed;
+mapping target;
+
+void check(string what, mixed got, mixed want) {
+    /* arrays are compared by what is in them */
+    if (got == want || (arrayp(want) && save_variable(got) ==
+			save_variable(want)))
+	return;
+    debug_message(sprintf("FAIL %s: got %O, want %O\n", what, got, want));
+    failed++;
+}
+
+/* n elements, alternately strings and numbers: nothing that can't share */
+mixed *list(int n) {
+    mixed *a = allocate(n);
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (i % 2)
+	    a[i] = i;
+	else
+	    a[i] = "s" + i;
+    return a;
+}
+
+int drop_next(string key, int value) {
+    map_delete(target, "k" + (value + 1));
+    return 1;
+}
+
+mapping table(int n) {
+    mapping m = ([ ]);
+    int i;
+
+    for (i = 0; i < n; i++)
+	m["k" + i] = i;
+    return m;
+}
+
+void arrays() {
+    mixed *a = list(20), *b, *c, *d;
+    mixed x;
+    int i;
+
+    b = copy(a);
+    check("copy is a new array", b == a, 0);
+    b[0] = "b";
+    check("b[0] = 'b' seen by a", a[0], "s0");
+    a[1] = -1;
+    check("a[1] = -1 seen by b", b[1], 1);
+
+    c = a[2..15];
+    c[0] = "c";
+    check("write to slice seen by a", a[2], "s2");
+    a[3] = "a";
+    check("write to a seen by slice", c[1], 3);
+    d = c[1..12];
+    d[<1] = "d";
+    check("write to slice of slice", c[12], "s14");
+
+    b = copy(a);
+    b[0..3] = ({ 1, 2 });
+    check("range assign seen by a", a[0..4], ({ "s0", -1, "s2", "a", "s4" }));
+    check("range assign", b[0..2], ({ 1, 2, "s4" }));
+
+    b = copy(a);
+    b[5]++;
+    b[7] += 10;
+    check("++ and += seen by a", a[5..7], ({ 5, "s6", 7 }));
+    check("++ and +=", b[5..7], ({ 6, "s6", 17 }));
+
+    b = copy(a);
+    i = 0;
+    foreach (x in b) {
+	b[19] = "last";
+	i++;
+    }
+    check("write in foreach seen by a", a[19], 19);
+    check("foreach sees its own write", x, "last");
+    check("foreach count", i, 20);
+
+    b = copy(a);
+    b += ({ "more" });
+    b -= ({ 7 });
+    check("+= and -= seen by a", sizeof(a), 20);
+    check("+= and -=", sizeof(b), 20);
+
+    /* a copy outlives the array it was made from */
+    b = copy(a);
+    c = a[4..15];
+    a = 0;
+    b[4] = "b4";
+    check("copy after original freed", c[0..1], ({ "s4", 5 }));
+    check("copy after original freed", b[3..5], ({ "a", "b4", 5 }));
+
+    /* containers inside are copied, not shared */
+    a = ({ ({ 1 }), ([ "k" : 2 ]) }) + list(10);
+    b = copy(a);
+    b[0][0] = 3;
+    b[1]["k"] = 4;
+    check("nested array", a[0][0], 1);
+    check("nested mapping", a[1]["k"], 2);
+
+    a = allocate(1000);
+    for (i = 0; i < 1000; i++)
+	a[i] = i;
+    b = allocate(20);
+    for (i = 0; i < 20; i++) {
+	b[i] = copy(a);
+	b[i][i] = -i;
+    }
+    for (i = 0; i < 20; i++)
+	check("copy " + i, b[i][i] + b[i][i + 1], 1);
+    check("original of 20 copies", a[0..2], ({ 0, 1, 2 }));
+}
+
+void mappings() {
+    mapping a = table(20), b, c;
+
+    b = copy(a);
+    check("copy is a new mapping", b == a, 0);
+    b["k0"] = "b";
+    check("b['k0'] = 'b' seen by a", a["k0"], 0);
+    a["k1"] = "a";
+    check("a['k1'] = 'a' seen by b", b["k1"], 1);
+
+    b = copy(a);
+    map_delete(b, "k2");
+    check("map_delete() seen by a", a["k2"], 2);
+    check("map_delete()", undefinedp(b["k2"]), 1);
+
+    b = copy(a);
+    b["k5"]++;
+    b["k7"] += 10;
+    b += ([ "k9" : "nine", "new" : 1 ]);
+    check("++, += and + seen by a", ({ a["k5"], a["k7"], a["k9"] }),
+	  ({ 5, 7, 9 }));
+    check("size seen by a", sizeof(a), 20);
+    check("++, += and +", ({ b["k5"], b["k7"], b["k9"] }), ({ 6, 17, "nine" }));
+
+    /* filter() looks at the mapping as it was when called */
+    c = table(20);
+    target = copy(c);
+    b = filter(target, (: drop_next :));
+    check("filter() of a changing mapping", sizeof(b), 20);
+    check("map_delete() in filter()", sizeof(target), 1);
+    check("map_delete() in filter() seen by the original", sizeof(c), 20);
+
+    b = copy(a);
+    a = 0;
+    b["k3"] = -3;
+    check("copy after original freed", b["k3"] + b["k4"], 1);
+
+    a = ([ "a" : ({ 1 }) ]) + table(10);
+    b = copy(a);
+    b["a"][0] = 2;
+    check("nested array", a["a"][0], 1);
+}
+
+int main() {
+    arrays();
+    mappings();
+    debug_message(failed ? "copy: FAILED\n" : "copy: ok\n");
+    shutdown(failed ? 1 : 0);
+    return 1;
+}
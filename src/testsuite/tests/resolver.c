@@ -0,0 +1,80 @@
+/*
+ * tests/resolver.c -- resolve() against tools/dns_stub.py:
+ *
+ *     python3 tools/dns_stub.py -- ../driver etc/config.test -ftests/resolver
+ *
+ * Each lookup's callback is checked against what the stub answers.  The
+ * driver exits with status 1 if anything was wrong.
+ */
+
+mapping expect = ([ ]);		/* key: ({ what was asked, answer }) */
+int failed, cached;
+
+void check(string what, mixed got, mixed want) {
+    if (got == want)
+	return;
+    debug_message(sprintf("FAIL %s: got %O, want %O\n", what, got, want));
+    failed++;
+}
+
+void ask(string what, string want) {
+    expect[resolve(what, "answer")] = ({ what, want });
+}
+
+void answer(string name, string number, int key) {
+    mixed *e = expect[key];
+
+    map_delete(expect, key);
+    if (!e) {
+	check("callback key", key, "one we asked for");
+	return;
+    }
+    if (e[0][0] >= '0' && e[0][0] <= '9')
+	check("resolve(\"" + e[0] + "\")", name, e[1]);
+    else
+	check("resolve(\"" + e[0] + "\")", number, e[1]);
+    /* once a.test is known, asking again comes from the cache */
+    if (e[0] == "a.test" && !cached++)
+	ask("a.test", "10.0.0.1");
+    if (!sizeof(expect))
+	call_out("finish", 0);
+}
+
+int stat(string what) {
+    string *lines = explode(mud_status(1), "\n");
+    int sent, retried, timed_out, stray, lookups, hits, joined;
+
+    foreach (string line in lines) {
+	sscanf(line, "Queries: %d sent, %d retried, %d timed out, %d stray replies",
+	       sent, retried, timed_out, stray);
+	sscanf(line, "Name server lookups: %d (%d cached, %d joined)%*s",
+	       lookups, hits, joined);
+    }
+    return ([ "stray" : stray, "hits" : hits, "joined" : joined,
+	      "timed out" : timed_out ])[what];
+}
+
+void finish() {
+    remove_call_out("finish");
+    check("unanswered lookups", sizeof(expect), 0);
+    /* spoof.test's two forged replies */
+    check("stray replies", stat("stray"), 2);
+    check("cache hits", stat("hits"), 1);
+    check("joined lookups", stat("joined"), 1);
+    check("timed out", stat("timed out"), 1);
+    debug_message(failed ? "resolver: FAILED\n" : "resolver: ok\n");
+    shutdown(failed ? 1 : 0);
+}
+
+int main() {
+    ask("a.test", "10.0.0.1");
+    ask("10.0.0.1", "a.test");
+    ask("slow.test", "10.0.0.2");
+    ask("slow.test", "10.0.0.2");
+    ask("missing.test", 0);
+    ask("drop.test", 0);
+    ask("spoof.test", "10.0.0.3");
+    /* drop.test gives up after RESOLVER_TRIES tries RESOLVER_RETRY apart */
+    call_out("finish", 20);
+    return 1;
+}
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""
+dns_stub.py -- a tiny name server for testing the driver's resolver.
+
+Answers a fixed set of names under .test on 127.0.0.1 (port 5353 unless
+-p is given), each one exercising a different path in resolver.c:
+
+    a.test          A 10.0.0.1, and 10.0.0.1 has PTR a.test
+    slow.test       A 10.0.0.2, answered after a second
+    missing.test    NXDOMAIN
+    drop.test       never answered, so the driver retries and gives up
+    spoof.test      two forged replies with the right ID but the wrong
+                    question name and type, then the real answer 10.0.0.3
+
+With a command after --, the stub serves while the command runs and
+exits with its status:
+
+    python3 tools/dns_stub.py -- ../driver etc/config.test -ftests/resolver
+"""
+
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+T_A, T_PTR = 1, 12
+
+ANSWERS = {
+    ("a.test", T_A): "10.0.0.1",
+    ("1.0.0.10.in-addr.arpa", T_PTR): "a.test",
+    ("slow.test", T_A): "10.0.0.2",
+    ("spoof.test", T_A): "10.0.0.3",
+}
+
+
+def encode_name(name):
+    out = b""
+    for label in name.rstrip(".").split("."):
+        out += bytes([len(label)]) + label.encode()
+    return out + b"\0"
+
+
+def parse_query(msg):
+    qid, = struct.unpack(">H", msg[:2])
+    off, labels = 12, []
+    while msg[off]:
+        n = msg[off]
+        labels.append(msg[off + 1:off + 1 + n].decode())
+        off += n + 1
+    qtype, qclass = struct.unpack(">HH", msg[off + 1:off + 5])
+    return qid, ".".join(labels), qtype, qclass
+
+
+def reply(qid, name, qtype, answer=None, rcode=0, ttl=60):
+    header = struct.pack(">HHHHHH", qid, 0x8180 | rcode, 1,
+                         1 if answer else 0, 0, 0)
+    question = encode_name(name) + struct.pack(">HH", qtype, 1)
+    if not answer:
+        return header + question
+    if qtype == T_A:
+        rdata = socket.inet_aton(answer)
+    else:
+        rdata = encode_name(answer)
+    # the answer's name points back at the question
+    rr = struct.pack(">HHHIH", 0xc00c, qtype, 1, ttl, len(rdata)) + rdata
+    return header + question + rr
+
+
+def serve(sock):
+    while True:
+        msg, peer = sock.recvfrom(512)
+        try:
+            qid, name, qtype, qclass = parse_query(msg)
+        except (IndexError, struct.error, UnicodeDecodeError):
+            continue
+        name = name.lower()
+        answer = ANSWERS.get((name, qtype))
+        if name == "drop.test":
+            continue
+        if name == "slow.test":
+            threading.Timer(1.0, sock.sendto,
+                            (reply(qid, name, qtype, answer), peer)).start()
+            continue
+        if name == "spoof.test":
+            sock.sendto(reply(qid, "other.test", qtype, "6.6.6.6"), peer)
+            sock.sendto(reply(qid, name, T_PTR, "evil.test"), peer)
+        if answer:
+            sock.sendto(reply(qid, name, qtype, answer), peer)
+        else:
+            sock.sendto(reply(qid, name, qtype, rcode=3), peer)
+
+
+def main():
+    args = sys.argv[1:]
+    port = 5353
+    if args[:1] == ["-p"]:
+        port = int(args[1])
+        args = args[2:]
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", port))
+    if args[:1] != ["--"]:
+        serve(sock)
+        return 0
+    threading.Thread(target=serve, args=(sock,), daemon=True).start()
+    time.sleep(0.1)
+    return subprocess.call(args[1:])
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+logon_storm.py -- many clients connecting at once, as after a reboot.
+
+Opens one connection and logs in, then opens N more (1000 unless -n is
+given) all at once to 127.0.0.1 (port 4000 unless -p is given) and
+waits for each to be welcomed.  While they log on, the first connection
+says something every 50ms to see how long a player already on waits for
+a command.  At the end it prints how many logged on and how long that
+took, how many were refused or reset, and the driver's counters of
+connections accepted, waiting and dropped.
+
+-w <n> makes the master's connect() spin an empty loop n times first,
+so that each logon costs the driver something, as in a real mudlib.
+-t <seconds> is how long to wait for the crowd (60 by default).
+
+With a command after --, it starts that command as the driver and shuts
+it down afterwards:
+
+    python3 tools/logon_storm.py -n 1000 -w 20000 -- ../driver etc/config.test
+"""
+
+import errno
+import getopt
+import resource
+import selectors
+import socket
+import subprocess
+import sys
+import time
+
+WELCOME = b"Welcome to the driver test suite."
+
+
+class Player:
+    """The connection that is already logged on."""
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.sock.settimeout(10)
+        self.buf = b""
+        self.wait_for(WELCOME)
+        self.sock.setblocking(False)
+        self.sent = None
+        self.worst = 0.0
+        self.pings = 0
+
+    def wait_for(self, what):
+        self.sock.setblocking(True)
+        while what not in self.buf:
+            data = self.sock.recv(4096)
+            if not data:
+                raise EOFError("connection closed")
+            self.buf += data
+        line = self.buf[self.buf.index(what):].split(b"\n")[0]
+        self.buf = b""
+        self.sock.setblocking(False)
+        return line.strip().decode("latin-1")
+
+    def command(self, line):
+        self.sock.sendall(line.encode() + b"\r\n")
+
+    def ping(self):
+        if self.sent is None:
+            self.sent = time.time()
+            self.command("say ping")
+
+    def readable(self):
+        self.buf += self.sock.recv(4096)
+        if self.sent is not None and b"You say: ping" in self.buf:
+            self.worst = max(self.worst, time.time() - self.sent)
+            self.pings += 1
+            self.sent = None
+            self.buf = b""
+
+
+def storm(port, clients, work, timeout):
+    player = Player(port)
+    player.command("logonwork %d" % work)
+    player.wait_for(b"logon work:")
+
+    sel = selectors.DefaultSelector()
+    sel.register(player.sock, selectors.EVENT_READ, None)
+    start = time.time()
+    waiting = {}
+    for i in range(clients):
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.setblocking(False)
+        err = s.connect_ex(("127.0.0.1", port))
+        if err not in (0, errno.EINPROGRESS):
+            s.close()
+            continue
+        waiting[s] = b""
+        sel.register(s, selectors.EVENT_READ, i)
+
+    welcomed, failed, last = [], clients - len(waiting), start
+    next_ping = start
+    while waiting and time.time() - start < timeout:
+        now = time.time()
+        if now >= next_ping:
+            player.ping()
+            next_ping = now + 0.05
+        for key, events in sel.select(0.05):
+            if key.data is None:
+                player.readable()
+                continue
+            s = key.fileobj
+            try:
+                data = s.recv(4096)
+            except OSError:
+                data = b""
+            if data:
+                waiting[s] += data
+                if WELCOME not in waiting[s]:
+                    continue
+                last = time.time()
+                welcomed.append(s)
+            else:
+                failed += 1
+                s.close()
+            sel.unregister(s)
+            del waiting[s]
+
+    print("%d clients: %d logged on in %.2fs, %d refused or reset, "
+          "%d still waiting after %.0fs"
+          % (clients, len(welcomed), last - start, failed, len(waiting),
+             time.time() - start))
+    print("player already on: %d commands, slowest answered in %.0fms"
+          % (player.pings, player.worst * 1000))
+    player.command("netstats")
+    print(player.wait_for(b"Connections accepted:"))
+
+    for s in welcomed + list(waiting):
+        s.close()
+    return player
+
+
+def main():
+    opts, args = getopt.getopt(sys.argv[1:], "p:n:w:t:")
+    opts = dict(opts)
+    port = int(opts.get("-p", 4000))
+    clients = int(opts.get("-n", 1000))
+    work = int(opts.get("-w", 0))
+    timeout = float(opts.get("-t", 60))
+    # enough descriptors for the clients, and for a driver started here
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft < clients + 64:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+    if not args:
+        storm(port, clients, work, timeout)
+        return 0
+
+    driver = subprocess.Popen(args)
+    for i in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", port)).close()
+            break
+        except OSError:
+            time.sleep(0.1)
+    try:
+        player = storm(port, clients, work, timeout)
+        player.command("shutdown")
+        driver.wait(10)
+    finally:
+        if driver.poll() is None:
+            driver.kill()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+mccp_client.py -- check MCCP (telnet COMPRESS2) output compression.
+
+Logs in to the test suite on 127.0.0.1 (port 4000 unless -p is given),
+answers the driver's IAC WILL COMPRESS2 with IAC DO COMPRESS2 and
+inflates everything after IAC SB COMPRESS2 IAC SE.  It checks that:
+
+  - compressedp() says the connection is compressed,
+  - a few thousand lines from "spam" come through whole and in order,
+  - IAC DONT COMPRESS2 ends the zlib stream, and output after that is
+    plain text again.
+
+It prints how many bytes went over the wire for how much text, and
+exits with status 1 if anything was wrong.  With a command after --, it
+starts that command as the driver and shuts it down afterwards:
+
+    python3 tools/mccp_client.py -- ../driver etc/config.test
+"""
+
+import socket
+import subprocess
+import sys
+import time
+import zlib
+
+IAC, DONT, DO, WILL, SB, SE = 255, 254, 253, 251, 250, 240
+COMPRESS2 = 86
+START = bytes([IAC, SB, COMPRESS2, IAC, SE])
+LINES = 5000
+
+failed = 0
+
+
+def fail(what):
+    global failed
+    print("FAIL", what)
+    failed += 1
+
+
+class Client:
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.sock.settimeout(5)
+        self.raw = b""          # as received, not yet looked at
+        self.wire = 0           # bytes received in all
+        self.zs = None          # the decompressor while compressing
+        self.text = b""         # received text, inflated
+
+    def send(self, data):
+        self.sock.sendall(data)
+
+    def command(self, line):
+        self.send(line.encode() + b"\r\n")
+
+    def receive(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError("connection closed")
+        self.wire += len(data)
+        self.raw += data
+        self.decode()
+
+    def decode(self):
+        while self.raw:
+            if self.zs:
+                self.text += self.zs.decompress(self.raw)
+                self.raw = b""
+                if self.zs.eof:
+                    self.raw = self.zs.unused_data
+                    self.zs = None
+                continue
+            start = self.raw.find(START)
+            if start == -1:
+                # keep back the start of an IAC SB ... cut off at the end
+                keep = len(self.raw)
+                for n in range(1, len(START)):
+                    if self.raw.endswith(START[:n]):
+                        keep = len(self.raw) - n
+                self.text += self.raw[:keep]
+                self.raw = self.raw[keep:]
+                return
+            self.text += self.raw[:start]
+            self.raw = self.raw[start + len(START):]
+            self.zs = zlib.decompressobj()
+
+    def wait_for(self, what):
+        """Read until what has been received; return the text up to it."""
+        what = what.encode("latin-1")
+        deadline = time.time() + 10
+        while what not in self.text.replace(b"\r", b""):
+            if time.time() > deadline:
+                raise TimeoutError("waiting for %r" % what)
+            self.receive()
+        text = self.text.replace(b"\r", b"")
+        end = text.index(what) + len(what)
+        self.text = text[end:]
+        return text[:end].decode("latin-1")
+
+
+def run(port):
+    c = Client(port)
+    offer = chr(IAC) + chr(WILL) + chr(COMPRESS2)
+    if offer not in c.wait_for("Welcome to the driver test suite.\n"):
+        c.wait_for(offer)
+    c.send(bytes([IAC, DO, COMPRESS2]))
+
+    c.command("compressed")
+    c.wait_for("compressed: ")
+    if c.zs is None:
+        fail("no IAC SB COMPRESS2 IAC SE after IAC DO COMPRESS2")
+    if not c.wait_for("\n").startswith("1"):
+        fail("compressedp() is 0 after negotiation")
+
+    before = c.wire
+    c.command("spam %d" % LINES)
+    c.command("say done")
+    text = c.wait_for("You say: done\n")
+    # a prompt may come first
+    lines = [l[l.find("line "):] for l in text.split("\n") if "line " in l]
+    want = ["line %d of %d: the quick brown fox jumps over the lazy dog"
+            % (i, LINES) for i in range(LINES)]
+    if lines != want:
+        fail("spam output came back as %d lines, not the %d sent"
+             % (len(lines), LINES))
+    print("%d lines: %d bytes of text in %d bytes compressed (%.1f%%)"
+          % (LINES, len(text), c.wire - before,
+             100.0 * (c.wire - before) / len(text)))
+
+    c.send(bytes([IAC, DONT, COMPRESS2]))
+    c.command("say plain")
+    c.wait_for("You say: plain\n")
+    if c.zs is not None:
+        fail("compressed stream not ended after IAC DONT COMPRESS2")
+    c.command("compressed")
+    c.wait_for("compressed: ")
+    if not c.wait_for("\n").startswith("0"):
+        fail("compressedp() is still 1 after IAC DONT COMPRESS2")
+    return c
+
+
+def check(port):
+    try:
+        return run(port)
+    except (OSError, EOFError) as e:
+        fail(str(e))
+        return None
+
+
+def main():
+    args = sys.argv[1:]
+    port = 4000
+    if args[:1] == ["-p"]:
+        port = int(args[1])
+        args = args[2:]
+    if args[:1] != ["--"]:
+        check(port)
+    else:
+        driver = subprocess.Popen(args[1:])
+        for i in range(50):
+            try:
+                socket.create_connection(("127.0.0.1", port)).close()
+                break
+            except OSError:
+                time.sleep(0.1)
+        c = check(port)
+        if c:
+            c.command("shutdown")
+        try:
+            driver.wait(10)
+        except subprocess.TimeoutExpired:
+            driver.kill()
+    print("mccp: FAILED" if failed else "mccp: ok")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())